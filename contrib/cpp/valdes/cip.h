@@ -54,7 +54,7 @@ struct  tCIPTagParam {     // Tag parameter
          string tagName;   // tag name
            int  tagType;   // Tag type. As defined on CIP_DATA_TYPE_XXXX
            int  elemCount; // elements count: 1- single, n-array
-        plc_tag tagPtr;    // PLC Tag pointer. If null means wasn't assigned
+        plc_tag tagPtr;    // PLC Tag handle. If PLC_TAG_NULL means wasn't assigned
 };
 
 // Tag list
@@ -0,0 +1,644 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * Throughput and latency benchmark for the tag I/O stack.
+ *
+ * This is meant to be run against tools/ab_server on the local machine
+ * so that the numbers show the cost of the library and not the PLC.
+ * Each scenario prints one JSON object per line so that runs can be
+ * saved and compared between versions.
+ *
+ * Scenarios:
+ *
+ *   scalar  - many scalar tags, all read at once, over and over.
+ *   array   - one large array that needs fragmented reads.
+ *   mixed   - one small array, alternating writes and reads.
+ *   threads - many threads, each reading its own tag on one PLC.
+ *   plcs    - many PLCs (127.0.0.x addresses) driven from one thread.
+ *   accessors - the cost of one call to get or set a value in tag data
+ *             that is already read, through the API and through the
+ *             inline view in libplctag_view.h.  No IO is timed.
+ *
+ * usage: benchmark [-g gateway] [-d seconds] [-s scenario]
+ *
+ * The allocation count comes from replacing the library's mem_alloc()
+ * with a counting version here.  That only works when the executable's
+ * symbol wins over the one in the shared library, which is the normal
+ * case on Linux.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "../lib/libplctag.h"
+#include "../lib/libplctag_view.h"
+
+
+#define DEFAULT_GATEWAY "127.0.0.1"
+#define DEFAULT_SECONDS 5
+#define MAX_SAMPLES (1000000)
+#define DATA_TIMEOUT 5000
+
+#define SCALAR_TAGS 50
+#define NUM_THREADS 16
+#define NUM_PLCS 8
+
+#define SCALAR_ATTRIBS "protocol=ab_eip&gateway=%s&path=1,0&cpu=LGX&elem_size=4&elem_count=1&name=TestDINT"
+#define ARRAY_ATTRIBS "protocol=ab_eip&gateway=%s&path=1,0&cpu=LGX&elem_size=4&elem_count=2000&name=TestBigArray"
+#define MIXED_ATTRIBS "protocol=ab_eip&gateway=%s&path=1,0&cpu=LGX&elem_size=4&elem_count=10&name=TestDINTArray"
+
+
+/*
+ * count allocations made by the library.
+ */
+static volatile long alloc_count = 0;
+
+extern void *mem_alloc(int size)
+{
+    __sync_fetch_and_add(&alloc_count, 1);
+
+    return calloc(size, 1);
+}
+
+extern void mem_free(const void *mem)
+{
+    if(mem) {
+        free((void *)mem);
+    }
+}
+
+
+struct worker {
+    pthread_t thread;
+    plc_tag *tags;
+    int num_tags;
+    int write_every;    /* every Nth operation is a write, 0 for never */
+    int64_t deadline_us;
+
+    /* results */
+    int64_t *samples;
+    int num_samples;
+    int64_t ops;
+    int errors;
+};
+
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+
+static int64_t cpu_us(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+
+    return ((int64_t)ru.ru_utime.tv_sec * 1000000) + ru.ru_utime.tv_usec +
+           ((int64_t)ru.ru_stime.tv_sec * 1000000) + ru.ru_stime.tv_usec;
+}
+
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+static plc_tag create_tag(const char *fmt, const char *gateway)
+{
+    char attribs[256];
+    plc_tag tag;
+    int rc;
+
+    snprintf(attribs, sizeof(attribs), fmt, gateway);
+
+    tag = plc_tag_create(attribs);
+
+    if(!tag) {
+        fprintf(stderr,"ERROR: could not create tag %s!\n", attribs);
+        return PLC_TAG_NULL;
+    }
+
+    if((rc = plc_tag_status(tag)) != PLCTAG_STATUS_OK) {
+        fprintf(stderr,"ERROR: tag %s has status %d!\n", attribs, rc);
+        plc_tag_destroy(tag);
+        return PLC_TAG_NULL;
+    }
+
+    /* the first read sets up fragment sizes, keep it out of the numbers. */
+    if(plc_tag_read(tag, DATA_TIMEOUT) != PLCTAG_STATUS_OK) {
+        fprintf(stderr,"ERROR: first read of %s failed!\n", attribs);
+        plc_tag_destroy(tag);
+        return PLC_TAG_NULL;
+    }
+
+    return tag;
+}
+
+
+/*
+ * start one operation on every tag, then poll until they are all done.
+ * Repeat until the deadline.
+ */
+static void *worker_func(void *arg)
+{
+    struct worker *w = (struct worker *)arg;
+    int64_t *start = calloc(w->num_tags, sizeof(int64_t));
+    int *pending = calloc(w->num_tags, sizeof(int));
+    int i;
+
+    if(!start || !pending) {
+        w->errors++;
+        free(start);
+        free(pending);
+        return NULL;
+    }
+
+    while(now_us() < w->deadline_us) {
+        int64_t timeout;
+        int outstanding = 0;
+
+        for(i=0; i < w->num_tags; i++) {
+            int rc;
+
+            start[i] = now_us();
+
+            if(w->write_every && (w->ops % w->write_every) == 0) {
+                plc_tag_set_int32(w->tags[i], 0, (int32_t)w->ops);
+                rc = plc_tag_write(w->tags[i], 0);
+            } else {
+                rc = plc_tag_read(w->tags[i], 0);
+            }
+
+            w->ops++;
+
+            if(rc == PLCTAG_STATUS_PENDING) {
+                pending[i] = 1;
+                outstanding++;
+            } else if(rc == PLCTAG_STATUS_OK) {
+                pending[i] = 0;
+
+                if(w->num_samples < MAX_SAMPLES) {
+                    w->samples[w->num_samples++] = now_us() - start[i];
+                }
+            } else {
+                pending[i] = 0;
+                w->errors++;
+            }
+        }
+
+        timeout = now_us() + ((int64_t)DATA_TIMEOUT * 1000);
+
+        while(outstanding > 0) {
+            usleep(20);
+
+            for(i=0; i < w->num_tags; i++) {
+                int rc;
+
+                if(!pending[i]) {
+                    continue;
+                }
+
+                rc = plc_tag_status(w->tags[i]);
+
+                if(rc == PLCTAG_STATUS_PENDING) {
+                    if(now_us() < timeout) {
+                        continue;
+                    }
+
+                    plc_tag_abort(w->tags[i]);
+                    rc = PLCTAG_ERR_TIMEOUT;
+                }
+
+                pending[i] = 0;
+                outstanding--;
+
+                if(rc != PLCTAG_STATUS_OK) {
+                    w->errors++;
+                } else if(w->num_samples < MAX_SAMPLES) {
+                    w->samples[w->num_samples++] = now_us() - start[i];
+                }
+            }
+        }
+    }
+
+    free(start);
+    free(pending);
+
+    return NULL;
+}
+
+
+/*
+ * Run the workers, then print a JSON line for the combined results.
+ */
+static int run_workers(const char *scenario, struct worker *workers, int num_workers, int num_tags, int seconds)
+{
+    int64_t *all;
+    int64_t total_ops = 0;
+    int total_samples = 0;
+    int errors = 0;
+    int64_t wall_start;
+    int64_t wall;
+    int64_t cpu_start;
+    int64_t cpu;
+    long allocs_start;
+    long allocs;
+    int i;
+
+    for(i=0; i < num_workers; i++) {
+        workers[i].samples = calloc(MAX_SAMPLES, sizeof(int64_t));
+
+        if(!workers[i].samples) {
+            fprintf(stderr,"ERROR: unable to allocate sample buffer!\n");
+            return -1;
+        }
+    }
+
+    allocs_start = alloc_count;
+    cpu_start = cpu_us();
+    wall_start = now_us();
+
+    for(i=0; i < num_workers; i++) {
+        workers[i].deadline_us = wall_start + ((int64_t)seconds * 1000000);
+        pthread_create(&workers[i].thread, NULL, worker_func, &workers[i]);
+    }
+
+    for(i=0; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    wall = now_us() - wall_start;
+    cpu = cpu_us() - cpu_start;
+    allocs = alloc_count - allocs_start;
+
+    for(i=0; i < num_workers; i++) {
+        total_ops += workers[i].ops;
+        total_samples += workers[i].num_samples;
+        errors += workers[i].errors;
+    }
+
+    all = calloc(total_samples > 0 ? total_samples : 1, sizeof(int64_t));
+
+    if(!all) {
+        fprintf(stderr,"ERROR: unable to allocate sample buffer!\n");
+        return -1;
+    }
+
+    total_samples = 0;
+
+    for(i=0; i < num_workers; i++) {
+        memcpy(all + total_samples, workers[i].samples, workers[i].num_samples * sizeof(int64_t));
+        total_samples += workers[i].num_samples;
+        free(workers[i].samples);
+        workers[i].samples = NULL;
+    }
+
+    qsort(all, total_samples, sizeof(int64_t), cmp_int64);
+
+    if(total_samples == 0) {
+        all[0] = 0;
+        total_samples = 1;
+    }
+
+    printf("{\"scenario\":\"%s\",\"threads\":%d,\"tags\":%d,\"seconds\":%.3f,\"ops\":%lld,\"errors\":%d,"
+           "\"ops_per_sec\":%.1f,\"p50_us\":%lld,\"p99_us\":%lld,\"p999_us\":%lld,\"max_us\":%lld,"
+           "\"cpu_us_per_op\":%.2f,\"allocs_per_op\":%.2f}\n",
+           scenario,
+           num_workers,
+           num_tags,
+           (double)wall / 1000000.0,
+           (long long)total_ops,
+           errors,
+           total_ops * 1000000.0 / (double)wall,
+           (long long)all[(int)((total_samples - 1) * 0.5)],
+           (long long)all[(int)((total_samples - 1) * 0.99)],
+           (long long)all[(int)((total_samples - 1) * 0.999)],
+           (long long)all[total_samples - 1],
+           total_ops ? (double)cpu / (double)total_ops : 0.0,
+           total_ops ? (double)allocs / (double)total_ops : 0.0);
+
+    fflush(stdout);
+
+    free(all);
+
+    return errors ? -1 : 0;
+}
+
+
+static void destroy_tags(plc_tag *tags, int num_tags)
+{
+    int i;
+
+    for(i=0; i < num_tags; i++) {
+        if(tags[i]) {
+            plc_tag_destroy(tags[i]);
+        }
+    }
+}
+
+
+static int bench_scalar(const char *gateway, int seconds)
+{
+    plc_tag tags[SCALAR_TAGS] = {0};
+    struct worker w;
+    int rc;
+    int i;
+
+    for(i=0; i < SCALAR_TAGS; i++) {
+        if(!(tags[i] = create_tag(SCALAR_ATTRIBS, gateway))) {
+            destroy_tags(tags, SCALAR_TAGS);
+            return -1;
+        }
+    }
+
+    memset(&w, 0, sizeof(w));
+    w.tags = tags;
+    w.num_tags = SCALAR_TAGS;
+
+    rc = run_workers("scalar", &w, 1, SCALAR_TAGS, seconds);
+
+    destroy_tags(tags, SCALAR_TAGS);
+
+    return rc;
+}
+
+
+static int bench_single(const char *scenario, const char *fmt, int write_every, const char *gateway, int seconds)
+{
+    plc_tag tag;
+    struct worker w;
+    int rc;
+
+    if(!(tag = create_tag(fmt, gateway))) {
+        return -1;
+    }
+
+    memset(&w, 0, sizeof(w));
+    w.tags = &tag;
+    w.num_tags = 1;
+    w.write_every = write_every;
+
+    rc = run_workers(scenario, &w, 1, 1, seconds);
+
+    plc_tag_destroy(tag);
+
+    return rc;
+}
+
+
+static int bench_threads(const char *gateway, int seconds)
+{
+    plc_tag tags[NUM_THREADS] = {0};
+    struct worker w[NUM_THREADS];
+    int rc;
+    int i;
+
+    memset(w, 0, sizeof(w));
+
+    for(i=0; i < NUM_THREADS; i++) {
+        if(!(tags[i] = create_tag(SCALAR_ATTRIBS, gateway))) {
+            destroy_tags(tags, NUM_THREADS);
+            return -1;
+        }
+
+        w[i].tags = &tags[i];
+        w[i].num_tags = 1;
+    }
+
+    rc = run_workers("threads", w, NUM_THREADS, NUM_THREADS, seconds);
+
+    destroy_tags(tags, NUM_THREADS);
+
+    return rc;
+}
+
+
+static int bench_plcs(const char *gateway, int seconds)
+{
+    plc_tag tags[NUM_PLCS] = {0};
+    struct worker w;
+    char plc_gateway[32];
+    int rc;
+    int i;
+
+    /*
+     * Each loopback address is a different PLC as far as the library
+     * is concerned.  A real gateway gets separate sessions instead.
+     */
+    for(i=0; i < NUM_PLCS; i++) {
+        if(!strcmp(gateway, DEFAULT_GATEWAY)) {
+            snprintf(plc_gateway, sizeof(plc_gateway), "127.0.0.%d", i + 1);
+        } else {
+            snprintf(plc_gateway, sizeof(plc_gateway), "%s&share_session=0", gateway);
+        }
+
+        if(!(tags[i] = create_tag(SCALAR_ATTRIBS, plc_gateway))) {
+            destroy_tags(tags, NUM_PLCS);
+            return -1;
+        }
+    }
+
+    memset(&w, 0, sizeof(w));
+    w.tags = tags;
+    w.num_tags = NUM_PLCS;
+
+    rc = run_workers("plcs", &w, 1, NUM_PLCS, seconds);
+
+    destroy_tags(tags, NUM_PLCS);
+
+    return rc;
+}
+
+
+/*
+ * Time passes over every element of the big array with one accessor
+ * method for a third of the run and print the cost per call.
+ */
+#define ACC_GET      (0)
+#define ACC_SET      (1)
+#define ACC_VIEW     (2)
+
+static volatile int32_t accessor_sink;
+
+static int bench_accessor(plc_tag tag, int method, const char *name, int seconds)
+{
+    int64_t deadline;
+    int64_t start;
+    int64_t elapsed;
+    int64_t calls = 0;
+    int32_t sum = 0;
+    int elems = plc_tag_get_size(tag) / 4;
+    plc_tag_view_t view;
+    int i;
+
+    start = now_us();
+    deadline = start + ((int64_t)seconds * 1000000) / 3;
+
+    do {
+        switch(method) {
+        case ACC_GET:
+            for(i=0; i < elems; i++) {
+                sum += plc_tag_get_int32(tag, i*4);
+            }
+            break;
+
+        case ACC_SET:
+            for(i=0; i < elems; i++) {
+                sum += plc_tag_set_int32(tag, i*4, i);
+            }
+            break;
+
+        case ACC_VIEW:
+            do {
+                if(plc_tag_view_begin(tag, &view) != PLCTAG_STATUS_OK) {
+                    fprintf(stderr,"ERROR: unable to get a view of the tag!\n");
+                    return -1;
+                }
+
+                for(i=0; i < elems; i++) {
+                    sum += plc_tag_view_get_int32(&view, i*4);
+                }
+            } while(plc_tag_view_end(&view) == PLCTAG_STATUS_PENDING);
+            break;
+        }
+
+        calls += elems;
+    } while(now_us() < deadline);
+
+    elapsed = now_us() - start;
+
+    accessor_sink = sum;
+
+    printf("{\"scenario\":\"accessors\",\"method\":\"%s\",\"calls\":%lld,\"ns_per_call\":%.2f}\n",
+           name,
+           (long long)calls,
+           calls ? (double)elapsed * 1000.0 / (double)calls : 0.0);
+
+    fflush(stdout);
+
+    return 0;
+}
+
+
+static int bench_accessors(const char *gateway, int seconds)
+{
+    plc_tag tag;
+    int rc = 0;
+
+    if(!(tag = create_tag(ARRAY_ATTRIBS, gateway))) {
+        return -1;
+    }
+
+    rc |= bench_accessor(tag, ACC_GET, "get_int32", seconds);
+    rc |= bench_accessor(tag, ACC_SET, "set_int32", seconds);
+    rc |= bench_accessor(tag, ACC_VIEW, "view_get_int32", seconds);
+
+    plc_tag_destroy(tag);
+
+    return rc;
+}
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,"usage: %s [-g gateway] [-d seconds] [-s scalar|array|mixed|threads|plcs|accessors]\n", prog);
+    exit(1);
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *gateway = DEFAULT_GATEWAY;
+    const char *scenario = NULL;
+    int seconds = DEFAULT_SECONDS;
+    int rc = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "g:d:s:")) != -1) {
+        switch(opt) {
+        case 'g':
+            gateway = optarg;
+            break;
+
+        case 'd':
+            seconds = atoi(optarg);
+            break;
+
+        case 's':
+            scenario = optarg;
+            break;
+
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if(seconds <= 0) {
+        usage(argv[0]);
+    }
+
+    if(scenario && strcmp(scenario, "scalar") && strcmp(scenario, "array") && strcmp(scenario, "mixed") &&
+       strcmp(scenario, "threads") && strcmp(scenario, "plcs") && strcmp(scenario, "accessors")) {
+        usage(argv[0]);
+    }
+
+    if(!scenario || !strcmp(scenario, "scalar")) {
+        rc |= bench_scalar(gateway, seconds);
+    }
+
+    if(!scenario || !strcmp(scenario, "array")) {
+        rc |= bench_single("array", ARRAY_ATTRIBS, 0, gateway, seconds);
+    }
+
+    if(!scenario || !strcmp(scenario, "mixed")) {
+        rc |= bench_single("mixed", MIXED_ATTRIBS, 2, gateway, seconds);
+    }
+
+    if(!scenario || !strcmp(scenario, "threads")) {
+        rc |= bench_threads(gateway, seconds);
+    }
+
+    if(!scenario || !strcmp(scenario, "plcs")) {
+        rc |= bench_plcs(gateway, seconds);
+    }
+
+    if(!scenario || !strcmp(scenario, "accessors")) {
+        rc |= bench_accessors(gateway, seconds);
+    }
+
+    return rc ? 1 : 0;
+}
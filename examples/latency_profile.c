@@ -0,0 +1,229 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * Compare read round trip latency for each socket profile.
+ *
+ * Every profile gets its own session (share_session=0) to the same
+ * gateway.  Reads are started asynchronously and the status is polled
+ * tightly so that the 5ms poll in plc_tag_read() does not hide the
+ * difference between profiles.
+ *
+ * After the round trip numbers, the mean per read time spent in each
+ * stage (see plc_tag_get_last_timing()) is printed for each profile.
+ *
+ * usage: latency_profile [gateway] [iterations]
+ *
+ * The gateway defaults to a simulator on the local machine.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "../lib/libplctag.h"
+
+
+#define TAG_ATTRIBS "protocol=ab_eip&gateway=%s&path=1,0&cpu=LGX&elem_size=4&elem_count=1&name=TestDINT&share_session=0&socket_profile=%s"
+#define DEFAULT_GATEWAY "127.0.0.1"
+#define DEFAULT_ITERATIONS 2000
+#define WARMUP_ITERATIONS 50
+#define DATA_TIMEOUT 5000
+
+static const char *profiles[] = { "default", "low_latency" };
+#define NUM_PROFILES (int)(sizeof(profiles)/sizeof(profiles[0]))
+
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/* read once, returns the round trip in microseconds or -1 on error. */
+static int64_t timed_read(plc_tag tag, plc_tag_timing_t *stages)
+{
+    plc_tag_timing_t timing;
+
+    int64_t start = now_us();
+    int64_t timeout = start + ((int64_t)DATA_TIMEOUT * 1000);
+    int rc;
+
+    rc = plc_tag_read(tag, 0);
+
+    while(rc == PLCTAG_STATUS_PENDING && now_us() < timeout) {
+        usleep(20);
+        rc = plc_tag_status(tag);
+    }
+
+    if(rc != PLCTAG_STATUS_OK) {
+        plc_tag_abort(tag);
+        return -1;
+    }
+
+    if(stages && plc_tag_get_last_timing(tag, &timing) == PLCTAG_STATUS_OK) {
+        stages->requests += timing.requests;
+        stages->queue_us += timing.queue_us;
+        stages->send_us += timing.send_us;
+        stages->wait_us += timing.wait_us;
+        stages->recv_us += timing.recv_us;
+        stages->pickup_us += timing.pickup_us;
+        stages->total_us += timing.total_us;
+    }
+
+    return now_us() - start;
+}
+
+
+static int run_profile(const char *gateway, const char *profile, int iterations, int64_t *samples, plc_tag_timing_t *stages)
+{
+    char attribs[256];
+    plc_tag tag;
+    int rc;
+    int i;
+
+    snprintf(attribs, sizeof(attribs), TAG_ATTRIBS, gateway, profile);
+
+    tag = plc_tag_create(attribs);
+
+    if(!tag) {
+        fprintf(stderr,"ERROR: Could not create tag for profile %s!\n", profile);
+        return -1;
+    }
+
+    if((rc = plc_tag_status(tag)) != PLCTAG_STATUS_OK) {
+        fprintf(stderr,"ERROR: tag for profile %s has status %d!\n", profile, rc);
+        plc_tag_destroy(tag);
+        return -1;
+    }
+
+    for(i=0; i < WARMUP_ITERATIONS; i++) {
+        if(timed_read(tag, NULL) < 0) {
+            fprintf(stderr,"ERROR: warm up read failed for profile %s!\n", profile);
+            plc_tag_destroy(tag);
+            return -1;
+        }
+    }
+
+    for(i=0; i < iterations; i++) {
+        samples[i] = timed_read(tag, stages);
+
+        if(samples[i] < 0) {
+            fprintf(stderr,"ERROR: read %d failed for profile %s!\n", i, profile);
+            plc_tag_destroy(tag);
+            return -1;
+        }
+    }
+
+    plc_tag_destroy(tag);
+
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *gateway = DEFAULT_GATEWAY;
+    int iterations = DEFAULT_ITERATIONS;
+    int64_t *samples;
+    plc_tag_timing_t stages[NUM_PROFILES];
+    int p;
+
+    if(argc > 1) {
+        gateway = argv[1];
+    }
+
+    if(argc > 2) {
+        iterations = atoi(argv[2]);
+    }
+
+    if(iterations <= 0) {
+        fprintf(stderr,"usage: %s [gateway] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    samples = calloc(iterations, sizeof(int64_t));
+
+    if(!samples) {
+        fprintf(stderr,"ERROR: unable to allocate sample buffer!\n");
+        return 1;
+    }
+
+    memset(stages, 0, sizeof(stages));
+
+    printf("%-12s %8s %8s %8s %8s %8s %8s\n", "profile", "reads", "min_us", "p50_us", "p99_us", "max_us", "mean_us");
+
+    for(p=0; p < NUM_PROFILES; p++) {
+        int64_t total = 0;
+        int i;
+
+        if(run_profile(gateway, profiles[p], iterations, samples, &stages[p])) {
+            free(samples);
+            return 1;
+        }
+
+        for(i=0; i < iterations; i++) {
+            total += samples[i];
+        }
+
+        qsort(samples, iterations, sizeof(int64_t), cmp_int64);
+
+        printf("%-12s %8d %8lld %8lld %8lld %8lld %8lld\n",
+               profiles[p],
+               iterations,
+               (long long)samples[0],
+               (long long)samples[iterations/2],
+               (long long)samples[(int)((iterations - 1) * 0.99)],
+               (long long)samples[iterations - 1],
+               (long long)(total/iterations));
+    }
+
+    printf("\n%-12s %8s %8s %8s %8s %8s %8s\n", "profile", "queue_us", "send_us", "wait_us", "recv_us", "pickup_us", "total_us");
+
+    for(p=0; p < NUM_PROFILES; p++) {
+        printf("%-12s %8lld %8lld %8lld %8lld %8lld %8lld\n",
+               profiles[p],
+               (long long)(stages[p].queue_us/iterations),
+               (long long)(stages[p].send_us/iterations),
+               (long long)(stages[p].wait_us/iterations),
+               (long long)(stages[p].recv_us/iterations),
+               (long long)(stages[p].pickup_us/iterations),
+               (long long)(stages[p].total_us/iterations));
+    }
+
+    free(samples);
+
+    return 0;
+}
@@ -306,7 +306,7 @@ void thread_func(void *data)
         }
 
         plc_tag_destroy(tag);
-        tag = NULL;
+        tag = PLC_TAG_NULL;
 
         sleep_ms(100+random_min_max(0,100));
     }
@@ -80,14 +80,8 @@ int main(int argc, char **argv)
 
     /* print out the data */
     for(i=0; i < ELEM_COUNT; i++) {
-		int str_size = plc_tag_get_int32(tag,(i*ELEM_SIZE));
-		char str[83] = {0};
-		int j;
-
-		for(j=0; j<str_size; j++) {
-			str[j] = (char)plc_tag_get_uint8(tag,(i*ELEM_SIZE)+j+4);
-		}
-		str[j] = (char)0;
+		char str[PLCTAG_STRING_MAX_CHARS + 1] = {0};
+		int str_size = plc_tag_get_string(tag, (i*ELEM_SIZE), str, sizeof(str));
 
 		printf("string %d (%d chars) = '%s'\n",i, str_size, str);
     }
@@ -104,14 +98,8 @@ int main(int argc, char **argv)
 
     /* print out the data */
     for(i=0; i < ELEM_COUNT; i++) {
-		int str_size = plc_tag_get_int32(tag,(i*ELEM_SIZE));
-		char str[83] = {0};
-		int j;
-
-		for(j=0; j<str_size; j++) {
-			str[j] = (char)plc_tag_get_uint8(tag,(i*ELEM_SIZE)+j+4);
-		}
-		str[j] = (char)0;
+		char str[PLCTAG_STRING_MAX_CHARS + 1] = {0};
+		int str_size = plc_tag_get_string(tag, (i*ELEM_SIZE), str, sizeof(str));
 
 		printf("string %d (%d chars) = '%s'\n",i, str_size, str);
     }
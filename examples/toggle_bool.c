@@ -25,11 +25,12 @@
 #include "../lib/libplctag.h"
 
 
-#define TAG_PATH "protocol=ab_eip&gateway=10.206.1.27&path=1,0&cpu=LGX&elem_size=1&elem_count=1&debug=1&name=pcomm_test_bool"
+#define TAG_PATH "protocol=ab_eip&gateway=10.206.1.27&path=1,0&cpu=LGX&elem_size=4&elem_count=1&debug=1&name=pcomm_test_dint"
 #define DATA_TIMEOUT 5000
+#define BIT_NUM (5)
 
 /*
- * Read a boolean value and toggle it.
+ * Read one bit of a DINT and toggle it.
  */
 
 
@@ -70,10 +71,11 @@ int main(int argc, char **argv)
     }
 
     /* print out the data */
-    b = plc_tag_get_uint8(tag,0);
-    fprintf(stderr,"bool = %d\n", b);
+    b = plc_tag_get_bit(tag, BIT_NUM);
+    fprintf(stderr,"bit %d = %d\n", BIT_NUM, b);
 
-    plc_tag_set_uint8(tag, 0, (b ? 0 : 255));
+    /* only this bit is sent, the PLC leaves the rest of the DINT alone. */
+    plc_tag_set_bit(tag, BIT_NUM, !b);
 
     rc = plc_tag_write(tag, DATA_TIMEOUT);
 
@@ -94,8 +96,8 @@ int main(int argc, char **argv)
     }
 
     /* print out the data */
-    b = plc_tag_get_uint8(tag,0);
-    fprintf(stderr,"bool = %d\n", b);
+    b = plc_tag_get_bit(tag, BIT_NUM);
+    fprintf(stderr,"bit %d = %d\n", BIT_NUM, b);
 
     /* we are done */
     plc_tag_destroy(tag);
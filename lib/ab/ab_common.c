@@ -37,7 +37,11 @@
 #include <ab/eip_pccc.h>
 #include <ab/eip_dhp_pccc.h>
 #include <util/attr.h>
+#include <util/stats.h>
+#include <util/trace.h>
 #include <ab/session.h>
+#include <ab/symbol.h>
+#include <ab/batch.h>
 #include <ab/connection.h>
 #include <ab/tag.h>
 #include <ab/request.h>
@@ -77,9 +81,13 @@ struct tag_vtable_t plc_dhp_vtable /*= { ab_tag_abort, ab_tag_destroy, eip_dhp_p
 int session_check_incoming_data_unsafe(ab_session_p session);
 int request_check_outgoing_data_unsafe(ab_session_p session, ab_request_p req);
 tag_vtable_p set_tag_vtable(ab_tag_p tag);
+static void ab_tag_abort_unsafe(ab_tag_p tag);
+static void ab_tag_unlink_unsafe(ab_tag_p tag);
+static void ab_tag_free(ab_tag_p tag);
+static int make_share_key(ab_tag_p tag, uint8_t *key, int key_max);
 
 
-plc_tag ab_tag_create(attr attribs)
+plc_tag_p ab_tag_create(attr attribs)
 {
     ab_tag_p tag = AB_TAG_NULL;
     const char *path;
@@ -111,7 +119,7 @@ plc_tag ab_tag_create(attr attribs)
      */
     if(check_cpu(tag, attribs) != PLCTAG_STATUS_OK) {
         tag->status = PLCTAG_ERR_BAD_DEVICE;
-        return (plc_tag)tag;
+        return (plc_tag_p)tag;
     }
 
     /* AB PLCs are little endian. */
@@ -120,19 +128,26 @@ plc_tag ab_tag_create(attr attribs)
     /* allocate memory for the data */
     tag->elem_count = attr_get_int(attribs,"elem_count",1);
     tag->elem_size = attr_get_int(attribs,"elem_size",0);
+
+    /* a declared type lets the first write go out without a read. */
+    if(check_tag_type(tag, attribs) != PLCTAG_STATUS_OK) {
+        tag->status = PLCTAG_ERR_BAD_PARAM;
+        return (plc_tag_p)tag;
+    }
+
     tag->size = (tag->elem_count) * (tag->elem_size);
 
     if(tag->size == 0) {
         /* failure! Need data_size! */
         tag->status = PLCTAG_ERR_BAD_PARAM;
-        return (plc_tag)tag;
+        return (plc_tag_p)tag;
     }
 
     tag->data = (uint8_t*)mem_alloc(tag->size);
 
     if(tag->data == NULL) {
         tag->status = PLCTAG_ERR_NO_MEM;
-        return (plc_tag)tag;
+        return (plc_tag_p)tag;
     }
 
     /* get the connection path, punt if there is not one and we have a Logix-class PLC. */
@@ -140,17 +155,20 @@ plc_tag ab_tag_create(attr attribs)
 
     if(path == NULL && tag->protocol_type == AB_PROTOCOL_LGX) {
         tag->status = PLCTAG_ERR_BAD_PARAM;
-        return (plc_tag)tag;
+        return (plc_tag_p)tag;
     }
 
     tag->first_read = 1;
 
+    /* how many fragments of a large write may be outstanding at once */
+    tag->write_window = attr_get_int(attribs,"write_window",AB_DEFAULT_WRITE_WINDOW);
+
     /* make sure the global mutex is set up */
     rc = check_mutex(tag->debug);
 
     if(rc != PLCTAG_STATUS_OK) {
         tag->status = rc;
-        return (plc_tag)tag;
+        return (plc_tag_p)tag;
     }
 
     /*
@@ -175,7 +193,7 @@ plc_tag ab_tag_create(attr attribs)
         pdebug(debug,"leaving critical block %p",global_session_mut);
 
         if(tag->status != PLCTAG_STATUS_OK) {
-            return (plc_tag)tag;
+            return (plc_tag_p)tag;
         }
     }
 
@@ -193,7 +211,7 @@ plc_tag ab_tag_create(attr attribs)
     if(path && cip_encode_path(tag,path) != PLCTAG_STATUS_OK) {
         pdebug(debug,"Unable to convert links strings to binary path!");
         tag->status = PLCTAG_ERR_BAD_PARAM;
-        return (plc_tag)tag;
+        return (plc_tag_p)tag;
     }
 
     /* handle the strange LGX->DH+->PLC5 case */
@@ -210,7 +228,7 @@ plc_tag ab_tag_create(attr attribs)
     if(!tag->vtable) {
         pdebug(debug,"Unable to set tag vtable!");
         tag->status = PLCTAG_ERR_BAD_PARAM;
-        return (plc_tag)tag;
+        return (plc_tag_p)tag;
     }
 
     /*
@@ -221,14 +239,14 @@ plc_tag ab_tag_create(attr attribs)
     if(find_or_create_session(&tag->session, attribs) != PLCTAG_STATUS_OK) {
         pdebug(debug,"Unable to create session!");
         tag->status = PLCTAG_ERR_BAD_GATEWAY;
-        return (plc_tag)tag;
+        return (plc_tag_p)tag;
     }
 
     if(tag->needs_connection) {
         /* Find or create a connection.*/
         if((tag->status = find_or_create_connection(tag, tag->session, attribs)) != PLCTAG_STATUS_OK) {
             pdebug(debug,"Unable to create connection! Status=%d",tag->status);
-            return (plc_tag)tag;
+            return (plc_tag_p)tag;
         }
 
         /* tag is a connected tag */
@@ -244,12 +262,95 @@ plc_tag ab_tag_create(attr attribs)
     if(check_tag_name(tag, attr_get_str(attribs,"name","NONE")) != PLCTAG_STATUS_OK) {
         pdebug(debug,"Bad tag name!");
         tag->status = PLCTAG_ERR_BAD_PARAM;
-        return (plc_tag)tag;
+        return (plc_tag_p)tag;
+    }
+
+    /*
+     * With symbol_instance=1, Logix tags are addressed by symbol instance
+     * once the controller's symbol table has been browsed.
+     */
+    if(tag->protocol_type == AB_PROTOCOL_LGX && !tag->needs_connection
+       && attr_get_int(attribs,"symbol_instance",0)) {
+        if((tag->status = symbol_tag_init(tag)) != PLCTAG_STATUS_OK) {
+            pdebug(debug,"Unable to set up symbol instance addressing!");
+            return (plc_tag_p)tag;
+        }
+    }
+
+    /*
+     * Handles with a read cache share it with the other handles for the
+     * same tag.  share=1 joins without a cache, share=0 stays out.
+     */
+    if(attr_get_int(attribs,"share",(attr_get_int(attribs,"read_cache_ms",0) > 0))) {
+        uint8_t key[512];
+        int key_size = make_share_key(tag, key, (int)sizeof(key));
+
+        if(key_size > 0) {
+            tag->share = share_attach(key, key_size);
+        }
     }
 
     pdebug(debug,"Done.");
 
-    return (plc_tag)tag;
+    return (plc_tag_p)tag;
+}
+
+
+
+/* append len bytes to the key, returns 0 if they do not fit. */
+static int share_key_add(uint8_t *key, int *key_size, int key_max, const void *src, int len)
+{
+    if(*key_size + len > key_max) {
+        return 0;
+    }
+
+    mem_copy(key + *key_size, (void *)src, len);
+    *key_size += len;
+
+    return 1;
+}
+
+
+/*
+ * make_share_key
+ *
+ * Build the share key from the parsed tag, so that handles written
+ * differently for the same data (host case, default port, elem_count
+ * left out) still find each other.  Returns the key size or 0.
+ */
+static int make_share_key(ab_tag_p tag, uint8_t *key, int key_max)
+{
+    char host[MAX_SESSION_HOST];
+    int vals[5];
+    int key_size = 0;
+    int i;
+
+    for(i = 0; i < MAX_SESSION_HOST - 1 && tag->session->host[i]; i++) {
+        char c = tag->session->host[i];
+
+        host[i] = (char)((c >= 'A' && c <= 'Z') ? (c - 'A' + 'a') : c);
+    }
+
+    host[i] = 0;
+
+    vals[0] = tag->session->port;
+    vals[1] = tag->protocol_type;
+    vals[2] = tag->use_dhp_direct ? (tag->dhp_src << 8) | tag->dhp_dest : -1;
+    vals[3] = tag->elem_count;
+    vals[4] = tag->elem_size;
+
+    if(!share_key_add(key, &key_size, key_max, host, i + 1)
+       || !share_key_add(key, &key_size, key_max, vals, (int)sizeof(vals))
+       || !share_key_add(key, &key_size, key_max, &tag->conn_path_size, 1)
+       || !share_key_add(key, &key_size, key_max, tag->conn_path, tag->conn_path_size)
+       || !share_key_add(key, &key_size, key_max, &tag->routing_path_size, 1)
+       || !share_key_add(key, &key_size, key_max, tag->routing_path, tag->routing_path_size)
+       || !share_key_add(key, &key_size, key_max, tag->encoded_name, tag->encoded_name_size)) {
+        pdebug(tag->debug, "Share key too long, tag will not share.");
+        return 0;
+    }
+
+    return key_size;
 }
 
 
@@ -271,9 +372,12 @@ tag_vtable_p set_tag_vtable(ab_tag_p tag)
                 if(!plc_dhp_vtable.abort) {
                     plc_dhp_vtable.abort     = (tag_abort_func)ab_tag_abort;
                     plc_dhp_vtable.destroy   = (tag_destroy_func)ab_tag_destroy;
+                    plc_dhp_vtable.destroy_many = (tag_destroy_many_func)ab_tag_destroy_many;
                     plc_dhp_vtable.read      = (tag_read_func)eip_dhp_pccc_tag_read_start;
                     plc_dhp_vtable.status    = (tag_status_func)eip_dhp_pccc_tag_status;
                     plc_dhp_vtable.write     = (tag_write_func)eip_dhp_pccc_tag_write_start;
+                    plc_dhp_vtable.stats     = (tag_stats_func)ab_tag_get_stats;
+                    plc_dhp_vtable.session_stats = (tag_stats_func)ab_tag_get_session_stats;
                 }
 
                 return &plc_dhp_vtable;
@@ -281,9 +385,12 @@ tag_vtable_p set_tag_vtable(ab_tag_p tag)
                 if(!plc_vtable.abort) {
                     plc_vtable.abort     = (tag_abort_func)ab_tag_abort;
                     plc_vtable.destroy   = (tag_destroy_func)ab_tag_destroy;
+                    plc_vtable.destroy_many = (tag_destroy_many_func)ab_tag_destroy_many;
                     plc_vtable.read      = (tag_read_func)eip_pccc_tag_read_start;
                     plc_vtable.status    = (tag_status_func)eip_pccc_tag_status;
                     plc_vtable.write     = (tag_write_func)eip_pccc_tag_write_start;
+                    plc_vtable.stats     = (tag_stats_func)ab_tag_get_stats;
+                    plc_vtable.session_stats = (tag_stats_func)ab_tag_get_session_stats;
                 }
 
                 return &plc_vtable;
@@ -295,9 +402,12 @@ tag_vtable_p set_tag_vtable(ab_tag_p tag)
             if(!plc_vtable.abort) {
                 plc_vtable.abort     = (tag_abort_func)ab_tag_abort;
                 plc_vtable.destroy   = (tag_destroy_func)ab_tag_destroy;
+                plc_vtable.destroy_many = (tag_destroy_many_func)ab_tag_destroy_many;
                 plc_vtable.read      = (tag_read_func)eip_pccc_tag_read_start;
                 plc_vtable.status    = (tag_status_func)eip_pccc_tag_status;
                 plc_vtable.write     = (tag_write_func)eip_pccc_tag_write_start;
+                plc_vtable.stats     = (tag_stats_func)ab_tag_get_stats;
+                plc_vtable.session_stats = (tag_stats_func)ab_tag_get_session_stats;
             }
 
             return &plc_vtable;
@@ -309,9 +419,12 @@ tag_vtable_p set_tag_vtable(ab_tag_p tag)
             if(!cip_vtable.abort) {
                 cip_vtable.abort     = (tag_abort_func)ab_tag_abort;
                 cip_vtable.destroy   = (tag_destroy_func)ab_tag_destroy;
+                cip_vtable.destroy_many = (tag_destroy_many_func)ab_tag_destroy_many;
                 cip_vtable.read      = (tag_read_func)eip_cip_tag_read_start;
                 cip_vtable.status    = (tag_status_func)eip_cip_tag_status;
                 cip_vtable.write     = (tag_write_func)eip_cip_tag_write_start;
+                cip_vtable.stats     = (tag_stats_func)ab_tag_get_stats;
+                cip_vtable.session_stats = (tag_stats_func)ab_tag_get_session_stats;
             }
 
             return &cip_vtable;
@@ -327,6 +440,68 @@ tag_vtable_p set_tag_vtable(ab_tag_p tag)
 }
 
 
+/*
+ * tag_record_timing_unsafe
+ *
+ * If every request the tag has out got a response, the operation
+ * finished normally.  Roll the request timestamps up into the tag's
+ * last operation timing and count the time the responses waited
+ * for the tag to pick them up.
+ */
+static void tag_record_timing_unsafe(ab_tag_p tag)
+{
+    plc_tag_timing_t timing;
+    int64_t now = time_mono_us();
+    int64_t first_created = 0;
+    ab_request_p req;
+    int i;
+
+    if (!tag->reqs) {
+        return;
+    }
+
+    for (i = 0; i < tag->max_requests; i++) {
+        req = tag->reqs[i];
+
+        if (req && (!req->resp_received || !req->time_matched_us)) {
+            return;
+        }
+    }
+
+    mem_set(&timing, 0, sizeof(timing));
+
+    for (i = 0; i < tag->max_requests; i++) {
+        req = tag->reqs[i];
+
+        if (!req) {
+            continue;
+        }
+
+        timing.requests++;
+        timing.queue_us += req->time_send_start_us - req->time_created_us;
+        timing.send_us += req->time_sent_us - req->time_send_start_us;
+        timing.wait_us += req->time_resp_start_us - req->time_sent_us;
+        timing.recv_us += req->time_matched_us - req->time_resp_start_us;
+        timing.pickup_us += now - req->time_matched_us;
+
+        if (!first_created || req->time_created_us < first_created) {
+            first_created = req->time_created_us;
+        }
+
+        stats_hist_add(tag->stats.pickup_hist, now - req->time_matched_us);
+
+        if (tag->session) {
+            stats_hist_add(tag->session->stats.pickup_hist, now - req->time_matched_us);
+        }
+    }
+
+    if (timing.requests) {
+        timing.total_us = now - first_created;
+        tag->timing = timing;
+    }
+}
+
+
 /*
  * ab_tag_abort
  *
@@ -336,11 +511,29 @@ tag_vtable_p set_tag_vtable(ab_tag_p tag)
  */
 
 int ab_tag_abort(ab_tag_p tag)
+{
+    critical_block(global_session_mut) {
+        ab_tag_abort_unsafe(tag);
+    }
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+/* must have the session mutex held here. */
+static void ab_tag_abort_unsafe(ab_tag_p tag)
 {
     int i;
 
+    /*
+     * the IO thread may still be sending one of these, so make
+     * sure it stops counting against this tag's stats first.
+     */
+    tag_record_timing_unsafe(tag);
+
     for (i = 0; i < tag->max_requests; i++) {
         if (tag->reqs && tag->reqs[i]) {
+            tag->reqs[i]->tag_stats = NULL;
             tag->reqs[i]->abort_request = 1;
             tag->reqs[i] = NULL;
         }
@@ -348,6 +541,84 @@ int ab_tag_abort(ab_tag_p tag)
 
     tag->read_in_progress = 0;
     tag->write_in_progress = 0;
+}
+
+
+
+/*
+ * request_count_gauges_unsafe
+ *
+ * Count one request toward the queue depth or in flight gauges.
+ */
+static void request_count_gauges_unsafe(ab_request_p req, plc_tag_stats_t *stats)
+{
+    if(req->abort_request) {
+        return;
+    }
+
+    if(req->send_request) {
+        stats->queue_depth++;
+    } else if(req->recv_in_progress && !req->resp_received) {
+        stats->in_flight++;
+    }
+}
+
+
+/*
+ * request_count_matched_unsafe
+ *
+ * Count the stages that end when a response is matched.
+ */
+static void request_count_matched_unsafe(ab_request_p req, plc_tag_stats_t *stats)
+{
+    stats_hist_add(stats->response_hist, req->time_matched_us - req->time_sent_us);
+    stats_hist_add(stats->wait_hist, req->time_resp_start_us - req->time_sent_us);
+    stats_hist_add(stats->recv_hist, req->time_matched_us - req->time_resp_start_us);
+}
+
+
+/*
+ * ab_tag_get_stats
+ *
+ * The counters are already filled in by the caller.  Sample the
+ * tag's outstanding requests for the gauges.
+ */
+int ab_tag_get_stats(ab_tag_p tag, plc_tag_stats_t *stats)
+{
+    int i;
+
+    critical_block(global_session_mut) {
+        for (i = 0; i < tag->max_requests; i++) {
+            if (tag->reqs && tag->reqs[i]) {
+                request_count_gauges_unsafe(tag->reqs[i], stats);
+            }
+        }
+    }
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+/*
+ * ab_tag_get_session_stats
+ *
+ * Copy the session counters and sample all the session's requests.
+ */
+int ab_tag_get_session_stats(ab_tag_p tag, plc_tag_stats_t *stats)
+{
+    ab_request_p req;
+
+    if(!tag->session) {
+        return PLCTAG_ERR_NULL_PTR;
+    }
+
+    critical_block(global_session_mut) {
+        stats_snapshot(stats, &tag->session->stats);
+
+        for(req = tag->session->requests; req; req = req->next) {
+            request_count_gauges_unsafe(req, stats);
+        }
+    }
 
     return PLCTAG_STATUS_OK;
 }
@@ -358,38 +629,81 @@ int ab_tag_abort(ab_tag_p tag)
  * This is not completely thread-safe.  Two threads could hit this at
  * once.  It will safely remove outstanding requests, but that is about
  * it.  If two threads hit this at the same time, at least a double-free
- * will result.
+ * will result.  The handle table keeps the API from doing that.
  */
 
 int ab_tag_destroy(ab_tag_p tag)
 {
-    int rc = PLCTAG_STATUS_OK;
-
     /* already destroyed? */
     if (!tag)
-        return rc;
+        return PLCTAG_STATUS_OK;
 
-    ab_connection_p connection = tag->connection;
-    ab_session_p session = tag->session;
-    int debug = tag->debug;
+    pdebug(tag->debug, "Starting.");
 
-    pdebug(debug, "Starting.");
+    return ab_tag_destroy_many((plc_tag_p *)&tag, 1);
+}
 
-    /*
-     * stop any current actions. Note that we
-     * want to use the thread-safe version here.  We
-     * do lock a mutex later, but a different one.
-     */
-    plc_tag_abort((plc_tag)tag);
+
+
+/*
+ * ab_tag_destroy_many
+ *
+ * Tear down a batch of tags with one pass under the session mutex
+ * rather than one lock round trip per tag.  Sessions and connections
+ * left empty are handled as usual, they linger or go away.  NULL
+ * entries are skipped.
+ */
+
+int ab_tag_destroy_many(plc_tag_p *tags, int count)
+{
+    int i;
+
+    critical_block(global_session_mut) {
+        for(i = 0; i < count; i++) {
+            if(tags[i]) {
+                ab_tag_unlink_unsafe((ab_tag_p)tags[i]);
+            }
+        }
+    }
+
+    for(i = 0; i < count; i++) {
+        if(tags[i]) {
+            ab_tag_free((ab_tag_p)tags[i]);
+        }
+    }
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * ab_tag_unlink_unsafe
+ *
+ * Stop any requests and take the tag out of its connection or session.
+ * Must have the session mutex held here.
+ */
+static void ab_tag_unlink_unsafe(ab_tag_p tag)
+{
+    int debug = tag->debug;
+
+    ab_tag_abort_unsafe(tag);
 
     /* tags are stored in different locations depending on the type. */
-    if(connection) {
+    if(tag->connection) {
         pdebug(debug, "Removing tag from connection.");
-        connection_remove_tag(connection, tag);
-    } else {
+        connection_remove_tag_unsafe(tag->connection, tag);
+    } else if(tag->session) {
         pdebug(debug, "Removing tag from session.");
-        session_remove_tag(session, tag);
+        session_remove_tag_unsafe(tag->session, tag);
     }
+}
+
+
+
+static void ab_tag_free(ab_tag_p tag)
+{
+    int debug = tag->debug;
 
     if (tag->reqs) {
         mem_free(tag->reqs);
@@ -406,6 +720,11 @@ int ab_tag_destroy(ab_tag_p tag)
         tag->write_req_sizes = NULL;
     }
 
+    if (tag->read_tmpl) {
+        mem_free(tag->read_tmpl);
+        tag->read_tmpl = NULL;
+    }
+
     if (tag->data) {
         mem_free(tag->data);
         tag->data = NULL;
@@ -415,8 +734,6 @@ int ab_tag_destroy(ab_tag_p tag)
     mem_free(tag);
 
     pdebug(debug, "done");
-
-    return rc;
 }
 
 
@@ -425,8 +742,10 @@ int check_cpu(ab_tag_p tag, attr attribs)
 {
     const char* cpu_type = attr_get_str(attribs, "cpu", "NONE");
 
-    if (!str_cmp_i(cpu_type, "plc") || !str_cmp_i(cpu_type, "plc5") || !str_cmp_i(cpu_type, "slc") ||
-        !str_cmp_i(cpu_type, "slc500")) {
+    if (!str_cmp_i(cpu_type, "plc") || !str_cmp_i(cpu_type, "plc5")) {
+        tag->protocol_type = AB_PROTOCOL_PLC;
+        tag->pccc_rmw = 1;
+    } else if (!str_cmp_i(cpu_type, "slc") || !str_cmp_i(cpu_type, "slc500")) {
         tag->protocol_type = AB_PROTOCOL_PLC;
     } else if (!str_cmp_i(cpu_type, "micrologix800") || !str_cmp_i(cpu_type, "mlgx800") || !str_cmp_i(cpu_type, "micro800")) {
         tag->protocol_type = AB_PROTOCOL_MLGX800;
@@ -445,6 +764,100 @@ int check_cpu(ab_tag_p tag, attr attribs)
     return PLCTAG_STATUS_OK;
 }
 
+/*
+ * check_tag_type
+ *
+ * Logix writes must carry the tag's CIP type.  Normally we learn
+ * that from the first read, so the first write of a tag has to read
+ * it first.  If the caller tells us the type with type=<name> (or
+ * type=udt and udt_handle=<n> for a structure), we encode it here and
+ * the write can go out immediately.  A base type also supplies the
+ * element size when elem_size is not given.
+ */
+
+static const struct {
+    const char *name;
+    uint8_t cip_type;
+    int size;
+} ab_cip_types[] = {
+    {"bool",  AB_CIP_DATA_BIT,   1},
+    {"sint",  AB_CIP_DATA_SINT,  1},
+    {"int",   AB_CIP_DATA_INT,   2},
+    {"dint",  AB_CIP_DATA_DINT,  4},
+    {"lint",  AB_CIP_DATA_LINT,  8},
+    {"usint", AB_CIP_DATA_USINT, 1},
+    {"uint",  AB_CIP_DATA_UINT,  2},
+    {"udint", AB_CIP_DATA_UDINT, 4},
+    {"ulint", AB_CIP_DATA_ULINT, 8},
+    {"real",  AB_CIP_DATA_REAL,  4},
+    {"lreal", AB_CIP_DATA_LREAL, 8},
+    {"byte",  AB_CIP_DATA_BYTE,  1},
+    {"word",  AB_CIP_DATA_WORD,  2},
+    {"dword", AB_CIP_DATA_DWORD, 4},
+    {"lword", AB_CIP_DATA_LWORD, 8},
+    {NULL, 0, 0}
+};
+
+int check_tag_type(ab_tag_p tag, attr attribs)
+{
+    const char *type = attr_get_str(attribs, "type", NULL);
+    int debug = tag->debug;
+    int handle;
+    int i;
+
+    if (!type) {
+        return PLCTAG_STATUS_OK;
+    }
+
+    if (tag->protocol_type != AB_PROTOCOL_LGX && tag->protocol_type != AB_PROTOCOL_MLGX800) {
+        /* PCCC types come from the data file, nothing to do. */
+        pdebug(debug, "Ignoring type %s on a PCCC tag.", type);
+        return PLCTAG_STATUS_OK;
+    }
+
+    if (!str_cmp_i(type, "udt")) {
+        handle = attr_get_int(attribs, "udt_handle", -1);
+
+        if (handle < 0 || handle > 0xFFFF) {
+            pdebug(debug, "type=udt needs a udt_handle between 0 and 65535!");
+            return PLCTAG_ERR_BAD_PARAM;
+        }
+
+        /* abbreviated structure: type byte, length, 16-bit handle. */
+        tag->encoded_type_info[0] = AB_CIP_DATA_ABREV_STRUCT;
+        tag->encoded_type_info[1] = 2;
+        tag->encoded_type_info[2] = (uint8_t)(handle & 0xFF);
+        tag->encoded_type_info[3] = (uint8_t)((handle >> 8) & 0xFF);
+        tag->encoded_type_info_size = 4;
+
+        return PLCTAG_STATUS_OK;
+    }
+
+    for (i = 0; ab_cip_types[i].name; i++) {
+        if (!str_cmp_i(type, ab_cip_types[i].name)) {
+            break;
+        }
+    }
+
+    if (!ab_cip_types[i].name) {
+        pdebug(debug, "Unsupported data type: %s", type);
+        return PLCTAG_ERR_BAD_PARAM;
+    }
+
+    if (tag->elem_size == 0) {
+        tag->elem_size = ab_cip_types[i].size;
+    } else if (tag->elem_size != ab_cip_types[i].size) {
+        pdebug(debug, "elem_size %d does not match type %s!", tag->elem_size, type);
+        return PLCTAG_ERR_BAD_PARAM;
+    }
+
+    tag->encoded_type_info[0] = ab_cip_types[i].cip_type;
+    tag->encoded_type_info[1] = 0;
+    tag->encoded_type_info_size = 2;
+
+    return PLCTAG_STATUS_OK;
+}
+
 int check_tag_name(ab_tag_p tag, const char* name)
 {
     int debug = tag->debug;
@@ -463,6 +876,11 @@ int check_tag_name(ab_tag_p tag, const char* name)
                 return PLCTAG_ERR_BAD_PARAM;
             }
 
+            /* not every file is made of words, those cannot write single bits */
+            if (!tag->pccc_rmw && !pccc_encode_slc_name(tag->encoded_slc_name, &(tag->encoded_slc_name_size), name, MAX_TAG_NAME)) {
+                pdebug(debug, "%s has no SLC word address.", name);
+            }
+
             break;
 
 		case AB_PROTOCOL_MLGX800:
@@ -602,10 +1020,34 @@ int session_check_incoming_data_unsafe(ab_session_p session)
             tmp = tmp->next;
         }
 
+        atomic_add_u64(&session->stats.bytes_received, session->recv_offset);
+
         if (tmp) {
+            int64_t elapsed_us;
+
+            tmp->time_resp_start_us = session->recv_start_us;
+            tmp->time_matched_us = time_mono_us();
+            elapsed_us = tmp->time_matched_us - tmp->time_sent_us;
+
             pdebug(tmp->debug, "got full packet of size %d", session->recv_offset);
             pdebug_dump_bytes(tmp->debug, session->recv_data, session->recv_offset);
 
+            atomic_add_u64(&session->stats.responses_matched, 1);
+            request_count_matched_unsafe(tmp, &session->stats);
+
+            trace_event(TRACE_RESP_MATCHED, TRACE_ID(session), TRACE_ID(tmp), session->recv_offset, (int32_t)elapsed_us, 0);
+
+            if(tmp->tag_stats) {
+                atomic_add_u64(&tmp->tag_stats->bytes_received, session->recv_offset);
+                atomic_add_u64(&tmp->tag_stats->responses_matched, 1);
+                request_count_matched_unsafe(tmp, tmp->tag_stats);
+            }
+
+            /* identical reads waiting on this one get the same reply */
+            if (tmp->shareable) {
+                request_deliver_riders_unsafe(session, tmp);
+            }
+
             /* copy the data from the session's buffer */
             mem_copy(tmp->data, session->recv_data, session->recv_offset);
 
@@ -613,10 +1055,21 @@ int session_check_incoming_data_unsafe(ab_session_p session)
             tmp->send_in_progress = 0;
             tmp->send_request = 0;
             tmp->request_size = session->recv_offset;
-        } /*else {
 
-	        pdebug(debug,"Response for unknown request.");
-        }*/
+            /* a Multiple Service Packet, hand out the replies. */
+            if (tmp->batch_count) {
+                batch_dispatch_unsafe(session, tmp);
+            }
+
+            if (tmp->on_reply) {
+                tmp->on_reply(tmp);
+            }
+        } else {
+            /*pdebug(debug,"Response for unknown request.");*/
+            atomic_add_u64(&session->stats.responses_orphaned, 1);
+
+            trace_event(TRACE_RESP_ORPHANED, TRACE_ID(session), 0, session->recv_offset, (uint32_t)session->resp_seq_id, 0);
+        }
 
         /*
          * if we did not find a request, it may have already been aborted, so
@@ -626,6 +1079,7 @@ int session_check_incoming_data_unsafe(ab_session_p session)
         /* reset the session's buffer */
         mem_set(session->recv_data, 0, MAX_REQ_RESP_SIZE);
         session->recv_offset = 0;
+        session->recv_start_us = 0;
         session->resp_seq_id = 0;
         session->has_response = 0;
     }
@@ -646,6 +1100,24 @@ int request_check_outgoing_data_unsafe(ab_session_p session, ab_request_p req)
      */
 
     if (!session->current_request && req->send_request /*&& session->num_reqs_in_flight < MAX_REQS_IN_FLIGHT*/) {
+        /* connected requests wait until the ForwardOpen is done. */
+        if (req->connection) {
+            if (!req->connection->is_connected) {
+                return rc;
+            }
+
+            connection_fill_request_unsafe(req->connection, req);
+        }
+
+        /* send other writes on the same path along with this one */
+        if (req->batchable) {
+            ab_request_p carrier = batch_build_unsafe(session, req);
+
+            if (carrier) {
+                req = carrier;
+            }
+        }
+
         /* nothing being sent and this request is outstanding */
         session->current_request = req;
 
@@ -682,6 +1154,7 @@ void* request_handler_func(void* not_used)
 {
     int rc;
     ab_session_p cur_sess;
+    ab_session_p next_sess;
     int debug = 0;
 
     while (1) {
@@ -705,6 +1178,8 @@ void* request_handler_func(void* not_used)
             while (cur_sess) {
                 ab_request_p cur_req;
                 ab_request_p prev_req;
+                ab_connection_p cur_conn;
+                ab_connection_p next_conn;
 
                 /* check for incoming data. */
                 rc = session_check_incoming_data_unsafe(cur_sess);
@@ -721,6 +1196,10 @@ void* request_handler_func(void* not_used)
                 /*pdebug(debug,"checking outstanding requests.");*/
 
                 while (cur_req) {
+                    if (cur_req->batch_count) {
+                        batch_tickle_unsafe(cur_req);
+                    }
+
                     /* check for abort before anything else. */
                     if (cur_req->abort_request) {
                         ab_request_p tmp;
@@ -734,6 +1213,16 @@ void* request_handler_func(void* not_used)
                          * FIXME
                          */
                         if (cur_sess->current_request != cur_req) {
+                            /* gave up waiting for the response. */
+                            if (cur_req->recv_in_progress && !cur_req->resp_received) {
+                                atomic_add_u64(&cur_sess->stats.timeouts, 1);
+                                trace_event(TRACE_REQ_ABANDONED, TRACE_ID(cur_sess), TRACE_ID(cur_req), 0, 0, 0);
+                            }
+
+                            trace_event(TRACE_REQ_DESTROYED, TRACE_ID(cur_sess), TRACE_ID(cur_req), 0, 0, 0);
+
+                            request_release_riders_unsafe(cur_sess, cur_req);
+
                             if (prev_req) {
                                 prev_req->next = cur_req->next;
                             } else {
@@ -758,9 +1247,31 @@ void* request_handler_func(void* not_used)
                     cur_req = cur_req->next;
                 }
 
+                /*
+                 * move ForwardOpen and ForwardClose along.  Finishing a
+                 * close can free the connection and then the session.
+                 * The session keepalive and idle reaping come first for
+                 * that reason.
+                 */
+                next_sess = cur_sess->next;
+
+                if(session_tickle_unsafe(cur_sess)) {
+                    /* the session lingered too long and is gone. */
+                    cur_sess = next_sess;
+                    continue;
+                }
+
+                cur_conn = cur_sess->connections;
+
+                while (cur_conn) {
+                    next_conn = cur_conn->next;
+                    connection_tickle_unsafe(cur_conn);
+                    cur_conn = next_conn;
+                }
+
                 /*  move to the next session */
                 /*pdebug(debug,"cur_sess=%p, cur_sess->next=%p",cur_sess, cur_sess->next);*/
-                cur_sess = cur_sess->next;
+                cur_sess = next_sess;
             }
         } /* end synchronized block */
         /*pdebug(debug,"leaving critical block %p",global_session_mut);*/
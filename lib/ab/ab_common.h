@@ -43,6 +43,9 @@ typedef struct ab_session_t *ab_session_p;
 typedef struct ab_request_t *ab_request_p;
 #define AB_REQUEST_NULL ((ab_request_p)NULL)
 
+typedef struct ab_symtab_t *ab_symtab_p;
+#define AB_SYMTAB_NULL ((ab_symtab_p)NULL)
+
 
 extern volatile ab_session_p sessions;
 extern volatile mutex_p global_session_mut;
@@ -51,8 +54,12 @@ extern volatile thread_p io_handler_thread;
 
 int ab_tag_abort(ab_tag_p tag);
 int ab_tag_destroy(ab_tag_p p_tag);
+int ab_tag_destroy_many(plc_tag_p *tags, int count);
+int ab_tag_get_stats(ab_tag_p tag, plc_tag_stats_t *stats);
+int ab_tag_get_session_stats(ab_tag_p tag, plc_tag_stats_t *stats);
 int check_cpu(ab_tag_p tag, attr attribs);
 int check_tag_name(ab_tag_p tag, const char *name);
+int check_tag_type(ab_tag_p tag, attr attribs);
 int check_mutex(int debug);
 
 
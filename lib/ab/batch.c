@@ -0,0 +1,353 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/*
+ * batch.c
+ *
+ * Multiple Service Packet batching of unconnected CIP writes.
+ *
+ * Tags build their write requests as usual and mark them batchable.
+ * When the IO thread is about to send one, it looks down the session's
+ * queue for more batchable requests to the same routing path.  If it
+ * finds any, it builds a carrier request: an Unconnected Send holding a
+ * Multiple Service Packet (service 0x0A to the Message Router) with the
+ * embedded message of each request as one service.  The requests are
+ * marked as sent and given consecutive session sequence IDs.
+ *
+ * When the carrier's reply arrives, each service reply is copied into
+ * its request as if it had come back on its own, so the tags check
+ * their results exactly as before.  Requests aborted in the meantime
+ * are simply skipped.  If the whole packet fails, the requests are sent
+ * again one at a time.  If the controller does not support the service,
+ * the session stops batching.
+ */
+
+#include <platform.h>
+#include <ab/ab_common.h>
+#include <ab/batch.h>
+#include <ab/session.h>
+#include <ab/request.h>
+#include <ab/eip.h>
+#include <util/stats.h>
+
+
+
+/*
+ * The embedded message and the routing path after it in an unconnected
+ * CIP request built by eip_cip.c.
+ */
+static int get_parts(ab_request_p req, uint8_t **msg, int *msg_size, uint8_t **route, int *route_size)
+{
+    eip_cip_uc_req *cip = (eip_cip_uc_req*)(req->data);
+    int offset = (int)sizeof(eip_cip_uc_req);
+
+    *msg = req->data + offset;
+    *msg_size = le2h16(cip->uc_cmd_length);
+
+    offset += *msg_size;
+
+    if (offset + 2 > req->request_size) {
+        return 0;
+    }
+
+    *route = req->data + offset + 2;
+    *route_size = req->data[offset] * 2;
+
+    if (offset + 2 + *route_size > req->request_size) {
+        return 0;
+    }
+
+    return 1;
+}
+
+
+static int same_bytes(const uint8_t *a, const uint8_t *b, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+        if (a[i] != b[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+static int is_queued(ab_request_p req)
+{
+    return req->batchable && req->send_request && !req->send_in_progress && !req->abort_request;
+}
+
+
+/*
+ * batch_build_unsafe
+ *
+ * Called by the IO thread with a batchable request it is about to send.
+ * Returns the carrier, already queued, if at least one more request
+ * could go with it.  Otherwise returns NULL and the request goes out
+ * alone.
+ */
+ab_request_p batch_build_unsafe(ab_session_p session, ab_request_p first)
+{
+    ab_request_p members[BATCH_MAX_REQUESTS];
+    ab_request_p carrier = NULL;
+    ab_request_p req;
+    eip_cip_uc_req *cip;
+    uint8_t *route, *msg, *r, *m;
+    int route_size, msg_size, r_size, m_size;
+    uint8_t *data, *embed_start, *offsets;
+    int count = 0;
+    int size;
+    int i;
+
+    if (session->no_batch || !is_queued(first) || !get_parts(first, &msg, &msg_size, &route, &route_size)) {
+        return NULL;
+    }
+
+    /* Unconnected Send, MSP header and count, then the routing path */
+    size = (int)sizeof(eip_cip_uc_req) + 6 + 2 + 2 + route_size;
+
+    for (req = first; req && count < BATCH_MAX_REQUESTS; req = req->next) {
+        if (!is_queued(req) || !get_parts(req, &m, &m_size, &r, &r_size)) {
+            continue;
+        }
+
+        if (r_size != route_size || !same_bytes(r, route, route_size)) {
+            continue;
+        }
+
+        if (size + m_size + 2 > MAX_EIP_PACKET_SIZE) {
+            break;
+        }
+
+        size += m_size + 2;
+        members[count++] = req;
+    }
+
+    if (count < 2) {
+        return NULL;
+    }
+
+    if (request_create(&carrier) != PLCTAG_STATUS_OK) {
+        return NULL;
+    }
+
+    carrier->debug = first->debug;
+
+    /* the encapsulation and Unconnected Send fields are the same */
+    mem_copy(carrier->data, first->data, sizeof(eip_cip_uc_req));
+
+    cip = (eip_cip_uc_req*)(carrier->data);
+    data = carrier->data + sizeof(eip_cip_uc_req);
+    embed_start = data;
+
+    *data++ = AB_EIP_CMD_CIP_MULTI;
+    *data++ = 2;        /* path size in words */
+    *data++ = 0x20;     /* class */
+    *data++ = 0x02;     /* Message Router */
+    *data++ = 0x24;     /* instance */
+    *data++ = 0x01;     /* instance 1 */
+
+    /* service count, then offsets from the count */
+    *((uint16_t*)data) = h2le16(count);
+    offsets = data;
+    data += 2 + (count * 2);
+
+    for (i = 0; i < count; i++) {
+        get_parts(members[i], &m, &m_size, &r, &r_size);
+
+        *((uint16_t*)(offsets + 2 + (i * 2))) = h2le16((uint16_t)(data - offsets));
+
+        mem_copy(data, m, m_size);
+        data += m_size;
+    }
+
+    cip->uc_cmd_length = h2le16((uint16_t)(data - embed_start));
+
+    /* routing path */
+    *data++ = (uint8_t)(route_size / 2);
+    *data++ = 0;
+    mem_copy(data, route, route_size);
+    data += route_size;
+
+    cip->cpf_udi_item_length = h2le16((uint16_t)(data - (uint8_t*)(&(cip->cm_service_code))));
+
+    carrier->request_size = (int)(data - carrier->data);
+    carrier->send_request = 1;
+    carrier->batch_count = count;
+    carrier->batch_first_id = session->session_seq_id;
+
+    session->session_seq_id += count;
+
+    /* the members now wait for their part of the carrier's reply */
+    for (i = 0; i < count; i++) {
+        members[i]->session_seq_id = carrier->batch_first_id + i;
+        members[i]->send_request = 0;
+        members[i]->recv_in_progress = 1;
+    }
+
+    request_add_unsafe(session, carrier);
+
+    pdebug(first->debug, "Packed %d requests into %d bytes.", count, carrier->request_size);
+
+    return carrier;
+}
+
+
+
+/*
+ * Hand one service reply to the request it belongs to, dressed up as
+ * the response to that request alone.
+ */
+static void deliver(ab_request_p carrier, ab_request_p req, uint8_t *reply, int reply_size)
+{
+    int header = (int)offsetof(eip_cip_uc_resp, reply_service);
+    eip_cip_uc_resp *resp = (eip_cip_uc_resp*)(req->data);
+
+    if (header + reply_size > MAX_REQ_RESP_SIZE) {
+        reply_size = MAX_REQ_RESP_SIZE - header;
+    }
+
+    mem_copy(req->data, carrier->data, header);
+    mem_copy(req->data + header, reply, reply_size);
+
+    resp->encap_length = h2le16((uint16_t)(header + reply_size - sizeof(eip_encap_t)));
+    resp->encap_sender_context = req->session_seq_id;
+    resp->cpf_udi_item_length = h2le16((uint16_t)reply_size);
+
+    req->time_send_start_us = carrier->time_send_start_us;
+    req->time_sent_us = carrier->time_sent_us;
+    req->time_resp_start_us = carrier->time_resp_start_us;
+    req->time_matched_us = carrier->time_matched_us;
+
+    if (req->tag_stats) {
+        plc_tag_stats_t *stats = req->tag_stats;
+
+        atomic_add_u64(&stats->requests_sent, 1);
+        atomic_add_u64(&stats->bytes_sent, req->request_size);
+        atomic_add_u64(&stats->responses_matched, 1);
+        atomic_add_u64(&stats->bytes_received, header + reply_size);
+        stats_hist_add(stats->response_hist, req->time_matched_us - req->time_sent_us);
+    }
+
+    req->request_size = header + reply_size;
+    req->resp_received = 1;
+
+    if (req->on_reply) {
+        req->on_reply(req);
+    }
+}
+
+
+
+/*
+ * batch_dispatch_unsafe
+ *
+ * The carrier has its reply.  Split it up among the requests that are
+ * still waiting, then let the IO thread free the carrier.
+ */
+void batch_dispatch_unsafe(ab_session_p session, ab_request_p carrier)
+{
+    eip_cip_uc_resp *resp = (eip_cip_uc_resp*)(carrier->data);
+    uint8_t *end = carrier->data + carrier->request_size;
+    uint8_t *base;
+    ab_request_p members[BATCH_MAX_REQUESTS];
+    ab_request_p req;
+    int count = 0;
+    int ok;
+    int i;
+
+    for (i = 0; i < carrier->batch_count; i++) {
+        members[i] = NULL;
+    }
+
+    for (req = session->requests; req; req = req->next) {
+        if (req != carrier && req->batchable && req->recv_in_progress && !req->resp_received
+            && req->session_seq_id >= carrier->batch_first_id
+            && req->session_seq_id < carrier->batch_first_id + carrier->batch_count) {
+            members[req->session_seq_id - carrier->batch_first_id] = req;
+        }
+    }
+
+    base = &resp->reply_service + 4 + (resp->num_status_words * 2);
+
+    ok = (le2h16(resp->encap_command) == AB_EIP_READ_RR_DATA && le2h16(resp->encap_status) == AB_EIP_OK
+          && resp->reply_service == (AB_EIP_CMD_CIP_MULTI | AB_EIP_CMD_CIP_OK)
+          && (resp->status == AB_CIP_STATUS_OK || resp->status == AB_CIP_STATUS_EMBEDDED)
+          && base + 2 <= end);
+
+    if (ok) {
+        count = le2h16(*((uint16_t*)base));
+        ok = (count == carrier->batch_count && base + 2 + (count * 2) <= end);
+    }
+
+    if (!ok) {
+        pdebug(carrier->debug, "Multiple Service Packet failed, status %d, sending the requests one at a time.", resp->status);
+
+        if (resp->reply_service == (AB_EIP_CMD_CIP_MULTI | AB_EIP_CMD_CIP_OK) && resp->status == AB_CIP_STATUS_UNSUPPORTED) {
+            session->no_batch = 1;
+        }
+
+        for (i = 0; i < carrier->batch_count; i++) {
+            if (members[i]) {
+                members[i]->batchable = 0;
+                members[i]->recv_in_progress = 0;
+                members[i]->send_request = 1;
+
+                atomic_add_u64(&session->stats.retries, 1);
+
+                if (members[i]->tag_stats) {
+                    atomic_add_u64(&members[i]->tag_stats->retries, 1);
+                }
+            }
+        }
+    } else {
+        for (i = 0; i < count; i++) {
+            int start = le2h16(*((uint16_t*)(base + 2 + (i * 2))));
+            int stop = (i + 1 < count ? le2h16(*((uint16_t*)(base + 2 + ((i + 1) * 2)))) : (int)(end - base));
+
+            if (members[i] && start < stop && base + stop <= end) {
+                deliver(carrier, members[i], base + start, stop - start);
+            }
+        }
+    }
+
+    carrier->abort_request = 1;
+}
+
+
+
+/*
+ * batch_tickle_unsafe
+ *
+ * A carrier whose reply never comes would sit in the queue forever, the
+ * tags that were waiting on it time out on their own.
+ */
+void batch_tickle_unsafe(ab_request_p carrier)
+{
+    if (carrier->recv_in_progress && !carrier->resp_received
+        && time_mono_us() - carrier->time_sent_us > BATCH_TIMEOUT_US) {
+        pdebug(carrier->debug, "Giving up on Multiple Service Packet reply.");
+        carrier->abort_request = 1;
+    }
+}
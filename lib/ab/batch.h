@@ -0,0 +1,47 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/*
+ * batch.h
+ *
+ * Unconnected CIP writes that are waiting to go out on the same session
+ * and routing path are packed into one Multiple Service Packet.
+ */
+
+#ifndef __LIBPLCTAG_AB_BATCH_H__
+#define __LIBPLCTAG_AB_BATCH_H__
+
+#include <libplctag.h>
+#include <ab/ab_common.h>
+#include <ab/session.h>
+#include <ab/request.h>
+
+/* most requests in one packet, keeps the reply well under 500 bytes */
+#define BATCH_MAX_REQUESTS		(32)
+
+/* a packet that gets no reply in this long is thrown away */
+#define BATCH_TIMEOUT_US		(30000000)
+
+ab_request_p batch_build_unsafe(ab_session_p session, ab_request_p first);
+void batch_dispatch_unsafe(ab_session_p session, ab_request_p carrier);
+void batch_tickle_unsafe(ab_request_p carrier);
+
+#endif
@@ -58,13 +58,16 @@ int find_or_create_connection(ab_tag_p tag, ab_session_p session, attr attribs)
     const char* path = attr_get_str(attribs, "path", "");
     ab_connection_p connection = AB_CONNECTION_NULL;
     int rc = PLCTAG_STATUS_OK;
-    int is_new = 0;
 
     pdebug(debug, "Starting.");
 
     /* lock the session while this is happening because we do not
      * want a race condition where two tags try to create the same
      * connection at the same time.
+     *
+     * The Forward Open is only queued here.  The IO thread finishes
+     * it and any tags created in the mean time queue their requests
+     * behind it.
      */
 
     pdebug(debug,"entering critical block %p",global_session_mut);
@@ -73,10 +76,32 @@ int find_or_create_connection(ab_tag_p tag, ab_session_p session, attr attribs)
 
         if (connection == AB_CONNECTION_NULL) {
             connection = connection_create_unsafe(debug, path, session);
-            is_new = 1;
+
+            if (connection != AB_CONNECTION_NULL) {
+                /* copy path data from the tag */
+                mem_copy(connection->conn_path, tag->conn_path, tag->conn_path_size);
+                connection->conn_path_size = tag->conn_path_size;
+                connection->use_dhp_direct = tag->use_dhp_direct;
+                connection->dhp_src = tag->dhp_src;
+                connection->dhp_dest = tag->dhp_dest;
+
+                /* the tag that creates the connection picks the parameters */
+                if((rc = connection_set_params(connection, tag->protocol_type, attribs)) != PLCTAG_STATUS_OK) {
+                    pdebug(debug, "Bad connection parameters!");
+                    connection_destroy_unsafe(connection);
+                    connection = AB_CONNECTION_NULL;
+                    break;
+                }
+
+                /* start the ForwardOpen call to set up the connection */
+                if((rc = connection_open_unsafe(connection)) != PLCTAG_STATUS_OK) {
+                    pdebug(debug, "Unable to start ForwardOpen to set up connection with PLC!");
+                }
+            }
         } else {
-            /* found a connection, nothing more to do. */
+            /* found a connection, keep the IO thread from reaping it if it is idle. */
             pdebug(debug, "find_or_create_connection() reusing existing connection.");
+            connection->idle_since_ms = 0;
             rc = PLCTAG_STATUS_OK;
         }
     }
@@ -84,27 +109,12 @@ int find_or_create_connection(ab_tag_p tag, ab_session_p session, attr attribs)
 
     if (connection == AB_CONNECTION_NULL) {
         pdebug(debug, "unable to create or find a connection!");
-        rc = PLCTAG_ERR_BAD_GATEWAY;
-        return rc;
-    } else if(is_new) {
-        /* only do this if this is a new connection. */
-
-        /* copy path data from the tag */
-        mem_copy(connection->conn_path, tag->conn_path, tag->conn_path_size);
-        connection->conn_path_size = tag->conn_path_size;
-
-        /* do the ForwardOpen call to set up the session */
-        if((rc = connection_perform_forward_open(connection)) != PLCTAG_STATUS_OK) {
-            pdebug(debug, "Unable to perform ForwardOpen to set up connection with PLC!");
-
-            /*critical_block(global_session_mut) {
-                connection_destroy_unsafe(connection);
-            }
-
-            tag->connection = NULL;
 
-            return rc;*/
+        if(rc == PLCTAG_STATUS_OK) {
+            rc = PLCTAG_ERR_BAD_GATEWAY;
         }
+
+        return rc;
     }
 
     tag->connection = connection;
@@ -146,11 +156,110 @@ ab_connection_p connection_create_unsafe(int debug, const char* path, ab_session
 
 
 
-int connection_perform_forward_open(ab_connection_p connection)
+/*
+ * Forward Open defaults per PLC family.  Logix controllers take a Large
+ * Forward Open and as big a connection as we can buffer.  Anything
+ * else, including PLC/5s and SLCs behind a DH+ bridge, gets the classic
+ * Forward Open with the size those are known to accept.  A controller
+ * that wants less will say so and we retry.
+ */
+static struct {
+    int protocol_type;
+    int use_large_fo;
+    int conn_size;
+} conn_defaults[] = {
+    { AB_PROTOCOL_LGX, 1, CONNECTION_MAX_SIZE },
+    { AB_PROTOCOL_MLGX800, 0, (AB_EIP_LGX_PARAM & AB_EIP_CONN_PARAM_SIZE_MASK) },
+    { AB_PROTOCOL_PLC, 0, (AB_EIP_PLC5_PARAM & AB_EIP_CONN_PARAM_SIZE_MASK) },
+    { AB_PROTOCOL_MLGX, 0, (AB_EIP_SLC_PARAM & AB_EIP_CONN_PARAM_SIZE_MASK) }
+};
+
+#define NUM_CONN_DEFAULTS ((int)(sizeof(conn_defaults)/sizeof(conn_defaults[0])))
+
+
+/*
+ * connection_set_params
+ *
+ * Pick the Forward Open parameters from the PLC type, then let the
+ * conn_size, conn_priority and conn_rpi_ms attributes override them.
+ */
+int connection_set_params(ab_connection_p connection, int protocol_type, attr attribs)
+{
+    const char *priority = attr_get_str(attribs, "conn_priority", "low");
+    int rpi_ms = attr_get_int(attribs, "conn_rpi_ms", AB_EIP_RPI/1000);
+    int linger_ms = attr_get_int(attribs, "linger_ms", SESSION_DEFAULT_LINGER_MS);
+    int debug = connection->debug;
+    int i;
+
+    connection->protocol_type = protocol_type;
+    connection->use_large_fo = 0;
+    connection->conn_size = (AB_EIP_PLC5_PARAM & AB_EIP_CONN_PARAM_SIZE_MASK);
+
+    for(i=0; i < NUM_CONN_DEFAULTS; i++) {
+        if(conn_defaults[i].protocol_type == protocol_type) {
+            connection->use_large_fo = conn_defaults[i].use_large_fo;
+            connection->conn_size = conn_defaults[i].conn_size;
+            break;
+        }
+    }
+
+    connection->conn_size = attr_get_int(attribs, "conn_size", connection->conn_size);
+
+    if(connection->conn_size < CONNECTION_MIN_SIZE || connection->conn_size > CONNECTION_MAX_SIZE) {
+        pdebug(debug, "Connection size %d must be between %d and %d!", connection->conn_size, CONNECTION_MIN_SIZE, CONNECTION_MAX_SIZE);
+        return PLCTAG_ERR_BAD_PARAM;
+    }
+
+    /* only a Large Forward Open can ask for more than 511 bytes. */
+    connection->use_large_fo = (connection->conn_size > CONNECTION_MAX_SMALL_SIZE);
+
+    if(!str_cmp_i(priority, "low")) {
+        connection->conn_priority = AB_EIP_CONN_PRIORITY_LOW;
+    } else if(!str_cmp_i(priority, "high")) {
+        connection->conn_priority = AB_EIP_CONN_PRIORITY_HIGH;
+    } else if(!str_cmp_i(priority, "scheduled")) {
+        connection->conn_priority = AB_EIP_CONN_PRIORITY_SCHEDULED;
+    } else if(!str_cmp_i(priority, "urgent")) {
+        connection->conn_priority = AB_EIP_CONN_PRIORITY_URGENT;
+    } else {
+        pdebug(debug, "Unknown connection priority %s!", priority);
+        return PLCTAG_ERR_BAD_PARAM;
+    }
+
+    if(rpi_ms <= 0) {
+        pdebug(debug, "Connection RPI must be positive!");
+        return PLCTAG_ERR_BAD_PARAM;
+    }
+
+    connection->rpi_us = (uint32_t)rpi_ms * 1000;
+
+    if(linger_ms < 0) {
+        pdebug(debug, "Linger time must not be negative!");
+        return PLCTAG_ERR_BAD_PARAM;
+    }
+
+    connection->linger_ms = (uint64_t)linger_ms;
+
+    pdebug(debug, "Connection size %d, priority %d, RPI %uus, %s Forward Open.",
+           connection->conn_size, connection->conn_priority, connection->rpi_us, (connection->use_large_fo ? "large" : "small"));
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * connection_open_unsafe
+ *
+ * Queue a ForwardOpen request.  This does not wait for the response,
+ * connection_tickle_unsafe() picks that up in the IO thread.
+ *
+ * The session mutex must be held.
+ */
+int connection_open_unsafe(ab_connection_p connection)
 {
     int debug = connection->debug;
     ab_request_p req;
-    uint64_t timeout_time;
     int rc = PLCTAG_STATUS_OK;
 
     pdebug(debug, "Starting.");
@@ -158,57 +267,296 @@ int connection_perform_forward_open(ab_connection_p connection)
     /* get a request buffer */
     rc = request_create(&req);
 
-    do {
-        if(rc != PLCTAG_STATUS_OK) {
-            pdebug(debug,"Unable to get new request.  rc=%d",rc);
-            rc = 0;
-            break;
-        }
+    if(rc != PLCTAG_STATUS_OK) {
+        pdebug(debug,"Unable to get new request.  rc=%d",rc);
+        connection->status = rc;
+        return rc;
+    }
 
-        /* send the ForwardOpen command to the PLC */
-        if((rc = send_forward_open_req(connection, req)) != PLCTAG_STATUS_OK) {
-            pdebug(connection->debug,"Unable to send ForwardOpen packet!");
-            break;
-        }
+    /* send the ForwardOpen command to the PLC */
+    if((rc = send_forward_open_req(connection, req)) != PLCTAG_STATUS_OK) {
+        pdebug(debug,"Unable to send ForwardOpen packet!");
+        request_destroy_unsafe(&req);
+        connection->status = rc;
+        return rc;
+    }
 
-        /* wait for a response */
-        timeout_time = time_ms() + 5000; /* MAGIC five seconds */
+    connection->cm_req = req;
+    connection->cm_timeout = time_ms() + CONNECTION_OPEN_TIMEOUT_MS;
+    connection->connect_in_progress = 1;
+    connection->status = PLCTAG_STATUS_PENDING;
 
-        while (timeout_time > time_ms() && !req->resp_received) {
-            sleep_ms(1);
+    pdebug(debug, "Done.");
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * connection_tickle_unsafe
+ *
+ * Called by the IO thread for each connection on every pass.  Finish
+ * a ForwardOpen or ForwardClose once its response is in, its send
+ * failed or it timed out.  When a close finishes, the connection is
+ * freed and that may free the session too.
+ *
+ * The session mutex must be held.
+ */
+int connection_tickle_unsafe(ab_connection_p connection)
+{
+    ab_request_p req = connection->cm_req;
+    int debug = connection->debug;
+    int rc = PLCTAG_STATUS_OK;
+    uint64_t now = time_ms();
+
+    if(!req) {
+        uint64_t keepalive_ms = (uint64_t)(connection->rpi_us/1000) * CONNECTION_KEEPALIVE_RPIS;
+
+        /*
+         * if the target does not answer keepalives, close an idle
+         * connection before the PLC times it out, or the next tag would
+         * get a dead connection from the pool.
+         */
+        if(connection->idle_since_ms && !connection->tags
+           && (now - connection->idle_since_ms >= connection->linger_ms
+               || (connection->keepalive_failed && now - connection->last_send_ms >= keepalive_ms))) {
+            pdebug(debug, "idle connection lingered %ums, closing it", (unsigned int)(now - connection->idle_since_ms));
+            connection_destroy_unsafe(connection);
+        } else if(connection->is_connected && now - connection->last_send_ms >= keepalive_ms) {
+            /* count it as traffic even if it could not be queued so we do not spin. */
+            connection->last_send_ms = now;
+            connection_send_keepalive_unsafe(connection);
         }
 
-        /* timeout? */
-        if(!req->resp_received) {
+        return PLCTAG_STATUS_OK;
+    }
+
+    if(!req->resp_received && req->status == PLCTAG_STATUS_OK && time_ms() < connection->cm_timeout) {
+        return PLCTAG_STATUS_PENDING;
+    }
+
+    /* done with the request either way, let the IO thread free it. */
+    connection->cm_req = NULL;
+    req->abort_request = 1;
+
+    if(connection->connect_in_progress) {
+        connection->connect_in_progress = 0;
+
+        if(req->resp_received) {
+            rc = recv_forward_open_resp(connection, req);
+
+            /* the PLC wants different parameters, try again with those. */
+            if((rc == PLCTAG_ERR_TOO_LONG || rc == PLCTAG_ERR_UNSUPPORTED)
+               && connection->open_retries < CONNECTION_MAX_OPEN_RETRIES) {
+                connection->open_retries++;
+                atomic_add_u64(&connection->session->stats.retries, 1);
+
+                pdebug(debug,"Retrying ForwardOpen with size %d.", connection->conn_size);
+
+                rc = connection_open_unsafe(connection);
+
+                return (rc == PLCTAG_STATUS_OK ? PLCTAG_STATUS_PENDING : rc);
+            }
+        } else if(req->status != PLCTAG_STATUS_OK) {
+            pdebug(debug,"Unable to send ForwardOpen packet! rc=%d", req->status);
+            rc = req->status;
+        } else {
             pdebug(debug,"Timed out waiting for ForwardOpen response!");
             rc = PLCTAG_ERR_TIMEOUT_ACK;
-            break;
         }
 
-        /* wait for the ForwardOpen response. */
-        if((rc = recv_forward_open_resp(connection, req)) != PLCTAG_STATUS_OK) {
-            pdebug(debug,"Unable to use ForwardOpen response!");
-            rc = PLCTAG_ERR_REMOTE_ERR;
-            break;
+        connection->status = rc;
+        connection->last_send_ms = now;
+
+        return rc;
+    }
+
+    if(connection->close_in_progress) {
+        if(!req->resp_received) {
+            pdebug(debug,"No ForwardClose response, dropping the connection anyway.");
         }
-    } while(0);
 
-    connection->status = rc;
+        connection->close_in_progress = 0;
+
+        session_remove_connection_unsafe(connection->session, connection);
+
+        mem_free(connection);
 
-    if(req) {
-        request_destroy(&req);
+        return rc;
     }
 
-    pdebug(debug, "Done.");
+    /* otherwise it was a keepalive. */
+    if(!req->resp_received) {
+        pdebug(debug,"No reply to connection keepalive!");
+    }
+
+    connection->keepalive_failed = !req->resp_received;
 
     return rc;
 }
 
 
+
+/*
+ * connection_fill_request_unsafe
+ *
+ * Connected requests can be built before the ForwardOpen finishes.
+ * Put the connection IDs into the request just before it is sent.
+ * All connected requests share the same header up to the sequence
+ * number, so the generic response layout works for any of them.
+ */
+int connection_fill_request_unsafe(ab_connection_p connection, ab_request_p req)
+{
+    eip_cip_co_generic_response *co = (eip_cip_co_generic_response *)(req->data);
+
+    co->cpf_targ_conn_id = h2le32(connection->orig_connection_id);
+    req->conn_id = connection->targ_connection_id;
+
+    connection->last_send_ms = time_ms();
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * send_identity_keepalive_unsafe
+ *
+ * Connected Get_Attribute_Single of attribute 1, the vendor ID, of the
+ * Identity object.  The reply does not matter, only that there is one.
+ */
+static int send_identity_keepalive_unsafe(ab_connection_p connection, ab_request_p req, uint16_t conn_seq_id)
+{
+    eip_cip_co_generic_response *co = (eip_cip_co_generic_response *)(req->data);
+    uint8_t *data = req->data + sizeof(eip_cip_co_generic_response);
+    int rc;
+
+    *data++ = AB_EIP_CMD_CIP_GET_ATTR_SINGLE;
+    *data++ = 3;    /* path size in 16-bit words */
+    *data++ = 0x20; /* class */
+    *data++ = 0x01; /* Identity */
+    *data++ = 0x24; /* instance */
+    *data++ = 0x01; /* instance 1 */
+    *data++ = 0x30; /* attribute */
+    *data++ = 0x01; /* vendor ID */
+
+    co->encap_command = h2le16(AB_EIP_CONNECTED_SEND);
+    co->router_timeout = h2le16(1);
+
+    co->cpf_item_count = h2le16(2);
+    co->cpf_cai_item_type = h2le16(AB_EIP_ITEM_CAI);
+    co->cpf_cai_item_length = h2le16(4);
+    co->cpf_targ_conn_id = h2le32(connection->orig_connection_id);
+    co->cpf_cdi_item_type = h2le16(AB_EIP_ITEM_CDI);
+    co->cpf_cdi_item_length = h2le16(data - (uint8_t*)(&(co->cpf_conn_seq_num)));
+    co->cpf_conn_seq_num = h2le16(conn_seq_id);
+
+    req->request_size = data - (req->data);
+    req->send_request = 1;
+    req->conn_id = connection->targ_connection_id;
+    req->conn_seq = conn_seq_id;
+
+    rc = request_add_unsafe(connection->session, req);
+
+    if(rc != PLCTAG_STATUS_OK) {
+        request_destroy_unsafe(&req);
+        return rc;
+    }
+
+    connection->cm_req = req;
+    connection->cm_timeout = time_ms() + CONNECTION_KEEPALIVE_TIMEOUT_MS;
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * connection_send_keepalive_unsafe
+ *
+ * Queue something small on the connection so that the PLC does not
+ * time it out.  For DH+ that is a PCCC echo to the node the connection
+ * routes to.  Anything else is a CIP device, and every CIP device has
+ * an Identity object, so read its vendor ID.
+ *
+ * The session mutex must be held.
+ */
+int connection_send_keepalive_unsafe(ab_connection_p connection)
+{
+    pccc_dhp_co_req *pccc;
+    ab_request_p req;
+    uint8_t *data;
+    uint16_t conn_seq_id;
+    int rc;
+
+    rc = request_create(&req);
+
+    if(rc != PLCTAG_STATUS_OK) {
+        return rc;
+    }
+
+    req->debug = connection->debug;
+
+    conn_seq_id = connection->conn_seq_num++;
+
+    if(!connection->use_dhp_direct) {
+        return send_identity_keepalive_unsafe(connection, req, conn_seq_id);
+    }
+
+    pccc = (pccc_dhp_co_req *)(req->data);
+
+    /* the echo data starts right after the function code. */
+    data = (uint8_t *)(&pccc->pccc_offset);
+    *((uint16_t *)data) = h2le16(conn_seq_id);
+    data += sizeof(uint16_t);
+
+    pccc->encap_command = h2le16(AB_EIP_CONNECTED_SEND);
+    pccc->router_timeout = h2le16(1);
+
+    pccc->cpf_item_count = h2le16(2);
+    pccc->cpf_cai_item_type = h2le16(AB_EIP_ITEM_CAI);
+    pccc->cpf_cai_item_length = h2le16(4);
+    pccc->cpf_targ_conn_id = h2le32(connection->orig_connection_id);
+    pccc->cpf_cdi_item_type = h2le16(AB_EIP_ITEM_CDI);
+    pccc->cpf_cdi_item_length = h2le16(data - (uint8_t*)(&(pccc->cpf_conn_seq_num)));
+    pccc->cpf_conn_seq_num = h2le16(conn_seq_id);
+
+    pccc->dest_link = 0;
+    pccc->dest_node = h2le16(connection->dhp_dest);
+    pccc->src_link = 0;
+    pccc->src_node = 0;
+
+    pccc->pccc_command = AB_EIP_PCCC_ECHO_CMD;
+    pccc->pccc_status = 0;
+    pccc->pccc_seq_num = h2le16((uint16_t)(intptr_t)(connection));
+    pccc->pccc_function = AB_EIP_PCCC_ECHO_FUNC;
+
+    req->request_size = data - (req->data);
+    req->send_request = 1;
+    req->conn_id = connection->targ_connection_id;
+    req->conn_seq = conn_seq_id;
+
+    rc = request_add_unsafe(connection->session, req);
+
+    if(rc != PLCTAG_STATUS_OK) {
+        request_destroy_unsafe(&req);
+        return rc;
+    }
+
+    connection->cm_req = req;
+    connection->cm_timeout = time_ms() + CONNECTION_KEEPALIVE_TIMEOUT_MS;
+
+    return PLCTAG_STATUS_OK;
+}
+
+
 int send_forward_open_req(ab_connection_p connection, ab_request_p req)
 {
     eip_forward_open_request_t *fo;
+    eip_forward_open_request_ex_t *fo_ex;
     uint8_t *data;
+    uint32_t conn_params;
     int rc = PLCTAG_STATUS_OK;
     int debug = connection->debug;
 
@@ -216,10 +564,20 @@ int send_forward_open_req(ab_connection_p connection, ab_request_p req)
 
     req->debug = debug;
 
+    /*
+     * The two kinds of Forward Open only differ after the RPI.  Fill
+     * in the common parts through fo and the rest through the right
+     * one.
+     */
     fo = (eip_forward_open_request_t*)(req->data);
+    fo_ex = (eip_forward_open_request_ex_t*)(req->data);
 
     /* point to the end of the struct */
-    data = (req->data) + sizeof(eip_forward_open_request_t);
+    if(connection->use_large_fo) {
+        data = (req->data) + sizeof(eip_forward_open_request_ex_t);
+    } else {
+        data = (req->data) + sizeof(eip_forward_open_request_t);
+    }
 
     /* set up the path information. */
     mem_copy(data, connection->conn_path, connection->conn_path_size);
@@ -242,7 +600,7 @@ int send_forward_open_req(ab_connection_p connection, ab_request_p req)
         h2le16(data - (uint8_t*)(&fo->cm_service_code)); /* length of remaining data in UC data item */
 
     /* Connection Manager parts */
-    fo->cm_service_code = AB_EIP_CMD_FORWARD_OPEN; /* 0x54 Forward Open Request */
+    fo->cm_service_code = (connection->use_large_fo ? AB_EIP_CMD_LARGE_FORWARD_OPEN : AB_EIP_CMD_FORWARD_OPEN);
     fo->cm_req_path_size = 2;                      /* size of path in 16-bit words */
     fo->cm_req_path[0] = 0x20;                     /* class */
     fo->cm_req_path[1] = 0x06;                     /* CM class */
@@ -258,12 +616,28 @@ int send_forward_open_req(ab_connection_p connection, ab_request_p req)
     fo->orig_vendor_id = h2le16(AB_EIP_VENDOR_ID);               /* our unique :-) vendor ID */
     fo->orig_serial_number = h2le32(AB_EIP_VENDOR_SN);           /* our serial number. */
     fo->conn_timeout_multiplier = AB_EIP_TIMEOUT_MULTIPLIER;     /* timeout = mult * RPI */
-    fo->orig_to_targ_rpi = h2le32(AB_EIP_RPI); /* us to target RPI - Request Packet Interval in microseconds */
-    fo->orig_to_targ_conn_params = h2le16(AB_EIP_PLC5_PARAM); /* FIXME - must be based on PLC type. what kind of PLC we are targetting, PLC5 */
-    fo->targ_to_orig_rpi = h2le32(AB_EIP_RPI); /* target to us RPI - not really used for explicit messages? */
-    fo->targ_to_orig_conn_params = h2le16(AB_EIP_PLC5_PARAM); /* FIXME - must be based on PLC type. We are pretending to be a LGX. */
-    fo->transport_class = AB_EIP_TRANSPORT_CLASS_T3; /* 0xA3, server transport, class 3, application trigger */
-    fo->path_size = connection->conn_path_size/2; /* size in 16-bit words */
+    fo->orig_to_targ_rpi = h2le32(connection->rpi_us); /* us to target RPI - Request Packet Interval in microseconds */
+
+    /* point to point, variable size, same both ways. */
+    conn_params = AB_EIP_CONN_PARAM_P2P | AB_EIP_CONN_PARAM_VARIABLE | (connection->conn_priority << AB_EIP_CONN_PARAM_PRIO_SHIFT);
+
+    if(connection->use_large_fo) {
+        conn_params = (conn_params << AB_EIP_CONN_PARAM_LARGE_SHIFT) | (uint32_t)(connection->conn_size & 0xFFFF);
+
+        fo_ex->orig_to_targ_conn_params = h2le32(conn_params);
+        fo_ex->targ_to_orig_rpi = h2le32(connection->rpi_us); /* target to us RPI - not really used for explicit messages? */
+        fo_ex->targ_to_orig_conn_params = h2le32(conn_params);
+        fo_ex->transport_class = AB_EIP_TRANSPORT_CLASS_T3; /* 0xA3, server transport, class 3, application trigger */
+        fo_ex->path_size = connection->conn_path_size/2; /* size in 16-bit words */
+    } else {
+        conn_params |= (uint32_t)(connection->conn_size & AB_EIP_CONN_PARAM_SIZE_MASK);
+
+        fo->orig_to_targ_conn_params = h2le16((uint16_t)conn_params);
+        fo->targ_to_orig_rpi = h2le32(connection->rpi_us); /* target to us RPI - not really used for explicit messages? */
+        fo->targ_to_orig_conn_params = h2le16((uint16_t)conn_params);
+        fo->transport_class = AB_EIP_TRANSPORT_CLASS_T3; /* 0xA3, server transport, class 3, application trigger */
+        fo->path_size = connection->conn_path_size/2; /* size in 16-bit words */
+    }
 
     /* set the size of the request */
     req->request_size = data - (req->data);
@@ -272,7 +646,7 @@ int send_forward_open_req(ab_connection_p connection, ab_request_p req)
     req->send_request = 1;
 
     /* add the request to the session's list. */
-    rc = request_add(connection->session, req);
+    rc = request_add_unsafe(connection->session, req);
 
     pdebug(debug, "Done");
 
@@ -280,6 +654,68 @@ int send_forward_open_req(ab_connection_p connection, ab_request_p req)
 }
 
 
+/*
+ * recv_forward_open_error
+ *
+ * Look at why a Forward Open failed.  If the PLC did not like the
+ * connection size or does not do Large Forward Open, change the
+ * connection parameters and return PLCTAG_ERR_TOO_LONG or
+ * PLCTAG_ERR_UNSUPPORTED so that the caller can try again.
+ */
+static int recv_forward_open_error(ab_connection_p connection, eip_forward_open_response_t *fo_resp)
+{
+    /* on failure, the extended status words follow the status size. */
+    uint8_t *ext = (uint8_t *)(&fo_resp->orig_to_targ_conn_id);
+    uint16_t ext_status = 0;
+    int new_size = 0;
+    int debug = connection->debug;
+
+    if(fo_resp->general_status == AB_CIP_STATUS_UNSUPPORTED && connection->use_large_fo) {
+        pdebug(debug,"PLC does not support Large Forward Open.");
+
+        connection->use_large_fo = 0;
+
+        if(connection->conn_size > CONNECTION_MAX_SMALL_SIZE) {
+            connection->conn_size = (AB_EIP_LGX_PARAM & AB_EIP_CONN_PARAM_SIZE_MASK);
+        }
+
+        return PLCTAG_ERR_UNSUPPORTED;
+    }
+
+    if(fo_resp->general_status != AB_CIP_STATUS_CONN_FAILURE || fo_resp->status_size < 1) {
+        return PLCTAG_ERR_REMOTE_ERR;
+    }
+
+    ext_status = (uint16_t)(ext[0] | (ext[1] << 8));
+
+    if(ext_status != AB_CIP_EXT_BAD_CONN_SIZE) {
+        pdebug(debug,"Forward Open extended status: %x", ext_status);
+        return PLCTAG_ERR_REMOTE_ERR;
+    }
+
+    /* most PLCs send back the largest size they will take. */
+    if(fo_resp->status_size >= 2) {
+        new_size = ext[2] | (ext[3] << 8);
+    }
+
+    if(new_size <= 0 || new_size >= connection->conn_size) {
+        new_size = connection->conn_size / 2;
+    }
+
+    if(new_size < CONNECTION_MIN_SIZE) {
+        pdebug(debug,"PLC will not take a usable connection size!");
+        return PLCTAG_ERR_REMOTE_ERR;
+    }
+
+    pdebug(debug,"PLC rejected connection size %d, trying %d.", connection->conn_size, new_size);
+
+    connection->conn_size = new_size;
+    connection->use_large_fo = (new_size > CONNECTION_MAX_SMALL_SIZE);
+
+    return PLCTAG_ERR_TOO_LONG;
+}
+
+
 int recv_forward_open_resp(ab_connection_p connection, ab_request_p req)
 {
     eip_forward_open_response_t *fo_resp;
@@ -305,7 +741,7 @@ int recv_forward_open_resp(ab_connection_p connection, ab_request_p req)
 
         if(fo_resp->general_status != AB_EIP_OK) {
             pdebug(debug,"Forward Open command failed, response code: %d",fo_resp->general_status);
-            rc = PLCTAG_ERR_REMOTE_ERR;
+            rc = recv_forward_open_error(connection, fo_resp);
             break;
         }
 
@@ -328,7 +764,13 @@ int connection_add_tag_unsafe(ab_connection_p connection, ab_tag_p tag)
 {
     pdebug(connection->debug, "Starting");
 
+    tag->prev = NULL;
     tag->next = connection->tags;
+
+    if(connection->tags) {
+        connection->tags->prev = tag;
+    }
+
     connection->tags = tag;
 
     pdebug(connection->debug, "Done");
@@ -358,26 +800,23 @@ int connection_add_tag(ab_connection_p connection, ab_tag_p tag)
 
 int connection_remove_tag_unsafe(ab_connection_p connection, ab_tag_p tag)
 {
-    ab_tag_p cur;
-    ab_tag_p prev;
     int debug = tag->debug;
     int rc;
 
-    cur = connection->tags;
-    prev = NULL;
-
-    while (cur && cur != tag) {
-        prev = cur;
-        cur = cur->next;
-    }
+    /* the list is doubly linked, only the head has no prev. */
+    if (tag->connection == connection && (tag->prev || connection->tags == tag)) {
+        if (tag->next) {
+            tag->next->prev = tag->prev;
+        }
 
-    if (cur == tag) {
-        if (prev) {
-            prev->next = cur->next;
+        if (tag->prev) {
+            tag->prev->next = tag->next;
         } else {
-            connection->tags = cur->next;
+            connection->tags = tag->next;
         }
 
+        tag->next = NULL;
+        tag->prev = NULL;
         tag->connection = NULL;
 
         rc = PLCTAG_STATUS_OK;
@@ -385,9 +824,15 @@ int connection_remove_tag_unsafe(ab_connection_p connection, ab_tag_p tag)
         rc = PLCTAG_ERR_NOT_FOUND;
     }
 
+    /* open connections linger for new tags, see connection_tickle_unsafe(). */
     if (connection_empty_unsafe(connection)) {
-        pdebug(debug, "destroying connection");
-        connection_destroy_unsafe(connection);
+        if (connection->linger_ms && connection->is_connected && !connection->close_in_progress) {
+            pdebug(debug, "connection is idle");
+            connection->idle_since_ms = time_ms();
+        } else {
+            pdebug(debug, "destroying connection");
+            connection_destroy_unsafe(connection);
+        }
     }
 
     return rc;
@@ -433,6 +878,12 @@ int connection_is_empty(ab_connection_p connection)
     return rc;
 }
 
+/*
+ * connection_destroy_unsafe
+ *
+ * An open connection is closed with a ForwardClose first and the IO
+ * thread frees it when that is done.  Anything else is freed now.
+ */
 int connection_destroy_unsafe(ab_connection_p connection)
 {
     if (!connection) {
@@ -450,8 +901,16 @@ int connection_destroy_unsafe(ab_connection_p connection)
         return 0;
     }
 
-    if (connection_close(connection)) {
-        return 0;
+    /* nobody is waiting for a ForwardOpen still in flight. */
+    if (connection->cm_req) {
+        connection->cm_req->abort_request = 1;
+        connection->cm_req = NULL;
+        connection->connect_in_progress = 0;
+    }
+
+    if (connection->is_connected && connection_close_unsafe(connection) == PLCTAG_STATUS_OK) {
+        pdebug(debug, "Done, waiting for ForwardClose.");
+        return 1;
     }
 
     /* call the mutex protected version */
@@ -464,7 +923,16 @@ int connection_destroy_unsafe(ab_connection_p connection)
     return 1;
 }
 
-int connection_close(ab_connection_p connection)
+
+/*
+ * connection_close_unsafe
+ *
+ * Queue a ForwardClose.  The connection is no longer usable after
+ * this and is freed by connection_tickle_unsafe().
+ *
+ * The session mutex must be held.
+ */
+int connection_close_unsafe(ab_connection_p connection)
 {
     int debug = connection->debug;
     ab_request_p req;
@@ -472,24 +940,26 @@ int connection_close(ab_connection_p connection)
 
     pdebug(debug, "Starting.");
 
+    connection->is_connected = 0;
+
     /* get a request buffer */
     rc = request_create(&req);
 
-    do {
-        if(rc != PLCTAG_STATUS_OK) {
-            pdebug(debug,"Unable to get new request.  rc=%d",rc);
-            rc = 0;
-            break;
-        }
+    if(rc != PLCTAG_STATUS_OK) {
+        pdebug(debug,"Unable to get new request.  rc=%d",rc);
+        return rc;
+    }
 
-        /* send the ForwardClose command to the PLC */
-        if((rc = send_forward_close_req(connection, req)) != PLCTAG_STATUS_OK) {
-            pdebug(connection->debug,"Unable to send ForwardClose packet!");
-            break;
-        }
-    } while(0);
+    /* send the ForwardClose command to the PLC */
+    if((rc = send_forward_close_req(connection, req)) != PLCTAG_STATUS_OK) {
+        pdebug(debug,"Unable to send ForwardClose packet!");
+        request_destroy_unsafe(&req);
+        return rc;
+    }
 
-    connection->status = rc;
+    connection->cm_req = req;
+    connection->cm_timeout = time_ms() + CONNECTION_CLOSE_TIMEOUT_MS;
+    connection->close_in_progress = 1;
 
     pdebug(debug, "Done.");
 
@@ -554,7 +1024,6 @@ int send_forward_close_req(ab_connection_p connection, ab_request_p req)
 
     /* mark it as ready to send */
     req->send_request = 1;
-    req->abort_after_send = 1; /* don't return to us.*/
 
     /* add the request to the session's list. */
     rc = request_add_unsafe(connection->session, req);
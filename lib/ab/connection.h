@@ -31,16 +31,45 @@
 
 #define MAX_CONN_PATH 		(128)
 
+/* how long the IO thread waits for Forward Open and Forward Close responses */
+#define CONNECTION_OPEN_TIMEOUT_MS	(5000)
+#define CONNECTION_CLOSE_TIMEOUT_MS	(1000)
+
+/*
+ * Connection sizes are in bytes of CIP message.  The upper limit
+ * leaves room for the encapsulation and CPF headers in a request
+ * buffer.  A rejected Forward Open is retried with a smaller size
+ * a few times before giving up.
+ */
+#define CONNECTION_MIN_SIZE			(64)
+#define CONNECTION_MAX_SIZE			(MAX_REQ_RESP_SIZE - 64)
+#define CONNECTION_MAX_SMALL_SIZE	(AB_EIP_CONN_PARAM_SIZE_MASK)
+#define CONNECTION_MAX_OPEN_RETRIES	(4)
+
+/*
+ * With the timeout multiplier we use, the PLC drops a connection that
+ * has been quiet for eight RPIs.  Send a keepalive after half that.  An
+ * idle connection whose keepalive went unanswered is closed instead.
+ */
+#define CONNECTION_KEEPALIVE_RPIS	(4)
+#define CONNECTION_KEEPALIVE_TIMEOUT_MS	(1000)
+
 
 #include <platform.h>
 #include <ab/ab_common.h>
 #include <util/attr.h>
 #include <ab/session.h>
+#include <ab/eip.h>
 #include <ab/tag.h>
 
 
 struct ab_connection_t {
     ab_connection_p next;
+    ab_connection_p prev;
+
+    /* lookup chain, see session_find_connection_by_path_unsafe() */
+    ab_connection_p hash_next;
+    ab_connection_p hash_prev;
 
     char path[MAX_CONN_PATH];
 
@@ -57,13 +86,34 @@ struct ab_connection_t {
     uint8_t conn_path[MAX_CONN_PATH];
     uint8_t conn_path_size;
 
+    /* Forward Open parameters, see connection_set_params() */
+    int conn_size;
+    int conn_priority;
+    int use_large_fo;
+    uint32_t rpi_us;
+
     /* how do we talk to this device? */
     int protocol_type;
     int use_dhp_direct;
     uint8_t dhp_src;
     uint8_t dhp_dest;
 
+    /*
+     * Forward Open and Forward Close are run by the IO thread, see
+     * connection_tickle_unsafe().  cm_req is the one in flight.
+     */
     int connect_in_progress;
+    int close_in_progress;
+    int open_retries;
+    ab_request_p cm_req;
+    uint64_t cm_timeout;
+
+    /* pooling and keepalive, the linger time comes from the session's default */
+    uint64_t linger_ms;
+    uint64_t idle_since_ms;	/* zero while in use */
+    uint64_t last_send_ms;
+    int keepalive_failed;	/* the last keepalive got no reply */
+
     int status;
     int debug;
 
@@ -75,7 +125,11 @@ struct ab_connection_t {
 int find_or_create_connection(ab_tag_p tag, ab_session_p session, attr attribs);
 ab_connection_p session_find_connection_by_path_unsafe(ab_session_p session,const char *path);
 ab_connection_p connection_create_unsafe(int debug, const char* path, ab_session_p session);
-int connection_perform_forward_open(ab_connection_p connection);
+int connection_set_params(ab_connection_p connection, int protocol_type, attr attribs);
+int connection_open_unsafe(ab_connection_p connection);
+int connection_tickle_unsafe(ab_connection_p connection);
+int connection_fill_request_unsafe(ab_connection_p connection, ab_request_p req);
+int connection_send_keepalive_unsafe(ab_connection_p connection);
 int send_forward_open_req(ab_connection_p connection, ab_request_p req);
 int recv_forward_open_resp(ab_connection_p connection, ab_request_p req);
 int connection_add_tag_unsafe(ab_connection_p connection, ab_tag_p tag);
@@ -85,7 +139,7 @@ int connection_remove_tag(ab_connection_p connection, ab_tag_p tag);
 int connection_empty_unsafe(ab_connection_p connection);
 int connection_is_empty(ab_connection_p connection);
 int connection_destroy_unsafe(ab_connection_p connection);
-int connection_close(ab_connection_p connection);
+int connection_close_unsafe(ab_connection_p connection);
 int send_forward_close_req(ab_connection_p connection, ab_request_p req);
 
 
@@ -30,16 +30,26 @@
 #include <ab/eip.h>
 #include <ab/session.h>
 #include <ab/request.h>
+#include <util/stats.h>
+#include <util/trace.h>
 
 
 
+/* this must be called with the session mutex held */
+static void request_count_sent_unsafe(ab_request_p req, plc_tag_stats_t *stats)
+{
+	atomic_add_u64(&stats->requests_sent, 1);
+	atomic_add_u64(&stats->bytes_sent, req->request_size);
+	stats_hist_add(stats->queue_hist, req->time_send_start_us - req->time_created_us);
+	stats_hist_add(stats->send_hist, req->time_sent_us - req->time_send_start_us);
+}
+
+
 /* this must be called with the session mutex held */
 int send_eip_request_unsafe(ab_request_p req)
 {
 	int rc;
 
-	pdebug(req->debug, "Starting.");
-
 	/* if we have not already started, then start the send */
 	if (!req->send_in_progress) {
 		eip_encap_t* encap = (eip_encap_t*)(req->data);
@@ -68,7 +78,10 @@ int send_eip_request_unsafe(ab_request_p req)
 		/* display the data */
 		pdebug_dump_bytes(req->debug, req->data, req->request_size);
 
+		trace_event(TRACE_REQ_SEND_START, TRACE_ID(req->session), TRACE_ID(req), req->request_size, (uint32_t)req->session_seq_id, le2h16(encap->encap_command));
+
 		req->send_in_progress = 1;
+		req->time_send_start_us = time_mono_us();
 	}
 
 	/* send the packet */
@@ -83,6 +96,16 @@ int send_eip_request_unsafe(ab_request_p req)
 			req->send_in_progress = 0;
 			req->current_offset = 0;
 
+			req->time_sent_us = time_mono_us();
+			req->session->last_send_ms = time_ms();
+			request_count_sent_unsafe(req, &req->session->stats);
+
+			if(req->tag_stats) {
+				request_count_sent_unsafe(req, req->tag_stats);
+			}
+
+			trace_event(TRACE_REQ_SENT, TRACE_ID(req->session), TRACE_ID(req), req->request_size, (int32_t)(req->time_sent_us - req->time_created_us), 0);
+
 			/* set this request up for a receive action */
 			if(req->abort_after_send) {
 				req->abort_request = 1; /* for one shots */
@@ -98,9 +121,9 @@ int send_eip_request_unsafe(ab_request_p req)
 		req->send_request = 0;
 		req->send_in_progress = 0;
 		req->recv_in_progress = 0;
-	}
 
-	pdebug(req->debug, "Done.");
+		trace_event(TRACE_REQ_SEND_ERROR, TRACE_ID(req->session), TRACE_ID(req), rc, req->current_offset, 0);
+	}
 
 	return rc;
 }
@@ -142,9 +165,14 @@ int recv_eip_response_unsafe(ab_session_p session)
 				if (rc != PLCTAG_ERR_NO_DATA) {
 					/* error! */
 					pdebug(session->debug,"Error reading socket! rc=%d",rc);
+					trace_event(TRACE_SOCKET_ERROR, TRACE_ID(session), 0, rc, session->recv_offset, 0);
 					return rc;
 				}
 			} else {
+				if(session->recv_offset == 0 && rc > 0) {
+					session->recv_start_us = time_mono_us();
+				}
+
 				session->recv_offset += rc;
 
 				/*pdebug_dump_bytes(session->debug, session->recv_data, session->recv_offset);*/
@@ -162,7 +190,8 @@ int recv_eip_response_unsafe(ab_session_p session)
 		session->resp_seq_id = ((eip_encap_t*)(session->recv_data))->encap_sender_context;
 		session->has_response = 1;
 
-		pdebug(session->debug, "request received all needed data.");
+		trace_event(TRACE_RESP_RECEIVED, TRACE_ID(session), 0, session->recv_offset,
+		            (uint32_t)session->resp_seq_id, le2h16(((eip_encap_t*)(session->recv_data))->encap_command));
 
 		/*
 		if(session->resp_seq_id == 0) {
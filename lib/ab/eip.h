@@ -56,6 +56,7 @@ int recv_eip_response_unsafe(ab_session_p session);
 									*/
 
 #define DEFAULT_MAX_REQUESTS (10)	/* number of requests and request sizes to allocate by default. */
+#define AB_DEFAULT_WRITE_WINDOW (16)	/* fragments of one write outstanding at once, see write_window. */
 
 
 /* AB Constants*/
@@ -66,6 +67,7 @@ int recv_eip_response_unsafe(ab_session_p session);
 #define AB_EIP_DEFAULT_TIMEOUT 2000 /* in ms */
 
 /* AB Commands */
+#define AB_EIP_NOP 					((uint16_t)0x0000)
 #define AB_EIP_REGISTER_SESSION 	((uint16_t)0x0065)
 #define AB_EIP_UNREGISTER_SESSION 	((uint16_t)0x0066)
 #define AB_EIP_READ_RR_DATA 		((uint16_t)0x006F)
@@ -79,23 +81,35 @@ int recv_eip_response_unsafe(ab_session_p session);
 #define AB_EIP_CMD_FORWARD_CLOSE    	((uint8_t)0x4E)
 #define AB_EIP_CMD_UNCONNECTED_SEND 	((uint8_t)0x52)
 #define AB_EIP_CMD_FORWARD_OPEN     	((uint8_t)0x54)
+#define AB_EIP_CMD_LARGE_FORWARD_OPEN	((uint8_t)0x5B)
 
 /* CIP embedded packet commands */
 #define AB_EIP_CMD_CIP_READ         	((uint8_t)0x4C)
 #define AB_EIP_CMD_CIP_WRITE        	((uint8_t)0x4D)
 #define AB_EIP_CMD_CIP_READ_FRAG		((uint8_t)0x52)
 #define AB_EIP_CMD_CIP_WRITE_FRAG		((uint8_t)0x53)
+#define AB_EIP_CMD_CIP_RMW				((uint8_t)0x4E)	/* Read_Modify_Write, same code as Forward Close */
+#define AB_EIP_CMD_CIP_LIST_INSTANCES	((uint8_t)0x55)	/* Get_Instance_Attribute_List */
+#define AB_EIP_CMD_CIP_MULTI			((uint8_t)0x0A)	/* Multiple Service Packet */
+#define AB_EIP_CMD_CIP_GET_ATTR_SINGLE	((uint8_t)0x0E)	/* Get_Attribute_Single */
 
 /* flag set when command is OK */
 #define AB_EIP_CMD_CIP_OK           	((uint8_t)0x80)
 
 #define AB_CIP_STATUS_OK				((uint8_t)0x00)
+#define AB_CIP_STATUS_PATH_SEGMENT		((uint8_t)0x04)
+#define AB_CIP_STATUS_PATH_DEST			((uint8_t)0x05)
 #define AB_CIP_STATUS_FRAG				((uint8_t)0x06)
+#define AB_CIP_STATUS_EMBEDDED			((uint8_t)0x1E)	/* one or more services in a packet failed */
 
 /* PCCC commands */
 #define AB_EIP_PCCC_TYPED_CMD ((uint8_t)0x0F)
 #define AB_EIP_PCCC_TYPED_READ_FUNC ((uint8_t)0x68)
 #define AB_EIP_PCCC_TYPED_WRITE_FUNC ((uint8_t)0x67)
+#define AB_EIP_PCCC_RMW_FUNC ((uint8_t)0x26)	/* Read-Modify-Write, address then AND and OR masks */
+#define AB_EIP_PCCC_MASKED_WRITE_FUNC ((uint8_t)0xAB)	/* SLC, size, three address fields, mask, data */
+#define AB_EIP_PCCC_ECHO_CMD ((uint8_t)0x06)
+#define AB_EIP_PCCC_ECHO_FUNC ((uint8_t)0x00)
 
 
 /* PCCC defs */
@@ -185,6 +199,27 @@ int recv_eip_response_unsafe(ab_session_p session);
 #define AB_EIP_PLC5_PARAM 0x4302
 #define AB_EIP_SLC_PARAM 0x4302
 #define AB_EIP_LGX_PARAM 0x43F8
+
+/*
+ * Connection parameter bits for a Forward Open.  A Large Forward Open
+ * uses 32-bit parameters with the same bits shifted up 16 and a 16-bit
+ * size field.
+ */
+#define AB_EIP_CONN_PARAM_P2P		(0x4000)
+#define AB_EIP_CONN_PARAM_VARIABLE	(0x0200)
+#define AB_EIP_CONN_PARAM_PRIO_SHIFT	(10)
+#define AB_EIP_CONN_PARAM_SIZE_MASK	(0x01FF)
+#define AB_EIP_CONN_PARAM_LARGE_SHIFT	(16)
+
+#define AB_EIP_CONN_PRIORITY_LOW		(0)
+#define AB_EIP_CONN_PRIORITY_HIGH		(1)
+#define AB_EIP_CONN_PRIORITY_SCHEDULED	(2)
+#define AB_EIP_CONN_PRIORITY_URGENT		(3)
+
+/* Forward Open failure, general status 0x01 with an extended status */
+#define AB_CIP_STATUS_CONN_FAILURE		((uint8_t)0x01)
+#define AB_CIP_STATUS_UNSUPPORTED		((uint8_t)0x08)
+#define AB_CIP_EXT_BAD_CONN_SIZE		((uint16_t)0x0109)
 #define AB_EIP_TRANSPORT 0xA3
 
 
@@ -296,6 +331,60 @@ START_PACK typedef struct {
 } END_PACK eip_forward_open_request_t;
 
 
+/*
+ * Large Forward Open Request
+ *
+ * The same as above except that the connection parameters are
+ * 32 bits so that the connection size can be more than 511 bytes.
+ */
+START_PACK typedef struct {
+	/* encap header */
+	uint16_t encap_command;    /* ALWAYS 0x006f Unconnected Send*/
+	uint16_t encap_length;   /* packet size in bytes - 24 */
+	uint32_t encap_session_handle;  /* from session set up */
+	uint32_t encap_status;          /* always _sent_ as 0 */
+	uint64_t encap_sender_context;/* whatever we want to set this to, used for
+                                     * identifying responses when more than one
+                                     * are in flight at once.
+                                     */
+	uint32_t encap_options;         /* 0, reserved for future use */
+
+	/* Interface Handle etc. */
+	uint32_t interface_handle;      /* ALWAYS 0 */
+	uint16_t router_timeout;        /* in seconds */
+
+	/* Common Packet Format - CPF Unconnected */
+	uint16_t cpf_item_count;        /* ALWAYS 2 */
+	uint16_t cpf_nai_item_type;     /* ALWAYS 0 */
+	uint16_t cpf_nai_item_length;   /* ALWAYS 0 */
+	uint16_t cpf_udi_item_type;     /* ALWAYS 0x00B2 - Unconnected Data Item */
+	uint16_t cpf_udi_item_length;   /* REQ: fill in with length of remaining data. */
+
+	/* CM Service Request - Connection Manager */
+	uint8_t cm_service_code;        /* ALWAYS 0x5B Large Forward Open Request */
+	uint8_t cm_req_path_size;       /* ALWAYS 2, size in words of path, next field */
+	uint8_t cm_req_path[4];         /* ALWAYS 0x20,0x06,0x24,0x01 for CM, instance 1*/
+
+	/* Forward Open Params */
+	uint8_t secs_per_tick;       	/* seconds per tick */
+	uint8_t timeout_ticks;       	/* timeout = srd_secs_per_tick * src_timeout_ticks */
+	uint32_t orig_to_targ_conn_id;  /* 0, returned by target in reply. */
+	uint32_t targ_to_orig_conn_id;  /* what is _our_ ID for this connection */
+	uint16_t conn_serial_number;    /* our connection serial number ?? */
+	uint16_t orig_vendor_id;        /* our unique vendor ID */
+	uint32_t orig_serial_number;    /* our unique serial number */
+	uint8_t conn_timeout_multiplier;/* timeout = mult * RPI */
+	uint8_t reserved[3];            /* reserved, set to 0 */
+	uint32_t orig_to_targ_rpi;      /* us to target RPI - Request Packet Interval in microseconds */
+	uint32_t orig_to_targ_conn_params; /* 32-bit connection parameters */
+	uint32_t targ_to_orig_rpi;      /* target to us RPI, in microseconds */
+	uint32_t targ_to_orig_conn_params; /* 32-bit connection parameters */
+	uint8_t transport_class;        /* ALWAYS 0xA3, server transport, class 3, application trigger */
+	uint8_t path_size;              /* size of connection path in 16-bit words */
+	uint8_t conn_path[ZLA_SIZE];    /* connection path */
+} END_PACK eip_forward_open_request_ex_t;
+
+
 /* Forward Open Response */
 START_PACK typedef struct {
 	/* encap header */
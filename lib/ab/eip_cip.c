@@ -44,15 +44,21 @@
 #include <ab/tag.h>
 #include <ab/session.h>
 #include <ab/eip_cip.h>
+#include <ab/symbol.h>
 
 
 int allocate_request_slot(ab_tag_p tag);
 int allocate_read_request_slot(ab_tag_p tag);
 int allocate_write_request_slot(ab_tag_p tag);
 int build_read_request(ab_tag_p tag, int slot, int byte_offset);
-int build_write_request(ab_tag_p tag, int slot, int byte_offset);
+int build_write_request(ab_tag_p tag, int slot, int byte_offset, int size, int frag, int hold);
+static void plan_dirty_write(ab_tag_p tag);
+static int send_write_frags(ab_tag_p tag);
+static int rmw_mask_size(ab_tag_p tag);
+static int build_rmw_request(ab_tag_p tag, int mask_size);
 static int check_read_status(ab_tag_p tag);
 static int check_write_status(ab_tag_p tag);
+static void count_retry(ab_tag_p tag);
 int calculate_write_sizes(ab_tag_p tag);
 
 /*************************************************************************
@@ -121,6 +127,9 @@ int eip_cip_tag_read_start(ab_tag_p tag)
 
     pdebug(debug, "Starting");
 
+    /* pick up or drop the symbol instance */
+    symbol_tag_update(tag);
+
     /* is this the first read? */
     if (tag->first_read) {
         /*
@@ -202,20 +211,50 @@ int eip_cip_tag_read_start(ab_tag_p tag)
 int eip_cip_tag_write_start(ab_tag_p tag)
 {
     int rc = PLCTAG_STATUS_OK;
-    int i;
-    int byte_offset = 0;
+    int mask_size;
     int debug = tag->debug;
 
     pdebug(debug, "Starting");
 
+    symbol_tag_update(tag);
+
+    /*
+     * if only bits of the first element changed, set and clear
+     * them in the PLC.  This needs no type information.
+     */
+    mask_size = rmw_mask_size(tag);
+
+    if (mask_size) {
+        if (!tag->max_requests && (rc = allocate_request_slot(tag)) != PLCTAG_STATUS_OK) {
+            tag->status = rc;
+            return rc;
+        }
+
+        rc = build_rmw_request(tag, mask_size);
+
+        if (rc != PLCTAG_STATUS_OK) {
+            tag->status = rc;
+            return rc;
+        }
+
+        tag->write_frags = 1;
+        tag->write_frags_sent = 1;
+        tag->write_frags_done = 0;
+        tag->write_in_progress = 1;
+        tag->status = PLCTAG_STATUS_PENDING;
+
+        return PLCTAG_STATUS_PENDING;
+    }
+
     /*
      * if the tag has not been read yet, read it.
      *
      * This gets the type data and sets up the request
-     * buffers.
+     * buffers.  If the type was declared when the tag was
+     * created, we already have what we need.
      */
 
-    if (tag->first_read) {
+    if (tag->first_read && !tag->encoded_type_info_size) {
         pdebug(debug, "No read has completed yet, doing pre-read to get type information.");
 
         tag->pre_write_read = 1;
@@ -236,18 +275,32 @@ int eip_cip_tag_write_start(ab_tag_p tag)
         return rc;
     }
 
-    /* set up all the requests at once. */
-    byte_offset = 0;
+    /* send only what the application changed if that saves packets */
+    tag->num_write_ranges = 0;
 
-    for (i = 0; i < tag->num_write_requests; i++) {
-        rc = build_write_request(tag, i, byte_offset);
+    if (tag->num_dirty && tag->num_write_requests > 1) {
+        plan_dirty_write(tag);
+    }
 
-        if (rc != PLCTAG_STATUS_OK) {
-            tag->status = rc;
-            return rc;
-        }
+    if (!tag->num_write_ranges) {
+        tag->write_ranges[0].start = 0;
+        tag->write_ranges[0].end = tag->size;
+        tag->num_write_ranges = 1;
+        tag->write_chunk = tag->write_req_sizes[0];
+        tag->write_frags = tag->num_write_requests;
+        tag->write_frag_service = (tag->num_write_requests > 1);
+    }
+
+    tag->write_frags_sent = 0;
+    tag->write_frags_done = 0;
+    tag->write_range = 0;
+    tag->write_offset = tag->write_ranges[0].start;
 
-        byte_offset += tag->write_req_sizes[i];
+    rc = send_write_frags(tag);
+
+    if (rc != PLCTAG_STATUS_OK) {
+        tag->status = rc;
+        return rc;
     }
 
     /* the write is now pending */
@@ -362,28 +415,27 @@ int allocate_write_request_slot(ab_tag_p tag)
     return PLCTAG_STATUS_OK;
 }
 
-int build_read_request(ab_tag_p tag, int slot, int byte_offset)
+/*
+ * encode_read_template
+ *
+ * Encode the parts of a fragmented read that never change for this tag
+ * and keep a copy.  Every read after that is a copy of the template with
+ * the byte offset patched in.
+ */
+static int encode_read_template(ab_tag_p tag)
 {
     eip_cip_uc_req* cip;
     uint8_t* data;
     uint8_t* embed_start, *embed_end;
     ab_request_p req = NULL;
-    int debug = tag->debug;
     int rc;
 
-    pdebug(debug, "Starting.");
-
-    /* get a request buffer */
     rc = request_create(&req);
 
     if (rc != PLCTAG_STATUS_OK) {
-        pdebug(debug, "Unable to get new request.  rc=%d", rc);
-        tag->status = rc;
         return rc;
     }
 
-    req->debug = debug;
-
     /* point the request struct at the buffer */
     cip = (eip_cip_uc_req*)(req->data);
 
@@ -413,8 +465,9 @@ int build_read_request(ab_tag_p tag, int slot, int byte_offset)
     *((uint16_t*)data) = h2le16(tag->elem_count);
     data += sizeof(uint16_t);
 
-    /* add the byte offset for this request */
-    *((uint32_t*)data) = h2le32(byte_offset);
+    /* the byte offset is patched in for each request */
+    tag->read_tmpl_patch = (int)(data - req->data);
+    *((uint32_t*)data) = h2le32(0);
     data += sizeof(uint32_t);
 
     /* mark the end of the embedded packet */
@@ -470,6 +523,57 @@ int build_read_request(ab_tag_p tag, int slot, int byte_offset)
     /* set the size of the request */
     req->request_size = data - (req->data);
 
+    tag->read_tmpl = (uint8_t*)mem_alloc(req->request_size);
+
+    if (!tag->read_tmpl) {
+        request_destroy(&req);
+        return PLCTAG_ERR_NO_MEM;
+    }
+
+    mem_copy(tag->read_tmpl, req->data, req->request_size);
+    tag->read_tmpl_size = req->request_size;
+
+    request_destroy(&req);
+
+    return PLCTAG_STATUS_OK;
+}
+
+int build_read_request(ab_tag_p tag, int slot, int byte_offset)
+{
+    ab_request_p req = NULL;
+    int debug = tag->debug;
+    int rc;
+
+    pdebug(debug, "Starting.");
+
+    if (!tag->read_tmpl) {
+        rc = encode_read_template(tag);
+
+        if (rc != PLCTAG_STATUS_OK) {
+            pdebug(debug, "Unable to encode read template.  rc=%d", rc);
+            tag->status = rc;
+            return rc;
+        }
+    }
+
+    /* get a request buffer with the packet already filled in */
+    rc = request_create_from_template(&req, tag->read_tmpl, tag->read_tmpl_size);
+
+    if (rc != PLCTAG_STATUS_OK) {
+        pdebug(debug, "Unable to get new request.  rc=%d", rc);
+        tag->status = rc;
+        return rc;
+    }
+
+    req->debug = debug;
+    req->tag_stats = &tag->stats;
+
+    /* add the byte offset for this request */
+    *((uint32_t*)(req->data + tag->read_tmpl_patch)) = h2le32(byte_offset);
+
+    /* other handles reading the same tag can share the reply */
+    req->shareable = 1;
+
     /* mark it as ready to send */
     req->send_request = 1;
 
@@ -491,7 +595,318 @@ int build_read_request(ab_tag_p tag, int slot, int byte_offset)
     return PLCTAG_STATUS_OK;
 }
 
-int build_write_request(ab_tag_p tag, int slot, int byte_offset)
+/*
+ * plan_dirty_write
+ *
+ * Plan fragmented writes covering only the ranges changed since the
+ * last write, rounded out to whole elements.  The plan is left empty
+ * if writing the whole tag would not take more packets.
+ */
+static void plan_dirty_write(ab_tag_p tag)
+{
+    tag_range_t *ranges = tag->write_ranges;
+    int num_ranges = 0;
+    int align = (tag->elem_size > 0 ? tag->elem_size : 1);
+    int chunk = tag->write_req_sizes[0]; /* the full packet size */
+    int num_reqs = 0;
+    int i;
+
+    chunk -= chunk % align;
+
+    if (chunk <= 0) {
+        return;
+    }
+
+    /* the dirty list is sorted, rounding out can only join neighbours */
+    for (i = 0; i < tag->num_dirty; i++) {
+        int start = tag->dirty[i].start - (tag->dirty[i].start % align);
+        int end = tag->dirty[i].end + align - 1;
+
+        end -= end % align;
+
+        if (end > tag->size) {
+            end = tag->size;
+        }
+
+        if (num_ranges && start <= ranges[num_ranges - 1].end) {
+            if (end > ranges[num_ranges - 1].end) {
+                ranges[num_ranges - 1].end = end;
+            }
+        } else {
+            ranges[num_ranges].start = start;
+            ranges[num_ranges].end = end;
+            num_ranges++;
+        }
+    }
+
+    for (i = 0; i < num_ranges; i++) {
+        num_reqs += (ranges[i].end - ranges[i].start + chunk - 1) / chunk;
+    }
+
+    if (num_reqs >= tag->num_write_requests) {
+        return;
+    }
+
+    pdebug(tag->debug, "Writing %d changed range(s) in %d request(s).", num_ranges, num_reqs);
+
+    tag->num_write_ranges = num_ranges;
+    tag->write_chunk = chunk;
+    tag->write_frags = num_reqs;
+    tag->write_frag_service = 1;
+}
+
+/*
+ * write_frag_reply
+ *
+ * Called by the IO thread with the session mutex held when a fragment's
+ * reply is in.  If it went through, send the fragment that was held
+ * back for it, so the window stays full without waiting for the
+ * application to call plc_tag_status.
+ */
+static void write_frag_reply(ab_request_p req)
+{
+    eip_cip_uc_resp *cip_resp = (eip_cip_uc_resp*)(req->data);
+    ab_request_p next = req->next_frag;
+
+    if (!next || req->abort_request || next->abort_request) {
+        return;
+    }
+
+    if (le2h16(cip_resp->encap_command) != AB_EIP_READ_RR_DATA
+        || le2h16(cip_resp->encap_status) != AB_EIP_OK
+        || (cip_resp->status != AB_CIP_STATUS_OK && cip_resp->status != AB_CIP_STATUS_FRAG)) {
+        /* check_write_status sees the error and aborts the rest */
+        return;
+    }
+
+    req->next_frag = NULL;
+    next->send_request = 1;
+}
+
+/*
+ * send_write_frags
+ *
+ * Queue every fragment of the planned write.  Only the first
+ * write_window go out now, each of the others is held until the reply
+ * to the fragment write_window before it comes in.
+ */
+static int send_write_frags(ab_tag_p tag)
+{
+    int size;
+    int rc;
+    int i;
+
+    while (tag->write_frags_sent < tag->write_frags) {
+        if (tag->write_offset >= tag->write_ranges[tag->write_range].end) {
+            tag->write_range++;
+            tag->write_offset = tag->write_ranges[tag->write_range].start;
+        }
+
+        size = tag->write_ranges[tag->write_range].end - tag->write_offset;
+
+        if (size > tag->write_chunk) {
+            size = tag->write_chunk;
+        }
+
+        rc = build_write_request(tag, tag->write_frags_sent, tag->write_offset, size, tag->write_frag_service,
+                                 (tag->write_window && tag->write_frags_sent >= tag->write_window));
+
+        if (rc != PLCTAG_STATUS_OK) {
+            return rc;
+        }
+
+        tag->write_offset += size;
+        tag->write_frags_sent++;
+    }
+
+    if (!tag->write_window || tag->write_frags <= tag->write_window) {
+        return PLCTAG_STATUS_OK;
+    }
+
+    /* the first fragments may already have their replies */
+    critical_block(global_session_mut) {
+        for (i = tag->write_window; i < tag->write_frags; i++) {
+            ab_request_p prev = tag->reqs[i - tag->write_window];
+
+            prev->next_frag = tag->reqs[i];
+            prev->on_reply = write_frag_reply;
+
+            if (prev->resp_received) {
+                write_frag_reply(prev);
+            }
+        }
+    }
+
+    return PLCTAG_STATUS_OK;
+}
+
+/*
+ * rmw_mask_size
+ *
+ * Read_Modify_Write works on one element, with masks as wide as the
+ * element.  Returns that width if the only changes since the last
+ * write were bits in the first element, zero otherwise.
+ */
+static int rmw_mask_size(ab_tag_p tag)
+{
+    int mask_size = tag->elem_size;
+    int i;
+
+    if (!tag->bits_only) {
+        return 0;
+    }
+
+    if (mask_size != 1 && mask_size != 2 && mask_size != 4 && mask_size != 8) {
+        return 0;
+    }
+
+    for (i = mask_size; i < TAG_MAX_BIT_BYTES; i++) {
+        if (tag->bit_mask[i]) {
+            return 0;
+        }
+    }
+
+    return mask_size;
+}
+
+/*
+ * build_rmw_request
+ *
+ * Queue a Read_Modify_Write of the first element.  The OR mask sets the
+ * changed bits that are now 1 and the AND mask clears the ones that are
+ * now 0.  Other bits are left as the PLC has them.
+ */
+static int build_rmw_request(ab_tag_p tag, int mask_size)
+{
+    int rc = PLCTAG_STATUS_OK;
+    int debug = tag->debug;
+    eip_cip_uc_req* cip;
+    uint8_t* data;
+    uint8_t* embed_start, *embed_end;
+    ab_request_p req = NULL;
+    int i;
+
+    pdebug(debug, "Starting.");
+
+    /* get a request buffer */
+    rc = request_create(&req);
+
+    if (rc != PLCTAG_STATUS_OK) {
+        pdebug(debug, "Unable to get new request.  rc=%d", rc);
+        tag->status = rc;
+        return rc;
+    }
+
+    req->debug = tag->debug;
+    req->tag_stats = &tag->stats;
+    req->batchable = 1;
+
+    cip = (eip_cip_uc_req*)(req->data);
+
+    /* point to the end of the struct */
+    data = (req->data) + sizeof(eip_cip_uc_req);
+
+    /*
+     * set up the embedded CIP Read_Modify_Write packet
+     * The format is:
+     *
+     * uint8_t cmd
+     * LLA formatted name
+     * uint16_t mask size in bytes
+     * OR mask
+     * AND mask
+     */
+
+    embed_start = data;
+
+    *data = AB_EIP_CMD_CIP_RMW;
+    data++;
+
+    /* copy the tag name into the request */
+    mem_copy(data, tag->encoded_name, tag->encoded_name_size);
+    data += tag->encoded_name_size;
+
+    *((uint16_t*)data) = h2le16(mask_size);
+    data += 2;
+
+    /* OR mask, the changed bits that are set */
+    for (i = 0; i < mask_size; i++) {
+        *data = tag->bit_mask[i] & tag->data[i];
+        data++;
+    }
+
+    /* AND mask, zero for the changed bits that are clear */
+    for (i = 0; i < mask_size; i++) {
+        *data = (uint8_t)(~tag->bit_mask[i] | tag->data[i]);
+        data++;
+    }
+
+    /* mark the end of the embedded packet */
+    embed_end = data;
+
+    /* Now copy in the routing information for the embedded message */
+    *data = (tag->conn_path_size) / 2; /* in 16-bit words */
+    data++;
+    *data = 0;
+    data++;
+    mem_copy(data, tag->conn_path, tag->conn_path_size);
+    data += tag->conn_path_size;
+
+    /* now fill in the rest of the structure. */
+
+    /* encap fields */
+    cip->encap_command = h2le16(AB_EIP_READ_RR_DATA); /* ALWAYS 0x006F Unconnected Send*/
+
+    /* router timeout */
+    cip->router_timeout = h2le16(1); /* one second timeout, enough? */
+
+    /* Common Packet Format fields for unconnected send. */
+    cip->cpf_item_count = h2le16(2);                  /* ALWAYS 2 */
+    cip->cpf_nai_item_type = h2le16(AB_EIP_ITEM_NAI); /* ALWAYS 0 */
+    cip->cpf_nai_item_length = h2le16(0);             /* ALWAYS 0 */
+    cip->cpf_udi_item_type = h2le16(AB_EIP_ITEM_UDI); /* ALWAYS 0x00B2 - Unconnected Data Item */
+    cip->cpf_udi_item_length = h2le16(data - (uint8_t*)(&(cip->cm_service_code))); /* REQ: fill in with length of remaining data. */
+
+    /* CM Service Request - Connection Manager */
+    cip->cm_service_code = AB_EIP_CMD_UNCONNECTED_SEND; /* 0x52 Unconnected Send */
+    cip->cm_req_path_size = 2;                          /* 2, size in 16-bit words of path, next field */
+    cip->cm_req_path[0] = 0x20;                         /* class */
+    cip->cm_req_path[1] = 0x06;                         /* Connection Manager */
+    cip->cm_req_path[2] = 0x24;                         /* instance */
+    cip->cm_req_path[3] = 0x01;                         /* instance 1 */
+
+    /* Unconnected send needs timeout information */
+    cip->secs_per_tick = AB_EIP_SECS_PER_TICK; /* seconds per tick */
+    cip->timeout_ticks = AB_EIP_TIMEOUT_TICKS; /* timeout = srd_secs_per_tick * src_timeout_ticks */
+
+    /* size of embedded packet */
+    cip->uc_cmd_length = h2le16(embed_end - embed_start);
+
+    /* set the size of the request */
+    req->request_size = data - (req->data);
+
+    /* mark it as ready to send */
+    req->send_request = 1;
+
+    /* add the request to the session's list. */
+    rc = request_add(tag->session, req);
+
+    if (rc != PLCTAG_STATUS_OK) {
+        pdebug(debug, "Unable to lock add request to session! rc=%d", rc);
+        request_destroy(&req);
+        tag->status = rc;
+        return rc;
+    }
+
+    /* save the request for later */
+    tag->reqs[0] = req;
+
+    pdebug(debug, "Done");
+
+    return PLCTAG_STATUS_OK;
+}
+
+int build_write_request(ab_tag_p tag, int slot, int byte_offset, int size, int frag, int hold)
 {
     int rc = PLCTAG_STATUS_OK;
     int debug = tag->debug;
@@ -513,6 +928,8 @@ int build_write_request(ab_tag_p tag, int slot, int byte_offset)
 
     /* set debug flag on the request too */
     req->debug = tag->debug;
+    req->tag_stats = &tag->stats;
+    req->batchable = 1;
 
     cip = (eip_cip_uc_req*)(req->data);
 
@@ -539,7 +956,7 @@ int build_write_request(ab_tag_p tag, int slot, int byte_offset)
      * This handles a bug where attempting fragmented requests
      * does not appear to work with a single boolean.
      */
-    *data = (tag->num_write_requests > 1) ? AB_EIP_CMD_CIP_WRITE_FRAG : AB_EIP_CMD_CIP_WRITE;
+    *data = frag ? AB_EIP_CMD_CIP_WRITE_FRAG : AB_EIP_CMD_CIP_WRITE;
     data++;
 
     /* copy the tag name into the request */
@@ -559,18 +976,18 @@ int build_write_request(ab_tag_p tag, int slot, int byte_offset)
     *((uint16_t*)data) = h2le16(tag->elem_count);
     data += 2;
 
-    if (tag->num_write_requests > 1) {
+    if (frag) {
         /* put in the byte offset */
         *((uint32_t*)data) = h2le32(byte_offset);
         data += 4;
     }
 
     /* now copy the data to write */
-    mem_copy(data, tag->data + byte_offset, tag->write_req_sizes[slot]);
-    data += tag->write_req_sizes[slot];
+    mem_copy(data, tag->data + byte_offset, size);
+    data += size;
 
     /* need to pad data to multiple of 16-bits */
-    if (tag->write_req_sizes[slot] & 0x01) {
+    if (size & 0x01) {
         *data = 0;
         data++;
     }
@@ -624,8 +1041,8 @@ int build_write_request(ab_tag_p tag, int slot, int byte_offset)
     /* set the size of the request */
     req->request_size = data - (req->data);
 
-    /* mark it as ready to send */
-    req->send_request = 1;
+    /* mark it as ready to send unless it waits for an earlier fragment */
+    req->send_request = !hold;
 
     req->debug = tag->debug;
 
@@ -634,7 +1051,7 @@ int build_write_request(ab_tag_p tag, int slot, int byte_offset)
 
     if (rc != PLCTAG_STATUS_OK) {
         pdebug(debug, "Unable to lock add request to session! rc=%d", rc);
-        plc_tag_abort((plc_tag)tag);
+        tag_abort((plc_tag_p)tag);
         request_destroy(&req);
         tag->status = rc;
         return rc;
@@ -666,6 +1083,8 @@ static int check_read_status(ab_tag_p tag)
     int i;
     ab_request_p req;
     int byte_offset = 0;
+    int path_error = 0;
+    uint8_t* type_start;
     int debug = tag->debug;
 
     /* is there an outstanding request? */
@@ -685,8 +1104,11 @@ static int check_read_status(ab_tag_p tag)
     /*
      * process each request.  If there is more than one request, then
      * we need to make sure that we copy the data into the right part
-     * of the tag's data buffer.
+     * of the tag's data buffer.  Readers in other threads see all of
+     * the new data or none of it.
      */
+    tag_data_write_begin((plc_tag_p)tag);
+
     for (i = 0; i < tag->num_read_requests; i++) {
         req = tag->reqs[i];
 
@@ -746,9 +1168,13 @@ static int check_read_status(ab_tag_p tag)
             pdebug(debug, cip_decode_status(cip_resp->status));
 
             switch (cip_resp->status) {
-                case 0x04: /* FIXME - should be defined constants */
-                case 0x05:
-                case 0x13:
+                case AB_CIP_STATUS_PATH_SEGMENT:
+                case AB_CIP_STATUS_PATH_DEST:
+                    path_error = 1;
+                    rc = PLCTAG_ERR_BAD_PARAM;
+                    break;
+
+                case 0x13: /* FIXME - should be defined constants */
                 case 0x1C:
                     rc = PLCTAG_ERR_BAD_PARAM;
                     break;
@@ -764,6 +1190,8 @@ static int check_read_status(ab_tag_p tag)
         /* the first byte of the response is a type byte. */
         pdebug(debug, "type byte = %d (%x)", (int)*data, (int)*data);
 
+        type_start = data;
+
         /*
          * AB has a relatively complicated scheme for data typing.  The type is
          * required when writing.  Most of the types are basic types and occupy
@@ -820,6 +1248,14 @@ static int check_read_status(ab_tag_p tag)
             break;
         }
 
+        /* by instance, another type means we got another tag's data. */
+        if (!symbol_tag_check_type(tag, type_start, (int)(data - type_start))) {
+            pdebug(debug, "Symbol instance returned a different type!");
+            path_error = 1;
+            rc = PLCTAG_ERR_BAD_DATA;
+            break;
+        }
+
         /* copy data into the tag. */
         if ((byte_offset + (data_end - data)) > tag->size) {
             pdebug(debug,
@@ -862,6 +1298,8 @@ static int check_read_status(ab_tag_p tag)
         }
     } /* end of for(i = 0; i < tag->num_requests; i++) */
 
+    tag_data_write_end((plc_tag_p)tag);
+
     /* are we actually done? */
     if (rc == PLCTAG_STATUS_OK) {
         if (byte_offset < tag->size) {
@@ -924,6 +1362,18 @@ static int check_read_status(ab_tag_p tag)
     } else {
         /* error ! */
         pdebug(debug, "Error received!");
+
+        /* a stale symbol instance, try again by name. */
+        if (path_error && symbol_tag_stale(tag)) {
+            count_retry(tag);
+            ab_tag_abort(tag);
+
+            if (tag->first_read) {
+                tag->num_read_requests = 0;
+            }
+
+            rc = eip_cip_tag_read_start(tag);
+        }
     }
 
     tag->status = rc;
@@ -933,6 +1383,16 @@ static int check_read_status(ab_tag_p tag)
     return rc;
 }
 
+/* a request is going out again, count it for the tag and the session. */
+static void count_retry(ab_tag_p tag)
+{
+    atomic_add_u64(&tag->stats.retries, 1);
+
+    if (tag->session) {
+        atomic_add_u64(&tag->session->stats.retries, 1);
+    }
+}
+
 /*
  * check_write_status
  *
@@ -946,6 +1406,7 @@ static int check_write_status(ab_tag_p tag)
     int rc = PLCTAG_STATUS_OK;
     int i;
     ab_request_p req;
+    int path_error = 0;
     int debug = tag->debug;
 
     /* is there an outstanding request? */
@@ -955,21 +1416,11 @@ static int check_write_status(ab_tag_p tag)
         return PLCTAG_ERR_NULL_PTR;
     }
 
-    for (i = 0; i < tag->num_write_requests; i++) {
-        if (tag->reqs[i] && !tag->reqs[i]->resp_received) {
-            tag->status = PLCTAG_STATUS_PENDING;
-            return PLCTAG_STATUS_PENDING;
-        }
-    }
-
     /*
-     * process each request.  If there is more than one request, then
-     * we need to make sure that we copy the data into the right part
-     * of the tag's data buffer.
+     * check each reply as it comes in.  The first error ends the
+     * write and the fragments still out are aborted below.
      */
-    for (i = 0; i < tag->num_write_requests; i++) {
-        int reply_service;
-
+    for (i = 0; i < tag->write_frags_sent; i++) {
         req = tag->reqs[i];
 
         if (!req) {
@@ -977,6 +1428,10 @@ static int check_write_status(ab_tag_p tag)
             break;
         }
 
+        if (!req->resp_received || req->processed) {
+            continue;
+        }
+
         /* point to the data */
         cip_resp = (eip_cip_uc_resp*)(req->data);
 
@@ -992,11 +1447,10 @@ static int check_write_status(ab_tag_p tag)
             break;
         }
 
-        /* if we have fragmented the request, we need to look for a different return code */
-        reply_service = ((tag->num_write_requests > 1) ? (AB_EIP_CMD_CIP_WRITE_FRAG | AB_EIP_CMD_CIP_OK) :
-                         (AB_EIP_CMD_CIP_WRITE | AB_EIP_CMD_CIP_OK));
-
-        if (cip_resp->reply_service != reply_service) {
+        /* partial writes are always fragmented, full ones only if they need to be */
+        if (cip_resp->reply_service != (AB_EIP_CMD_CIP_WRITE_FRAG | AB_EIP_CMD_CIP_OK)
+            && cip_resp->reply_service != (AB_EIP_CMD_CIP_WRITE | AB_EIP_CMD_CIP_OK)
+            && cip_resp->reply_service != (AB_EIP_CMD_CIP_RMW | AB_EIP_CMD_CIP_OK)) {
             pdebug(debug, "CIP response reply service unexpected: %d", cip_resp->reply_service);
             rc = PLCTAG_ERR_BAD_DATA;
             break;
@@ -1005,9 +1459,19 @@ static int check_write_status(ab_tag_p tag)
         if (cip_resp->status != AB_CIP_STATUS_OK && cip_resp->status != AB_CIP_STATUS_FRAG) {
             pdebug(debug, "CIP read failed with status: %d", cip_resp->status);
             pdebug(debug, cip_decode_status(cip_resp->status));
+            path_error = (cip_resp->status == AB_CIP_STATUS_PATH_SEGMENT || cip_resp->status == AB_CIP_STATUS_PATH_DEST);
             rc = PLCTAG_ERR_REMOTE_ERR;
             break;
         }
+
+        req->processed = 1;
+        tag->write_frags_done++;
+    }
+
+    /* the IO thread sends the held fragments as replies come in */
+    if (rc == PLCTAG_STATUS_OK && tag->write_frags_done < tag->write_frags) {
+        tag->status = PLCTAG_STATUS_PENDING;
+        return PLCTAG_STATUS_PENDING;
     }
 
     /*
@@ -1043,6 +1507,17 @@ static int check_write_status(ab_tag_p tag)
     ab_tag_abort(tag);
 
     tag->write_in_progress = 0;
+
+    if (rc == PLCTAG_STATUS_OK) {
+        tag_clear_dirty((plc_tag_p)tag);
+    }
+
+    /* a stale symbol instance, try again by name. */
+    if (path_error && symbol_tag_stale(tag)) {
+        count_retry(tag);
+        rc = eip_cip_tag_write_start(tag);
+    }
+
     tag->status = rc;
 
     pdebug(debug, "Done.");
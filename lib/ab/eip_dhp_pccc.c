@@ -52,6 +52,19 @@ int eip_dhp_pccc_tag_status(ab_tag_p tag)
 {
 	int rc = PLCTAG_STATUS_OK;
 
+	/*
+	 * requests queued behind a ForwardOpen that failed will
+	 * never be sent, so give up on them here.
+	 */
+	if(tag->connection && tag->connection->status != PLCTAG_STATUS_OK && tag->connection->status != PLCTAG_STATUS_PENDING) {
+		if(tag->read_in_progress || tag->write_in_progress) {
+			ab_tag_abort(tag);
+		}
+
+		tag->status = tag->connection->status;
+		return tag->status;
+	}
+
 	if(tag->read_in_progress) {
 		rc = check_read_status(tag);
 
@@ -100,6 +113,86 @@ int eip_dhp_pccc_tag_status(ab_tag_p tag)
 
 
 
+/*
+ * encode_read_template
+ *
+ * Encode the connected typed read for this tag once.  Each read copies
+ * the result and patches in the connection sequence number.  The target
+ * connection ID is filled in when the request is sent.
+ */
+static int encode_read_template(ab_tag_p tag)
+{
+	int rc;
+	ab_request_p req;
+	pccc_dhp_co_req *pccc;
+	uint8_t *data;
+
+	rc = request_create(&req);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	pccc = (pccc_dhp_co_req*)(req->data);
+
+	/* point to the end of the struct */
+	data = (req->data) + sizeof(pccc_dhp_co_req);
+
+	/* copy encoded into the request */
+	mem_copy(data,tag->encoded_name,tag->encoded_name_size);
+	data += tag->encoded_name_size;
+
+	/* we need the count twice? */
+	*((uint16_t*)data) = h2le16(tag->elem_count); /* FIXME - bytes or INTs? */
+	data += sizeof(uint16_t);
+
+	/* encap fields */
+	pccc->encap_command = h2le16(AB_EIP_CONNECTED_SEND);    /* ALWAYS 0x006F Unconnected Send*/
+
+	/* router timeout */
+	pccc->router_timeout = h2le16(1);                 /* one second timeout, enough? */
+
+	/* Common Packet Format fields */
+	pccc->cpf_item_count = h2le16(2);                 /* ALWAYS 2 */
+	pccc->cpf_cai_item_type = h2le16(AB_EIP_ITEM_CAI);/* ALWAYS 0x00A1 connected address item */
+	pccc->cpf_cai_item_length = h2le16(4);            /* ALWAYS 4 ? */
+	pccc->cpf_targ_conn_id = h2le32(tag->connection->orig_connection_id); /* refreshed at send time */
+	pccc->cpf_cdi_item_type = h2le16(AB_EIP_ITEM_CDI);/* ALWAYS 0x00B1 - connected Data Item */
+	pccc->cpf_cdi_item_length = h2le16(data - (uint8_t*)(&(pccc->cpf_conn_seq_num)));/* REQ: fill in with length of remaining data. */
+	pccc->cpf_conn_seq_num = h2le16(0); /* patched in for each request */
+
+	/* DH+ Routing */
+	pccc->dest_link = 0;
+	pccc->dest_node = h2le16(tag->dhp_dest);
+	pccc->src_link = 0;
+	pccc->src_node = 0 /*h2le16(tag->dhp_src)*/;
+
+	/* PCCC Command */
+	pccc->pccc_command = AB_EIP_PCCC_TYPED_CMD;
+	pccc->pccc_status = 0;  /* STS 0 in request */
+	pccc->pccc_seq_num = /*h2le16(conn_seq_id)*/ h2le16((uint16_t)(intptr_t)(tag->connection));
+	pccc->pccc_function = AB_EIP_PCCC_TYPED_READ_FUNC;
+	pccc->pccc_transfer_size = h2le16(tag->elem_count); /* This is not in the docs, but it is in the data. */
+
+	req->request_size = data - (req->data);
+	tag->read_tmpl_patch = (int)offsetof(pccc_dhp_co_req, cpf_conn_seq_num);
+
+	tag->read_tmpl = (uint8_t*)mem_alloc(req->request_size);
+
+	if(!tag->read_tmpl) {
+		request_destroy(&req);
+		return PLCTAG_ERR_NO_MEM;
+	}
+
+	mem_copy(tag->read_tmpl, req->data, req->request_size);
+	tag->read_tmpl_size = req->request_size;
+
+	request_destroy(&req);
+
+	return PLCTAG_STATUS_OK;
+}
+
+
 /*
  * eip_dhp_pccc_tag_read_start
  *
@@ -107,8 +200,6 @@ int eip_dhp_pccc_tag_status(ab_tag_p tag)
  */
 int eip_dhp_pccc_tag_read_start(ab_tag_p tag)
 {
-	pccc_dhp_co_req *pccc;
-	uint8_t *data;
 	int data_per_packet;
 	int overhead;
 	int rc = PLCTAG_STATUS_OK;
@@ -148,8 +239,18 @@ int eip_dhp_pccc_tag_read_start(ab_tag_p tag)
 		}
 	}
 
-	/* get a request buffer */
-	rc = request_create(&req);
+	if(!tag->read_tmpl) {
+		rc = encode_read_template(tag);
+
+		if(rc != PLCTAG_STATUS_OK) {
+			pdebug(debug,"Unable to encode read template.  rc=%d",rc);
+			tag->status = rc;
+			return rc;
+		}
+	}
+
+	/* get a request buffer with the packet already filled in */
+	rc = request_create_from_template(&req, tag->read_tmpl, tag->read_tmpl_size);
 
 	if(rc != PLCTAG_STATUS_OK) {
 		pdebug(debug,"Unable to get new request.  rc=%d",rc);
@@ -158,58 +259,20 @@ int eip_dhp_pccc_tag_read_start(ab_tag_p tag)
 	}
 
 	req->debug = tag->debug;
+	req->tag_stats = &tag->stats;
 
 	/* get a new connection sequence id */
 	critical_block(global_session_mut) {
 		conn_seq_id = tag->connection->conn_seq_num++;
 	}
 
-	pccc = (pccc_dhp_co_req*)(req->data);
-
-	/* point to the end of the struct */
-	data = (req->data) + sizeof(pccc_dhp_co_req);
-
-	/* copy encoded into the request */
-	mem_copy(data,tag->encoded_name,tag->encoded_name_size);
-	data += tag->encoded_name_size;
-
-	/* we need the count twice? */
-	*((uint16_t*)data) = h2le16(tag->elem_count); /* FIXME - bytes or INTs? */
-	data += sizeof(uint16_t);
-
-	/* encap fields */
-	pccc->encap_command = h2le16(AB_EIP_CONNECTED_SEND);    /* ALWAYS 0x006F Unconnected Send*/
-
-	/* router timeout */
-	pccc->router_timeout = h2le16(1);                 /* one second timeout, enough? */
-
-	/* Common Packet Format fields */
-	pccc->cpf_item_count = h2le16(2);                 /* ALWAYS 2 */
-	pccc->cpf_cai_item_type = h2le16(AB_EIP_ITEM_CAI);/* ALWAYS 0x00A1 connected address item */
-	pccc->cpf_cai_item_length = h2le16(4);            /* ALWAYS 4 ? */
-	pccc->cpf_targ_conn_id = h2le32(tag->connection->orig_connection_id);
-	pccc->cpf_cdi_item_type = h2le16(AB_EIP_ITEM_CDI);/* ALWAYS 0x00B1 - connected Data Item */
-	pccc->cpf_cdi_item_length = h2le16(data - (uint8_t*)(&(pccc->cpf_conn_seq_num)));/* REQ: fill in with length of remaining data. */
-	pccc->cpf_conn_seq_num = h2le16(conn_seq_id);
-
-	/* DH+ Routing */
-	pccc->dest_link = 0;
-	pccc->dest_node = h2le16(tag->dhp_dest);
-	pccc->src_link = 0;
-	pccc->src_node = 0 /*h2le16(tag->dhp_src)*/;
-
-	/* PCCC Command */
-	pccc->pccc_command = AB_EIP_PCCC_TYPED_CMD;
-	pccc->pccc_status = 0;  /* STS 0 in request */
-	pccc->pccc_seq_num = /*h2le16(conn_seq_id)*/ h2le16((uint16_t)(intptr_t)(tag->connection));
-	pccc->pccc_function = AB_EIP_PCCC_TYPED_READ_FUNC;
-	pccc->pccc_transfer_size = h2le16(tag->elem_count); /* This is not in the docs, but it is in the data. */
+	*((uint16_t*)(req->data + tag->read_tmpl_patch)) = h2le16(conn_seq_id);
 
 	/* get ready to add the request to the queue for this session */
-	req->request_size = data - (req->data);
 	req->send_request = 1;
 	req->conn_id = tag->connection->targ_connection_id;
 	req->conn_seq = conn_seq_id;
+	req->connection = tag->connection;
 
 	/* add the request to the session's list. */
 	rc = request_add(tag->session, req);
@@ -293,6 +356,7 @@ int eip_dhp_pccc_tag_write_start(ab_tag_p tag)
 	}
 
 	req->debug = tag->debug;
+	req->tag_stats = &tag->stats;
 
 	/* get a new connection sequence id */
 	critical_block(global_session_mut) {
@@ -387,6 +451,7 @@ int eip_dhp_pccc_tag_write_start(ab_tag_p tag)
 	req->send_request = 1;
 	req->conn_id = tag->connection->targ_connection_id;
 	req->conn_seq = conn_seq_id;
+	req->connection = tag->connection;
 
 	/* add the request to the session's list. */
 	rc = request_add(tag->session, req);
@@ -498,7 +563,9 @@ static int check_read_status(ab_tag_p tag)
 		}
 
 		/* all OK, copy the data. */
+		tag_data_write_begin((plc_tag_p)tag);
 		mem_copy(tag->data, data, data_end - data);
+		tag_data_write_end((plc_tag_p)tag);
 
 		rc = PLCTAG_STATUS_OK;
 	} while(0);
@@ -580,6 +647,8 @@ static int check_write_status(ab_tag_p tag)
 		}*/
 
 		/* everything OK */
+		tag_clear_dirty((plc_tag_p)tag);
+
 		rc = PLCTAG_STATUS_OK;
 	} while(0);
 
@@ -42,6 +42,7 @@ extern "C"
 
 static int check_read_status(ab_tag_p tag);
 static int check_write_status(ab_tag_p tag);
+static int rmw_write_start(ab_tag_p tag);
 
 /*
  * ab_tag_status_pccc
@@ -87,66 +88,25 @@ int eip_pccc_tag_status(ab_tag_p tag)
 
 
 /*
- * eip_pccc_tag_read_start
+ * encode_read_template
  *
- * Start a PCCC tag read (PLC5, SLC).
+ * Encode the typed read for this tag once.  Each read copies the result
+ * and patches in a fresh PCCC sequence number.
  */
-
-int eip_pccc_tag_read_start(ab_tag_p tag)
+static int encode_read_template(ab_tag_p tag)
 {
-	int rc = PLCTAG_STATUS_OK;
+	int rc;
 	ab_request_p req;
-	uint16_t conn_seq_id = (uint16_t)(session_get_new_seq_id(tag->session));;
-	int overhead;
-	int data_per_packet;
 	pccc_req *pccc;
 	uint8_t *data;
 	uint8_t *embed_start;
-	int debug = tag->debug;
-
-	pdebug(debug,"Starting");
-
-	/* how many packets will we need? How much overhead? */
-	overhead = sizeof(pccc_resp) + 4 + tag->encoded_name_size; /* MAGIC 4 = fudge */
-
-	data_per_packet = MAX_PCCC_PACKET_SIZE - overhead;
-
-	if(data_per_packet <= 0) {
-		pdebug(debug,"Unable to send request.  Packet overhead, %d bytes, is too large for packet, %d bytes!", overhead, MAX_EIP_PACKET_SIZE);
-		tag->status = PLCTAG_ERR_TOO_LONG;
-		return tag->status;
-	}
-
-	if(data_per_packet < tag->size) {
-		pdebug(debug,"PCCC requests cannot be fragmented.  Too much data requested.");
-		tag->status = PLCTAG_ERR_TOO_LONG;
-		return tag->status;
-	}
 
-	if(!tag->reqs) {
-		tag->reqs = (ab_request_p*)mem_alloc(1 * sizeof(ab_request_p));
-		tag->max_requests = 1;
-		tag->num_read_requests = 1;
-		tag->num_write_requests = 1;
-
-		if(!tag->reqs) {
-			pdebug(debug,"Unable to get memory for request array!");
-			tag->status = PLCTAG_ERR_NO_MEM;
-			return tag->status;
-		}
-	}
-
-	/* get a request buffer */
 	rc = request_create(&req);
 
 	if(rc != PLCTAG_STATUS_OK) {
-		pdebug(debug,"Unable to get new request.  rc=%d",rc);
-		tag->status = rc;
 		return rc;
 	}
 
-	req->debug = tag->debug;
-
 	/* point the struct pointers to the buffer*/
 	pccc = (pccc_req*)(req->data);
 
@@ -169,7 +129,7 @@ int eip_pccc_tag_read_start(ab_tag_p tag)
 	/* fill in the PCCC command */
 	pccc->pccc_command = AB_EIP_PCCC_TYPED_CMD;
 	pccc->pccc_status = 0;  /* STS 0 in request */
-	pccc->pccc_seq_num = h2le16(conn_seq_id); /* FIXME - get sequence ID from session? */
+	pccc->pccc_seq_num = h2le16(0); /* patched in for each request */
 	pccc->pccc_function = AB_EIP_PCCC_TYPED_READ_FUNC;
 	pccc->pccc_transfer_size = h2le16(tag->elem_count); /* This is not in the docs, but it is in the data. */
 
@@ -205,6 +165,96 @@ int eip_pccc_tag_read_start(ab_tag_p tag)
 	/* set the size of the request */
 	req->request_size = data - (req->data);
 
+	tag->read_tmpl_patch = (int)offsetof(pccc_req, pccc_seq_num);
+
+	tag->read_tmpl = (uint8_t*)mem_alloc(req->request_size);
+
+	if(!tag->read_tmpl) {
+		request_destroy(&req);
+		return PLCTAG_ERR_NO_MEM;
+	}
+
+	mem_copy(tag->read_tmpl, req->data, req->request_size);
+	tag->read_tmpl_size = req->request_size;
+
+	request_destroy(&req);
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+/*
+ * eip_pccc_tag_read_start
+ *
+ * Start a PCCC tag read (PLC5, SLC).
+ */
+int eip_pccc_tag_read_start(ab_tag_p tag)
+{
+	int rc = PLCTAG_STATUS_OK;
+	ab_request_p req;
+	uint16_t conn_seq_id;
+	int overhead;
+	int data_per_packet;
+	int debug = tag->debug;
+
+	pdebug(debug,"Starting");
+
+	/* how many packets will we need? How much overhead? */
+	overhead = sizeof(pccc_resp) + 4 + tag->encoded_name_size; /* MAGIC 4 = fudge */
+
+	data_per_packet = MAX_PCCC_PACKET_SIZE - overhead;
+
+	if(data_per_packet <= 0) {
+		pdebug(debug,"Unable to send request.  Packet overhead, %d bytes, is too large for packet, %d bytes!", overhead, MAX_EIP_PACKET_SIZE);
+		tag->status = PLCTAG_ERR_TOO_LONG;
+		return tag->status;
+	}
+
+	if(data_per_packet < tag->size) {
+		pdebug(debug,"PCCC requests cannot be fragmented.  Too much data requested.");
+		tag->status = PLCTAG_ERR_TOO_LONG;
+		return tag->status;
+	}
+
+	if(!tag->reqs) {
+		tag->reqs = (ab_request_p*)mem_alloc(1 * sizeof(ab_request_p));
+		tag->max_requests = 1;
+		tag->num_read_requests = 1;
+		tag->num_write_requests = 1;
+
+		if(!tag->reqs) {
+			pdebug(debug,"Unable to get memory for request array!");
+			tag->status = PLCTAG_ERR_NO_MEM;
+			return tag->status;
+		}
+	}
+
+	if(!tag->read_tmpl) {
+		rc = encode_read_template(tag);
+
+		if(rc != PLCTAG_STATUS_OK) {
+			pdebug(debug,"Unable to encode read template.  rc=%d",rc);
+			tag->status = rc;
+			return rc;
+		}
+	}
+
+	/* get a request buffer with the packet already filled in */
+	rc = request_create_from_template(&req, tag->read_tmpl, tag->read_tmpl_size);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		pdebug(debug,"Unable to get new request.  rc=%d",rc);
+		tag->status = rc;
+		return rc;
+	}
+
+	req->debug = tag->debug;
+	req->tag_stats = &tag->stats;
+
+	/* FIXME - get sequence ID from session? */
+	conn_seq_id = (uint16_t)(session_get_new_seq_id(tag->session));
+	*((uint16_t*)(req->data + tag->read_tmpl_patch)) = h2le16(conn_seq_id);
+
 	/* mark it as ready to send */
 	req->send_request = 1;
 
@@ -330,7 +380,9 @@ static int check_read_status(ab_tag_p tag)
 			break;
 		}
 
+		tag_data_write_begin((plc_tag_p)tag);
 		mem_copy(tag->data, data, data_end - data);
+		tag_data_write_end((plc_tag_p)tag);
 
 		rc = PLCTAG_STATUS_OK;
 	} while(0);
@@ -401,6 +453,26 @@ int eip_pccc_tag_write_start(ab_tag_p tag)
 		}
 	}
 
+	/* only bits of the first element changed, set and clear them in place */
+	if(tag->bits_only && tag->elem_size <= TAG_MAX_BIT_BYTES) {
+		int i;
+
+		for(i = tag->elem_size; i < TAG_MAX_BIT_BYTES && !tag->bit_mask[i]; i++);
+
+		if(i == TAG_MAX_BIT_BYTES) {
+			if(tag->elem_size == 2 && (tag->pccc_rmw || tag->encoded_slc_name_size)) {
+				return rmw_write_start(tag);
+			}
+
+			/* on SLC writing the whole element would undo what the PLC changed */
+			if(!tag->pccc_rmw) {
+				pdebug(debug,"Single bits can only be written in words of the word files.");
+				tag->status = PLCTAG_ERR_UNSUPPORTED;
+				return tag->status;
+			}
+		}
+	}
+
 	/* get a request buffer */
 	rc = request_create(&req);
 
@@ -411,6 +483,7 @@ int eip_pccc_tag_write_start(ab_tag_p tag)
 	}
 
 	req->debug = tag->debug;
+	req->tag_stats = &tag->stats;
 
 	pccc = (pccc_req*)(req->data);
 
@@ -534,6 +607,142 @@ int eip_pccc_tag_write_start(ab_tag_p tag)
 
 
 
+/*
+ * rmw_write_start
+ *
+ * Send the changed bits of the first word without touching the rest.
+ *
+ * PLC-5 takes a read-modify-write.  The request is the word address
+ * followed by an AND mask that clears the changed bits that are now 0
+ * and an OR mask that sets the ones that are now 1.  There are no
+ * offset or transfer size fields.
+ *
+ * SLC and MicroLogix take a masked write instead: the byte count, the
+ * three address fields, a mask of the changed bits and the new word.
+ */
+static int rmw_write_start(ab_tag_p tag)
+{
+	int rc = PLCTAG_STATUS_OK;
+	pccc_req *pccc;
+	uint8_t *data;
+	uint16_t conn_seq_id = (uint16_t)(session_get_new_seq_id(tag->session));
+	uint16_t bits;
+	uint16_t value;
+	ab_request_p req = NULL;
+	int debug = tag->debug;
+	uint8_t *embed_start;
+
+	pdebug(debug,"Starting.");
+
+	/* get a request buffer */
+	rc = request_create(&req);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		pdebug(debug,"Unable to get new request.  rc=%d",rc);
+		tag->status = rc;
+		return rc;
+	}
+
+	req->debug = tag->debug;
+	req->tag_stats = &tag->stats;
+
+	pccc = (pccc_req*)(req->data);
+
+	embed_start = (uint8_t*)(&pccc->service_code);
+
+	/* the address goes where a typed command has its offset field */
+	data = (uint8_t*)(&pccc->pccc_offset);
+
+	bits = (uint16_t)(tag->bit_mask[0] | (tag->bit_mask[1] << 8));
+	value = (uint16_t)(tag->data[0] | (tag->data[1] << 8));
+
+	if(tag->pccc_rmw) {
+		mem_copy(data,tag->encoded_name,tag->encoded_name_size);
+		data += tag->encoded_name_size;
+
+		/* AND mask */
+		*((uint16_t*)data) = h2le16((uint16_t)(~bits | value));
+		data += 2;
+
+		/* OR mask */
+		*((uint16_t*)data) = h2le16((uint16_t)(bits & value));
+		data += 2;
+	} else {
+		/* one word */
+		*data = 2;
+		data++;
+
+		mem_copy(data,tag->encoded_slc_name,tag->encoded_slc_name_size);
+		data += tag->encoded_slc_name_size;
+
+		/* mask */
+		*((uint16_t*)data) = h2le16(bits);
+		data += 2;
+
+		/* data */
+		*((uint16_t*)data) = h2le16(value);
+		data += 2;
+	}
+
+	/* encap fields */
+	pccc->encap_command = h2le16(AB_EIP_READ_RR_DATA);    /* ALWAYS 0x0070 Unconnected Send*/
+
+	/* router timeout */
+	pccc->router_timeout = h2le16(1);                 /* one second timeout, enough? */
+
+	/* Common Packet Format fields for unconnected send. */
+	pccc->cpf_item_count 		= h2le16(2);				/* ALWAYS 2 */
+	pccc->cpf_nai_item_type 	= h2le16(AB_EIP_ITEM_NAI);  /* ALWAYS 0 */
+	pccc->cpf_nai_item_length 	= h2le16(0);   				/* ALWAYS 0 */
+	pccc->cpf_udi_item_type		= h2le16(AB_EIP_ITEM_UDI);  /* ALWAYS 0x00B2 - Unconnected Data Item */
+	pccc->cpf_udi_item_length	= h2le16(data - embed_start);  /* REQ: fill in with length of remaining data. */
+
+	/* Command Routing */
+	pccc->service_code = AB_EIP_CMD_PCCC_EXECUTE;  /* ALWAYS 0x4B, Execute PCCC */
+	pccc->req_path_size = 2;   /* ALWAYS 2, size in words of path, next field */
+	pccc->req_path[0] = 0x20;  /* class */
+	pccc->req_path[1] = 0x67;  /* PCCC Execute */
+	pccc->req_path[2] = 0x24;  /* instance */
+	pccc->req_path[3] = 0x01;  /* instance 1 */
+
+	/* PCCC ID */
+	pccc->request_id_size = 7;  /* ALWAYS 7 */
+	pccc->vendor_id = h2le16(AB_EIP_VENDOR_ID);             /* Our CIP Vendor */
+	pccc->vendor_serial_number = h2le32(AB_EIP_VENDOR_SN);      /* our unique serial number */
+
+	/* PCCC Command */
+	pccc->pccc_command = AB_EIP_PCCC_TYPED_CMD;
+	pccc->pccc_status = 0;  /* STS 0 in request */
+	pccc->pccc_seq_num = h2le16(conn_seq_id);
+	pccc->pccc_function = (tag->pccc_rmw ? AB_EIP_PCCC_RMW_FUNC : AB_EIP_PCCC_MASKED_WRITE_FUNC);
+
+	/* get ready to add the request to the queue for this session */
+	req->request_size = data - (req->data);
+	req->send_request = 1;
+	req->conn_seq = conn_seq_id;
+
+	/* add the request to the session's list. */
+	rc = request_add(tag->session, req);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		pdebug(debug,"Unable to lock add request to session! rc=%d",rc);
+		request_destroy(&req);
+		tag->status = rc;
+		return rc;
+	}
+
+	/* save the request for later */
+	tag->reqs[0] = req;
+
+	/* the write is now pending */
+	tag->write_in_progress = 1;
+	tag->status = PLCTAG_STATUS_PENDING;
+
+	return PLCTAG_STATUS_PENDING;
+}
+
+
+
 /*
  * check_write_status
  *
@@ -592,6 +801,8 @@ static int check_write_status(ab_tag_p tag)
 			break;
 		}
 
+		tag_clear_dirty((plc_tag_p)tag);
+
 		tag->status = PLCTAG_STATUS_OK;
 		rc = PLCTAG_STATUS_OK;
 	} while(0);
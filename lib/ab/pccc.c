@@ -176,6 +176,92 @@ int pccc_encode_tag_name(uint8_t *data, int *size, const char *name, int max_tag
 
 
 
+/*
+ * Encode the name as the SLC three address fields, for the commands
+ * that take them.
+ *
+ * Byte Meaning
+ * 1-3	file number
+ * 1	file type
+ * 1-3	element number
+ * 1-3	sub-element number
+ *
+ * Only the files made of 16-bit words are encoded.  Returns 0 for
+ * anything else.
+ */
+
+int pccc_encode_slc_name(uint8_t *data, int *size, const char *name, int max_tag_name_size)
+{
+	const char *tmp = name;
+	uint8_t file_type;
+	uint8_t sub_element = 0;
+
+	if(!data || !size || !name) {
+		return 0;
+	}
+
+	*size = 0;
+
+	if(max_tag_name_size < 10) {
+		return 0;
+	}
+
+	/* one letter names the file type */
+	switch(toupper((unsigned char)*tmp)) {
+		case 'O': file_type = 0x82; break;
+		case 'I': file_type = 0x83; break;
+		case 'S': file_type = 0x84; break;
+		case 'B': file_type = 0x85; break;
+		case 'T': file_type = 0x86; break;
+		case 'C': file_type = 0x87; break;
+		case 'R': file_type = 0x88; break;
+		case 'N': file_type = 0x89; break;
+		default: return 0;
+	}
+
+	tmp++;
+
+	/* the file number */
+	tmp = parse_pccc_name_number(tmp, data, size);
+
+	if(!tmp || *tmp != ':') {
+		*size = 0;
+		return 0;
+	}
+
+	data[*size] = file_type;
+	*size = *size + 1;
+
+	/* bump past the : character */
+	++tmp;
+
+	/* the element number */
+	tmp = parse_pccc_name_number(tmp, data, size);
+
+	if(!tmp) {
+		*size = 0;
+		return 0;
+	}
+
+	/* the same sub-elements as the level encoding above */
+	if(*tmp == '/' || *tmp == '.') {
+		++tmp;
+
+		if(!str_cmp_i(tmp,"acc") || !str_cmp_i(tmp, "pos")) {
+			sub_element = 2;
+		} else if(!str_cmp_i(tmp,"len") || !str_cmp_i(tmp, "pre")) {
+			sub_element = 1;
+		}
+	}
+
+	data[*size] = sub_element;
+	*size = *size + 1;
+
+	return 1;
+}
+
+
+
 
 
 uint8_t pccc_calculate_bcc(uint8_t *data,int size)
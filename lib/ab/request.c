@@ -30,6 +30,8 @@
 #include <ab/request.h>
 #include <platform.h>
 #include <ab/session.h>
+#include <ab/eip.h>
+#include <util/trace.h>
 
 /*
  * request_create
@@ -50,12 +52,38 @@ int request_create(ab_request_p* req)
 		*req = NULL;
 		rc = PLCTAG_ERR_NO_MEM;
 	} else {
+		res->time_created_us = time_mono_us();
 		*req = res;
 	}
 
 	return rc;
 }
 
+/*
+ * request_create_from_template
+ *
+ * Create a request whose packet is a copy of a pre-encoded template.
+ * The caller patches whatever varies between requests.
+ */
+int request_create_from_template(ab_request_p *req, const uint8_t *tmpl, int size)
+{
+	int rc;
+
+	if(size <= 0 || size > MAX_REQ_RESP_SIZE) {
+		*req = NULL;
+		return PLCTAG_ERR_TOO_LONG;
+	}
+
+	rc = request_create(req);
+
+	if(rc == PLCTAG_STATUS_OK) {
+		mem_copy((*req)->data, (void *)tmpl, size);
+		(*req)->request_size = size;
+	}
+
+	return rc;
+}
+
 /*
  * request_add_unsafe
  *
@@ -71,6 +99,13 @@ int request_add_unsafe(ab_session_p sess, ab_request_p req)
 	/* make sure the request points to the session */
 	req->session = sess;
 
+	trace_event(TRACE_REQ_QUEUED, TRACE_ID(sess), TRACE_ID(req), req->request_size, 0, 0);
+
+	/* an identical read already queued will answer this one too */
+	if(req->shareable) {
+		request_ride_unsafe(sess, req);
+	}
+
 	/* we add the request to the end of the list. */
 	cur = sess->requests;
 	prev = NULL;
@@ -212,3 +247,135 @@ int request_destroy(ab_request_p* req_pp)
 
 	return PLCTAG_STATUS_OK;
 }
+
+
+
+/*
+ * Reads of the same tag on the same session are identical packets apart
+ * from the encapsulation header.  Instead of sending a second copy, a
+ * request waits for the reply to the one already queued and gets a copy
+ * of it.  The match is made once, when the request is queued, and the
+ * payload hash keeps the compares cheap.
+ */
+
+static uint32_t payload_hash(ab_request_p req)
+{
+	uint32_t hash = HASH_FNV_OFFSET;
+	int i;
+
+	for(i = (int)sizeof(eip_encap_t); i < req->request_size; i++) {
+		hash = (hash ^ req->data[i]) * HASH_FNV_PRIME;
+	}
+
+	return hash;
+}
+
+
+static int same_payload(ab_request_p a, ab_request_p b)
+{
+	int start = (int)sizeof(eip_encap_t);
+	int i;
+
+	if(a->payload_hash != b->payload_hash || a->request_size != b->request_size) {
+		return 0;
+	}
+
+	for(i = start; i < a->request_size; i++) {
+		if(a->data[i] != b->data[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+/*
+ * request_ride_unsafe
+ *
+ * Called as a shareable request is queued.  If an identical one is
+ * already queued or on the wire and has no reply yet, hold this one
+ * back and return 1.  The reply is handed over by
+ * request_deliver_riders_unsafe().
+ */
+int request_ride_unsafe(ab_session_p sess, ab_request_p req)
+{
+	ab_request_p cur;
+
+	req->payload_hash = payload_hash(req);
+
+	for(cur = sess->requests; cur; cur = cur->next) {
+		if(cur == req || !cur->shareable || cur->riding || cur->abort_request || cur->resp_received) {
+			continue;
+		}
+
+		if(same_payload(cur, req)) {
+			pdebug(req->debug, "Sharing the reply to an identical request.");
+
+			req->riding = 1;
+			req->send_request = 0;
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * request_deliver_riders_unsafe
+ *
+ * The session's receive buffer holds the reply to req.  Give a copy to
+ * every request riding on it.  This must be called before the reply is
+ * copied over req's packet.
+ */
+void request_deliver_riders_unsafe(ab_session_p sess, ab_request_p req)
+{
+	ab_request_p cur;
+
+	for(cur = sess->requests; cur; cur = cur->next) {
+		if(cur == req || !cur->riding || cur->abort_request || !same_payload(cur, req)) {
+			continue;
+		}
+
+		mem_copy(cur->data, sess->recv_data, sess->recv_offset);
+
+		cur->request_size = sess->recv_offset;
+		cur->riding = 0;
+		cur->resp_received = 1;
+
+		cur->time_send_start_us = req->time_send_start_us;
+		cur->time_sent_us = req->time_sent_us;
+		cur->time_resp_start_us = sess->recv_start_us;
+		cur->time_matched_us = time_mono_us();
+
+		if(cur->tag_stats) {
+			atomic_add_u64(&cur->tag_stats->responses_matched, 1);
+			atomic_add_u64(&cur->tag_stats->bytes_received, sess->recv_offset);
+		}
+	}
+}
+
+
+/*
+ * request_release_riders_unsafe
+ *
+ * req is going away without a reply.  Anything riding on it goes back
+ * to being sent on its own.
+ */
+void request_release_riders_unsafe(ab_session_p sess, ab_request_p req)
+{
+	ab_request_p cur;
+
+	if(!req->shareable || req->riding || req->resp_received) {
+		return;
+	}
+
+	for(cur = sess->requests; cur; cur = cur->next) {
+		if(cur != req && cur->riding && same_payload(cur, req)) {
+			cur->riding = 0;
+			cur->send_request = 1;
+		}
+	}
+}
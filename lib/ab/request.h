@@ -64,6 +64,36 @@ struct ab_request_t {
 	uint32_t conn_id;
 	uint16_t conn_seq;
 
+	/* connected requests are held until this connection is open */
+	ab_connection_p connection;
+
+	/* Multiple Service Packet batching, see batch.c */
+	int batchable;				/* an unconnected CIP write that may share a packet */
+	int batch_count;			/* carrier only, how many requests it holds */
+	uint64_t batch_first_id;	/* carrier only, session_seq_id of the first */
+
+	/* identical reads share one packet, see request_ride_unsafe() */
+	int shareable;				/* a read whose reply other requests may copy */
+	int riding;					/* waiting for the reply to an identical request */
+	uint32_t payload_hash;		/* of the packet after the encapsulation header */
+
+	/*
+	 * called by the IO thread, session mutex held, once the reply is
+	 * in.  Fragmented writes use it to release next_frag.
+	 */
+	void (*on_reply)(ab_request_p req);
+	ab_request_p next_frag;		/* held until this one's reply is in */
+
+	/* statistics, tag_stats is cleared if the tag aborts the request */
+	plc_tag_stats_t *tag_stats;
+
+	/* monotonic timestamps in microseconds, zero until reached */
+	int64_t time_created_us;
+	int64_t time_send_start_us;		/* first byte sent */
+	int64_t time_sent_us;			/* last byte sent */
+	int64_t time_resp_start_us;		/* first response byte read */
+	int64_t time_matched_us;
+
 	/* used by the background thread for incrementally getting data */
 	int current_offset;
 	int request_size; /* total bytes, not just data */
@@ -75,12 +105,16 @@ struct ab_request_t {
 
 
 int request_create(ab_request_p *req);
+int request_create_from_template(ab_request_p *req, const uint8_t *tmpl, int size);
 int request_add_unsafe(ab_session_p sess, ab_request_p req);
 int request_add(ab_session_p sess, ab_request_p req);
 int request_remove_unsafe(ab_session_p sess, ab_request_p req);
 int request_remove(ab_session_p sess, ab_request_p req);
 int request_destroy_unsafe(ab_request_p* req_pp);
 int request_destroy(ab_request_p *req);
+int request_ride_unsafe(ab_session_p sess, ab_request_p req);
+void request_deliver_riders_unsafe(ab_session_p sess, ab_request_p req);
+void request_release_riders_unsafe(ab_session_p sess, ab_request_p req);
 
 
 
@@ -32,6 +32,92 @@
 #include <ab/connection.h>
 #include <ab/request.h>
 #include <ab/eip.h>
+#include <ab/symbol.h>
+#include <util/trace.h>
+
+
+/* hash chains for lookups, see find_session_by_host_unsafe() */
+static ab_session_p session_hash[SESSION_HASH_BUCKETS];
+static ab_connection_p connection_hash[CONNECTION_HASH_BUCKETS];
+
+
+
+/*
+ * hash_str_i
+ *
+ * FNV-1a over the string folded to lower case, so that names that
+ * compare equal with str_cmp_i() hash the same.
+ */
+uint32_t hash_str_i(const char *str)
+{
+    uint32_t hash = HASH_FNV_OFFSET;
+    char c;
+
+    while((c = *str++)) {
+        if(c >= 'A' && c <= 'Z') {
+            c = (char)(c - 'A' + 'a');
+        }
+
+        hash = (hash ^ (uint8_t)c) * HASH_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+
+static uint32_t session_hash_bucket(const char *host, int port)
+{
+    return ((hash_str_i(host) ^ (uint32_t)port) * HASH_FNV_PRIME) % SESSION_HASH_BUCKETS;
+}
+
+
+static uint32_t connection_hash_bucket(ab_session_p session, const char *path)
+{
+    return ((hash_str_i(path) ^ (uint32_t)(uintptr_t)session) * HASH_FNV_PRIME) % CONNECTION_HASH_BUCKETS;
+}
+
+
+static void session_hash_add_unsafe(ab_session_p session)
+{
+    uint32_t bucket = session_hash_bucket(session->host, session->port);
+
+    if(session->hashed) {
+        return;
+    }
+
+    session->hash_prev = NULL;
+    session->hash_next = session_hash[bucket];
+
+    if(session_hash[bucket]) {
+        session_hash[bucket]->hash_prev = session;
+    }
+
+    session_hash[bucket] = session;
+    session->hashed = 1;
+}
+
+
+static void session_hash_remove_unsafe(ab_session_p session)
+{
+    if(!session->hashed) {
+        return;
+    }
+
+    if(session->hash_next) {
+        session->hash_next->hash_prev = session->hash_prev;
+    }
+
+    if(session->hash_prev) {
+        session->hash_prev->hash_next = session->hash_next;
+    } else {
+        session_hash[session_hash_bucket(session->host, session->port)] = session->hash_next;
+    }
+
+    session->hash_next = NULL;
+    session->hash_prev = NULL;
+    session->hashed = 0;
+}
+
 
 /*
  * session_get_new_seq_id_unsafe
@@ -71,10 +157,14 @@ ab_connection_p session_find_connection_by_path_unsafe(ab_session_p session,cons
 {
     ab_connection_p connection;
 
-    connection = session->connections;
+    connection = connection_hash[connection_hash_bucket(session, path)];
 
-    while (connection && str_cmp_i(connection->path, path) != 0) {
-        connection = connection->next;
+    /* skip connections that are closing or failed to open. */
+    while (connection && (connection->session != session
+                          || str_cmp_i(connection->path, path) != 0
+                          || connection->close_in_progress
+                          || (connection->status != PLCTAG_STATUS_OK && connection->status != PLCTAG_STATUS_PENDING))) {
+        connection = connection->hash_next;
     }
 
     return connection;
@@ -84,12 +174,32 @@ ab_connection_p session_find_connection_by_path_unsafe(ab_session_p session,cons
 
 int session_add_connection_unsafe(ab_session_p session, ab_connection_p connection)
 {
+    uint32_t bucket;
+
     pdebug(session->debug, "Starting");
 
     /* add the connection to the list in the session */
+    connection->prev = NULL;
     connection->next = session->connections;
+
+    if(session->connections) {
+        session->connections->prev = connection;
+    }
+
     session->connections = connection;
 
+    /* and to the lookup chain. */
+    bucket = connection_hash_bucket(session, connection->path);
+
+    connection->hash_prev = NULL;
+    connection->hash_next = connection_hash[bucket];
+
+    if(connection_hash[bucket]) {
+        connection_hash[bucket]->hash_prev = connection;
+    }
+
+    connection_hash[bucket] = connection;
+
     pdebug(session->debug, "Done");
 
     return PLCTAG_STATUS_OK;
@@ -117,37 +227,45 @@ int session_add_connection(ab_session_p session, ab_connection_p connection)
 /* must have the session mutex held here. */
 int session_remove_connection_unsafe(ab_session_p session, ab_connection_p connection)
 {
-    ab_connection_p cur;
-    ab_connection_p prev;
     int debug = session->debug;
     int rc;
 
     pdebug(debug, "Starting");
 
-    cur = session->connections;
-    prev = NULL;
+    /* the list is doubly linked, only the head has no prev. */
+    if (connection->session == session && (connection->prev || session->connections == connection)) {
+        if (connection->next) {
+            connection->next->prev = connection->prev;
+        }
 
-    while (cur && cur != connection) {
-        prev = cur;
-        cur = cur->next;
-    }
+        if (connection->prev) {
+            connection->prev->next = connection->next;
+        } else {
+            session->connections = connection->next;
+        }
 
-    if (cur == connection) {
-        if (prev) {
-            prev->next = cur->next;
+        connection->next = NULL;
+        connection->prev = NULL;
+
+        if (connection->hash_next) {
+            connection->hash_next->hash_prev = connection->hash_prev;
+        }
+
+        if (connection->hash_prev) {
+            connection->hash_prev->hash_next = connection->hash_next;
         } else {
-            session->connections = cur->next;
+            connection_hash[connection_hash_bucket(session, connection->path)] = connection->hash_next;
         }
 
+        connection->hash_next = NULL;
+        connection->hash_prev = NULL;
+
         rc = PLCTAG_STATUS_OK;
     } else {
         rc = PLCTAG_ERR_NOT_FOUND;
     }
 
-    if (session_is_empty(session)) {
-        pdebug(debug, "destroying session");
-        session_destroy_unsafe(session);
-    }
+    session_check_empty_unsafe(session);
 
     pdebug(debug, "Done");
 
@@ -181,30 +299,71 @@ int find_or_create_session(ab_session_p *tag_session, attr attribs)
     int session_gw_port = attr_get_int(attribs, "gateway_port", AB_EIP_DEFAULT_PORT);
     ab_session_p session = AB_SESSION_NULL;
     int shared_session = attr_get_int(attribs, "share_session", 1); /* share the session by default. */
+    const char *profile_name = attr_get_str(attribs, "socket_profile", "default");
+    int sock_profile = SOCKET_PROFILE_DEFAULT;
+    int sock_busy_poll_us = attr_get_int(attribs, "socket_busy_poll_us", 0);
+    int sock_buf_size;
+    int linger_ms = attr_get_int(attribs, "linger_ms", SESSION_DEFAULT_LINGER_MS);
     int rc = PLCTAG_STATUS_OK;
 
     pdebug(debug, "Starting");
 
+    if(linger_ms < 0) {
+        pdebug(debug, "Linger time must not be negative!");
+        return PLCTAG_ERR_BAD_PARAM;
+    }
+
+    /*
+     * the socket settings belong to the session, so tags only share a
+     * session with others that asked for the same settings.
+     */
+    if(str_cmp_i(profile_name, "low_latency") == 0) {
+        sock_profile = SOCKET_PROFILE_LOW_LATENCY;
+    } else if(str_cmp_i(profile_name, "default") != 0) {
+        pdebug(debug, "Unknown socket profile %s!", profile_name);
+        return PLCTAG_ERR_BAD_PARAM;
+    }
+
+    sock_buf_size = attr_get_int(attribs, "socket_buf_size", (sock_profile == SOCKET_PROFILE_LOW_LATENCY ? SESSION_LOW_LATENCY_BUF_SIZE : 0));
+
+    if(sock_busy_poll_us < 0 || sock_buf_size < 0) {
+        pdebug(debug, "Socket busy poll time and buffer size must not be negative!");
+        return PLCTAG_ERR_BAD_PARAM;
+    }
+
     pdebug(debug,"entering critical block %p", global_session_mut);
     critical_block(global_session_mut) {
-        /* if we are to share sessions, then look for an existing one. */
-        if (shared_session) {
-            session = find_session_by_host_unsafe(session_gw);
-        } else {
-            /* no sharing, create a new one */
-            session = AB_SESSION_NULL;
-        }
+        /*
+         * if we are to share sessions, then look for an existing one.
+         * Otherwise we can still take over an idle unshared one.
+         */
+        session = find_session_by_host_unsafe(session_gw, session_gw_port, shared_session, sock_profile, sock_busy_poll_us, sock_buf_size);
 
         if (session == AB_SESSION_NULL) {
             pdebug(debug,"Creating new session.");
-            session = session_create_unsafe(debug, session_gw, session_gw_port);
+            session = session_create_unsafe(debug, session_gw, session_gw_port, sock_profile, sock_busy_poll_us, sock_buf_size);
 
             if (session == AB_SESSION_NULL) {
                 pdebug(debug, "unable to create or find a session!");
                 rc = PLCTAG_ERR_BAD_GATEWAY;
+            } else {
+                session->shared = shared_session;
+                session->linger_ms = (uint64_t)linger_ms;
+
+                if(shared_session) {
+                    session_hash_add_unsafe(session);
+                }
             }
         } else {
             pdebug(debug,"Reusing existing session.");
+
+            /* keep the IO thread from reaping it before the tag is added. */
+            session->idle_since_ms = 0;
+
+            /* an unshared session belongs to this tag now. */
+            if(!session->shared) {
+                session_hash_remove_unsafe(session);
+            }
         }
     }
     pdebug(debug, "leaving critical block %p", global_session_mut);
@@ -253,22 +412,18 @@ int add_session(ab_session_p s)
 
 int remove_session_unsafe(ab_session_p n)
 {
-    ab_session_p tmp;
-
     if (!n || !sessions)
         return 0;
 
     pdebug(n->debug, "Starting");
 
-    tmp = sessions;
-
-    while (tmp && tmp != n)
-        tmp = tmp->next;
-
-    if (!tmp || tmp != n) {
+    /* only the head of the list has no prev. */
+    if (!n->prev && sessions != n) {
         return PLCTAG_ERR_NOT_FOUND;
     }
 
+    session_hash_remove_unsafe(n);
+
     if (n->next) {
         n->next->prev = n->prev;
     }
@@ -300,14 +455,30 @@ int remove_session(ab_session_p s)
     return rc;
 }
 
-ab_session_p find_session_by_host_unsafe(const char* t)
+/*
+ * find_session_by_host_unsafe
+ *
+ * Shared sessions can be found by any tag that allows sharing.  An
+ * unshared session can only be taken over once it is idle.  Either way
+ * the socket must have been set up with the profile, busy poll time and
+ * buffer size the tag asked for.  Busy unshared sessions are not in the
+ * hash chains at all, so many of them to one gateway do not slow this
+ * down.
+ */
+ab_session_p find_session_by_host_unsafe(const char* t, int port, int shared, int sock_profile, int sock_busy_poll_us, int sock_buf_size)
 {
     ab_session_p tmp;
 
-    tmp = sessions;
+    tmp = session_hash[session_hash_bucket(t, port)];
 
-    while (tmp && str_cmp_i(tmp->host, t)) {
-        tmp = tmp->next;
+    while (tmp && (str_cmp_i(tmp->host, t)
+                   || tmp->port != port
+                   || tmp->shared != shared
+                   || tmp->sock_profile != sock_profile
+                   || tmp->sock_busy_poll_us != sock_busy_poll_us
+                   || tmp->sock_buf_size != sock_buf_size
+                   || (!shared && !tmp->idle_since_ms))) {
+        tmp = tmp->hash_next;
     }
 
     if (!tmp) {
@@ -322,7 +493,13 @@ int session_add_tag_unsafe(ab_session_p session, ab_tag_p tag)
 {
     pdebug(session->debug, "Starting");
 
+    tag->prev = NULL;
     tag->next = session->tags;
+
+    if(session->tags) {
+        session->tags->prev = tag;
+    }
+
     session->tags = tag;
 
     pdebug(session->debug, "Done");
@@ -350,31 +527,28 @@ int session_add_tag(ab_session_p session, ab_tag_p tag)
 /* not threadsafe */
 int session_remove_tag_unsafe(ab_session_p session, ab_tag_p tag)
 {
-    ab_tag_p tmp, prev;
     int debug = session->debug;
 
     pdebug(debug, "Starting");
 
-    tmp = session->tags;
-    prev = NULL;
-
-    while (tmp && tmp != tag) {
-        prev = tmp;
-        tmp = tmp->next;
-    }
+    /* the list is doubly linked, only the head has no prev. */
+    if (!tag->connection && (tag->prev || session->tags == tag)) {
+        if (tag->next) {
+            tag->next->prev = tag->prev;
+        }
 
-    if (tmp) {
-        if (!prev) {
-            session->tags = tmp->next;
+        if (tag->prev) {
+            tag->prev->next = tag->next;
         } else {
-            prev->next = tmp->next;
+            session->tags = tag->next;
         }
+
+        tag->next = NULL;
+        tag->prev = NULL;
     }
 
     /* if the session is empty, get rid of it. */
-    if(session_is_empty(session)) {
-        session_destroy_unsafe(session);
-    }
+    session_check_empty_unsafe(session);
 
     pdebug(debug, "Done");
 
@@ -399,7 +573,7 @@ int session_remove_tag(ab_session_p session, ab_tag_p tag)
     return rc;
 }
 
-ab_session_p session_create_unsafe(int debug, const char* host, int gw_port)
+ab_session_p session_create_unsafe(int debug, const char* host, int gw_port, int sock_profile, int sock_busy_poll_us, int sock_buf_size)
 {
     ab_session_p session = AB_SESSION_NULL;
 
@@ -415,6 +589,10 @@ ab_session_p session_create_unsafe(int debug, const char* host, int gw_port)
     session->debug = debug;
 
     str_copy(session->host, host, MAX_SESSION_HOST);
+    session->port = gw_port;
+    session->sock_profile = sock_profile;
+    session->sock_busy_poll_us = sock_busy_poll_us;
+    session->sock_buf_size = sock_buf_size;
 
     /* we must connect to the gateway and register */
     if (!session_connect(session, host)) {
@@ -435,6 +613,7 @@ ab_session_p session_create_unsafe(int debug, const char* host, int gw_port)
      *
      * FIXME - is this needed?
      */
+    session->last_send_ms = time_ms();
     session->session_seq_id = (uint64_t)(intptr_t)(session);
     session->conn_serial_number = (uint32_t)(intptr_t)(session) + (uint32_t)42; /* MAGIC */
 
@@ -468,7 +647,17 @@ int session_connect(ab_session_p session, const char* host)
         return 0;
     }
 
-    rc = socket_connect_tcp(session->sock, host, AB_EIP_DEFAULT_PORT);
+    rc = socket_set_profile(session->sock, session->sock_profile, session->sock_busy_poll_us, session->sock_buf_size);
+
+    if (rc != PLCTAG_STATUS_OK) {
+        pdebug(debug, "Unable to set socket profile for session!");
+        socket_destroy(&(session->sock));
+        return 0;
+    }
+
+    rc = socket_connect_tcp(session->sock, host, session->port);
+
+    trace_event(TRACE_SESSION_CONNECT, TRACE_ID(session), 0, rc, session->port, session->sock_profile);
 
     if (rc != PLCTAG_STATUS_OK) {
         pdebug(debug, "Unable to connect socket for session!");
@@ -494,6 +683,8 @@ int session_destroy_unsafe(ab_session_p session)
 
     pdebug(debug, "Starting.");
 
+    trace_event(TRACE_SESSION_DESTROY, TRACE_ID(session), 0, 0, 0, 0);
+
     /* do not destroy the session if there are
      * tags or connections still */
     if(!session_is_empty(session)) {
@@ -514,6 +705,8 @@ int session_destroy_unsafe(ab_session_p session)
     /* need the mutex-protected version */
     remove_session_unsafe(session);
 
+    symbol_destroy_all_unsafe(session);
+
     /* remove any remaining requests, they are dead */
     req = session->requests;
 
@@ -548,6 +741,100 @@ int session_is_empty(ab_session_p session)
     return (session->tags == NULL) && (session->connections == NULL);
 }
 
+
+/*
+ * session_check_empty_unsafe
+ *
+ * Called when a tag or connection leaves the session.  An empty
+ * session is destroyed now if it does not linger, otherwise it is
+ * marked idle and session_tickle_unsafe() destroys it later.
+ */
+int session_check_empty_unsafe(ab_session_p session)
+{
+    if(!session_is_empty(session)) {
+        return 0;
+    }
+
+    if(!session->linger_ms) {
+        pdebug(session->debug, "destroying session");
+        return session_destroy_unsafe(session);
+    }
+
+    if(!session->idle_since_ms) {
+        pdebug(session->debug, "session is idle");
+        session->idle_since_ms = time_ms();
+
+        /* other unshared tags may take it over now. */
+        session_hash_add_unsafe(session);
+    }
+
+    return 0;
+}
+
+
+/*
+ * session_send_nop_unsafe
+ *
+ * Queue an EIP NOP.  There is no reply, it only keeps the TCP
+ * connection and the gateway's session from timing out.
+ */
+static int session_send_nop_unsafe(ab_session_p session)
+{
+    ab_request_p req;
+    eip_encap_t *encap;
+    int rc;
+
+    rc = request_create(&req);
+
+    if(rc != PLCTAG_STATUS_OK) {
+        return rc;
+    }
+
+    req->debug = session->debug;
+
+    encap = (eip_encap_t *)(req->data);
+    encap->encap_command = h2le16(AB_EIP_NOP);
+
+    req->request_size = sizeof(eip_encap_t);
+    req->send_request = 1;
+    req->abort_after_send = 1;
+
+    return request_add_unsafe(session, req);
+}
+
+
+/*
+ * session_tickle_unsafe
+ *
+ * Called by the IO thread for each session on every pass.  Send a
+ * keepalive if the session has been quiet and destroy it if it has
+ * been idle longer than its linger time.  Also moves any symbol
+ * browse along.  Returns 1 if the session was destroyed.
+ */
+int session_tickle_unsafe(ab_session_p session)
+{
+    uint64_t now = time_ms();
+    ab_symtab_p symtab;
+
+    if(session->idle_since_ms && session_is_empty(session)
+       && now - session->idle_since_ms >= session->linger_ms) {
+        pdebug(session->debug, "idle session lingered %ums, destroying it", (unsigned int)session->linger_ms);
+        return session_destroy_unsafe(session);
+    }
+
+    if(session->is_connected && now - session->last_send_ms >= SESSION_KEEPALIVE_MS) {
+        /* count the NOP as traffic even if it could not be queued so we do not spin. */
+        session->last_send_ms = now;
+        session_send_nop_unsafe(session);
+    }
+
+    for(symtab = session->symtabs; symtab; symtab = symtab->next) {
+        symbol_tickle_unsafe(symtab);
+    }
+
+    return 0;
+}
+
 int session_register(ab_session_p session)
 {
     int debug = session->debug;
@@ -692,6 +979,8 @@ int session_register(ab_session_p session)
      */
     session->session_handle = resp->encap_session_handle; /* opaque to us */
 
+    trace_event(TRACE_SESSION_REGISTER, TRACE_ID(session), 0, session->session_handle, 0, 0);
+
     pdebug(debug, "Done.");
 
     return 1;
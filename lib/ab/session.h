@@ -33,10 +33,37 @@
 
 #define MAX_SESSION_HOST 	(128)
 
+/* socket buffer size used by the low latency profile unless overridden. */
+#define SESSION_LOW_LATENCY_BUF_SIZE (65536)
+
+/*
+ * Empty sessions stay open for linger_ms (this is the default) so that
+ * new tags can pick them up without connecting again.  Any session
+ * that has not sent anything for SESSION_KEEPALIVE_MS gets a NOP so
+ * that the gateway does not drop it.
+ */
+#define SESSION_DEFAULT_LINGER_MS	(5000)
+#define SESSION_KEEPALIVE_MS		(30000)
+
+/*
+ * Sessions are found by (host, port) and connections by (session, path)
+ * through hash tables.  Chains stay short for any sane deployment.
+ */
+#define SESSION_HASH_BUCKETS		(256)
+#define CONNECTION_HASH_BUCKETS		(1024)
+
 struct ab_session_t {
 	ab_session_p next;
 	ab_session_p prev;
 
+	/*
+	 * lookup chain.  Shared sessions are always in it, unshared ones
+	 * only while they are idle and can be taken over.
+	 */
+	ab_session_p hash_next;
+	ab_session_p hash_prev;
+	int hashed;
+
 	/* gateway connection related info */
 	char host[MAX_SESSION_HOST];
 	int port;
@@ -45,6 +72,17 @@ struct ab_session_t {
 	int status;
 	int debug;
 
+	/* socket tuning, see socket_set_profile() */
+	int sock_profile;
+	int sock_busy_poll_us;
+	int sock_buf_size;
+
+	/* pooling, see session_check_empty_unsafe() and session_tickle_unsafe() */
+	int shared;
+	uint64_t linger_ms;
+	uint64_t idle_since_ms;	/* zero while in use */
+	uint64_t last_send_ms;
+
 	/* registration info */
 	uint32_t session_handle;
 
@@ -57,13 +95,20 @@ struct ab_session_t {
 	/* list of outstanding requests for this session */
 	ab_request_p requests;
 
+	/* set if the PLC rejects Multiple Service Packets, see batch.c */
+	int no_batch;
+
 	/* counter for number of messages in flight */
 	int num_reqs_in_flight;
 
+	/* performance counters, see plc_tag_get_session_stats() */
+	plc_tag_stats_t stats;
+
 	/* data for receiving messages */
 	uint64_t resp_seq_id;
 	int has_response;
 	int recv_offset;
+	int64_t recv_start_us;	/* when the first byte of this response was read */
 	uint8_t recv_data[MAX_REQ_RESP_SIZE];
 
 	/*int recv_size;*/
@@ -74,8 +119,15 @@ struct ab_session_t {
 	/* connections for this session */
 	ab_connection_p connections;
 	uint32_t conn_serial_number; /* id for the next connection */
+
+	/* Logix symbol tables, one per path, see symbol.c */
+	ab_symtab_p symtabs;
 };
 
+#define HASH_FNV_OFFSET	(2166136261U)
+#define HASH_FNV_PRIME	(16777619U)
+
+uint32_t hash_str_i(const char *str);
 uint64_t session_get_new_seq_id_unsafe(ab_session_p sess);
 uint64_t session_get_new_seq_id(ab_session_p sess);
 
@@ -84,7 +136,7 @@ int add_session_unsafe(ab_session_p n);
 int add_session(ab_session_p s);
 int remove_session_unsafe(ab_session_p n);
 int remove_session(ab_session_p s);
-ab_session_p find_session_by_host_unsafe(const char  *t);
+ab_session_p find_session_by_host_unsafe(const char  *t, int port, int shared, int sock_profile, int sock_busy_poll_us, int sock_buf_size);
 int session_add_connection_unsafe(ab_session_p session, ab_connection_p connection);
 int session_add_connection(ab_session_p session, ab_connection_p connection);
 int session_remove_connection_unsafe(ab_session_p session, ab_connection_p connection);
@@ -93,11 +145,13 @@ int session_add_tag_unsafe(ab_session_p session, ab_tag_p tag);
 int session_add_tag(ab_session_p session, ab_tag_p tag);
 int session_remove_tag_unsafe(ab_session_p session, ab_tag_p tag);
 int session_remove_tag(ab_session_p session, ab_tag_p tag);
-ab_session_p session_create_unsafe(int debug, const char* host, int gw_port);
+ab_session_p session_create_unsafe(int debug, const char* host, int gw_port, int sock_profile, int sock_busy_poll_us, int sock_buf_size);
 int session_connect(ab_session_p session, const char *host);
 int session_destroy_unsafe(ab_session_p session);
 int session_destroy(ab_session_p session);
 int session_is_empty(ab_session_p session);
+int session_check_empty_unsafe(ab_session_p session);
+int session_tickle_unsafe(ab_session_p session);
 int session_register(ab_session_p session);
 int session_unregister(ab_session_p session);
 
@@ -0,0 +1,801 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/*
+ * symbol.c
+ *
+ * Logix controller symbol tables.
+ *
+ * The first Logix tag that goes out on a path starts a browse of the
+ * controller's Symbol Object (class 0x6B) with Get_Instance_Attribute_List.
+ * The IO thread pages through it and keeps the name, instance and type
+ * of every controller scope symbol.  Once the table is complete, tags
+ * whose name starts with one of those symbols swap that leading name
+ * segment for the instance.  Member and element segments after it are
+ * left as they are.
+ *
+ * If the project is downloaded again the instances can change, and an
+ * old instance may now be another symbol.  A tag only moves to its
+ * instance once it has been read by name, and every read by instance
+ * must come back with the type that read had.  A tag addressed by
+ * instance that gets a path error or another type back throws the
+ * table away, goes back to its name and retries.  The other tags on
+ * that controller go back to their names on their next request and
+ * pick up the new instances once the table has been browsed again.
+ *
+ * A write by instance is not checked that way, which is why instance
+ * addressing has to be asked for with symbol_instance=1.
+ *
+ * Program scope tags are always addressed by name.
+ */
+
+#include <platform.h>
+#include <ab/ab_common.h>
+#include <ab/symbol.h>
+#include <ab/session.h>
+#include <ab/connection.h>
+#include <ab/tag.h>
+#include <ab/request.h>
+#include <ab/eip.h>
+#include <ab/cip.h>
+
+
+
+/*
+ * The leading name segment of a tag's symbolic encoding.  The encoding
+ * starts with the word count, then 0x91, length, name, pad.
+ */
+static int tag_name_segment(ab_tag_p tag, const char **name, int *name_len)
+{
+    const uint8_t *enc = tag->sym_encoded_name;
+
+    if(tag->sym_encoded_name_size < 4 || enc[1] != 0x91) {
+        return 0;
+    }
+
+    *name = (const char *)(enc + 3);
+    *name_len = enc[2];
+
+    return 2 + enc[2] + (enc[2] & 0x01);
+}
+
+
+static int same_path(ab_symtab_p symtab, ab_tag_p tag)
+{
+    int i;
+
+    if(symtab->conn_path_size != tag->conn_path_size) {
+        return 0;
+    }
+
+    for(i = 0; i < tag->conn_path_size; i++) {
+        if(symtab->conn_path[i] != tag->conn_path[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/*
+ * Does the rest of the encoded name, after the leading name segment,
+ * have anything but element segments?  Then the data is a member and
+ * its type says nothing about the symbol's.
+ */
+static int tag_has_members(ab_tag_p tag, int seg_size)
+{
+    const uint8_t *p = tag->sym_encoded_name + 1 + seg_size;
+    const uint8_t *end = tag->sym_encoded_name + tag->sym_encoded_name_size;
+
+    while(p < end) {
+        switch(*p) {
+        case 0x28:
+            p += 2;
+            break;
+
+        case 0x29:
+            p += 4;
+            break;
+
+        case 0x2A:
+            p += 6;
+            break;
+
+        default:
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Can the symbol be the one the tag read by name?  Only the base type
+ * is compared, arrays and bit positions are in the upper bits.
+ */
+static int tag_type_matches(ab_tag_p tag, ab_symbol_p sym)
+{
+    const char *name;
+    int name_len;
+    int seg_size = tag_name_segment(tag, &name, &name_len);
+    uint8_t type = tag->sym_type_info[0];
+
+    if(!tag->sym_type_info_size) {
+        /* not read by name yet, nothing to compare with. */
+        return 0;
+    }
+
+    if(tag_has_members(tag, seg_size)) {
+        return 1;
+    }
+
+    if(sym->type & 0x8000) {
+        return (type == AB_CIP_DATA_ABREV_STRUCT || type == AB_CIP_DATA_FULL_STRUCT);
+    }
+
+    return ((sym->type & 0xFF) == type);
+}
+
+
+static void tag_drop_template(ab_tag_p tag)
+{
+    if(tag->read_tmpl) {
+        mem_free(tag->read_tmpl);
+        tag->read_tmpl = NULL;
+        tag->read_tmpl_size = 0;
+    }
+
+    /* the write fragment sizes depend on the encoded name size. */
+    tag->num_write_requests = 0;
+}
+
+
+static void tag_use_name(ab_tag_p tag)
+{
+    if(!tag->sym_by_instance) {
+        return;
+    }
+
+    pdebug(tag->debug, "addressing tag by name");
+
+    mem_copy(tag->encoded_name, tag->sym_encoded_name, tag->sym_encoded_name_size);
+    tag->encoded_name_size = tag->sym_encoded_name_size;
+    tag->sym_by_instance = 0;
+
+    tag_drop_template(tag);
+}
+
+
+static void tag_use_instance(ab_tag_p tag, uint32_t instance)
+{
+    const char *name;
+    int name_len;
+    int seg_size = tag_name_segment(tag, &name, &name_len);
+    int rest_size = tag->sym_encoded_name_size - 1 - seg_size;
+    uint8_t *data = tag->encoded_name + 1;
+
+    (void)name;
+
+    if(1 + 8 + rest_size > MAX_TAG_NAME) {
+        tag_use_name(tag);
+        return;
+    }
+
+    pdebug(tag->debug, "addressing tag by symbol instance %u", (unsigned int)instance);
+
+    *data++ = 0x20;     /* class */
+    *data++ = 0x6B;     /* Symbol Object */
+
+    if(instance <= 0xFF) {
+        *data++ = 0x24;
+        *data++ = (uint8_t)instance;
+    } else if(instance <= 0xFFFF) {
+        *data++ = 0x25;
+        *data++ = 0;    /* pad */
+        *data++ = instance & 0xFF;
+        *data++ = (instance >> 8) & 0xFF;
+    } else {
+        *data++ = 0x26;
+        *data++ = 0;    /* pad */
+        *data++ = instance & 0xFF;
+        *data++ = (instance >> 8) & 0xFF;
+        *data++ = (instance >> 16) & 0xFF;
+        *data++ = (instance >> 24) & 0xFF;
+    }
+
+    /* member and element segments follow unchanged */
+    mem_copy(data, tag->sym_encoded_name + 1 + seg_size, rest_size);
+    data += rest_size;
+
+    tag->encoded_name_size = (int)(data - tag->encoded_name);
+    tag->encoded_name[0] = (uint8_t)((tag->encoded_name_size - 1) / 2);
+    tag->sym_by_instance = 1;
+
+    tag_drop_template(tag);
+}
+
+
+
+static ab_symbol_p symbol_find_unsafe(ab_symtab_p symtab, const char *name)
+{
+    ab_symbol_p sym = symtab->symbols[hash_str_i(name) % SYMBOL_HASH_BUCKETS];
+
+    while(sym && str_cmp_i(sym->name, name)) {
+        sym = sym->next;
+    }
+
+    return sym;
+}
+
+
+static int symbol_add_unsafe(ab_symtab_p symtab, uint32_t instance, uint16_t type, const uint8_t *name, int name_len)
+{
+    ab_symbol_p sym;
+    uint32_t bucket;
+
+    if(name_len <= 0 || name_len > SYMBOL_MAX_NAME) {
+        /* not something a tag name can match. */
+        return PLCTAG_STATUS_OK;
+    }
+
+    sym = (ab_symbol_p)mem_alloc(sizeof(struct ab_symbol_t));
+
+    if(!sym) {
+        return PLCTAG_ERR_NO_MEM;
+    }
+
+    mem_copy(sym->name, (void *)name, name_len);
+    sym->name[name_len] = 0;
+    sym->instance = instance;
+    sym->type = type;
+
+    bucket = hash_str_i(sym->name) % SYMBOL_HASH_BUCKETS;
+    sym->next = symtab->symbols[bucket];
+    symtab->symbols[bucket] = sym;
+    symtab->num_symbols++;
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+static void symbol_clear_unsafe(ab_symtab_p symtab)
+{
+    int i;
+
+    for(i = 0; i < SYMBOL_HASH_BUCKETS; i++) {
+        while(symtab->symbols[i]) {
+            ab_symbol_p sym = symtab->symbols[i];
+
+            symtab->symbols[i] = sym->next;
+            mem_free(sym);
+        }
+    }
+
+    symtab->num_symbols = 0;
+}
+
+
+/*
+ * throw the table away.  The generation changes so that every tag
+ * using an instance from it goes back to its name.
+ */
+static void symbol_drop_unsafe(ab_symtab_p symtab)
+{
+    symbol_clear_unsafe(symtab);
+
+    symtab->generation++;
+    symtab->state = SYMTAB_EMPTY;
+}
+
+
+/* a browse did not make it, try again later unless that keeps happening. */
+static void symbol_browse_failed_unsafe(ab_symtab_p symtab)
+{
+    symbol_drop_unsafe(symtab);
+
+    symtab->failures++;
+
+    if(symtab->failures >= SYMBOL_MAX_FAILURES) {
+        pdebug(symtab->debug, "giving up on symbol instances for this controller");
+        symtab->state = SYMTAB_FAILED;
+    }
+}
+
+
+
+/*
+ * symbol_tag_init
+ *
+ * Called once the tag name is encoded.  Hook a controller scope Logix
+ * tag up to the symbol table of its controller, creating the table if
+ * this is the first tag on that path.
+ */
+int symbol_tag_init(ab_tag_p tag)
+{
+    const char *name;
+    int name_len;
+    int i;
+    ab_symtab_p symtab = NULL;
+    int rc = PLCTAG_STATUS_OK;
+
+    mem_copy(tag->sym_encoded_name, tag->encoded_name, tag->encoded_name_size);
+    tag->sym_encoded_name_size = tag->encoded_name_size;
+
+    if(!tag_name_segment(tag, &name, &name_len) || name_len > SYMBOL_MAX_NAME) {
+        return PLCTAG_STATUS_OK;
+    }
+
+    /* Program:Foo is looked up in the program's symbols, not the controller's. */
+    for(i = 0; i < name_len; i++) {
+        if(name[i] == ':') {
+            return PLCTAG_STATUS_OK;
+        }
+    }
+
+    critical_block(global_session_mut) {
+        for(symtab = tag->session->symtabs; symtab; symtab = symtab->next) {
+            if(same_path(symtab, tag)) {
+                break;
+            }
+        }
+
+        if(!symtab) {
+            symtab = (ab_symtab_p)mem_alloc(sizeof(struct ab_symtab_t));
+
+            if(!symtab) {
+                rc = PLCTAG_ERR_NO_MEM;
+                break;
+            }
+
+            symtab->session = tag->session;
+            symtab->debug = tag->debug;
+            mem_copy(symtab->conn_path, tag->conn_path, tag->conn_path_size);
+            symtab->conn_path_size = tag->conn_path_size;
+            symtab->generation = 1;
+            symtab->state = SYMTAB_EMPTY;
+
+            symtab->next = tag->session->symtabs;
+            tag->session->symtabs = symtab;
+        }
+
+        tag->symtab = symtab;
+    }
+
+    return rc;
+}
+
+
+
+/*
+ * symbol_tag_update
+ *
+ * Called before a request is built.  Starts the browse if nobody has
+ * yet and switches the tag between its instance and its name as the
+ * state of the table dictates.
+ */
+int symbol_tag_update(ab_tag_p tag)
+{
+    ab_symtab_p symtab = tag->symtab;
+    ab_symbol_p sym;
+    char name_buf[SYMBOL_MAX_NAME + 1];
+    const char *name;
+    int name_len;
+    int use_name = 0;
+    int use_instance = 0;
+    int give_up = 0;
+    uint32_t instance = 0;
+
+    if(!symtab) {
+        return PLCTAG_STATUS_OK;
+    }
+
+    /* the common case, checked without the lock. */
+    if(tag->sym_generation == symtab->generation && symtab->state == SYMTAB_READY) {
+        return PLCTAG_STATUS_OK;
+    }
+
+    tag_name_segment(tag, &name, &name_len);
+    mem_copy(name_buf, (void *)name, name_len);
+    name_buf[name_len] = 0;
+
+    critical_block(global_session_mut) {
+        if(symtab->state == SYMTAB_EMPTY) {
+            pdebug(tag->debug, "starting symbol browse");
+            symtab->state = SYMTAB_BROWSING;
+            symtab->next_instance = 0;
+        }
+
+        if(symtab->state == SYMTAB_FAILED) {
+            give_up = 1;
+            break;
+        }
+
+        if(tag->sym_generation == symtab->generation) {
+            /* nothing changed since we last looked. */
+            break;
+        }
+
+        if(symtab->state == SYMTAB_READY) {
+            tag->sym_generation = symtab->generation;
+            sym = symbol_find_unsafe(symtab, name_buf);
+
+            if(sym && tag_type_matches(tag, sym)) {
+                instance = sym->instance;
+                use_instance = 1;
+            } else {
+                /* look again once a read by name has told us the type. */
+                if(sym && !tag->sym_type_info_size) {
+                    tag->sym_generation = 0;
+                }
+
+                use_name = 1;
+            }
+        } else {
+            use_name = 1;
+        }
+    }
+
+    if(give_up) {
+        tag_use_name(tag);
+        tag->symtab = NULL;
+    } else if(use_instance) {
+        tag_use_instance(tag, instance);
+    } else if(use_name) {
+        tag_use_name(tag);
+    }
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * symbol_tag_stale
+ *
+ * Called when a request from the tag failed with a path error.  If the
+ * tag was addressed by instance, the instance may be stale.  Throw the
+ * table away, unless someone else already did, and go back to the name.
+ *
+ * Returns 1 if the caller should retry the request.
+ */
+int symbol_tag_stale(ab_tag_p tag)
+{
+    ab_symtab_p symtab = tag->symtab;
+
+    if(!symtab || !tag->sym_by_instance) {
+        return 0;
+    }
+
+    pdebug(tag->debug, "symbol instance rejected, the controller may have been downloaded again");
+
+    critical_block(global_session_mut) {
+        if(tag->sym_generation == symtab->generation) {
+            symbol_drop_unsafe(symtab);
+        }
+    }
+
+    tag_use_name(tag);
+
+    return 1;
+}
+
+
+
+/*
+ * symbol_tag_check_type
+ *
+ * Called with the type bytes of each read reply.  A reply by name sets
+ * the type the tag has.  A reply by instance with any other type means
+ * the instance now belongs to another symbol.
+ *
+ * Returns 0 if the data must not be used.
+ */
+int symbol_tag_check_type(ab_tag_p tag, const uint8_t *type_info, int size)
+{
+    int i;
+
+    if(!tag->symtab || size <= 0 || size > MAX_TAG_TYPE_INFO) {
+        return 1;
+    }
+
+    if(!tag->sym_by_instance) {
+        mem_copy(tag->sym_type_info, (void *)type_info, size);
+        tag->sym_type_info_size = size;
+        return 1;
+    }
+
+    if(size != tag->sym_type_info_size) {
+        return 0;
+    }
+
+    for(i = 0; i < size; i++) {
+        if(tag->sym_type_info[i] != type_info[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+
+/*
+ * Get_Instance_Attribute_List for the name (1) and type (2) attributes
+ * of the Symbol Object, starting at next_instance.
+ */
+static int symbol_send_browse_unsafe(ab_symtab_p symtab)
+{
+    eip_cip_uc_req *cip;
+    uint8_t *data;
+    uint8_t *embed_start, *embed_end;
+    uint8_t *path_size;
+    uint32_t instance = symtab->next_instance;
+    ab_request_p req;
+    int rc;
+
+    rc = request_create(&req);
+
+    if(rc != PLCTAG_STATUS_OK) {
+        return rc;
+    }
+
+    req->debug = symtab->debug;
+
+    cip = (eip_cip_uc_req *)(req->data);
+    data = (req->data) + sizeof(eip_cip_uc_req);
+
+    embed_start = data;
+
+    *data++ = AB_EIP_CMD_CIP_LIST_INSTANCES;
+    path_size = data++;
+    *data++ = 0x20;     /* class */
+    *data++ = 0x6B;     /* Symbol Object */
+
+    if(instance <= 0xFF) {
+        *data++ = 0x24;
+        *data++ = (uint8_t)instance;
+    } else if(instance <= 0xFFFF) {
+        *data++ = 0x25;
+        *data++ = 0;
+        *((uint16_t *)data) = h2le16((uint16_t)instance);
+        data += sizeof(uint16_t);
+    } else {
+        *data++ = 0x26;
+        *data++ = 0;
+        *((uint32_t *)data) = h2le32(instance);
+        data += sizeof(uint32_t);
+    }
+
+    *path_size = (uint8_t)((data - (path_size + 1)) / 2);
+
+    /* attribute count and IDs */
+    *((uint16_t *)data) = h2le16(2);
+    data += sizeof(uint16_t);
+    *((uint16_t *)data) = h2le16(1);    /* name */
+    data += sizeof(uint16_t);
+    *((uint16_t *)data) = h2le16(2);    /* type */
+    data += sizeof(uint16_t);
+
+    embed_end = data;
+
+    /* route to the controller */
+    if(symtab->conn_path_size > 0) {
+        *data++ = (symtab->conn_path_size) / 2;
+        *data++ = 0;
+        mem_copy(data, symtab->conn_path, symtab->conn_path_size);
+        data += symtab->conn_path_size;
+    }
+
+    cip->encap_command = h2le16(AB_EIP_READ_RR_DATA);
+    cip->router_timeout = h2le16(1);
+
+    cip->cpf_item_count = h2le16(2);
+    cip->cpf_nai_item_type = h2le16(AB_EIP_ITEM_NAI);
+    cip->cpf_nai_item_length = h2le16(0);
+    cip->cpf_udi_item_type = h2le16(AB_EIP_ITEM_UDI);
+    cip->cpf_udi_item_length = h2le16(data - (uint8_t *)(&cip->cm_service_code));
+
+    cip->cm_service_code = AB_EIP_CMD_UNCONNECTED_SEND;
+    cip->cm_req_path_size = 2;
+    cip->cm_req_path[0] = 0x20;
+    cip->cm_req_path[1] = 0x06;
+    cip->cm_req_path[2] = 0x24;
+    cip->cm_req_path[3] = 0x01;
+
+    cip->secs_per_tick = AB_EIP_SECS_PER_TICK;
+    cip->timeout_ticks = AB_EIP_TIMEOUT_TICKS;
+
+    cip->uc_cmd_length = h2le16(embed_end - embed_start);
+
+    req->request_size = data - (req->data);
+    req->send_request = 1;
+
+    rc = request_add_unsafe(symtab->session, req);
+
+    if(rc != PLCTAG_STATUS_OK) {
+        request_destroy_unsafe(&req);
+        return rc;
+    }
+
+    symtab->req = req;
+    symtab->req_timeout = time_ms() + SYMBOL_BROWSE_TIMEOUT_MS;
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+/*
+ * Add the symbols in one page of the browse to the table.  Returns
+ * PENDING if the controller has more.
+ */
+static int symbol_process_browse_unsafe(ab_symtab_p symtab, ab_request_p req)
+{
+    eip_cip_uc_resp *cip_resp = (eip_cip_uc_resp *)(req->data);
+    uint8_t *data;
+    uint8_t *data_end;
+    int count = 0;
+    int rc;
+
+    if(le2h16(cip_resp->encap_command) != AB_EIP_READ_RR_DATA || le2h32(cip_resp->encap_status) != AB_EIP_OK) {
+        return PLCTAG_ERR_BAD_DATA;
+    }
+
+    if(cip_resp->reply_service != (AB_EIP_CMD_CIP_LIST_INSTANCES | AB_EIP_CMD_CIP_OK)) {
+        return PLCTAG_ERR_BAD_DATA;
+    }
+
+    if(cip_resp->status != AB_CIP_STATUS_OK && cip_resp->status != AB_CIP_STATUS_FRAG) {
+        pdebug(symtab->debug, "symbol browse failed with status %d: %s", cip_resp->status, cip_decode_status(cip_resp->status));
+        return (cip_resp->status == AB_CIP_STATUS_UNSUPPORTED ? PLCTAG_ERR_UNSUPPORTED : PLCTAG_ERR_REMOTE_ERR);
+    }
+
+    data = req->data + sizeof(eip_cip_uc_resp) + (cip_resp->num_status_words * 2);
+    data_end = req->data + le2h16(cip_resp->encap_length) + sizeof(eip_encap_t);
+
+    /* instance (4), name length (2), name, type (2) */
+    while(data < data_end) {
+        uint32_t instance;
+        int name_len;
+        uint16_t type;
+
+        if(data_end - data < 8) {
+            return PLCTAG_ERR_BAD_DATA;
+        }
+
+        instance = le2h32(*((uint32_t *)data));
+        name_len = le2h16(*((uint16_t *)(data + 4)));
+
+        if(data_end - data < 8 + name_len) {
+            return PLCTAG_ERR_BAD_DATA;
+        }
+
+        type = le2h16(*((uint16_t *)(data + 6 + name_len)));
+
+        rc = symbol_add_unsafe(symtab, instance, type, data + 6, name_len);
+
+        if(rc != PLCTAG_STATUS_OK) {
+            return rc;
+        }
+
+        symtab->next_instance = instance + 1;
+        data += 8 + name_len;
+        count++;
+    }
+
+    if(cip_resp->status == AB_CIP_STATUS_FRAG) {
+        /* a partial page without any symbols would never finish. */
+        return (count ? PLCTAG_STATUS_PENDING : PLCTAG_ERR_BAD_DATA);
+    }
+
+    return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * symbol_tickle_unsafe
+ *
+ * Called by the IO thread for each symbol table on every pass.  Moves
+ * a browse along one page at a time.
+ *
+ * The session mutex must be held.
+ */
+int symbol_tickle_unsafe(ab_symtab_p symtab)
+{
+    ab_request_p req = symtab->req;
+    int rc;
+
+    if(symtab->state != SYMTAB_BROWSING) {
+        return PLCTAG_STATUS_OK;
+    }
+
+    if(!req) {
+        if(!symtab->session->is_connected) {
+            return PLCTAG_STATUS_PENDING;
+        }
+
+        rc = symbol_send_browse_unsafe(symtab);
+
+        if(rc != PLCTAG_STATUS_OK) {
+            pdebug(symtab->debug, "unable to send symbol browse request, rc=%d", rc);
+            symbol_browse_failed_unsafe(symtab);
+        }
+
+        return rc;
+    }
+
+    if(!req->resp_received && req->status == PLCTAG_STATUS_OK && time_ms() < symtab->req_timeout) {
+        return PLCTAG_STATUS_PENDING;
+    }
+
+    if(req->resp_received) {
+        rc = symbol_process_browse_unsafe(symtab, req);
+    } else {
+        rc = PLCTAG_ERR_TIMEOUT;
+    }
+
+    /* done with the request either way, let the IO thread free it. */
+    symtab->req = NULL;
+    req->abort_request = 1;
+
+    if(rc == PLCTAG_STATUS_OK) {
+        pdebug(symtab->debug, "symbol browse done, %d symbols", symtab->num_symbols);
+        symtab->state = SYMTAB_READY;
+        symtab->failures = 0;
+    } else if(rc != PLCTAG_STATUS_PENDING) {
+        pdebug(symtab->debug, "symbol browse failed, rc=%d", rc);
+
+        /* no point asking again. */
+        if(rc == PLCTAG_ERR_UNSUPPORTED) {
+            symtab->failures = SYMBOL_MAX_FAILURES;
+        }
+
+        symbol_browse_failed_unsafe(symtab);
+    }
+
+    return rc;
+}
+
+
+
+/*
+ * symbol_destroy_all_unsafe
+ *
+ * Free the session's symbol tables.  The session is going away and
+ * takes any browse request still queued with it.
+ */
+void symbol_destroy_all_unsafe(ab_session_p session)
+{
+    while(session->symtabs) {
+        ab_symtab_p symtab = session->symtabs;
+
+        session->symtabs = symtab->next;
+
+        if(symtab->req) {
+            symtab->req->abort_request = 1;
+        }
+
+        symbol_clear_unsafe(symtab);
+        mem_free(symtab);
+    }
+}
@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/*
+ * symbol.h
+ *
+ * Logix controller symbol tables.  Tags on a Logix controller are
+ * addressed through the Symbol Object instance once it is known, so
+ * the controller does not have to look the name up on every request.
+ */
+
+#ifndef __LIBPLCTAG_AB_SYMBOL_H__
+#define __LIBPLCTAG_AB_SYMBOL_H__
+
+#include <libplctag.h>
+#include <ab/ab_common.h>
+#include <ab/session.h>
+#include <ab/connection.h>
+
+/* Logix names are at most 40 characters. */
+#define SYMBOL_MAX_NAME				(40)
+#define SYMBOL_HASH_BUCKETS			(256)
+
+/* each page of the browse gets this long before we give up on it */
+#define SYMBOL_BROWSE_TIMEOUT_MS	(5000)
+
+/*
+ * A table is browsed again after a failed browse or when an instance
+ * turns out to be stale.  After this many browses fail in a row the
+ * tags on that controller just use names.
+ */
+#define SYMBOL_MAX_FAILURES			(3)
+
+#define SYMTAB_EMPTY				(0)
+#define SYMTAB_BROWSING				(1)
+#define SYMTAB_READY				(2)
+#define SYMTAB_FAILED				(3)
+
+typedef struct ab_symbol_t *ab_symbol_p;
+
+struct ab_symbol_t {
+	ab_symbol_p next;
+	uint32_t instance;
+	uint16_t type;
+	char name[SYMBOL_MAX_NAME + 1];
+};
+
+/* one per controller, that is per session and routing path. */
+struct ab_symtab_t {
+	ab_symtab_p next;
+	ab_session_p session;
+	int debug;
+
+	uint8_t conn_path[MAX_CONN_PATH];
+	uint8_t conn_path_size;
+
+	int state;
+	int failures;
+
+	/* bumped whenever the table is thrown away, see symbol_tag_update() */
+	int generation;
+
+	/* browse in progress */
+	ab_request_p req;
+	uint64_t req_timeout;
+	uint32_t next_instance;
+
+	int num_symbols;
+	ab_symbol_p symbols[SYMBOL_HASH_BUCKETS];
+};
+
+int symbol_tag_init(ab_tag_p tag);
+int symbol_tag_update(ab_tag_p tag);
+int symbol_tag_stale(ab_tag_p tag);
+int symbol_tag_check_type(ab_tag_p tag, const uint8_t *type_info, int size);
+int symbol_tickle_unsafe(ab_symtab_p symtab);
+void symbol_destroy_all_unsafe(ab_session_p session);
+
+#endif
@@ -49,6 +49,7 @@ struct ab_tag_t {
 	/* how do we talk to this device? */
 	int protocol_type;
 	int use_dhp_direct;
+	int pccc_rmw;				/* PLC-5, takes the PCCC read-modify-write */
 	uint8_t dhp_src;
 	uint8_t dhp_dest;
 
@@ -61,6 +62,10 @@ struct ab_tag_t {
 	uint8_t encoded_name[MAX_TAG_NAME];
 	int encoded_name_size;
 
+	/* SLC and MicroLogix word files, for the masked bit write */
+	uint8_t encoded_slc_name[MAX_TAG_NAME];
+	int encoded_slc_name_size;
+
 	/* the connection IOI path */
 	uint8_t conn_path[MAX_CONN_PATH];
 	uint8_t conn_path_size;
@@ -87,6 +92,35 @@ struct ab_tag_t {
 
 	ab_request_p *reqs;
 
+	/*
+	 * the write in progress, a plan of ranges sent write_chunk bytes
+	 * per fragment with at most write_window fragments outstanding.
+	 */
+	int write_window;			/* 0 for no limit */
+	tag_range_t write_ranges[TAG_MAX_DIRTY_RANGES];
+	int num_write_ranges;
+	int write_chunk;
+	int write_frag_service;		/* use Write Tag Fragmented */
+	int write_frags;			/* fragments in this write */
+	int write_frags_sent;
+	int write_frags_done;
+	int write_range;			/* where the next fragment starts */
+	int write_offset;
+
+	/* Logix symbol instance addressing, see symbol.c */
+	ab_symtab_p symtab;			/* NULL if the tag always goes by name */
+	int sym_generation;			/* table generation last looked at */
+	int sym_by_instance;		/* encoded_name holds the instance form */
+	uint8_t sym_encoded_name[MAX_TAG_NAME];	/* the name form */
+	int sym_encoded_name_size;
+	uint8_t sym_type_info[MAX_TAG_TYPE_INFO];	/* type last read by name */
+	int sym_type_info_size;
+
+	/* pre-encoded read request; each read copies it and patches one field */
+	uint8_t *read_tmpl;
+	int read_tmpl_size;
+	int read_tmpl_patch;
+
 	/* flags for operations */
 	int read_in_progress;
 	int write_in_progress;
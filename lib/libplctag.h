@@ -59,13 +59,18 @@ extern "C" {
 	typedef float real32_t;
 
 
-	/* opaque type definitions */
-	typedef struct plc_tag_t *plc_tag;
-#define PLC_TAG_NULL ((plc_tag)NULL)
+	/*
+	 * opaque tag handle.  A handle to a destroyed tag is never reused
+	 * for another tag, API calls on it return PLCTAG_ERR_NULL_PTR (or
+	 * the error value of the accessor).
+	 */
+	typedef int32_t plc_tag;
+#define PLC_TAG_NULL ((plc_tag)0)
 
 
 
 	/* library internal status. */
+#define PLCTAG_STATUS_STALE			(2)	/* cached data returned, a refresh is under way */
 #define PLCTAG_STATUS_PENDING		(1)
 #define PLCTAG_STATUS_OK			(0)
 
@@ -125,7 +130,7 @@ extern "C" {
 	 * value pair "protocol=XXX" where XXX is one of the supported protocol
 	 * types.
 	 *
-	 * An opaque pointer is returned on success.  NULL is returned on allocation
+	 * An opaque handle is returned on success.  PLC_TAG_NULL is returned on allocation
 	 * failure.  Other failures will set the tag status.
 	 */
 
@@ -143,6 +148,9 @@ extern "C" {
 	 *
 	 * This should be used to initially lock a tag when starting operations with it
 	 * followed by a call to plc_tag_unlock when you have everything you need from the tag.
+	 *
+	 * A thread can hold up to 64 different tags locked or viewed at once, after that
+	 * PLCTAG_ERR_NO_MEM is returned.
 	 */
 
 	LIB_EXPORT int plc_tag_lock(plc_tag tag);
@@ -185,12 +193,31 @@ extern "C" {
 	 * This frees all resources associated with the tag.  Internally, it may result in closed
 	 * connections etc.   This calls through to a protocol-specific function.
 	 *
+	 * It is safe to call this while other threads are using the tag.  Calls already
+	 * in progress are allowed to finish first.  Later calls with the same handle
+	 * fail.  A thread that has the tag locked or a view open on it must unlock it
+	 * or end the view first; until then PLCTAG_ERR_NOT_ALLOWED is returned and the
+	 * tag is left alone.
+	 *
 	 * This is a function provided by the underlying protocol implementation.
 	 */
 	LIB_EXPORT int plc_tag_destroy(plc_tag tag);
 
 
 
+	/*
+	 * plc_tag_destroy_many
+	 *
+	 * Destroy a batch of tags at once, for instance at shutdown or when reconfiguring.
+	 * This is much faster than destroying the tags one by one.  PLC_TAG_NULL entries
+	 * are skipped.  PLCTAG_ERR_NOT_FOUND is returned if any handle was already
+	 * destroyed, and PLCTAG_ERR_NOT_ALLOWED if the calling thread has one locked,
+	 * as for plc_tag_destroy.  The rest are still destroyed.
+	 */
+	LIB_EXPORT int plc_tag_destroy_many(const plc_tag *tags, int count);
+
+
+
 
 
 
@@ -207,6 +234,24 @@ extern "C" {
 	LIB_EXPORT int plc_tag_read(plc_tag tag, int timeout);
 
 
+	/*
+	 * Stale-while-revalidate
+	 *
+	 * With read_cache_ms set and read_cache_stale=1 in the attributes, a
+	 * read after the cache expired does not wait.  It returns the data
+	 * from the last read with PLCTAG_STATUS_STALE and starts a refresh in
+	 * the background.  Later calls to plc_tag_read or plc_tag_status
+	 * finish the refresh; once it is in, plc_tag_read returns
+	 * PLCTAG_STATUS_OK with the new data.  A refresh that fails returns
+	 * its error from the next plc_tag_read.  The first read of a tag
+	 * always waits.
+	 *
+	 * plc_tag_get_age_ms returns how old the data in the tag is, or
+	 * PLCTAG_ERR_NO_DATA if it has not been read yet.
+	 */
+	LIB_EXPORT int plc_tag_get_age_ms(plc_tag tag);
+
+
 
 
 	/*
@@ -241,12 +286,157 @@ extern "C" {
 
 
 
+	/*
+	 * Performance statistics.
+	 *
+	 * Counters only ever go up from the time the tag or session is
+	 * created.  Take two snapshots and subtract to get rates.
+	 *
+	 * The histograms count requests by elapsed time in microseconds.
+	 * Bucket 0 holds everything under 2us, bucket N holds [2^N, 2^(N+1))us
+	 * and the last bucket holds everything larger.
+	 *
+	 * queue_hist: from the request being created to its first byte being sent.
+	 * send_hist: from the first byte being sent to the last byte being sent.
+	 * wait_hist: from the last byte being sent to the first response byte being read.
+	 * recv_hist: from the first response byte being read to the response being matched.
+	 * pickup_hist: from the response being matched to the tag seeing it.
+	 * response_hist: from the last byte being sent to the response being matched.
+	 *
+	 * The pickup time is how long the response sits before the tag's
+	 * status is checked, so it mostly measures the caller's polling.
+	 */
+
+#define PLCTAG_STATS_HIST_BUCKETS	(24)
+
+	typedef struct {
+		uint64_t requests_sent;
+		uint64_t bytes_sent;
+		uint64_t bytes_received;
+		uint64_t responses_matched;
+		uint64_t responses_orphaned;	/* sessions only, responses with no waiting request */
+		uint64_t retries;				/* requests sent again: Forward Opens, failed batches, stale symbols */
+		uint64_t timeouts;				/* tags: timed out calls, sessions: requests abandoned in flight */
+
+		/* these are sampled when the stats are fetched */
+		int32_t queue_depth;			/* requests waiting to be sent */
+		int32_t in_flight;				/* requests sent and waiting for a response */
+
+		uint64_t queue_hist[PLCTAG_STATS_HIST_BUCKETS];
+		uint64_t response_hist[PLCTAG_STATS_HIST_BUCKETS];
+		uint64_t send_hist[PLCTAG_STATS_HIST_BUCKETS];
+		uint64_t wait_hist[PLCTAG_STATS_HIST_BUCKETS];
+		uint64_t recv_hist[PLCTAG_STATS_HIST_BUCKETS];
+		uint64_t pickup_hist[PLCTAG_STATS_HIST_BUCKETS];
+	} plc_tag_stats_t;
+
+
+	/*
+	 * plc_tag_get_stats
+	 *
+	 * Fill in the passed structure with the statistics for this tag.
+	 */
+	LIB_EXPORT int plc_tag_get_stats(plc_tag tag, plc_tag_stats_t *stats);
+
+
+	/*
+	 * plc_tag_get_session_stats
+	 *
+	 * Fill in the passed structure with the statistics for the session
+	 * (the TCP connection to the gateway) that this tag uses.  This covers
+	 * every tag sharing the session.
+	 */
+	LIB_EXPORT int plc_tag_get_session_stats(plc_tag tag, plc_tag_stats_t *stats);
+
+
+
+	/*
+	 * Latency breakdown of the last completed read or write on a tag.
+	 *
+	 * Each stage is summed over all the requests (packets) that made up
+	 * the operation, so with pipelined requests the stages can add up to
+	 * more than the total.  The stages match the histograms above.
+	 */
+
+	typedef struct {
+		int32_t requests;	/* number of requests in the operation */
+		int64_t queue_us;	/* created to first byte sent */
+		int64_t send_us;	/* first byte sent to last byte sent */
+		int64_t wait_us;	/* last byte sent to first response byte read */
+		int64_t recv_us;	/* first response byte read to response matched */
+		int64_t pickup_us;	/* response matched to the tag seeing it */
+		int64_t total_us;	/* first request created to the tag seeing the last response */
+	} plc_tag_timing_t;
+
+
+	/*
+	 * plc_tag_get_last_timing
+	 *
+	 * Fill in the passed structure with the latency breakdown of the last
+	 * read or write that completed on this tag.  Returns PLCTAG_ERR_NO_DATA
+	 * if no operation has completed yet.
+	 */
+	LIB_EXPORT int plc_tag_get_last_timing(plc_tag tag, plc_tag_timing_t *timing);
+
+
+
+
+	/*
+	 * Binary trace.
+	 *
+	 * The library can record IO events into small per-thread rings.
+	 * Recording is off by default; turn it on while chasing a problem,
+	 * dump the rings to a file and decode it with the trace_decode tool.
+	 * Each thread's ring (64KB) is freed when the thread exits.
+	 */
+
+	/*
+	 * plc_tag_trace_enable
+	 *
+	 * Turn event recording on (non-zero) or off (zero).
+	 */
+	LIB_EXPORT int plc_tag_trace_enable(int enable);
+
+
+	/*
+	 * plc_tag_trace_dump
+	 *
+	 * Write the recorded events of all threads to the named file.
+	 */
+	LIB_EXPORT int plc_tag_trace_dump(const char *file_name);
+
+
+
+
 	/*
 	 * Tag data accessors.
+	 *
+	 * For loops over many values, libplctag_view.h has inline getters
+	 * that check the tag once rather than on every call.
 	 */
 
 	LIB_EXPORT int plc_tag_get_size(plc_tag tag);
 
+
+	/*
+	 * plc_tag_attach_buffer
+	 *
+	 * Use the caller's buffer as the tag's data, for instance part of a
+	 * memory mapped file or a shared memory segment.  Reads land in it
+	 * directly and the accessors and writes use it.  size must be the
+	 * size of the tag; to map part of an array, create the tag for that
+	 * part (name=Arr[100]&elem_count=50).  The current tag data is
+	 * copied in.  The buffer must stay valid until it is detached by
+	 * passing NULL, which copies the data back into the library, or the
+	 * tag is destroyed.  Detaching waits for calls on the tag in other
+	 * threads to finish, including open views.
+	 *
+	 * The buffer may be changed directly, so while one is attached every
+	 * write sends the whole tag rather than only what the setters
+	 * changed.
+	 */
+	LIB_EXPORT int plc_tag_attach_buffer(plc_tag tag, uint8_t *buf, int size);
+
 	LIB_EXPORT uint32_t plc_tag_get_uint32(plc_tag tag, int offset);
 	LIB_EXPORT int plc_tag_set_uint32(plc_tag tag, int offset, uint32_t val);
 
@@ -268,10 +458,76 @@ extern "C" {
 	LIB_EXPORT int plc_tag_set_int8(plc_tag, int offset, int8_t val);
 
 
+	/*
+	 * Single bits, counted from bit 0 of the first data byte.
+	 * plc_tag_get_bit returns 0 or 1, or an error.
+	 *
+	 * If only bits in the first element are set between writes,
+	 * the write changes just those bits: a read-modify-write on Logix
+	 * and PLC-5, a masked write on SLC and MicroLogix.  That takes one
+	 * round trip and leaves the other bits in the PLC alone, even if
+	 * the PLC program changed them since the last read.  On SLC and
+	 * MicroLogix the element must be one word of an O, I, S, B, T, C,
+	 * R or N file, otherwise such a write fails with
+	 * PLCTAG_ERR_UNSUPPORTED.  Tags bridged to DH+ write the whole
+	 * element.
+	 */
+	LIB_EXPORT int plc_tag_get_bit(plc_tag tag, int bit);
+	LIB_EXPORT int plc_tag_set_bit(plc_tag tag, int bit, int val);
+
+
 	LIB_EXPORT float plc_tag_get_float32(plc_tag tag, int offset);
 	LIB_EXPORT int plc_tag_set_float32(plc_tag tag, int offset, float val);
 
 
+	/* LINT, ULINT and LREAL */
+	LIB_EXPORT uint64_t plc_tag_get_uint64(plc_tag tag, int offset);
+	LIB_EXPORT int plc_tag_set_uint64(plc_tag tag, int offset, uint64_t val);
+
+	LIB_EXPORT int64_t plc_tag_get_int64(plc_tag tag, int offset);
+	LIB_EXPORT int plc_tag_set_int64(plc_tag tag, int offset, int64_t val);
+
+	LIB_EXPORT double plc_tag_get_float64(plc_tag tag, int offset);
+	LIB_EXPORT int plc_tag_set_float64(plc_tag tag, int offset, double val);
+
+
+	/*
+	 * Logix STRING: a DINT length, then up to PLCTAG_STRING_MAX_CHARS
+	 * characters, padded to PLCTAG_STRING_SIZE bytes.  Create string
+	 * tags with elem_size=88.
+	 *
+	 * plc_tag_get_string copies the string into buf with a terminating
+	 * zero and returns its length.  If buf is too small it returns
+	 * PLCTAG_ERR_TOO_LONG.  plc_tag_set_string returns
+	 * PLCTAG_ERR_TOO_LONG for strings longer than the PLC can hold.
+	 */
+#define PLCTAG_STRING_MAX_CHARS		(82)
+#define PLCTAG_STRING_SIZE			(88)
+
+	LIB_EXPORT int plc_tag_get_string(plc_tag tag, int offset, char *buf, int buf_size);
+	LIB_EXPORT int plc_tag_set_string(plc_tag tag, int offset, const char *str);
+
+
+	/*
+	 * Bulk forms.  count values are copied starting at offset, with one
+	 * status check and one bounds check for the lot.  Strings are taken
+	 * PLCTAG_STRING_SIZE bytes apart in the tag; on our side each one
+	 * gets buf_stride bytes of buf, or is one of the count pointers in
+	 * strs.
+	 */
+	LIB_EXPORT int plc_tag_get_uint64_array(plc_tag tag, int offset, uint64_t *vals, int count);
+	LIB_EXPORT int plc_tag_set_uint64_array(plc_tag tag, int offset, const uint64_t *vals, int count);
+
+	LIB_EXPORT int plc_tag_get_int64_array(plc_tag tag, int offset, int64_t *vals, int count);
+	LIB_EXPORT int plc_tag_set_int64_array(plc_tag tag, int offset, const int64_t *vals, int count);
+
+	LIB_EXPORT int plc_tag_get_float64_array(plc_tag tag, int offset, double *vals, int count);
+	LIB_EXPORT int plc_tag_set_float64_array(plc_tag tag, int offset, const double *vals, int count);
+
+	LIB_EXPORT int plc_tag_get_string_array(plc_tag tag, int offset, char *buf, int buf_stride, int count);
+	LIB_EXPORT int plc_tag_set_string_array(plc_tag tag, int offset, const char * const *strs, int count);
+
+
 #ifdef __cplusplus
 }
 #endif
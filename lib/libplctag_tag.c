@@ -31,18 +31,29 @@
 
 #include <limits.h>
 #include <float.h>
+#include <string.h>
 #include <libplctag.h>
 #include <libplctag_tag.h>
+#include <libplctag_view.h>
 #include <platform.h>
 #include <util/attr.h>
+#include <util/handle.h>
+#include <util/share.h>
+#include <util/stats.h>
+#include <util/trace.h>
 #include <ab/ab.h>
 
 
 
+static int tag_destroy(plc_tag_p tag);
+static int tag_status(plc_tag_p tag);
+static void tag_detach_buffer(plc_tag_p tag, int keep_data);
+static int tag_teardown(plc_tag_p tag);
+
 
 
 /**************************************************************************
- ***************************  API Functions  ******************************
+ ***************************  Tag Life Cycle  *****************************
  **************************************************************************/
 
 
@@ -55,7 +66,8 @@
 
 LIB_EXPORT plc_tag plc_tag_create(const char *attrib_str)
 {
-	plc_tag tag = PLC_TAG_NULL;
+	plc_tag_p tag = NULL;
+	plc_tag handle = PLC_TAG_NULL;
 	attr attribs = NULL;
 	int rc = PLCTAG_STATUS_OK;
 
@@ -88,6 +100,7 @@ LIB_EXPORT plc_tag plc_tag_create(const char *attrib_str)
 
 		tag->read_cache_expire = (uint64_t)0;
 		tag->read_cache_ms = attr_get_int(attribs,"read_cache_ms",0);
+		tag->read_cache_stale = attr_get_int(attribs,"read_cache_stale",0);
 	}
 
 	/*
@@ -100,13 +113,26 @@ LIB_EXPORT plc_tag plc_tag_create(const char *attrib_str)
 	 */
 	attr_destroy(attribs);
 
-	return tag;
+	if(!tag) {
+		return PLC_TAG_NULL;
+	}
+
+	/* the caller only ever sees the handle. */
+	handle = handle_alloc(tag);
+
+	if(handle <= 0) {
+		pdebug(tag->debug, "Unable to allocate a tag handle!");
+		tag_destroy(tag);
+		return PLC_TAG_NULL;
+	}
+
+	return handle;
 }
 
 
 
 /*
- * plc_tag_lock
+ * tag_lock
  *
  * Lock the tag against use by other threads.  Because operations on a tag are
  * very much asynchronous, actions like getting and extracting the data from
@@ -118,7 +144,7 @@ LIB_EXPORT plc_tag plc_tag_create(const char *attrib_str)
  * followed by a call to plc_tag_unlock when you have everything you need from the tag.
  */
 
-LIB_EXPORT int plc_tag_lock(plc_tag tag)
+static int tag_lock(plc_tag_p tag)
 {
 	if(!tag || !tag->mut)
 		return PLCTAG_ERR_NULL_PTR;
@@ -139,13 +165,13 @@ LIB_EXPORT int plc_tag_lock(plc_tag tag)
 
 
 /*
- * plc_tag_unlock
+ * tag_unlock
  *
  * The opposite action of plc_tag_unlock.  This allows other threads to access the
  * tag.
  */
 
-LIB_EXPORT int plc_tag_unlock(plc_tag tag)
+static int tag_unlock(plc_tag_p tag)
 {
 	if(!tag || !tag->mut)
 		return PLCTAG_ERR_NULL_PTR;
@@ -166,7 +192,7 @@ LIB_EXPORT int plc_tag_unlock(plc_tag tag)
 
 
 /*
- * plc_tag_abort()
+ * tag_abort()
  *
  * This function calls through the vtable in the passed tag to call
  * the protocol-specific implementation.
@@ -177,7 +203,7 @@ LIB_EXPORT int plc_tag_unlock(plc_tag tag)
  * The status of the operation is returned.
  */
 
-LIB_EXPORT int plc_tag_abort(plc_tag tag)
+int tag_abort(plc_tag_p tag)
 {
 	if(!tag || !tag->vtable)
 		return PLCTAG_ERR_NULL_PTR;
@@ -188,9 +214,14 @@ LIB_EXPORT int plc_tag_abort(plc_tag tag)
 
 	/* clear the status */
 	tag->status = PLCTAG_STATUS_OK;
+	tag->ready = 0;
 
 	/* who knows what state the tag data is in.  */
 	tag->read_cache_expire = (uint64_t)0;
+	tag->read_start_ms = 0;
+	tag->refreshing = 0;
+
+	trace_event(TRACE_TAG_ABORT, 0, TRACE_ID(tag), 0, 0, 0);
 
 	if(!tag->vtable->abort) {
 		pdebug(debug,"Tag does not have a abort function!");
@@ -214,52 +245,175 @@ LIB_EXPORT int plc_tag_abort(plc_tag tag)
  * Remove all implementation specific details about a tag and clear its
  * memory.
  *
- * FIXME - this leaves a dangling pointer.  Should we take the address
- * of the tag pointer as an arg and zero out the pointer?  That may not be
- * as portable.
+ * The handle is retired first, so no new calls can find the tag, and
+ * calls already in progress are waited for.  A second destroy of the
+ * same handle finds nothing.  A thread that still has the tag locked or
+ * a view open would wait for itself, so it gets an error instead.
  */
 
-LIB_EXPORT int plc_tag_destroy(plc_tag tag)
+LIB_EXPORT int plc_tag_destroy(plc_tag handle)
 {
-	if(!tag)
+	plc_tag_p tag;
+	int rc;
+
+	if(!handle)
 		return PLCTAG_STATUS_OK;
 
-	int debug = tag->debug;
-	mutex_p temp_mut;
+	rc = handle_remove(handle, (void **)&tag);
+
+	if(rc != PLCTAG_STATUS_OK)
+		return rc;
+
+	return tag_destroy(tag);
+}
+
+
+
+/*
+ * plc_tag_destroy_many()
+ *
+ * Retire all the handles first, then let each protocol tear its tags
+ * down together.
+ */
+
+LIB_EXPORT int plc_tag_destroy_many(const plc_tag *handles, int count)
+{
+	plc_tag_p *tags;
+	plc_tag_p *batch;
+	tag_destroy_many_func destroy_many;
 	int rc = PLCTAG_STATUS_OK;
+	int tmp_rc;
+	int num;
+	int i, j;
 
-	pdebug(debug, "Starting.");
+	if(!handles)
+		return PLCTAG_ERR_NULL_PTR;
+
+	if(count <= 0)
+		return (count ? PLCTAG_ERR_BAD_PARAM : PLCTAG_STATUS_OK);
+
+	/* one allocation, the second half collects each protocol's batch. */
+	tags = (plc_tag_p *)mem_alloc(2 * count * (int)sizeof(plc_tag_p));
+
+	if(!tags)
+		return PLCTAG_ERR_NO_MEM;
 
-	/* clear the mutex */
-	if(tag->mut) {
-		temp_mut = tag->mut;
-		tag->mut = NULL;
+	batch = tags + count;
 
-		critical_block(temp_mut) {
-			if(!tag->vtable || !tag->vtable->destroy) {
-				pdebug(debug, "tag destructor not defined!");
-				tag->status = PLCTAG_ERR_NOT_IMPLEMENTED;
-				return PLCTAG_ERR_NOT_IMPLEMENTED;
+	for(i = 0; i < count; i++) {
+		if(!handles[i])
+			continue;
+
+		tmp_rc = handle_remove(handles[i], (void **)&tags[i]);
+
+		if(tmp_rc != PLCTAG_STATUS_OK) {
+			rc = tmp_rc;
+			continue;
+		}
+
+		tmp_rc = tag_teardown(tags[i]);
+
+		if(tmp_rc != PLCTAG_STATUS_OK) {
+			if(tmp_rc != PLCTAG_ERR_NO_DATA) {
+				rc = tmp_rc;
 			}
 
-			/*
-			 * It is the responsibility of the destroy
-			 * function to free all memory associated with
-			 * the tag.
-			 */
-			rc = tag->vtable->destroy(tag);
+			tags[i] = NULL;
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+		if(!tags[i])
+			continue;
+
+		destroy_many = tags[i]->vtable->destroy_many;
+
+		if(!destroy_many) {
+			tags[i]->vtable->destroy(tags[i]);
+			tags[i] = NULL;
+			continue;
+		}
+
+		num = 0;
+
+		for(j = i; j < count; j++) {
+			if(tags[j] && tags[j]->vtable->destroy_many == destroy_many) {
+				batch[num++] = tags[j];
+				tags[j] = NULL;
+			}
 		}
 
-		mutex_destroy(&temp_mut);
+		destroy_many(batch, num);
 	}
 
+	mem_free(tags);
+
 	return rc;
 }
 
 
 
 /*
- * plc_tag_read()
+ * tag_teardown
+ *
+ * The generic part of destroying a tag, before the protocol frees it.
+ * The handle is gone and nobody holds a reference, so nobody holds the
+ * lock either.  Returns PLCTAG_ERR_NO_DATA for a tag that failed
+ * creation, which is left alone.
+ */
+static int tag_teardown(plc_tag_p tag)
+{
+	mutex_p temp_mut;
+
+	if(!tag->mut) {
+		return PLCTAG_ERR_NO_DATA;
+	}
+
+	if(!tag->vtable || !tag->vtable->destroy) {
+		pdebug(tag->debug, "tag destructor not defined!");
+		tag->status = PLCTAG_ERR_NOT_IMPLEMENTED;
+		return PLCTAG_ERR_NOT_IMPLEMENTED;
+	}
+
+	temp_mut = tag->mut;
+	tag->mut = NULL;
+	mutex_destroy(&temp_mut);
+
+	share_detach(tag->share);
+	tag->share = NULL;
+
+	/* the protocol frees its own buffer, not the caller's. */
+	tag_detach_buffer(tag, 0);
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+static int tag_destroy(plc_tag_p tag)
+{
+	int rc;
+
+	pdebug(tag->debug, "Starting.");
+
+	rc = tag_teardown(tag);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		return (rc == PLCTAG_ERR_NO_DATA ? PLCTAG_STATUS_OK : rc);
+	}
+
+	/*
+	 * It is the responsibility of the destroy
+	 * function to free all memory associated with
+	 * the tag.
+	 */
+	return tag->vtable->destroy(tag);
+}
+
+
+
+/*
+ * tag_read()
  *
  * This function calls through the vtable in the passed tag to call
  * the protocol-specific implementation.  That starts the read operation.
@@ -269,12 +423,15 @@ LIB_EXPORT int plc_tag_destroy(plc_tag tag)
  * The status of the operation is returned.
  */
 
-LIB_EXPORT int plc_tag_read(plc_tag tag, int timeout)
+static int tag_read(plc_tag_p tag, int timeout)
 {
 	if(!tag)
 		return PLCTAG_ERR_NULL_PTR;
 
 	int debug = tag->debug;
+	int64_t read_ms;
+	int64_t stamp;
+	int stale;
 	int rc;
 
 	pdebug(debug, "Starting.");
@@ -287,15 +444,59 @@ LIB_EXPORT int plc_tag_read(plc_tag tag, int timeout)
 	}
 
 
-	/* check read cache, if not expired, return existing data. */
-	if(tag->read_cache_expire > time_ms()) {
+	/* a refresh started by an earlier stale read may be in by now. */
+	if(tag->refreshing) {
+		rc = tag_status(tag);
+
+		if(rc == PLCTAG_STATUS_PENDING) {
+			pdebug(debug, "Refresh still under way, returning stale data.");
+			return PLCTAG_STATUS_STALE;
+		}
+
+		return rc;
+	}
+
+	/*
+	 * check read cache, if not expired, return existing data.  Handles
+	 * for the same tag share one cache so that a write through any of
+	 * them expires it for all.
+	 */
+	if(tag->share) {
+		if(tag->read_cache_ms) {
+			tag_data_write_begin(tag);
+			rc = share_get(tag->share, tag->data, tag->size, (int)tag->read_cache_ms, &stamp);
+			tag_data_write_end(tag);
+
+			if(rc == PLCTAG_STATUS_OK) {
+				pdebug(debug, "Returning shared cached data.");
+				tag->data_ms = stamp;
+				tag->status = PLCTAG_STATUS_OK;
+				return tag->status;
+			}
+		}
+	} else if(tag->read_cache_expire > time_ms()) {
 		pdebug(debug, "Returning cached data.");
 		tag->status = PLCTAG_STATUS_OK;
 		return tag->status;
 	}
 
+	/* the cache expired, but the old data may do while we refresh it. */
+	stale = (tag->read_cache_stale && tag->read_cache_ms && tag->data_ms);
+
 	/* the protocol implementation does not do the timeout. */
+	read_ms = time_ms();
 	rc = tag->vtable->read(tag);
+	tag->ready = (rc == PLCTAG_STATUS_OK);
+
+	/* publish the data when the read completes */
+	if(rc == PLCTAG_STATUS_OK) {
+		share_put(tag->share, tag->data, tag->size, read_ms);
+		tag->data_ms = read_ms;
+	} else if(rc == PLCTAG_STATUS_PENDING) {
+		tag->read_start_ms = read_ms;
+	}
+
+	trace_event(TRACE_TAG_READ, 0, TRACE_ID(tag), rc, timeout, 0);
 
 	/* set up the cache time */
 	if(tag->read_cache_ms) {
@@ -307,6 +508,12 @@ LIB_EXPORT int plc_tag_read(plc_tag tag, int timeout)
 		return rc;
 	}
 
+	if(rc == PLCTAG_STATUS_PENDING && stale) {
+		pdebug(debug, "Returning stale data, refresh started.");
+		tag->refreshing = 1;
+		return PLCTAG_STATUS_STALE;
+	}
+
 	/*
 	 * if there is a timeout, then loop until we get
 	 * an error or we timeout.
@@ -316,7 +523,7 @@ LIB_EXPORT int plc_tag_read(plc_tag tag, int timeout)
 		uint64_t start_time = time_ms();
 
 		while(rc == PLCTAG_STATUS_PENDING && timeout_time > time_ms()) {
-			rc = plc_tag_status(tag);
+			rc = tag_status(tag);
 
 			/*
 			 * terminate early and do not wait again if the
@@ -336,7 +543,9 @@ LIB_EXPORT int plc_tag_read(plc_tag tag, int timeout)
 		 * Abort the operation and set the status to show the timeout.
 		 */
 		if(rc == PLCTAG_STATUS_PENDING) {
-			plc_tag_abort(tag);
+			tag_abort(tag);
+			atomic_add_u64(&tag->stats.timeouts, 1);
+			trace_event(TRACE_TAG_TIMEOUT, 0, TRACE_ID(tag), timeout, 0, 0);
 			tag->status = PLCTAG_ERR_TIMEOUT;
 			rc = PLCTAG_ERR_TIMEOUT;
 		}
@@ -355,7 +564,7 @@ LIB_EXPORT int plc_tag_read(plc_tag tag, int timeout)
 
 
 /*
- * plc_tag_status
+ * tag_status
  *
  * Return the current status of the tag.  This will be PLCTAG_STATUS_PENDING if there is
  * an uncompleted IO operation.  It will be PLCTAG_STATUS_OK if everything is fine.  Other
@@ -363,8 +572,10 @@ LIB_EXPORT int plc_tag_read(plc_tag tag, int timeout)
  *
  * This is a function provided by the underlying protocol implementation.
  */
-LIB_EXPORT int plc_tag_status(plc_tag tag)
+static int tag_status(plc_tag_p tag)
 {
+	int rc;
+
 	/*pdebug("Starting.");*/
 
 	if(!tag)
@@ -384,7 +595,23 @@ LIB_EXPORT int plc_tag_status(plc_tag tag)
 	/* clear the status */
 	/*tag->status = PLCTAG_STATUS_OK;*/
 
-	return tag->vtable->status(tag);
+	rc = tag->vtable->status(tag);
+
+	/* nothing changes under the accessors until the next IO starts. */
+	tag->ready = (rc == PLCTAG_STATUS_OK);
+
+	/* a read just finished, let the other handles for this tag have it. */
+	if(tag->read_start_ms && rc != PLCTAG_STATUS_PENDING) {
+		if(rc == PLCTAG_STATUS_OK) {
+			share_put(tag->share, tag->data, tag->size, tag->read_start_ms);
+			tag->data_ms = tag->read_start_ms;
+		}
+
+		tag->read_start_ms = 0;
+		tag->refreshing = 0;
+	}
+
+	return rc;
 }
 
 
@@ -394,7 +621,7 @@ LIB_EXPORT int plc_tag_status(plc_tag tag)
 
 
 /*
- * plc_tag_write()
+ * tag_write()
  *
  * This function calls through the vtable in the passed tag to call
  * the protocol-specific implementation.  That starts the write operation.
@@ -404,7 +631,7 @@ LIB_EXPORT int plc_tag_status(plc_tag tag)
  * The status of the operation is returned.
  */
 
-LIB_EXPORT int plc_tag_write(plc_tag tag, int timeout)
+static int tag_write(plc_tag_p tag, int timeout)
 {
 	if(!tag)
 		return PLCTAG_ERR_NULL_PTR;
@@ -414,8 +641,23 @@ LIB_EXPORT int plc_tag_write(plc_tag tag, int timeout)
 
 	pdebug(debug, "Starting.");
 
+	/* a background refresh would clobber the data we are writing. */
+	if(tag->refreshing) {
+		tag_abort(tag);
+	}
+
 	/* we are writing so the tag existing data is stale. */
 	tag->read_cache_expire = (uint64_t)0;
+	tag->read_start_ms = 0;
+	share_invalidate(tag->share);
+
+	/*
+	 * The caller may have changed an attached buffer directly, without
+	 * the setters seeing it.  Write all of it.
+	 */
+	if(tag->own_data) {
+		tag_clear_dirty(tag);
+	}
 
 	/* check the vtable */
 	if(!tag->vtable || !tag->vtable->write) {
@@ -426,6 +668,9 @@ LIB_EXPORT int plc_tag_write(plc_tag tag, int timeout)
 
 	/* the protocol implementation does not do the timeout. */
 	rc = tag->vtable->write(tag);
+	tag->ready = (rc == PLCTAG_STATUS_OK);
+
+	trace_event(TRACE_TAG_WRITE, 0, TRACE_ID(tag), rc, timeout, 0);
 
 	/* if error, return now */
 	if(rc != PLCTAG_STATUS_PENDING && rc != PLCTAG_STATUS_OK)
@@ -439,7 +684,7 @@ LIB_EXPORT int plc_tag_write(plc_tag tag, int timeout)
 		uint64_t timeout_time = timeout + time_ms();
 
 		while(rc == PLCTAG_STATUS_PENDING && timeout_time > time_ms()) {
-			rc = plc_tag_status(tag);
+			rc = tag_status(tag);
 
 			/*
 			 * terminate early and do not wait again if the
@@ -459,7 +704,9 @@ LIB_EXPORT int plc_tag_write(plc_tag tag, int timeout)
 		 * Abort the operation and set the status to show the timeout.
 		 */
 		if(rc == PLCTAG_STATUS_PENDING) {
-			plc_tag_abort(tag);
+			tag_abort(tag);
+			atomic_add_u64(&tag->stats.timeouts, 1);
+			trace_event(TRACE_TAG_TIMEOUT, 0, TRACE_ID(tag), timeout, 0, 0);
 			tag->status = PLCTAG_ERR_TIMEOUT;
 			rc = PLCTAG_ERR_TIMEOUT;
 		}
@@ -475,305 +722,588 @@ LIB_EXPORT int plc_tag_write(plc_tag tag, int timeout)
 
 
 /*
- * Tag data accessors.
+ * tag_get_stats()
+ *
+ * Copy out the counters kept for this tag.  The protocol implementation
+ * fills in the queue and in flight gauges if it can.
  */
 
-
-
-LIB_EXPORT int plc_tag_get_size(plc_tag tag)
+static int tag_get_stats(plc_tag_p tag, plc_tag_stats_t *stats)
 {
-	if(!tag)
+	if(!tag || !stats)
 		return PLCTAG_ERR_NULL_PTR;
 
-	return tag->size;
+	mem_set(stats, 0, sizeof(*stats));
+
+	stats_snapshot(stats, &tag->stats);
+
+	if(tag->vtable && tag->vtable->stats) {
+		return tag->vtable->stats(tag, stats);
+	}
+
+	return PLCTAG_STATUS_OK;
 }
 
 
 
+/*
+ * tag_get_last_timing()
+ *
+ * Copy out the latency breakdown of the last completed operation.  The
+ * protocol implementation fills this in when it finishes a read or write.
+ */
 
-LIB_EXPORT uint32_t plc_tag_get_uint32(plc_tag t, int offset)
+static int tag_get_last_timing(plc_tag_p tag, plc_tag_timing_t *timing)
 {
-	uint32_t res = UINT32_MAX;
+	if(!tag || !timing)
+		return PLCTAG_ERR_NULL_PTR;
 
-	/* is there a tag? */
-	if(!t)
-		return res;
+	*timing = tag->timing;
 
-	/* is the tag ready for this operation? */
-	if(plc_tag_status(t) != PLCTAG_STATUS_OK && plc_tag_status(t) != PLCTAG_ERR_OUT_OF_BOUNDS) {
-		return res;
+	if(!timing->requests) {
+		return PLCTAG_ERR_NO_DATA;
 	}
 
-	/* is there data? */
-	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
-		return res;
-	}
+	return PLCTAG_STATUS_OK;
+}
 
-	/* is there enough data */
-	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
-		return res;
-	}
 
-	/* check whether data is little endian or big endian */
-	if(t->endian == PLCTAG_DATA_LITTLE_ENDIAN) {
-		res = ((uint32_t)(t->data[offset])) +
-		      ((uint32_t)(t->data[offset+1]) << 8) +
-		      ((uint32_t)(t->data[offset+2]) << 16) +
-		      ((uint32_t)(t->data[offset+3]) << 24);
-	} else {
-		res = ((uint32_t)(t->data[offset]) << 24) +
-		      ((uint32_t)(t->data[offset+1]) << 16) +
-		      ((uint32_t)(t->data[offset+2]) << 8) +
-		      ((uint32_t)(t->data[offset+3]));
-	}
 
-	t->status = PLCTAG_STATUS_OK;
+/*
+ * tag_get_age_ms()
+ *
+ * How long ago the data in the tag was read from the PLC.
+ */
 
-	return res;
+static int tag_get_age_ms(plc_tag_p tag)
+{
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	if(!tag->data_ms) {
+		return PLCTAG_ERR_NO_DATA;
+	}
+
+	return (int)(time_ms() - tag->data_ms);
 }
 
 
 
-LIB_EXPORT int plc_tag_set_uint32(plc_tag t, int offset, uint32_t val)
-{
-	int rc;
+/*
+ * tag_get_session_stats()
+ *
+ * Copy out the counters kept for the session under this tag.  This
+ * is entirely up to the protocol implementation.
+ */
 
-	/* is there a tag? */
-	if(!t)
+static int tag_get_session_stats(plc_tag_p tag, plc_tag_stats_t *stats)
+{
+	if(!tag || !stats)
 		return PLCTAG_ERR_NULL_PTR;
 
-	rc = plc_tag_status(t);
+	mem_set(stats, 0, sizeof(*stats));
 
-	/* is the tag ready for this operation? */
-	if(rc != PLCTAG_STATUS_OK && rc != PLCTAG_ERR_OUT_OF_BOUNDS) {
-		return rc;
+	if(!tag->vtable || !tag->vtable->session_stats) {
+		pdebug(tag->debug, "Tag does not have a session stats function!");
+		return PLCTAG_ERR_NOT_IMPLEMENTED;
 	}
 
-	/* is there data? */
-	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
-		return PLCTAG_ERR_NULL_PTR;
-	}
+	return tag->vtable->session_stats(tag, stats);
+}
 
-	/* is there enough data space to write the value? */
-	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
-		return PLCTAG_ERR_OUT_OF_BOUNDS;
-	}
 
-	/* check whether data is little endian or big endian */
-	if(t->endian == PLCTAG_DATA_LITTLE_ENDIAN) {
-		t->data[offset]   = (uint8_t)(val & 0xFF);
-		t->data[offset+1] = (uint8_t)((val >> 8) & 0xFF);
-		t->data[offset+2] = (uint8_t)((val >> 16) & 0xFF);
-		t->data[offset+3] = (uint8_t)((val >> 24) & 0xFF);
-	} else {
-		t->data[offset+3] = (uint8_t)(val & 0xFF);
-		t->data[offset+2] = (uint8_t)((val >> 8) & 0xFF);
-		t->data[offset+1] = (uint8_t)((val >> 16) & 0xFF);
-		t->data[offset]   = (uint8_t)((val >> 24) & 0xFF);
-	}
 
-	t->status = PLCTAG_STATUS_OK;
+
+
+/*
+ * plc_tag_trace_enable()
+ *
+ * Turn the binary event trace on or off for all threads.
+ */
+
+LIB_EXPORT int plc_tag_trace_enable(int enable)
+{
+	trace_enabled = (enable ? 1 : 0);
 
 	return PLCTAG_STATUS_OK;
 }
 
 
 
+/*
+ * plc_tag_trace_dump()
+ *
+ * Write the event trace to a file for tools/trace_decode.
+ */
 
+LIB_EXPORT int plc_tag_trace_dump(const char *file_name)
+{
+	return trace_dump(file_name);
+}
 
 
 
 
 
-LIB_EXPORT int32_t  plc_tag_get_int32(plc_tag t, int offset)
-{
-	int32_t res = INT32_MIN;
+/*
+ * Tag data accessors.
+ */
 
-	/* is there a tag? */
-	if(!t)
-		return res;
 
-	/* is the tag ready for this operation? */
-	if(plc_tag_status(t) != PLCTAG_STATUS_OK && plc_tag_status(t) != PLCTAG_ERR_OUT_OF_BOUNDS) {
-		return res;
-	}
 
-	/* is there data? */
-	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
-		return res;
-	}
+/* spins before giving up the CPU to a writer that may be preempted */
+#define TAG_DATA_SPINS	(1000)
 
-	/* is there enough data */
-	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
-		return res;
-	}
+void tag_data_write_begin(plc_tag_p tag)
+{
+	int32_t seq;
+	int spins = 0;
 
-	/* check whether data is little endian or big endian */
-	if(t->endian == PLCTAG_DATA_LITTLE_ENDIAN) {
-		res = (int32_t)(((uint32_t)(t->data[offset])) +
-		                ((uint32_t)(t->data[offset+1]) << 8) +
-		                ((uint32_t)(t->data[offset+2]) << 16) +
-		                ((uint32_t)(t->data[offset+3]) << 24));
-	} else {
-		res = (int32_t)(((uint32_t)(t->data[offset]) << 24) +
-		                ((uint32_t)(t->data[offset+1]) << 16) +
-		                ((uint32_t)(t->data[offset+2]) << 8) +
-		                ((uint32_t)(t->data[offset+3])));
-	}
+	/* an odd count means a write is under way, wait our turn. */
+	while(1) {
+		seq = atomic_get_i32(&tag->data_seq);
 
-	t->status = PLCTAG_STATUS_OK;
+		if(!(seq & 1) && atomic_cas_i32(&tag->data_seq, seq, seq + 1)) {
+			break;
+		}
 
-	return res;
+		if(++spins % TAG_DATA_SPINS == 0) {
+			sleep_ms(1);
+		}
+	}
 }
 
 
-
-LIB_EXPORT int plc_tag_set_int32(plc_tag t, int offset, int32_t ival)
+void tag_data_write_end(plc_tag_p tag)
 {
-	int rc;
-
-	uint32_t val = (uint32_t)(ival);
-
-	/* is there a tag? */
-	if(!t)
-		return -1;
+	atomic_add_i32(&tag->data_seq, 1);
+}
 
-	rc = plc_tag_status(t);
 
-	/* is the tag ready for this operation? */
-	if(rc != PLCTAG_STATUS_OK && rc != PLCTAG_ERR_OUT_OF_BOUNDS) {
-		return rc;
-	}
+int32_t tag_data_read_begin(plc_tag_p tag)
+{
+	int32_t seq;
+	int spins = 0;
 
-	/* is there data? */
-	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
-		return PLCTAG_ERR_NULL_PTR;
+	while((seq = atomic_load_i32(&tag->data_seq)) & 1) {
+		if(++spins % TAG_DATA_SPINS == 0) {
+			sleep_ms(1);
+		}
 	}
 
-	/* is there enough data space to write the value? */
-	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
-		return PLCTAG_ERR_OUT_OF_BOUNDS;
-	}
+	return seq;
+}
 
-	/* check whether data is little endian or big endian */
-	if(t->endian == PLCTAG_DATA_LITTLE_ENDIAN) {
-		t->data[offset]   = (uint8_t)(val & 0xFF);
-		t->data[offset+1] = (uint8_t)((val >> 8) & 0xFF);
-		t->data[offset+2] = (uint8_t)((val >> 16) & 0xFF);
-		t->data[offset+3] = (uint8_t)((val >> 24) & 0xFF);
-	} else {
-		t->data[offset+3] = (uint8_t)(val & 0xFF);
-		t->data[offset+2] = (uint8_t)((val >> 8) & 0xFF);
-		t->data[offset+1] = (uint8_t)((val >> 16) & 0xFF);
-		t->data[offset]   = (uint8_t)((val >> 24) & 0xFF);
-	}
 
-	t->status = PLCTAG_STATUS_OK;
+int tag_data_read_retry(plc_tag_p tag, int32_t seq)
+{
+	/* the data reads have to be done before we look again. */
+	atomic_read_fence();
 
-	return PLCTAG_STATUS_OK;
+	return atomic_load_i32(&tag->data_seq) != seq;
 }
 
 
 
+/*
+ * tag_get_ready
+ *
+ * Getters need data, not the latest IO state.  Once a read has come in
+ * they use what is there, even with more IO in progress, and leave the
+ * protocol alone so that any number of threads can read at once.
+ * Before that, the tag has to be ready as before.  An error stored by
+ * the last operation is returned either way.  The accessors only read
+ * the status, it belongs to the protocol code.
+ */
+static int tag_get_ready(plc_tag_p t)
+{
+	int status = atomic_load_i32(&t->status);
 
+	if(status < 0) {
+		return status;
+	}
 
+	if(t->data_ms || t->ready) {
+		return PLCTAG_STATUS_OK;
+	}
 
+	return tag_status(t);
+}
 
 
 
-LIB_EXPORT uint16_t plc_tag_get_uint16(plc_tag t, int offset)
+/*
+ * tag_set_ready
+ *
+ * Setters must not race a read that would overwrite what they set, so
+ * they wait for the IO to finish.  Once the protocol has said the tag
+ * is idle that holds until the next read or write is started, and the
+ * setters take the flag's word for it.
+ */
+static int tag_set_ready(plc_tag_p t)
 {
-	uint16_t res = UINT16_MAX;
+	if(t->ready) {
+		return PLCTAG_STATUS_OK;
+	}
+
+	return tag_status(t);
+}
+
+
+
+static int tag_get_size(plc_tag_p tag)
+{
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	return tag->size;
+}
+
+
+
+/*
+ * tag_attach_buffer
+ *
+ * Swap the caller's buffer in for the tag data.  The library's own
+ * buffer is kept in own_data until the caller's is detached.
+ */
+static int tag_attach_buffer(plc_tag_p tag, uint8_t *buf, int size)
+{
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	if(!buf) {
+		tag_detach_buffer(tag, 1);
+		return PLCTAG_STATUS_OK;
+	}
+
+	if(!tag->data) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	if(size != tag->size) {
+		pdebug(tag->debug, "Buffer is %d bytes, the tag is %d!", size, tag->size);
+		return PLCTAG_ERR_BAD_PARAM;
+	}
+
+	tag_data_write_begin(tag);
+
+	if(buf != tag->data) {
+		mem_copy(buf, tag->data, size);
+
+		if(!tag->own_data) {
+			tag->own_data = tag->data;
+		}
+
+		tag->data = buf;
+	}
+
+	tag_data_write_end(tag);
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+/* give the tag its own buffer back, with the current data if keep_data. */
+static void tag_detach_buffer(plc_tag_p tag, int keep_data)
+{
+	if(!tag->own_data) {
+		return;
+	}
+
+	tag_data_write_begin(tag);
+
+	if(keep_data) {
+		mem_copy(tag->own_data, tag->data, tag->size);
+	}
+
+	tag->data = tag->own_data;
+	tag->own_data = NULL;
+
+	tag_data_write_end(tag);
+}
+
+
+
+/*
+ * tag_view_begin
+ *
+ * Fill in a view for the inline getters in libplctag_view.h.  The
+ * caller holds the handle until tag_view_end.
+ */
+static int tag_view_begin(plc_tag_p tag, plc_tag_view_t *view)
+{
+	int rc;
+
+	rc = tag_get_ready(tag);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	if(!tag->data) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	view->seq = tag_data_read_begin(tag);
+	view->data = tag->data;
+	view->size = tag->size;
+	view->endian = tag->endian;
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+static int tag_view_end(plc_tag_p tag, plc_tag_view_t *view)
+{
+	if(tag_data_read_retry(tag, view->seq)) {
+		return PLCTAG_STATUS_PENDING;
+	}
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+
+static uint32_t tag_get_uint32(plc_tag_p t, int offset)
+{
+	uint32_t res = UINT32_MAX;
+	int32_t seq;
+	int rc;
 
 	/* is there a tag? */
 	if(!t)
 		return res;
 
+	rc = tag_get_ready(t);
+
 	/* is the tag ready for this operation? */
-	if(plc_tag_status(t) != PLCTAG_STATUS_OK && plc_tag_status(t) != PLCTAG_ERR_OUT_OF_BOUNDS) {
+	if(rc != PLCTAG_STATUS_OK) {
 		return res;
 	}
 
 	/* is there data? */
 	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
 		return res;
 	}
 
 	/* is there enough data */
-	if((offset < 0) || (offset + 1 >= t->size)) { /*MAGIC*/
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
+	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
 		return res;
 	}
 
-	/* check whether data is little endian or big endian */
-	if(t->endian == PLCTAG_DATA_LITTLE_ENDIAN) {
-		res = ((uint16_t)(t->data[offset])) +
-		      ((uint16_t)(t->data[offset+1]) << 8);
-	} else {
-		res = ((uint16_t)(t->data[offset+2]) << 8) +
-		      ((uint16_t)(t->data[offset+3]));
-	}
+	/* a read finishing in another thread makes us go around again */
+	do {
+		seq = tag_data_read_begin(t);
 
-	t->status = PLCTAG_STATUS_OK;
+		res = plc_tag_view_load32(&t->data[offset], t->endian);
+	} while(tag_data_read_retry(t, seq));
 
 	return res;
 }
 
 
 
+/*
+ * tag_mark_dirty
+ *
+ * Record that size bytes at offset were changed.  Any ranges the new
+ * one overlaps or comes within TAG_DIRTY_MERGE_GAP of are folded into
+ * it.  The list stays sorted.
+ */
+static void tag_mark_dirty(plc_tag_p t, int offset, int size)
+{
+	int start = offset;
+	int end = offset + size;
+	int i = 0;
+	int j;
+
+	while(i < t->num_dirty) {
+		if(t->dirty[i].start <= end + TAG_DIRTY_MERGE_GAP && start <= t->dirty[i].end + TAG_DIRTY_MERGE_GAP) {
+			if(t->dirty[i].start < start) {
+				start = t->dirty[i].start;
+			}
+
+			if(t->dirty[i].end > end) {
+				end = t->dirty[i].end;
+			}
+
+			for(j = i + 1; j < t->num_dirty; j++) {
+				t->dirty[j - 1] = t->dirty[j];
+			}
+
+			t->num_dirty--;
+		} else {
+			i++;
+		}
+	}
+
+	if(t->num_dirty >= TAG_MAX_DIRTY_RANGES) {
+		/* too scattered to be worth tracking, cover all of it. */
+		if(t->dirty[0].start < start) {
+			start = t->dirty[0].start;
+		}
+
+		if(t->dirty[t->num_dirty - 1].end > end) {
+			end = t->dirty[t->num_dirty - 1].end;
+		}
+
+		t->num_dirty = 0;
+	}
+
+	for(i = t->num_dirty; i > 0 && t->dirty[i - 1].start > start; i--) {
+		t->dirty[i] = t->dirty[i - 1];
+	}
+
+	t->dirty[i].start = start;
+	t->dirty[i].end = end;
+	t->num_dirty++;
+
+	t->bits_only = 0;
+}
+
+
+
+void tag_clear_dirty(plc_tag_p t)
+{
+	if(!t)
+		return;
+
+	t->num_dirty = 0;
+	t->bits_only = 0;
+	mem_set(t->bit_mask, 0, sizeof(t->bit_mask));
+}
+
+
+
+
+static int tag_get_bit(plc_tag_p t, int bit)
+{
+	int offset = bit / 8;
+	int32_t seq;
+	uint8_t byte;
+	int rc;
+
+	/* is there a tag? */
+	if(!t)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_ready(t);
+
+	/* is the tag ready for this operation? */
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	/* is there data? */
+	if(!t->data) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	/* is there enough data */
+	if((bit < 0) || (offset >= t->size)) {
+		return PLCTAG_ERR_OUT_OF_BOUNDS;
+	}
+
+	do {
+		seq = tag_data_read_begin(t);
+		byte = t->data[offset];
+	} while(tag_data_read_retry(t, seq));
+
+	return (byte >> (bit % 8)) & 0x01;
+}
+
+
 
-LIB_EXPORT int plc_tag_set_uint16(plc_tag t, int offset, uint16_t val)
+static int tag_set_bit(plc_tag_p t, int bit, int val)
 {
+	int offset = bit / 8;
+	uint8_t mask = (uint8_t)(1 << (bit % 8));
+	int only_bits;
 	int rc;
 
 	/* is there a tag? */
 	if(!t)
 		return PLCTAG_ERR_NULL_PTR;
 
-	rc = plc_tag_status(t);
+	rc = tag_set_ready(t);
 
 	/* is the tag ready for this operation? */
-	if(rc != PLCTAG_STATUS_OK && rc != PLCTAG_ERR_OUT_OF_BOUNDS) {
+	if(rc != PLCTAG_STATUS_OK) {
 		return rc;
 	}
 
 	/* is there data? */
 	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
 		return PLCTAG_ERR_NULL_PTR;
 	}
 
 	/* is there enough data space to write the value? */
-	if((offset < 0) || (offset + 1 >= t->size)) { /*MAGIC*/
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
+	if((bit < 0) || (offset >= t->size)) {
 		return PLCTAG_ERR_OUT_OF_BOUNDS;
 	}
 
-	/* check whether data is little endian or big endian */
-	if(t->endian == PLCTAG_DATA_LITTLE_ENDIAN) {
-		t->data[offset]   = (uint8_t)(val & 0xFF);
-		t->data[offset+1] = (uint8_t)((val >> 8) & 0xFF);
+	tag_data_write_begin(t);
+
+	if(val) {
+		t->data[offset] |= mask;
 	} else {
-		t->data[offset+1] = (uint8_t)(val & 0xFF);
-		t->data[offset]   = (uint8_t)((val >> 8) & 0xFF);
+		t->data[offset] &= (uint8_t)~mask;
 	}
 
-	t->status = PLCTAG_STATUS_OK;
+	tag_data_write_end(t);
+
+	only_bits = (t->num_dirty == 0 || t->bits_only);
+
+	tag_mark_dirty(t, offset, 1);
+
+	if(only_bits && offset < TAG_MAX_BIT_BYTES) {
+		t->bit_mask[offset] |= mask;
+		t->bits_only = 1;
+	}
 
 	return PLCTAG_STATUS_OK;
 }
 
 
 
+static int tag_set_uint32(plc_tag_p t, int offset, uint32_t val)
+{
+	int rc;
+
+	/* is there a tag? */
+	if(!t)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_ready(t);
+
+	/* is the tag ready for this operation? */
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	/* is there data? */
+	if(!t->data) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	/* is there enough data space to write the value? */
+	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
+		return PLCTAG_ERR_OUT_OF_BOUNDS;
+	}
+
+	tag_data_write_begin(t);
+	plc_tag_view_store32(&t->data[offset], t->endian, val);
+	tag_data_write_end(t);
+
+	tag_mark_dirty(t, offset, 4);
+
+	return PLCTAG_STATUS_OK;
+}
+
 
 
 
@@ -781,87 +1311,78 @@ LIB_EXPORT int plc_tag_set_uint16(plc_tag t, int offset, uint16_t val)
 
 
 
-LIB_EXPORT int16_t  plc_tag_get_int16(plc_tag t, int offset)
+
+static int32_t tag_get_int32(plc_tag_p t, int offset)
 {
-	int16_t res = INT16_MIN;
+	int32_t res = INT32_MIN;
+	int32_t seq;
+	int rc;
 
 	/* is there a tag? */
 	if(!t)
 		return res;
 
+	rc = tag_get_ready(t);
+
 	/* is the tag ready for this operation? */
-	if(plc_tag_status(t) != PLCTAG_STATUS_OK && plc_tag_status(t) != PLCTAG_ERR_OUT_OF_BOUNDS) {
+	if(rc != PLCTAG_STATUS_OK) {
 		return res;
 	}
 
 	/* is there data? */
 	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
 		return res;
 	}
 
 	/* is there enough data */
-	if((offset < 0) || (offset + 1 >= t->size)) { /*MAGIC*/
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
+	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
 		return res;
 	}
 
-	/* check whether data is little endian or big endian */
-	if(t->endian == PLCTAG_DATA_LITTLE_ENDIAN) {
-		res = (int16_t)(((uint16_t)(t->data[offset])) +
-		                ((uint16_t)(t->data[offset+1]) << 8));
-	} else {
-		res = (int16_t)(((uint16_t)(t->data[offset+2]) << 8) +
-		                ((uint16_t)(t->data[offset+3])));
-	}
+	/* a read finishing in another thread makes us go around again */
+	do {
+		seq = tag_data_read_begin(t);
 
-	t->status = PLCTAG_STATUS_OK;
+		res = (int32_t)plc_tag_view_load32(&t->data[offset], t->endian);
+	} while(tag_data_read_retry(t, seq));
 
 	return res;
 }
 
 
 
-
-LIB_EXPORT int plc_tag_set_int16(plc_tag t, int offset, int16_t ival)
+static int tag_set_int32(plc_tag_p t, int offset, int32_t ival)
 {
 	int rc;
 
-	uint16_t val = (uint16_t)ival;
+	uint32_t val = (uint32_t)(ival);
 
 	/* is there a tag? */
 	if(!t)
-		return PLCTAG_ERR_NULL_PTR;
+		return -1;
 
-	rc = plc_tag_status(t);
+	rc = tag_set_ready(t);
 
 	/* is the tag ready for this operation? */
-	if(rc != PLCTAG_STATUS_OK && rc != PLCTAG_ERR_OUT_OF_BOUNDS) {
+	if(rc != PLCTAG_STATUS_OK) {
 		return rc;
 	}
 
 	/* is there data? */
 	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
 		return PLCTAG_ERR_NULL_PTR;
 	}
 
 	/* is there enough data space to write the value? */
-	if((offset < 0) || (offset + 1 >= t->size)) { /*MAGIC*/
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
+	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
 		return PLCTAG_ERR_OUT_OF_BOUNDS;
 	}
 
-	/* check whether data is little endian or big endian */
-	if(t->endian == PLCTAG_DATA_LITTLE_ENDIAN) {
-		t->data[offset]   = (uint8_t)(val & 0xFF);
-		t->data[offset+1] = (uint8_t)((val >> 8) & 0xFF);
-	} else {
-		t->data[offset+1] = (uint8_t)(val & 0xFF);
-		t->data[offset]   = (uint8_t)((val >> 8) & 0xFF);
-	}
+	tag_data_write_begin(t);
+	plc_tag_view_store32(&t->data[offset], t->endian, val);
+	tag_data_write_end(t);
 
-	t->status = PLCTAG_STATUS_OK;
+	tag_mark_dirty(t, offset, 4);
 
 	return PLCTAG_STATUS_OK;
 }
@@ -874,35 +1395,39 @@ LIB_EXPORT int plc_tag_set_int16(plc_tag t, int offset, int16_t ival)
 
 
 
-
-LIB_EXPORT uint8_t  plc_tag_get_uint8(plc_tag t, int offset)
+static uint16_t tag_get_uint16(plc_tag_p t, int offset)
 {
-	uint8_t res = UINT8_MAX;
+	uint16_t res = UINT16_MAX;
+	int32_t seq;
+	int rc;
 
 	/* is there a tag? */
 	if(!t)
 		return res;
 
+	rc = tag_get_ready(t);
+
 	/* is the tag ready for this operation? */
-	if(plc_tag_status(t) != PLCTAG_STATUS_OK && plc_tag_status(t) != PLCTAG_ERR_OUT_OF_BOUNDS) {
+	if(rc != PLCTAG_STATUS_OK) {
 		return res;
 	}
 
 	/* is there data? */
 	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
 		return res;
 	}
 
 	/* is there enough data */
-	if((offset < 0) || (offset >= t->size)) {
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
+	if((offset < 0) || (offset + 1 >= t->size)) { /*MAGIC*/
 		return res;
 	}
 
-	res = t->data[offset];
+	/* a read finishing in another thread makes us go around again */
+	do {
+		seq = tag_data_read_begin(t);
 
-	t->status = PLCTAG_STATUS_OK;
+		res = plc_tag_view_load16(&t->data[offset], t->endian);
+	} while(tag_data_read_retry(t, seq));
 
 	return res;
 }
@@ -910,7 +1435,7 @@ LIB_EXPORT uint8_t  plc_tag_get_uint8(plc_tag t, int offset)
 
 
 
-LIB_EXPORT int plc_tag_set_uint8(plc_tag t, int offset, uint8_t val)
+static int tag_set_uint16(plc_tag_p t, int offset, uint16_t val)
 {
 	int rc;
 
@@ -918,28 +1443,28 @@ LIB_EXPORT int plc_tag_set_uint8(plc_tag t, int offset, uint8_t val)
 	if(!t)
 		return PLCTAG_ERR_NULL_PTR;
 
-	rc = plc_tag_status(t);
+	rc = tag_set_ready(t);
 
 	/* is the tag ready for this operation? */
-	if(rc != PLCTAG_STATUS_OK && rc != PLCTAG_ERR_OUT_OF_BOUNDS) {
+	if(rc != PLCTAG_STATUS_OK) {
 		return rc;
 	}
 
 	/* is there data? */
 	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
 		return PLCTAG_ERR_NULL_PTR;
 	}
 
 	/* is there enough data space to write the value? */
-	if((offset < 0) || (offset >= t->size)) {
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
+	if((offset < 0) || (offset + 1 >= t->size)) { /*MAGIC*/
 		return PLCTAG_ERR_OUT_OF_BOUNDS;
 	}
 
-	t->data[offset] = val;
+	tag_data_write_begin(t);
+	plc_tag_view_store16(&t->data[offset], t->endian, val);
+	tag_data_write_end(t);
 
-	t->status = PLCTAG_STATUS_OK;
+	tag_mark_dirty(t, offset, 2);
 
 	return PLCTAG_STATUS_OK;
 }
@@ -953,35 +1478,39 @@ LIB_EXPORT int plc_tag_set_uint8(plc_tag t, int offset, uint8_t val)
 
 
 
-
-LIB_EXPORT int8_t   plc_tag_get_int8(plc_tag t, int offset)
+static int16_t tag_get_int16(plc_tag_p t, int offset)
 {
-	int8_t res = INT8_MIN;
+	int16_t res = INT16_MIN;
+	int32_t seq;
+	int rc;
 
 	/* is there a tag? */
 	if(!t)
 		return res;
 
+	rc = tag_get_ready(t);
+
 	/* is the tag ready for this operation? */
-	if(plc_tag_status(t) != PLCTAG_STATUS_OK && plc_tag_status(t) != PLCTAG_ERR_OUT_OF_BOUNDS) {
+	if(rc != PLCTAG_STATUS_OK) {
 		return res;
 	}
 
 	/* is there data? */
 	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
 		return res;
 	}
 
 	/* is there enough data */
-	if((offset < 0) || (offset >= t->size)) {
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
+	if((offset < 0) || (offset + 1 >= t->size)) { /*MAGIC*/
 		return res;
 	}
 
-	res = (int8_t)(t->data[offset]);
+	/* a read finishing in another thread makes us go around again */
+	do {
+		seq = tag_data_read_begin(t);
 
-	t->status = PLCTAG_STATUS_OK;
+		res = (int16_t)plc_tag_view_load16(&t->data[offset], t->endian);
+	} while(tag_data_read_retry(t, seq));
 
 	return res;
 }
@@ -989,36 +1518,38 @@ LIB_EXPORT int8_t   plc_tag_get_int8(plc_tag t, int offset)
 
 
 
-LIB_EXPORT int plc_tag_set_int8(plc_tag t, int offset, int8_t val)
+static int tag_set_int16(plc_tag_p t, int offset, int16_t ival)
 {
 	int rc;
 
+	uint16_t val = (uint16_t)ival;
+
 	/* is there a tag? */
 	if(!t)
 		return PLCTAG_ERR_NULL_PTR;
 
-	rc = plc_tag_status(t);
+	rc = tag_set_ready(t);
 
 	/* is the tag ready for this operation? */
-	if(rc != PLCTAG_STATUS_OK && rc != PLCTAG_ERR_OUT_OF_BOUNDS) {
+	if(rc != PLCTAG_STATUS_OK) {
 		return rc;
 	}
 
 	/* is there data? */
 	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
 		return PLCTAG_ERR_NULL_PTR;
 	}
 
 	/* is there enough data space to write the value? */
-	if((offset < 0) || (offset >= t->size)) {
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
+	if((offset < 0) || (offset + 1 >= t->size)) { /*MAGIC*/
 		return PLCTAG_ERR_OUT_OF_BOUNDS;
 	}
 
-	t->data[offset] = (uint8_t)val;
+	tag_data_write_begin(t);
+	plc_tag_view_store16(&t->data[offset], t->endian, val);
+	tag_data_write_end(t);
 
-	t->status = PLCTAG_STATUS_OK;
+	tag_mark_dirty(t, offset, 2);
 
 	return PLCTAG_STATUS_OK;
 }
@@ -1032,107 +1563,1414 @@ LIB_EXPORT int plc_tag_set_int8(plc_tag t, int offset, int8_t val)
 
 
 
-/*
- * FIXME FIXME FIXME
- *
- * This is not portable!
- */
-LIB_EXPORT float plc_tag_get_float32(plc_tag t, int offset)
+static uint8_t tag_get_uint8(plc_tag_p t, int offset)
 {
-	uint32_t ures;
-	float res = FLT_MAX;
+	uint8_t res = UINT8_MAX;
+	int32_t seq;
+	int rc;
 
 	/* is there a tag? */
 	if(!t)
 		return res;
 
+	rc = tag_get_ready(t);
+
 	/* is the tag ready for this operation? */
-	if(plc_tag_status(t) != PLCTAG_STATUS_OK && plc_tag_status(t) != PLCTAG_ERR_OUT_OF_BOUNDS) {
+	if(rc != PLCTAG_STATUS_OK) {
 		return res;
 	}
 
 	/* is there data? */
 	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
 		return res;
 	}
 
 	/* is there enough data */
-	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
+	if((offset < 0) || (offset >= t->size)) {
 		return res;
 	}
 
-	/* check whether data is little endian or big endian */
-	if(t->endian == PLCTAG_DATA_LITTLE_ENDIAN) {
-		ures = ((uint32_t)(t->data[offset])) +
-		       ((uint32_t)(t->data[offset+1]) << 8) +
-		       ((uint32_t)(t->data[offset+2]) << 16) +
-		       ((uint32_t)(t->data[offset+3]) << 24);
-	} else {
-		ures = ((uint32_t)(t->data[offset]) << 24) +
-		       ((uint32_t)(t->data[offset+1]) << 16) +
-		       ((uint32_t)(t->data[offset+2]) << 8) +
-		       ((uint32_t)(t->data[offset+3]));
-	}
+	/* a read finishing in another thread makes us go around again */
+	do {
+		seq = tag_data_read_begin(t);
 
-	t->status = PLCTAG_STATUS_OK;
+		res = t->data[offset];
+	} while(tag_data_read_retry(t, seq));
 
-	/* FIXME - this is not portable! */
-	return *((float *)(&ures));
+	return res;
 }
 
 
 
 
-/*
- * FIXME FIXME FIXME
- *
- * This is not portable!
- */
-LIB_EXPORT int plc_tag_set_float32(plc_tag t, int offset, float fval)
+static int tag_set_uint8(plc_tag_p t, int offset, uint8_t val)
 {
 	int rc;
 
-	uint32_t val = *((uint32_t *)(&fval));
-
 	/* is there a tag? */
 	if(!t)
 		return PLCTAG_ERR_NULL_PTR;
 
-	rc = plc_tag_status(t);
+	rc = tag_set_ready(t);
 
 	/* is the tag ready for this operation? */
-	if(rc != PLCTAG_STATUS_OK && rc != PLCTAG_ERR_OUT_OF_BOUNDS) {
+	if(rc != PLCTAG_STATUS_OK) {
 		return rc;
 	}
 
 	/* is there data? */
 	if(!t->data) {
-		t->status = PLCTAG_ERR_NULL_PTR;
 		return PLCTAG_ERR_NULL_PTR;
 	}
 
 	/* is there enough data space to write the value? */
-	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
-		t->status = PLCTAG_ERR_OUT_OF_BOUNDS;
+	if((offset < 0) || (offset >= t->size)) {
 		return PLCTAG_ERR_OUT_OF_BOUNDS;
 	}
 
-	/* check whether data is little endian or big endian */
-	if(t->endian == PLCTAG_DATA_LITTLE_ENDIAN) {
-		t->data[offset]   = (uint8_t)(val & 0xFF);
-		t->data[offset+1] = (uint8_t)((val >> 8) & 0xFF);
-		t->data[offset+2] = (uint8_t)((val >> 16) & 0xFF);
-		t->data[offset+3] = (uint8_t)((val >> 24) & 0xFF);
-	} else {
-		t->data[offset+3] = (uint8_t)(val & 0xFF);
-		t->data[offset+2] = (uint8_t)((val >> 8) & 0xFF);
-		t->data[offset+1] = (uint8_t)((val >> 16) & 0xFF);
-		t->data[offset]   = (uint8_t)((val >> 24) & 0xFF);
-	}
+	tag_data_write_begin(t);
+	t->data[offset] = val;
+	tag_data_write_end(t);
 
-	t->status = PLCTAG_STATUS_OK;
+	tag_mark_dirty(t, offset, 1);
 
 	return PLCTAG_STATUS_OK;
 }
+
+
+
+
+
+
+
+
+
+
+
+static int8_t tag_get_int8(plc_tag_p t, int offset)
+{
+	int8_t res = INT8_MIN;
+	int32_t seq;
+	int rc;
+
+	/* is there a tag? */
+	if(!t)
+		return res;
+
+	rc = tag_get_ready(t);
+
+	/* is the tag ready for this operation? */
+	if(rc != PLCTAG_STATUS_OK) {
+		return res;
+	}
+
+	/* is there data? */
+	if(!t->data) {
+		return res;
+	}
+
+	/* is there enough data */
+	if((offset < 0) || (offset >= t->size)) {
+		return res;
+	}
+
+	/* a read finishing in another thread makes us go around again */
+	do {
+		seq = tag_data_read_begin(t);
+
+		res = (int8_t)(t->data[offset]);
+	} while(tag_data_read_retry(t, seq));
+
+	return res;
+}
+
+
+
+
+static int tag_set_int8(plc_tag_p t, int offset, int8_t val)
+{
+	int rc;
+
+	/* is there a tag? */
+	if(!t)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_ready(t);
+
+	/* is the tag ready for this operation? */
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	/* is there data? */
+	if(!t->data) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	/* is there enough data space to write the value? */
+	if((offset < 0) || (offset >= t->size)) {
+		return PLCTAG_ERR_OUT_OF_BOUNDS;
+	}
+
+	tag_data_write_begin(t);
+	t->data[offset] = (uint8_t)val;
+	tag_data_write_end(t);
+
+	tag_mark_dirty(t, offset, 1);
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+
+
+
+
+
+
+
+/*
+ * The PLC sends IEEE single precision floats, the same as every
+ * machine we run on.  Copy the bits rather than cast the pointer.
+ */
+static float tag_get_float32(plc_tag_p t, int offset)
+{
+	uint32_t ures;
+	float res = FLT_MAX;
+	int32_t seq;
+	int rc;
+
+	/* is there a tag? */
+	if(!t)
+		return res;
+
+	rc = tag_get_ready(t);
+
+	/* is the tag ready for this operation? */
+	if(rc != PLCTAG_STATUS_OK) {
+		return res;
+	}
+
+	/* is there data? */
+	if(!t->data) {
+		return res;
+	}
+
+	/* is there enough data */
+	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
+		return res;
+	}
+
+	/* a read finishing in another thread makes us go around again */
+	do {
+		seq = tag_data_read_begin(t);
+
+		ures = plc_tag_view_load32(&t->data[offset], t->endian);
+	} while(tag_data_read_retry(t, seq));
+
+	memcpy(&res, &ures, sizeof(res));
+
+	return res;
+}
+
+
+
+
+static int tag_set_float32(plc_tag_p t, int offset, float fval)
+{
+	int rc;
+	uint32_t val;
+
+	memcpy(&val, &fval, sizeof(val));
+
+	/* is there a tag? */
+	if(!t)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_ready(t);
+
+	/* is the tag ready for this operation? */
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	/* is there data? */
+	if(!t->data) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	/* is there enough data space to write the value? */
+	if((offset < 0) || (offset + 3 >= t->size)) { /*MAGIC*/
+		return PLCTAG_ERR_OUT_OF_BOUNDS;
+	}
+
+	tag_data_write_begin(t);
+	plc_tag_view_store32(&t->data[offset], t->endian, val);
+	tag_data_write_end(t);
+
+	tag_mark_dirty(t, offset, 4);
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * tag_check_data
+ *
+ * The checks every accessor makes before touching size bytes of data
+ * at offset.  The bulk accessors make them once for all the elements.
+ */
+static int tag_check_data(plc_tag_p t, int offset, int64_t size, int setting)
+{
+	int rc;
+
+	rc = (setting ? tag_set_ready(t) : tag_get_ready(t));
+
+	/* is the tag ready for this operation? */
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	/* is there data? */
+	if(!t->data) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	/* is there enough data */
+	if((offset < 0) || (size < 0) || ((int64_t)offset + size > t->size)) {
+		return PLCTAG_ERR_OUT_OF_BOUNDS;
+	}
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * 64-bit values.  LINT, ULINT and LREAL are the same eight bytes to
+ * us, the typed accessors only differ in how they see the bits.
+ */
+
+static int tag_get_raw64(plc_tag_p t, int offset, uint64_t *val)
+{
+	int32_t seq;
+	int rc;
+
+	rc = tag_check_data(t, offset, 8, 0);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	/* a read finishing in another thread makes us go around again */
+	do {
+		seq = tag_data_read_begin(t);
+
+		*val = plc_tag_view_load64(&t->data[offset], t->endian);
+	} while(tag_data_read_retry(t, seq));
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+static int tag_set_raw64(plc_tag_p t, int offset, uint64_t val)
+{
+	int rc;
+
+	rc = tag_check_data(t, offset, 8, 1);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	tag_data_write_begin(t);
+	plc_tag_view_store64(&t->data[offset], t->endian, val);
+	tag_data_write_end(t);
+
+	tag_mark_dirty(t, offset, 8);
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * swap count 64-bit values in place.  Written as a plain loop over
+ * independent elements so that the compiler can do several at a time.
+ */
+static void swap64(uint8_t *buf, int count)
+{
+	uint64_t v;
+	int i;
+
+	for(i=0; i < count; i++) {
+		memcpy(&v, buf + (i * 8), sizeof(v));
+		v = PLCTAG_VIEW_BSWAP64(v);
+		memcpy(buf + (i * 8), &v, sizeof(v));
+	}
+}
+
+
+
+static int tag_get_array64(plc_tag_p t, int offset, uint8_t *vals, int count)
+{
+	int32_t seq;
+	int rc;
+
+	if(!vals)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_check_data(t, offset, (int64_t)count * 8, 0);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	do {
+		seq = tag_data_read_begin(t);
+
+		mem_copy(vals, &t->data[offset], count * 8);
+	} while(tag_data_read_retry(t, seq));
+
+	/* the copy is ours now, fix the byte order outside the loop. */
+	if(t->endian != PLCTAG_VIEW_HOST_ENDIAN) {
+		swap64(vals, count);
+	}
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+static int tag_set_array64(plc_tag_p t, int offset, const uint8_t *vals, int count)
+{
+	int rc;
+
+	if(!vals)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_check_data(t, offset, (int64_t)count * 8, 1);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	if(count == 0) {
+		return PLCTAG_STATUS_OK;
+	}
+
+	tag_data_write_begin(t);
+
+	mem_copy(&t->data[offset], (void *)vals, count * 8);
+
+	if(t->endian != PLCTAG_VIEW_HOST_ENDIAN) {
+		swap64(&t->data[offset], count);
+	}
+
+	tag_data_write_end(t);
+
+	tag_mark_dirty(t, offset, count * 8);
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+static uint64_t tag_get_uint64(plc_tag_p t, int offset)
+{
+	uint64_t res;
+
+	if(tag_get_raw64(t, offset, &res) != PLCTAG_STATUS_OK) {
+		return UINT64_MAX;
+	}
+
+	return res;
+}
+
+
+
+static int64_t tag_get_int64(plc_tag_p t, int offset)
+{
+	uint64_t res;
+
+	if(tag_get_raw64(t, offset, &res) != PLCTAG_STATUS_OK) {
+		return INT64_MIN;
+	}
+
+	return (int64_t)res;
+}
+
+
+
+static double tag_get_float64(plc_tag_p t, int offset)
+{
+	uint64_t ures;
+	double res;
+
+	if(tag_get_raw64(t, offset, &ures) != PLCTAG_STATUS_OK) {
+		return DBL_MAX;
+	}
+
+	memcpy(&res, &ures, sizeof(res));
+
+	return res;
+}
+
+
+
+static int tag_set_float64(plc_tag_p t, int offset, double fval)
+{
+	uint64_t val;
+
+	memcpy(&val, &fval, sizeof(val));
+
+	return tag_set_raw64(t, offset, val);
+}
+
+
+
+/*
+ * Logix STRING.  The length is checked against what the PLC can hold
+ * so that a bad offset shows up as an error rather than a long copy.
+ */
+
+static int tag_decode_string(plc_tag_p t, int offset, char *buf, int buf_size)
+{
+	int32_t len;
+
+	len = (int32_t)plc_tag_view_load32(&t->data[offset], t->endian);
+
+	if(len < 0 || len > PLCTAG_STRING_MAX_CHARS) {
+		return PLCTAG_ERR_BAD_DATA;
+	}
+
+	if(len >= buf_size) {
+		return PLCTAG_ERR_TOO_LONG;
+	}
+
+	memcpy(buf, &t->data[offset + 4], (size_t)len);
+	buf[len] = 0;
+
+	return (int)len;
+}
+
+
+
+static int tag_get_string(plc_tag_p t, int offset, char *buf, int buf_size)
+{
+	int32_t seq;
+	int rc;
+
+	if(!buf)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_check_data(t, offset, PLCTAG_STRING_SIZE, 0);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	do {
+		seq = tag_data_read_begin(t);
+
+		rc = tag_decode_string(t, offset, buf, buf_size);
+	} while(tag_data_read_retry(t, seq));
+
+	return rc;
+}
+
+
+
+static int tag_get_string_array(plc_tag_p t, int offset, char *buf, int buf_stride, int count)
+{
+	int32_t seq;
+	int rc;
+	int i;
+
+	if(!buf)
+		return PLCTAG_ERR_NULL_PTR;
+
+	if(buf_stride <= 0) {
+		return PLCTAG_ERR_BAD_PARAM;
+	}
+
+	rc = tag_check_data(t, offset, (int64_t)count * PLCTAG_STRING_SIZE, 0);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	do {
+		seq = tag_data_read_begin(t);
+
+		rc = PLCTAG_STATUS_OK;
+
+		for(i=0; i < count && rc >= 0; i++) {
+			rc = tag_decode_string(t, offset + (i * PLCTAG_STRING_SIZE), buf + (i * buf_stride), buf_stride);
+		}
+	} while(tag_data_read_retry(t, seq));
+
+	if(rc < 0) {
+		return rc;
+	}
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * Only the length and the characters are changed, so only they are
+ * marked dirty.  What is left past the length does not matter to the
+ * PLC.
+ */
+static int tag_set_string_array(plc_tag_p t, int offset, const char * const *strs, int count)
+{
+	int last = 0;
+	int len;
+	int rc;
+	int i;
+
+	if(!strs)
+		return PLCTAG_ERR_NULL_PTR;
+
+	/* all or nothing */
+	for(i=0; i < count; i++) {
+		if(!strs[i])
+			return PLCTAG_ERR_NULL_PTR;
+
+		if(strlen(strs[i]) > PLCTAG_STRING_MAX_CHARS) {
+			return PLCTAG_ERR_TOO_LONG;
+		}
+	}
+
+	rc = tag_check_data(t, offset, (int64_t)count * PLCTAG_STRING_SIZE, 1);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		return rc;
+	}
+
+	if(count == 0) {
+		return PLCTAG_STATUS_OK;
+	}
+
+	tag_data_write_begin(t);
+
+	for(i=0; i < count; i++) {
+		len = (int)strlen(strs[i]);
+
+		plc_tag_view_store32(&t->data[offset + (i * PLCTAG_STRING_SIZE)], t->endian, (uint32_t)len);
+		memcpy(&t->data[offset + (i * PLCTAG_STRING_SIZE) + 4], strs[i], (size_t)len);
+
+		last = len;
+	}
+
+	tag_data_write_end(t);
+
+	tag_mark_dirty(t, offset, ((count - 1) * PLCTAG_STRING_SIZE) + 4 + last);
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+static int tag_set_string(plc_tag_p t, int offset, const char *str)
+{
+	return tag_set_string_array(t, offset, &str, 1);
+}
+
+
+
+/**************************************************************************
+ ***************************  API Functions  ******************************
+ **************************************************************************/
+
+/*
+ * Everything below takes a tag handle.  The handle is looked up and
+ * held for the length of the call so that plc_tag_destroy() in another
+ * thread waits for us instead of freeing the tag out from under us.
+ */
+
+/*
+ * The lock keeps its handle reference until plc_tag_unlock() so that a
+ * destroy waits for the unlock rather than for a mutex it cannot get.
+ */
+LIB_EXPORT int plc_tag_lock(plc_tag handle)
+{
+	plc_tag_p tag;
+	int rc;
+
+	rc = handle_pin(handle, (void **)&tag);
+
+	if(rc != PLCTAG_STATUS_OK)
+		return (rc == PLCTAG_ERR_NOT_FOUND ? PLCTAG_ERR_NULL_PTR : rc);
+
+	rc = tag_lock(tag);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		handle_unpin(handle);
+	}
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_unlock(plc_tag handle)
+{
+	/* the handle may already be retired by a destroy waiting on us. */
+	plc_tag_p tag = (plc_tag_p)handle_held(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_unlock(tag);
+
+	handle_unpin(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_abort(plc_tag handle)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_abort(tag);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_read(plc_tag handle, int timeout)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_read(tag, timeout);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_status(plc_tag handle)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_status(tag);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_write(plc_tag handle, int timeout)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_write(tag, timeout);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_stats(plc_tag handle, plc_tag_stats_t *stats)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_stats(tag, stats);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_last_timing(plc_tag handle, plc_tag_timing_t *timing)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_last_timing(tag, timing);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_age_ms(plc_tag handle)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_age_ms(tag);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_session_stats(plc_tag handle, plc_tag_stats_t *stats)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_session_stats(tag, stats);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_size(plc_tag handle)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_size(tag);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+/*
+ * A getter in another thread may still be reading the caller's old
+ * buffer.  Once the tag has let go of it, wait for the calls in other
+ * threads to finish before the caller gets to free it.
+ */
+LIB_EXPORT int plc_tag_attach_buffer(plc_tag handle, uint8_t *buf, int size)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int had_buffer;
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	had_buffer = (tag->own_data != NULL);
+
+	rc = tag_attach_buffer(tag, buf, size);
+
+	if(rc == PLCTAG_STATUS_OK && had_buffer) {
+		handle_wait_others(handle);
+	}
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+/*
+ * The handle reference taken here is kept for the life of the view and
+ * dropped by plc_tag_view_end(), as with plc_tag_lock().
+ */
+LIB_EXPORT int plc_tag_view_begin(plc_tag handle, plc_tag_view_t *view)
+{
+	plc_tag_p tag;
+	int rc;
+
+	if(!view)
+		return PLCTAG_ERR_NULL_PTR;
+
+	mem_set(view, 0, sizeof(*view));
+
+	rc = handle_pin(handle, (void **)&tag);
+
+	if(rc != PLCTAG_STATUS_OK)
+		return (rc == PLCTAG_ERR_NOT_FOUND ? PLCTAG_ERR_NULL_PTR : rc);
+
+	rc = tag_view_begin(tag, view);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		handle_unpin(handle);
+		return rc;
+	}
+
+	view->tag = handle;
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_view_end(plc_tag_view_t *view)
+{
+	plc_tag_p tag;
+	int rc;
+
+	if(!view || !view->data)
+		return PLCTAG_ERR_NULL_PTR;
+
+	/* the handle may already be retired by a destroy waiting on us. */
+	tag = (plc_tag_p)handle_held(view->tag);
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_view_end(tag, view);
+
+	view->data = NULL;
+	view->size = 0;
+
+	handle_unpin(view->tag);
+
+	return rc;
+}
+
+
+LIB_EXPORT uint32_t plc_tag_get_uint32(plc_tag handle, int offset)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	uint32_t res;
+
+	if(!tag)
+		return UINT32_MAX;
+
+	res = tag_get_uint32(tag, offset);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_uint32(plc_tag handle, int offset, uint32_t val)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_uint32(tag, offset, val);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int32_t plc_tag_get_int32(plc_tag handle, int offset)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int32_t res;
+
+	if(!tag)
+		return INT32_MIN;
+
+	res = tag_get_int32(tag, offset);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_int32(plc_tag handle, int offset, int32_t ival)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_int32(tag, offset, ival);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT uint16_t plc_tag_get_uint16(plc_tag handle, int offset)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	uint16_t res;
+
+	if(!tag)
+		return UINT16_MAX;
+
+	res = tag_get_uint16(tag, offset);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_uint16(plc_tag handle, int offset, uint16_t val)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_uint16(tag, offset, val);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int16_t plc_tag_get_int16(plc_tag handle, int offset)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int16_t res;
+
+	if(!tag)
+		return INT16_MIN;
+
+	res = tag_get_int16(tag, offset);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_int16(plc_tag handle, int offset, int16_t ival)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_int16(tag, offset, ival);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT uint8_t plc_tag_get_uint8(plc_tag handle, int offset)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	uint8_t res;
+
+	if(!tag)
+		return UINT8_MAX;
+
+	res = tag_get_uint8(tag, offset);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_uint8(plc_tag handle, int offset, uint8_t val)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_uint8(tag, offset, val);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_bit(plc_tag handle, int bit)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int res;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	res = tag_get_bit(tag, bit);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_bit(plc_tag handle, int bit, int val)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_bit(tag, bit, val);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int8_t plc_tag_get_int8(plc_tag handle, int offset)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int8_t res;
+
+	if(!tag)
+		return INT8_MIN;
+
+	res = tag_get_int8(tag, offset);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_int8(plc_tag handle, int offset, int8_t val)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_int8(tag, offset, val);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT float plc_tag_get_float32(plc_tag handle, int offset)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	float res;
+
+	if(!tag)
+		return FLT_MAX;
+
+	res = tag_get_float32(tag, offset);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_float32(plc_tag handle, int offset, float fval)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_float32(tag, offset, fval);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT uint64_t plc_tag_get_uint64(plc_tag handle, int offset)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	uint64_t res;
+
+	if(!tag)
+		return UINT64_MAX;
+
+	res = tag_get_uint64(tag, offset);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_uint64(plc_tag handle, int offset, uint64_t val)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_raw64(tag, offset, (uint64_t)val);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int64_t plc_tag_get_int64(plc_tag handle, int offset)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int64_t res;
+
+	if(!tag)
+		return INT64_MIN;
+
+	res = tag_get_int64(tag, offset);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_int64(plc_tag handle, int offset, int64_t val)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_raw64(tag, offset, (uint64_t)val);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT double plc_tag_get_float64(plc_tag handle, int offset)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	double res;
+
+	if(!tag)
+		return DBL_MAX;
+
+	res = tag_get_float64(tag, offset);
+
+	handle_release(handle);
+
+	return res;
+}
+
+
+LIB_EXPORT int plc_tag_set_float64(plc_tag handle, int offset, double val)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_float64(tag, offset, val);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_uint64_array(plc_tag handle, int offset, uint64_t *vals, int count)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_array64(tag, offset, (uint8_t *)vals, count);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_set_uint64_array(plc_tag handle, int offset, const uint64_t *vals, int count)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_array64(tag, offset, (const uint8_t *)vals, count);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_int64_array(plc_tag handle, int offset, int64_t *vals, int count)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_array64(tag, offset, (uint8_t *)vals, count);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_set_int64_array(plc_tag handle, int offset, const int64_t *vals, int count)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_array64(tag, offset, (const uint8_t *)vals, count);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_float64_array(plc_tag handle, int offset, double *vals, int count)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_array64(tag, offset, (uint8_t *)vals, count);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_set_float64_array(plc_tag handle, int offset, const double *vals, int count)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_array64(tag, offset, (const uint8_t *)vals, count);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_string(plc_tag handle, int offset, char *buf, int buf_size)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_string(tag, offset, buf, buf_size);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_set_string(plc_tag handle, int offset, const char *str)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_string(tag, offset, str);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_get_string_array(plc_tag handle, int offset, char *buf, int buf_stride, int count)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_get_string_array(tag, offset, buf, buf_stride, count);
+
+	handle_release(handle);
+
+	return rc;
+}
+
+
+LIB_EXPORT int plc_tag_set_string_array(plc_tag handle, int offset, const char * const *strs, int count)
+{
+	plc_tag_p tag = (plc_tag_p)handle_acquire(handle);
+	int rc;
+
+	if(!tag)
+		return PLCTAG_ERR_NULL_PTR;
+
+	rc = tag_set_string_array(tag, offset, strs, count);
+
+	handle_release(handle);
+
+	return rc;
+}
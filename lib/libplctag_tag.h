@@ -35,6 +35,7 @@
 #include "libplctag.h"
 #include <platform.h>
 #include <util/attr.h>
+#include <util/share.h>
 
 #define PLCTAG_CANARY (0xACA7CAFE)
 #define PLCTAG_DATA_LITTLE_ENDIAN	(0)
@@ -64,47 +65,120 @@
 
 
 
+/* the API hands out handles, internally we use the tag itself. */
+typedef struct plc_tag_t *plc_tag_p;
+
 /* define tag operation functions */
-typedef int (*tag_abort_func)(plc_tag tag);
-typedef int (*tag_destroy_func)(plc_tag tag);
-typedef int (*tag_read_func)(plc_tag);
-typedef int (*tag_status_func)(plc_tag);
-typedef int (*tag_write_func)(plc_tag tag);
+typedef int (*tag_abort_func)(plc_tag_p tag);
+typedef int (*tag_destroy_func)(plc_tag_p tag);
+typedef int (*tag_destroy_many_func)(plc_tag_p *tags, int count);
+typedef int (*tag_read_func)(plc_tag_p);
+typedef int (*tag_status_func)(plc_tag_p);
+typedef int (*tag_write_func)(plc_tag_p tag);
+typedef int (*tag_stats_func)(plc_tag_p tag, plc_tag_stats_t *stats);
 
 /* we'll need to set these per protocol type. */
 struct tag_vtable_t {
 	tag_abort_func 			abort;
 	tag_destroy_func 		destroy;
+	tag_destroy_many_func	destroy_many;	/* tags sharing it, NULLs skipped, may be NULL */
 	tag_read_func			read;
 	tag_status_func 		status;
 	tag_write_func 			write;
+	tag_stats_func			stats;			/* fills in the gauges, may be NULL */
+	tag_stats_func			session_stats;	/* may be NULL */
 };
 
 typedef struct tag_vtable_t *tag_vtable_p;
 
 
+/*
+ * Byte ranges, [start, end), changed by the plc_tag_set_* calls since
+ * the last write.  Ranges closer than TAG_DIRTY_MERGE_GAP bytes are
+ * merged.  If there would be more than TAG_MAX_DIRTY_RANGES, they all
+ * collapse into one.  Protocols that can write part of a tag use them
+ * and clear num_dirty when the write starts.
+ */
+#define TAG_MAX_DIRTY_RANGES	(8)
+#define TAG_DIRTY_MERGE_GAP		(64)
+
+typedef struct {
+	int start;
+	int end;
+} tag_range_t;
+
+
+/*
+ * Bits changed by plc_tag_set_bit.  bits_only stays set while every
+ * change since the last write was a bit in the first TAG_MAX_BIT_BYTES
+ * bytes; bit_mask then holds those bits and the protocol may send a
+ * read-modify-write instead of the data.  Any other setter clears it.
+ */
+#define TAG_MAX_BIT_BYTES		(8)
+
+
 /*
  * The base definition of the tag structure.  This is used
  * by the protocol-specific implementations.
  *
  * The base type only has a vtable for operations.
+ *
+ * ready is set when the protocol last reported the tag OK with no IO
+ * under way.  The data accessors trust it rather than asking again.
  */
 
 #define TAG_BASE_STRUCT tag_vtable_p vtable; \
 						mutex_p mut; \
 						int status; \
+						int ready; \
 						int endian; \
 						int debug; \
 						uint64_t read_cache_expire; \
 						uint64_t read_cache_ms; \
+						int read_cache_stale; \
+						int refreshing; \
+						int64_t read_start_ms; \
+						int64_t data_ms; \
+						share_p share; \
 						int size; \
-						uint8_t *data
+						uint8_t *data; \
+						uint8_t *own_data; \
+						volatile int32_t data_seq; \
+						int num_dirty; \
+						tag_range_t dirty[TAG_MAX_DIRTY_RANGES]; \
+						int bits_only; \
+						uint8_t bit_mask[TAG_MAX_BIT_BYTES]; \
+						plc_tag_stats_t stats; \
+						plc_tag_timing_t timing
 
 struct plc_tag_t {
 	TAG_BASE_STRUCT;
 };
 
 
+/* for protocol code that needs the generic operations on its own tags */
+extern int tag_abort(plc_tag_p tag);
+
+/* forget the changed ranges and bits once a write has succeeded */
+extern void tag_clear_dirty(plc_tag_p tag);
+
+/*
+ * The tag data is published through a sequence count (a seqlock).
+ * Anything that changes tag->data after creation brackets the change
+ * with tag_data_write_begin() and tag_data_write_end(); writers exclude
+ * each other, so do not nest them.  Readers take no lock:
+ *
+ *     do {
+ *         seq = tag_data_read_begin(tag);
+ *         ... copy out of tag->data ...
+ *     } while(tag_data_read_retry(tag, seq));
+ */
+extern void tag_data_write_begin(plc_tag_p tag);
+extern void tag_data_write_end(plc_tag_p tag);
+extern int32_t tag_data_read_begin(plc_tag_p tag);
+extern int tag_data_read_retry(plc_tag_p tag, int32_t seq);
+
+
 
 
 
@@ -0,0 +1,338 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * Inline access to tag data.
+ *
+ * Each plc_tag_get_* call looks up the handle, checks the tag and
+ * bounds, and takes the data lock, for one value.  In a loop over an
+ * array that is most of the time spent.  A view does the checking once
+ * and then the getters below are plain loads that the compiler can
+ * inline into the loop:
+ *
+ *     plc_tag_view_t view;
+ *
+ *     do {
+ *         if(plc_tag_view_begin(tag, &view) != PLCTAG_STATUS_OK) {
+ *             ... not ready or error ...
+ *         }
+ *
+ *         for(i=0; i < view.size/4; i++) {
+ *             sum += plc_tag_view_get_int32(&view, i*4);
+ *         }
+ *     } while(plc_tag_view_end(&view) == PLCTAG_STATUS_PENDING);
+ *
+ * Views are read only.  Change the data with plc_tag_set_* so that
+ * the next write knows what changed.
+ */
+
+
+#ifndef __LIBPLCTAG_VIEW_H__
+#define __LIBPLCTAG_VIEW_H__
+
+
+#include <string.h>
+#include "libplctag.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#if defined(_MSC_VER) && !defined(__cplusplus)
+	#define PLC_TAG_INLINE static __inline
+#else
+	#define PLC_TAG_INLINE static inline
+#endif
+
+
+/* byte order of the tag data, the same values the library uses. */
+#define PLCTAG_VIEW_LITTLE_ENDIAN	(0)
+#define PLCTAG_VIEW_BIG_ENDIAN		(1)
+
+/* byte order of this machine, fixed when the caller is compiled. */
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	#define PLCTAG_VIEW_HOST_ENDIAN		PLCTAG_VIEW_BIG_ENDIAN
+#else
+	#define PLCTAG_VIEW_HOST_ENDIAN		PLCTAG_VIEW_LITTLE_ENDIAN
+#endif
+
+#if defined(__GNUC__)
+	#define PLCTAG_VIEW_BSWAP16(v)	__builtin_bswap16(v)
+	#define PLCTAG_VIEW_BSWAP32(v)	__builtin_bswap32(v)
+	#define PLCTAG_VIEW_BSWAP64(v)	__builtin_bswap64(v)
+#elif defined(_MSC_VER)
+	#include <stdlib.h>
+	#define PLCTAG_VIEW_BSWAP16(v)	_byteswap_ushort(v)
+	#define PLCTAG_VIEW_BSWAP32(v)	_byteswap_ulong(v)
+	#define PLCTAG_VIEW_BSWAP64(v)	_byteswap_uint64(v)
+#else
+	#define PLCTAG_VIEW_BSWAP16(v)	((uint16_t)(((uint16_t)(v) << 8) | ((uint16_t)(v) >> 8)))
+	#define PLCTAG_VIEW_BSWAP32(v)	((((uint32_t)(v) & 0x000000FF) << 24) | \
+									 (((uint32_t)(v) & 0x0000FF00) << 8)  | \
+									 (((uint32_t)(v) & 0x00FF0000) >> 8)  | \
+									 (((uint32_t)(v) & 0xFF000000) >> 24))
+	#define PLCTAG_VIEW_BSWAP64(v)	(((uint64_t)PLCTAG_VIEW_BSWAP32((uint32_t)(v)) << 32) | \
+									 (uint64_t)PLCTAG_VIEW_BSWAP32((uint32_t)((uint64_t)(v) >> 32)))
+#endif
+
+
+	/*
+	 * Unaligned loads and stores in the given byte order.  The memcpy
+	 * becomes a single move on machines that allow unaligned access,
+	 * and the swap drops out when the order matches this machine.
+	 */
+
+	PLC_TAG_INLINE uint16_t plc_tag_view_load16(const uint8_t *p, int endian)
+	{
+		uint16_t v;
+
+		memcpy(&v, p, sizeof(v));
+
+		return (endian == PLCTAG_VIEW_HOST_ENDIAN) ? v : (uint16_t)PLCTAG_VIEW_BSWAP16(v);
+	}
+
+	PLC_TAG_INLINE uint32_t plc_tag_view_load32(const uint8_t *p, int endian)
+	{
+		uint32_t v;
+
+		memcpy(&v, p, sizeof(v));
+
+		return (endian == PLCTAG_VIEW_HOST_ENDIAN) ? v : (uint32_t)PLCTAG_VIEW_BSWAP32(v);
+	}
+
+	PLC_TAG_INLINE uint64_t plc_tag_view_load64(const uint8_t *p, int endian)
+	{
+		uint64_t v;
+
+		memcpy(&v, p, sizeof(v));
+
+		return (endian == PLCTAG_VIEW_HOST_ENDIAN) ? v : (uint64_t)PLCTAG_VIEW_BSWAP64(v);
+	}
+
+	PLC_TAG_INLINE void plc_tag_view_store16(uint8_t *p, int endian, uint16_t v)
+	{
+		if(endian != PLCTAG_VIEW_HOST_ENDIAN) {
+			v = (uint16_t)PLCTAG_VIEW_BSWAP16(v);
+		}
+
+		memcpy(p, &v, sizeof(v));
+	}
+
+	PLC_TAG_INLINE void plc_tag_view_store32(uint8_t *p, int endian, uint32_t v)
+	{
+		if(endian != PLCTAG_VIEW_HOST_ENDIAN) {
+			v = (uint32_t)PLCTAG_VIEW_BSWAP32(v);
+		}
+
+		memcpy(p, &v, sizeof(v));
+	}
+
+	PLC_TAG_INLINE void plc_tag_view_store64(uint8_t *p, int endian, uint64_t v)
+	{
+		if(endian != PLCTAG_VIEW_HOST_ENDIAN) {
+			v = (uint64_t)PLCTAG_VIEW_BSWAP64(v);
+		}
+
+		memcpy(p, &v, sizeof(v));
+	}
+
+
+
+	typedef struct {
+		plc_tag tag;
+		const uint8_t *data;
+		int size;
+		int endian;
+		int32_t seq;
+	} plc_tag_view_t;
+
+
+	/*
+	 * plc_tag_view_begin
+	 *
+	 * Check the tag once and fill in the view.  It returns
+	 * PLCTAG_STATUS_OK, or the tag status if the tag has no data yet.
+	 * On success the tag cannot be destroyed until plc_tag_view_end.
+	 *
+	 * plc_tag_view_end
+	 *
+	 * Let the tag go.  If a read or a plc_tag_set_* changed the data
+	 * while the view was open, the values taken from it may be mixed
+	 * and PLCTAG_STATUS_PENDING is returned; begin again to get a
+	 * consistent set.
+	 *
+	 * End a view in the thread that began it.  That thread cannot destroy
+	 * the tag while the view is open.
+	 */
+	LIB_EXPORT int plc_tag_view_begin(plc_tag tag, plc_tag_view_t *view);
+	LIB_EXPORT int plc_tag_view_end(plc_tag_view_t *view);
+
+
+	/*
+	 * The getters return the same values as the plc_tag_get_* calls
+	 * when the offset is out of range.
+	 */
+
+	PLC_TAG_INLINE uint64_t plc_tag_view_get_uint64(const plc_tag_view_t *view, int offset)
+	{
+		if(offset < 0 || offset + 8 > view->size) {
+			return UINT64_MAX;
+		}
+
+		return plc_tag_view_load64(view->data + offset, view->endian);
+	}
+
+	PLC_TAG_INLINE int64_t plc_tag_view_get_int64(const plc_tag_view_t *view, int offset)
+	{
+		if(offset < 0 || offset + 8 > view->size) {
+			return INT64_MIN;
+		}
+
+		return (int64_t)plc_tag_view_load64(view->data + offset, view->endian);
+	}
+
+	PLC_TAG_INLINE uint32_t plc_tag_view_get_uint32(const plc_tag_view_t *view, int offset)
+	{
+		if(offset < 0 || offset + 4 > view->size) {
+			return UINT32_MAX;
+		}
+
+		return plc_tag_view_load32(view->data + offset, view->endian);
+	}
+
+	PLC_TAG_INLINE int32_t plc_tag_view_get_int32(const plc_tag_view_t *view, int offset)
+	{
+		if(offset < 0 || offset + 4 > view->size) {
+			return INT32_MIN;
+		}
+
+		return (int32_t)plc_tag_view_load32(view->data + offset, view->endian);
+	}
+
+	PLC_TAG_INLINE uint16_t plc_tag_view_get_uint16(const plc_tag_view_t *view, int offset)
+	{
+		if(offset < 0 || offset + 2 > view->size) {
+			return UINT16_MAX;
+		}
+
+		return plc_tag_view_load16(view->data + offset, view->endian);
+	}
+
+	PLC_TAG_INLINE int16_t plc_tag_view_get_int16(const plc_tag_view_t *view, int offset)
+	{
+		if(offset < 0 || offset + 2 > view->size) {
+			return INT16_MIN;
+		}
+
+		return (int16_t)plc_tag_view_load16(view->data + offset, view->endian);
+	}
+
+	PLC_TAG_INLINE uint8_t plc_tag_view_get_uint8(const plc_tag_view_t *view, int offset)
+	{
+		if(offset < 0 || offset >= view->size) {
+			return UINT8_MAX;
+		}
+
+		return view->data[offset];
+	}
+
+	PLC_TAG_INLINE int8_t plc_tag_view_get_int8(const plc_tag_view_t *view, int offset)
+	{
+		if(offset < 0 || offset >= view->size) {
+			return INT8_MIN;
+		}
+
+		return (int8_t)view->data[offset];
+	}
+
+	PLC_TAG_INLINE int plc_tag_view_get_bit(const plc_tag_view_t *view, int bit)
+	{
+		if(bit < 0 || bit / 8 >= view->size) {
+			return PLCTAG_ERR_OUT_OF_BOUNDS;
+		}
+
+		return (view->data[bit / 8] >> (bit % 8)) & 0x01;
+	}
+
+	PLC_TAG_INLINE float plc_tag_view_get_float32(const plc_tag_view_t *view, int offset)
+	{
+		uint32_t v;
+		float res;
+
+		if(offset < 0 || offset + 4 > view->size) {
+			return 3.402823466e+38F; /* FLT_MAX */
+		}
+
+		v = plc_tag_view_load32(view->data + offset, view->endian);
+		memcpy(&res, &v, sizeof(res));
+
+		return res;
+	}
+
+	PLC_TAG_INLINE double plc_tag_view_get_float64(const plc_tag_view_t *view, int offset)
+	{
+		uint64_t v;
+		double res;
+
+		if(offset < 0 || offset + 8 > view->size) {
+			return 1.7976931348623158e+308; /* DBL_MAX */
+		}
+
+		v = plc_tag_view_load64(view->data + offset, view->endian);
+		memcpy(&res, &v, sizeof(res));
+
+		return res;
+	}
+
+	/* a Logix STRING, as plc_tag_get_string */
+	PLC_TAG_INLINE int plc_tag_view_get_string(const plc_tag_view_t *view, int offset, char *buf, int buf_size)
+	{
+		int32_t len;
+
+		if(offset < 0 || offset + PLCTAG_STRING_SIZE > view->size) {
+			return PLCTAG_ERR_OUT_OF_BOUNDS;
+		}
+
+		len = (int32_t)plc_tag_view_load32(view->data + offset, view->endian);
+
+		if(len < 0 || len > PLCTAG_STRING_MAX_CHARS) {
+			return PLCTAG_ERR_BAD_DATA;
+		}
+
+		if(!buf || len >= buf_size) {
+			return PLCTAG_ERR_TOO_LONG;
+		}
+
+		memcpy(buf, view->data + offset + 4, (size_t)len);
+		buf[len] = 0;
+
+		return (int)len;
+	}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+
+/*end of header */
+#endif
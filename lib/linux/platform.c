@@ -42,6 +42,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
@@ -550,6 +551,61 @@ extern int thread_destroy(thread_p *t)
 
 
 
+/*
+ * thread_key_create()
+ *
+ * Make a key for a per-thread value.  When a thread that has set a
+ * non-NULL value exits, the destructor is called with that value.
+ * Keys are never destroyed.
+ */
+
+struct thread_key_t {
+	pthread_key_t key;
+};
+
+extern int thread_key_create(thread_key_p *key, void (*destructor)(void *value))
+{
+	if(!key) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	*key = (thread_key_p)mem_alloc(sizeof(struct thread_key_t));
+
+	if(! *key) {
+		return PLCTAG_ERR_NO_MEM;
+	}
+
+	if(pthread_key_create(&((*key)->key), destructor)) {
+		mem_free(*key);
+		*key = NULL;
+		return PLCTAG_ERR_CREATE;
+	}
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+/*
+ * thread_key_set()
+ *
+ * Set the calling thread's value for the key.
+ */
+
+extern int thread_key_set(thread_key_p key, void *value)
+{
+	if(!key) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	if(pthread_setspecific(key->key, value)) {
+		return PLCTAG_ERR_SET;
+	}
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
 
 
 
@@ -600,6 +656,11 @@ struct sock_t {
 	int fd;
 	int port;
 	int is_open;
+
+	/* tuning, see socket_set_profile() */
+	int profile;
+	int busy_poll_us;
+	int buf_size;
 };
 
 
@@ -621,6 +682,93 @@ extern int socket_create(sock_p *s)
 		return PLCTAG_ERR_NO_MEM;
 	}
 
+	/* nothing open yet, keep socket_destroy() from closing a random fd. */
+	(*s)->fd = -1;
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+/*
+ * socket_set_profile
+ *
+ * Select the tuning profile for the socket.  This must be called before
+ * socket_connect_tcp() because buffer sizes need to be in place before
+ * the TCP window is negotiated.
+ *
+ * SOCKET_PROFILE_LOW_LATENCY turns off Nagle and delayed ACKs and, if
+ * busy_poll_us is non-zero, busy polls the device queue on reads.  A
+ * buf_size of zero leaves the kernel's buffer sizing alone.
+ */
+
+extern int socket_set_profile(sock_p s, int profile, int busy_poll_us, int buf_size)
+{
+	if(!s) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	if(profile != SOCKET_PROFILE_DEFAULT && profile != SOCKET_PROFILE_LOW_LATENCY) {
+		return PLCTAG_ERR_BAD_PARAM;
+	}
+
+	if(busy_poll_us < 0 || buf_size < 0) {
+		return PLCTAG_ERR_BAD_PARAM;
+	}
+
+	s->profile = profile;
+	s->busy_poll_us = busy_poll_us;
+	s->buf_size = buf_size;
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+/*
+ * apply the profile options to a freshly created socket.  Options the
+ * kernel does not know about are skipped rather than treated as errors.
+ */
+static int socket_apply_profile(sock_p s, int fd)
+{
+	int sock_opt;
+
+	if(s->buf_size > 0) {
+		sock_opt = s->buf_size;
+
+		if(setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (char*)&sock_opt, sizeof(sock_opt))) {
+			return PLCTAG_ERR_OPEN;
+		}
+
+		if(setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (char*)&sock_opt, sizeof(sock_opt))) {
+			return PLCTAG_ERR_OPEN;
+		}
+	}
+
+	if(s->profile != SOCKET_PROFILE_LOW_LATENCY) {
+		return PLCTAG_STATUS_OK;
+	}
+
+	sock_opt = 1;
+
+	if(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char*)&sock_opt, sizeof(sock_opt))) {
+		return PLCTAG_ERR_OPEN;
+	}
+
+#ifdef TCP_QUICKACK
+	sock_opt = 1;
+
+	/* not sticky, socket_read() turns it back on after each read. */
+	setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, (char*)&sock_opt, sizeof(sock_opt));
+#endif
+
+#ifdef SO_BUSY_POLL
+	if(s->busy_poll_us > 0) {
+		sock_opt = s->busy_poll_us;
+
+		/* needs CAP_NET_ADMIN on older kernels, fall back quietly. */
+		setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, (char*)&sock_opt, sizeof(sock_opt));
+	}
+#endif
+
 	return PLCTAG_STATUS_OK;
 }
 
@@ -672,6 +820,12 @@ extern int socket_connect_tcp(sock_p s, const char *host, int port)
 		return PLCTAG_ERR_OPEN;
 	}
 
+	if(socket_apply_profile(s, fd) != PLCTAG_STATUS_OK) {
+		close(fd);
+		/*pdebug("Error applying socket profile, errno: %d",errno);*/
+		return PLCTAG_ERR_OPEN;
+	}
+
 	/* figure out what address we are connecting to. */
 
 	/* try a numeric IP address conversion first. */
@@ -782,6 +936,14 @@ extern int socket_read(sock_p s, uint8_t *buf, int size)
 		}
 	}
 
+#ifdef TCP_QUICKACK
+	/* the kernel drops back to delayed ACKs, so keep re-arming it. */
+	if(s->profile == SOCKET_PROFILE_LOW_LATENCY && rc > 0) {
+		int sock_opt = 1;
+		setsockopt(s->fd, IPPROTO_TCP, TCP_QUICKACK, (char*)&sock_opt, sizeof(sock_opt));
+	}
+#endif
+
 	return rc;
 }
 
@@ -1067,6 +1229,22 @@ int64_t time_ms(void)
 }
 
 
+/*
+ * time_mono_us
+ *
+ * Microseconds from an arbitrary starting point.  This does not jump
+ * when the wall clock is changed, so use it for measuring intervals.
+ */
+int64_t time_mono_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((int64_t)ts.tv_sec*1000000) + ((int64_t)ts.tv_nsec/1000);
+}
+
+
 /*
  * Debugging support.
  */
@@ -1099,37 +1277,46 @@ extern void pdebug_impl(const char *func, int line_num, const char *templ, ...)
 
 
 
+/*
+ * pdebug_dump_bytes_impl
+ *
+ * This is called with whole packets from the IO thread, so do not
+ * format byte by byte.  Each line is built by hand and written out
+ * with one call while holding the stream lock.
+ */
 extern void pdebug_dump_bytes_impl(uint8_t *data,int count)
 {
+	static const char hex_digits[] = "0123456789abcdef";
+	char line[80];
 	int i;
-	int end;
-	char buf[2048];
+	int j;
 
-	snprintf(buf,sizeof buf,"Dumping bytes:\n");
+	pdebug_impl(__PRETTY_FUNCTION__, __LINE__, "Dumping %d bytes:", count);
 
-	end = str_length(buf);
+	flockfile(stderr);
 
-	for(i=0; i<count; i++) {
-		if((i%10) == 0) {
-			snprintf(buf+end,sizeof(buf)-end,"%05d",i);
+	for(i=0; i < count; i += 10) {
+		int len = 5;
+		int offset = i;
 
-			end = strlen(buf);
+		/* five digit offset */
+		for(j=4; j >= 0; j--) {
+			line[j] = (char)('0' + (offset % 10));
+			offset /= 10;
 		}
 
-		snprintf(buf+end,sizeof(buf)-end," %02x",data[i]);
-
-		end = strlen(buf);
+		for(j=i; j < count && j < i + 10; j++) {
+			line[len++] = ' ';
+			line[len++] = hex_digits[(data[j] >> 4) & 0x0F];
+			line[len++] = hex_digits[data[j] & 0x0F];
+		}
 
-		if((i%10) == 9) {
-			snprintf(buf+end,sizeof(buf)-end,"\n");
+		line[len++] = '\n';
 
-			end = strlen(buf);
-		}
+		fwrite(line, 1, len, stderr);
 	}
 
-	/*if( ((i%10)!=9) || (i>=count && (i%10)==9))
-	    snprintf(buf+end,sizeof(buf)-end,"\n");*/
-
-	pdebug("%s",buf);
 	fflush(stderr);
+
+	funlockfile(stderr);
 }
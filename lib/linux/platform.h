@@ -98,6 +98,14 @@ extern void thread_stop(void) __attribute__((noreturn));
 extern int thread_join(thread_p t);
 extern int thread_destroy(thread_p *t);
 
+/* per-thread storage */
+#define THREAD_LOCAL __thread
+
+/* per-thread values that are handed to a destructor when the thread exits */
+typedef struct thread_key_t *thread_key_p;
+extern int thread_key_create(thread_key_p *key, void (*destructor)(void *value));
+extern int thread_key_set(thread_key_p key, void *value);
+
 /* atomic operations */
 typedef int lock_t;
 
@@ -107,9 +115,28 @@ typedef int lock_t;
 extern int lock_acquire(lock_t *lock);
 extern void lock_release(lock_t *lock);
 
+/* 64-bit counters that one thread updates while others read them */
+#define atomic_add_u64(ptr, val) ((void)__sync_fetch_and_add((ptr), (uint64_t)(val)))
+#define atomic_get_u64(ptr) (__sync_fetch_and_add((ptr), (uint64_t)0))
+
+/* 32-bit reference counts and slot claims, these are full barriers */
+#define atomic_add_i32(ptr, val) (__sync_add_and_fetch((ptr), (int32_t)(val)))
+#define atomic_get_i32(ptr) (__sync_add_and_fetch((ptr), (int32_t)0))
+#define atomic_cas_i32(ptr, oldval, newval) (__sync_bool_compare_and_swap((ptr), (int32_t)(oldval), (int32_t)(newval)))
+
+/* plain loads for hot read paths: later reads stay after the load, earlier ones before the fence */
+#define atomic_load_i32(ptr) (__atomic_load_n((ptr), __ATOMIC_ACQUIRE))
+#define atomic_read_fence() (__atomic_thread_fence(__ATOMIC_ACQUIRE))
+
 /* socket functions */
 typedef struct sock_t *sock_p;
+
+/* socket tuning profiles, applied by socket_connect_tcp(). */
+#define SOCKET_PROFILE_DEFAULT      (0)
+#define SOCKET_PROFILE_LOW_LATENCY  (1)
+
 extern int socket_create(sock_p *s);
+extern int socket_set_profile(sock_p s, int profile, int busy_poll_us, int buf_size);
 extern int socket_connect_tcp(sock_p s, const char *host, int port);
 extern int socket_read(sock_p s, uint8_t *buf, int size);
 extern int socket_write(sock_p s, uint8_t *buf, int size);
@@ -140,6 +167,7 @@ extern uint32_t be2h32(uint32_t v);
 /* misc functions */
 extern int sleep_ms(int ms);
 extern int64_t time_ms(void);
+extern int64_t time_mono_us(void);
 
 extern void pdebug_impl(const char *func, int line_num, const char *templ, ...);
 #if defined(USE_STD_VARARG_MACROS) || defined(_WIN32)
@@ -0,0 +1,360 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/*
+ * handle.c
+ *
+ * Handle table for objects handed out through the API.
+ *
+ * Callers bracket every use of an object with handle_acquire() and
+ * handle_release().  Those only touch the slot's reference count, so
+ * threads using different objects never contend.  handle_remove()
+ * unpublishes the handle first and then waits for the references to
+ * drain, after which the caller owns the object outright and can free
+ * it without racing anyone.
+ *
+ * References that outlive an API call (a lock, a view) are pinned.  Each
+ * thread keeps a list of what it has pinned, so that removing a handle
+ * the same thread still holds fails instead of waiting forever.
+ *
+ * Only allocating and freeing slots takes the table lock.
+ */
+
+#include <libplctag.h>
+#include <platform.h>
+#include <util/handle.h>
+
+
+struct handle_slot_t {
+	volatile int32_t handle;	/* zero when the slot is not published */
+	volatile int32_t refs;
+	void *obj;
+	int32_t gen;
+	int32_t next_free;
+};
+
+typedef struct handle_slot_t *handle_slot_p;
+
+static handle_slot_p volatile segments[HANDLE_SEGMENTS];
+static lock_t table_lock = LOCK_INIT;
+static int32_t free_head = -1;
+static int32_t next_unused = 0;
+
+/* references the calling thread holds across API calls. */
+struct handle_pin_t {
+	int32_t handle;
+	int32_t count;
+};
+
+static THREAD_LOCAL struct handle_pin_t pins[HANDLE_MAX_PINS];
+
+
+
+static handle_slot_p slot_lookup(int32_t handle)
+{
+	int32_t index = handle & HANDLE_INDEX_MASK;
+	handle_slot_p seg;
+
+	if(handle <= 0) {
+		return NULL;
+	}
+
+	seg = segments[index >> HANDLE_SEGMENT_BITS];
+
+	if(!seg) {
+		return NULL;
+	}
+
+	return &seg[index & (HANDLE_SEGMENT_SIZE - 1)];
+}
+
+
+
+/*
+ * handle_alloc
+ *
+ * Publish an object and return its handle.  Handles are always positive.
+ * Returns PLCTAG_ERR_NO_MEM if the table is full.
+ */
+extern int32_t handle_alloc(void *obj)
+{
+	handle_slot_p slot = NULL;
+	int32_t index = -1;
+	int32_t handle;
+
+	while(!lock_acquire(&table_lock)) {
+		sleep_ms(1);
+	}
+
+	if(free_head >= 0) {
+		index = free_head;
+		slot = &segments[index >> HANDLE_SEGMENT_BITS][index & (HANDLE_SEGMENT_SIZE - 1)];
+		free_head = slot->next_free;
+	} else if(next_unused < HANDLE_MAX_SLOTS) {
+		int seg = next_unused >> HANDLE_SEGMENT_BITS;
+
+		if(!segments[seg]) {
+			/* mem_alloc() zeros the slots, the lock release publishes them. */
+			segments[seg] = (handle_slot_p)mem_alloc(HANDLE_SEGMENT_SIZE * (int)sizeof(struct handle_slot_t));
+		}
+
+		if(segments[seg]) {
+			index = next_unused++;
+			slot = &segments[seg][index & (HANDLE_SEGMENT_SIZE - 1)];
+		}
+	}
+
+	if(!slot) {
+		lock_release(&table_lock);
+		return PLCTAG_ERR_NO_MEM;
+	}
+
+	/* a new generation every time the slot is used. */
+	slot->gen = (slot->gen % HANDLE_MAX_GEN) + 1;
+	slot->obj = obj;
+	slot->next_free = -1;
+
+	handle = (slot->gen << HANDLE_INDEX_BITS) | index;
+
+	/* the object pointer must be visible before the handle is. */
+	atomic_cas_i32(&slot->handle, 0, handle);
+
+	lock_release(&table_lock);
+
+	return handle;
+}
+
+
+
+/*
+ * handle_acquire
+ *
+ * Return the object for the handle and hold a reference on it, or NULL if
+ * the handle is stale or bogus.  Every successful call must be paired
+ * with handle_release().
+ */
+extern void *handle_acquire(int32_t handle)
+{
+	handle_slot_p slot = slot_lookup(handle);
+
+	if(!slot) {
+		return NULL;
+	}
+
+	/*
+	 * take the reference before checking the handle.  handle_remove()
+	 * clears the handle before checking the count, so one of us will
+	 * see the other.
+	 */
+	atomic_add_i32(&slot->refs, 1);
+
+	/* the add above is a full barrier, a plain load is enough here. */
+	if(atomic_load_i32(&slot->handle) != handle) {
+		atomic_add_i32(&slot->refs, -1);
+		return NULL;
+	}
+
+	return slot->obj;
+}
+
+
+
+/*
+ * handle_release
+ *
+ * Drop a reference taken by handle_acquire().  A reference keeps the
+ * slot from being reused, so a handle from an older generation was
+ * never acquired and is ignored.
+ */
+extern void handle_release(int32_t handle)
+{
+	handle_slot_p slot = slot_lookup(handle);
+
+	if(slot && slot->gen == (handle >> HANDLE_INDEX_BITS)) {
+		atomic_add_i32(&slot->refs, -1);
+	}
+}
+
+
+
+/*
+ * handle_held
+ *
+ * Return the object for a handle the caller already holds a reference
+ * on.  Unlike handle_acquire() this still works after handle_remove()
+ * has retired the handle, since the reference keeps the slot from being
+ * reused.
+ */
+extern void *handle_held(int32_t handle)
+{
+	handle_slot_p slot = slot_lookup(handle);
+
+	if(!slot || slot->gen != (handle >> HANDLE_INDEX_BITS)) {
+		return NULL;
+	}
+
+	return slot->obj;
+}
+
+
+
+static struct handle_pin_t *pin_lookup(int32_t handle)
+{
+	int i;
+
+	for(i = 0; i < HANDLE_MAX_PINS; i++) {
+		if(pins[i].count && pins[i].handle == handle) {
+			return &pins[i];
+		}
+	}
+
+	return NULL;
+}
+
+
+
+/*
+ * handle_pin
+ *
+ * Acquire a reference that the calling thread keeps after the API call
+ * returns, until handle_unpin() from the same thread.  Returns
+ * PLCTAG_ERR_NOT_FOUND for a stale or bogus handle and PLCTAG_ERR_NO_MEM
+ * if the thread already has HANDLE_MAX_PINS handles pinned.
+ */
+extern int handle_pin(int32_t handle, void **obj)
+{
+	struct handle_pin_t *pin = pin_lookup(handle);
+	int i;
+
+	for(i = 0; !pin && i < HANDLE_MAX_PINS; i++) {
+		if(!pins[i].count) {
+			pin = &pins[i];
+		}
+	}
+
+	if(!pin) {
+		return PLCTAG_ERR_NO_MEM;
+	}
+
+	*obj = handle_acquire(handle);
+
+	if(!*obj) {
+		return PLCTAG_ERR_NOT_FOUND;
+	}
+
+	pin->handle = handle;
+	pin->count++;
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
+/*
+ * handle_unpin
+ *
+ * Drop a pinned reference.  Unpinning from another thread still drops
+ * the reference, but the pinning thread keeps its entry.
+ */
+extern void handle_unpin(int32_t handle)
+{
+	struct handle_pin_t *pin = pin_lookup(handle);
+
+	if(pin) {
+		pin->count--;
+	}
+
+	handle_release(handle);
+}
+
+
+
+/*
+ * handle_wait_others
+ *
+ * Wait until the only references left on a handle the caller holds are
+ * its own: the one it acquired for this call and any it has pinned.
+ * Calls that other threads start meanwhile also hold things up, so the
+ * caller should already have made sure they will not need what it is
+ * about to free.
+ */
+extern void handle_wait_others(int32_t handle)
+{
+	handle_slot_p slot = slot_lookup(handle);
+	struct handle_pin_t *pin = pin_lookup(handle);
+	int32_t mine = 1 + (pin ? pin->count : 0);
+
+	if(!slot) {
+		return;
+	}
+
+	while(atomic_get_i32(&slot->refs) > mine) {
+		sleep_ms(1);
+	}
+}
+
+
+
+/*
+ * handle_remove
+ *
+ * Unpublish the handle, wait until nobody holds a reference and free the
+ * slot.  The object, which now belongs to the caller, is passed back in
+ * obj.  Only one of several racing callers gets it, the others get
+ * PLCTAG_ERR_NOT_FOUND as for a handle that was not valid.
+ *
+ * If the calling thread has the handle pinned, the wait would never end.
+ * PLCTAG_ERR_NOT_ALLOWED is returned and the handle stays valid.  Do not
+ * call this while holding an unpinned reference to the same handle.
+ */
+extern int handle_remove(int32_t handle, void **obj)
+{
+	handle_slot_p slot = slot_lookup(handle);
+
+	*obj = NULL;
+
+	if(pin_lookup(handle)) {
+		return PLCTAG_ERR_NOT_ALLOWED;
+	}
+
+	if(!slot || !atomic_cas_i32(&slot->handle, handle, 0)) {
+		return PLCTAG_ERR_NOT_FOUND;
+	}
+
+	/* API calls that are already in progress get to finish. */
+	while(atomic_get_i32(&slot->refs) > 0) {
+		sleep_ms(1);
+	}
+
+	*obj = slot->obj;
+
+	while(!lock_acquire(&table_lock)) {
+		sleep_ms(1);
+	}
+
+	slot->obj = NULL;
+	slot->next_free = free_head;
+	free_head = handle & HANDLE_INDEX_MASK;
+
+	lock_release(&table_lock);
+
+	return PLCTAG_STATUS_OK;
+}
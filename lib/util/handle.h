@@ -0,0 +1,58 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/*
+ * handle.h
+ *
+ * A table mapping integer handles to objects.  A handle is a slot index
+ * plus the generation of the slot, so a handle to a destroyed object
+ * never finds the object that took its slot.  Lookups take no lock.
+ */
+
+#ifndef HANDLE_H_
+#define HANDLE_H_
+
+#include <platform.h>
+
+/* the low bits of a handle are the slot index, the rest the generation. */
+#define HANDLE_INDEX_BITS	(16)
+#define HANDLE_MAX_SLOTS	(1 << HANDLE_INDEX_BITS)
+#define HANDLE_INDEX_MASK	(HANDLE_MAX_SLOTS - 1)
+#define HANDLE_MAX_GEN		(0x7FFF)
+
+/* slots are allocated in segments that never move once created. */
+#define HANDLE_SEGMENT_BITS	(8)
+#define HANDLE_SEGMENT_SIZE	(1 << HANDLE_SEGMENT_BITS)
+#define HANDLE_SEGMENTS		(HANDLE_MAX_SLOTS / HANDLE_SEGMENT_SIZE)
+
+/* how many different handles one thread may hold pinned at once. */
+#define HANDLE_MAX_PINS		(64)
+
+extern int32_t handle_alloc(void *obj);
+extern void *handle_acquire(int32_t handle);
+extern void handle_release(int32_t handle);
+extern void *handle_held(int32_t handle);
+extern int handle_pin(int32_t handle, void **obj);
+extern void handle_unpin(int32_t handle);
+extern void handle_wait_others(int32_t handle);
+extern int handle_remove(int32_t handle, void **obj);
+
+#endif /* HANDLE_H_ */
@@ -0,0 +1,246 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * share.c
+ *
+ * Cache entries shared between handles for the same tag.
+ *
+ * Entries are found by a key the protocol builds from the parsed values
+ * that pick out the tag's data in the PLC.  The list is only touched when handles are
+ * created and destroyed; the data in an entry has its own mutex.
+ */
+
+#include <libplctag.h>
+#include <platform.h>
+#include <util/share.h>
+
+
+#define SHARE_MAX_KEY	(512)
+
+struct share_t {
+	struct share_t *next;
+	int refs;
+	uint8_t key[SHARE_MAX_KEY];
+	int key_size;
+
+	mutex_p mut;
+	int64_t stamp;		/* when the data was read, zero if none */
+	int64_t written;	/* when the tag was last written */
+	int size;
+	uint8_t *data;
+};
+
+static share_p shares = NULL;
+static lock_t share_lock = LOCK_INIT;
+
+
+
+/* keys are compared byte for byte. */
+static int key_match(share_p share, const uint8_t *key, int key_size)
+{
+	int i;
+
+	if(share->key_size != key_size) {
+		return 0;
+	}
+
+	for(i = 0; i < key_size; i++) {
+		if(share->key[i] != key[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+
+/*
+ * share_attach
+ *
+ * Find or create the entry for the tag with the given key and take a
+ * reference to it.  Returns NULL if there is none to be had, in which
+ * case the tag simply does not share.
+ */
+extern share_p share_attach(const uint8_t *key, int key_size)
+{
+	share_p share;
+
+	if(!key || key_size <= 0 || key_size > SHARE_MAX_KEY) {
+		return NULL;
+	}
+
+	while(!lock_acquire(&share_lock)) {
+		sleep_ms(1);
+	}
+
+	for(share = shares; share; share = share->next) {
+		if(key_match(share, key, key_size)) {
+			break;
+		}
+	}
+
+	if(share) {
+		share->refs++;
+	} else {
+		share = (share_p)mem_alloc((int)sizeof(struct share_t));
+
+		if(share && mutex_create(&share->mut) != PLCTAG_STATUS_OK) {
+			mem_free(share);
+			share = NULL;
+		}
+
+		if(share) {
+			mem_copy(share->key, (void *)key, key_size);
+			share->key_size = key_size;
+			share->refs = 1;
+			share->next = shares;
+			shares = share;
+		}
+	}
+
+	lock_release(&share_lock);
+
+	return share;
+}
+
+
+
+/*
+ * share_detach
+ *
+ * Drop a reference.  The last one frees the entry.
+ */
+extern void share_detach(share_p share)
+{
+	share_p *link;
+	int last = 0;
+
+	if(!share) {
+		return;
+	}
+
+	while(!lock_acquire(&share_lock)) {
+		sleep_ms(1);
+	}
+
+	if(--share->refs == 0) {
+		for(link = &shares; *link; link = &(*link)->next) {
+			if(*link == share) {
+				*link = share->next;
+				break;
+			}
+		}
+
+		last = 1;
+	}
+
+	lock_release(&share_lock);
+
+	if(last) {
+		mutex_destroy(&share->mut);
+
+		if(share->data) {
+			mem_free(share->data);
+		}
+
+		mem_free(share);
+	}
+}
+
+
+
+/*
+ * share_get
+ *
+ * Copy out the shared data if it is the right size and no older than
+ * max_age_ms.  The time it was read is passed back in stamp.
+ */
+extern int share_get(share_p share, uint8_t *data, int size, int max_age_ms, int64_t *stamp)
+{
+	int rc = PLCTAG_ERR_NO_DATA;
+
+	if(!share || max_age_ms <= 0) {
+		return PLCTAG_ERR_NO_DATA;
+	}
+
+	critical_block(share->mut) {
+		if(share->stamp && share->size == size && share->stamp + max_age_ms > time_ms()) {
+			mem_copy(data, share->data, size);
+			*stamp = share->stamp;
+			rc = PLCTAG_STATUS_OK;
+		}
+	}
+
+	return rc;
+}
+
+
+
+/*
+ * share_put
+ *
+ * Publish data from a read started at read_ms.  A read that started
+ * before the last write may hold the old values and is dropped.
+ */
+extern void share_put(share_p share, uint8_t *data, int size, int64_t read_ms)
+{
+	if(!share || size <= 0) {
+		return;
+	}
+
+	critical_block(share->mut) {
+		if(read_ms > share->written) {
+			if(share->size != size) {
+				if(share->data) {
+					mem_free(share->data);
+				}
+
+				share->data = (uint8_t *)mem_alloc(size);
+				share->size = (share->data ? size : 0);
+			}
+
+			if(share->data) {
+				mem_copy(share->data, data, size);
+				share->stamp = read_ms;
+			}
+		}
+	}
+}
+
+
+
+/*
+ * share_invalidate
+ *
+ * The tag was written, nobody should use the old data.
+ */
+extern void share_invalidate(share_p share)
+{
+	if(!share) {
+		return;
+	}
+
+	critical_block(share->mut) {
+		share->stamp = 0;
+		share->written = time_ms();
+	}
+}
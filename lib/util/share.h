@@ -0,0 +1,44 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * share.h
+ *
+ * Handles created for the same tag (same gateway, path, CPU, name and
+ * element count and size) share one cache entry.  A read by any of them
+ * refreshes the data for all the others within their read_cache_ms.
+ *
+ * Only handles with a read cache, or created with share=1, take part.
+ */
+
+#ifndef SHARE_H_
+#define SHARE_H_
+
+#include <platform.h>
+
+typedef struct share_t *share_p;
+
+extern share_p share_attach(const uint8_t *key, int key_size);
+extern void share_detach(share_p share);
+extern int share_get(share_p share, uint8_t *data, int size, int max_age_ms, int64_t *stamp);
+extern void share_put(share_p share, uint8_t *data, int size, int64_t read_ms);
+extern void share_invalidate(share_p share);
+
+#endif /* SHARE_H_ */
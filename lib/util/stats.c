@@ -0,0 +1,81 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * stats.c
+ *
+ * Helpers for keeping plc_tag_stats_t counters.
+ *
+ * Counters are only changed with atomic adds so that the IO thread
+ * never has to take another lock to update them and readers never
+ * see a torn 64-bit value.
+ */
+
+#include <platform.h>
+#include <util/stats.h>
+
+
+
+/*
+ * stats_hist_add
+ *
+ * Count one sample in a log2 microsecond histogram.
+ */
+extern void stats_hist_add(uint64_t *hist, int64_t elapsed_us)
+{
+	int bucket = 0;
+
+	while(elapsed_us > 1 && bucket < PLCTAG_STATS_HIST_BUCKETS - 1) {
+		elapsed_us >>= 1;
+		bucket++;
+	}
+
+	atomic_add_u64(&hist[bucket], 1);
+}
+
+
+
+/*
+ * stats_snapshot
+ *
+ * Copy the counters out of a live stats block.  The gauges are left
+ * alone, the caller fills those in.
+ */
+extern void stats_snapshot(plc_tag_stats_t *dest, plc_tag_stats_t *src)
+{
+	int i;
+
+	dest->requests_sent = atomic_get_u64(&src->requests_sent);
+	dest->bytes_sent = atomic_get_u64(&src->bytes_sent);
+	dest->bytes_received = atomic_get_u64(&src->bytes_received);
+	dest->responses_matched = atomic_get_u64(&src->responses_matched);
+	dest->responses_orphaned = atomic_get_u64(&src->responses_orphaned);
+	dest->retries = atomic_get_u64(&src->retries);
+	dest->timeouts = atomic_get_u64(&src->timeouts);
+
+	for(i=0; i < PLCTAG_STATS_HIST_BUCKETS; i++) {
+		dest->queue_hist[i] = atomic_get_u64(&src->queue_hist[i]);
+		dest->response_hist[i] = atomic_get_u64(&src->response_hist[i]);
+		dest->send_hist[i] = atomic_get_u64(&src->send_hist[i]);
+		dest->wait_hist[i] = atomic_get_u64(&src->wait_hist[i]);
+		dest->recv_hist[i] = atomic_get_u64(&src->recv_hist[i]);
+		dest->pickup_hist[i] = atomic_get_u64(&src->pickup_hist[i]);
+	}
+}
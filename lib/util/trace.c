@@ -0,0 +1,221 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * trace.c
+ *
+ * Per-thread binary event rings.
+ *
+ * Only the owning thread writes to a ring, so recording an event is a
+ * few stores and a clock read.  Rings are linked into a global list the
+ * first time a thread records something and are freed when that thread
+ * exits, so a dump only has the threads that are still running.
+ *
+ * Dumping does not stop the writers.  An event being written while it
+ * is copied can come out torn, which is fine for a diagnostic trace.
+ */
+
+#include <platform.h>
+#include <libplctag.h>
+#include <util/trace.h>
+#include <stdio.h>
+
+
+typedef struct trace_ring_t *trace_ring_p;
+
+struct trace_ring_t {
+	trace_ring_p next;
+	uint16_t thread;
+	volatile uint32_t count;	/* total events written */
+	trace_event_t events[TRACE_RING_SIZE];
+};
+
+
+/* off until plc_tag_trace_enable(), each thread that records gets a ring. */
+volatile int trace_enabled = 0;
+
+static volatile trace_ring_p trace_rings = NULL;
+static volatile lock_t trace_rings_lock = LOCK_INIT;
+static uint16_t trace_num_threads = 0;
+static thread_key_p trace_ring_key = NULL;
+
+static THREAD_LOCAL trace_ring_p thread_ring = NULL;
+
+
+
+static void trace_rings_lock_acquire(void)
+{
+	/* the list only changes when threads start and stop tracing. */
+	while(!lock_acquire((lock_t*)&trace_rings_lock)) {
+		sleep_ms(1);
+	}
+}
+
+
+
+/* called as a thread that recorded events exits. */
+static void trace_ring_destroy(void *arg)
+{
+	trace_ring_p ring = (trace_ring_p)arg;
+	trace_ring_p *link;
+
+	trace_rings_lock_acquire();
+
+	for(link = (trace_ring_p *)&trace_rings; *link; link = &(*link)->next) {
+		if(*link == ring) {
+			*link = ring->next;
+			break;
+		}
+	}
+
+	lock_release((lock_t*)&trace_rings_lock);
+
+	thread_ring = NULL;
+
+	mem_free(ring);
+}
+
+
+
+static trace_ring_p trace_ring_create(void)
+{
+	trace_ring_p ring = (trace_ring_p)mem_alloc(sizeof(struct trace_ring_t));
+	int rc = PLCTAG_STATUS_OK;
+
+	if(!ring) {
+		return NULL;
+	}
+
+	trace_rings_lock_acquire();
+
+	if(!trace_ring_key) {
+		rc = thread_key_create(&trace_ring_key, trace_ring_destroy);
+	}
+
+	/* without the key the ring could not be freed, so do without. */
+	if(rc == PLCTAG_STATUS_OK) {
+		rc = thread_key_set(trace_ring_key, ring);
+	}
+
+	if(rc == PLCTAG_STATUS_OK) {
+		ring->thread = trace_num_threads++;
+		ring->next = trace_rings;
+		trace_rings = ring;
+	}
+
+	lock_release((lock_t*)&trace_rings_lock);
+
+	if(rc != PLCTAG_STATUS_OK) {
+		mem_free(ring);
+		return NULL;
+	}
+
+	thread_ring = ring;
+
+	return ring;
+}
+
+
+
+/*
+ * trace_event_impl
+ *
+ * Use the trace_event() macro instead so that nothing is evaluated
+ * when tracing is off.
+ */
+extern void trace_event_impl(int event, uint32_t session, uint32_t request, int32_t a0, int32_t a1, int32_t a2)
+{
+	trace_ring_p ring = thread_ring;
+	trace_event_t *ev;
+
+	if(!ring && !(ring = trace_ring_create())) {
+		return;
+	}
+
+	ev = &ring->events[ring->count & (TRACE_RING_SIZE - 1)];
+
+	ev->time_us = time_mono_us();
+	ev->event = (uint16_t)event;
+	ev->thread = ring->thread;
+	ev->session = session;
+	ev->request = request;
+	ev->arg[0] = a0;
+	ev->arg[1] = a1;
+	ev->arg[2] = a2;
+
+	ring->count++;
+}
+
+
+
+/*
+ * trace_dump
+ *
+ * Write every ring to the named file, oldest events first within
+ * each ring.  The decoder sorts across threads.  Threads that exit
+ * while this runs wait for it before their ring is freed.
+ */
+extern int trace_dump(const char *file_name)
+{
+	trace_file_header_t header;
+	trace_ring_p ring;
+	FILE *f;
+	int rc = PLCTAG_STATUS_OK;
+
+	if(!file_name) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	f = fopen(file_name, "wb");
+
+	if(!f) {
+		return PLCTAG_ERR_OPEN;
+	}
+
+	mem_copy(header.magic, (void *)TRACE_FILE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_FILE_VERSION;
+	header.event_size = (uint32_t)sizeof(trace_event_t);
+
+	if(fwrite(&header, sizeof(header), 1, f) != 1) {
+		rc = PLCTAG_ERR_WRITE;
+	}
+
+	trace_rings_lock_acquire();
+
+	for(ring = trace_rings; ring && rc == PLCTAG_STATUS_OK; ring = ring->next) {
+		uint32_t count = ring->count;
+		uint32_t i = (count > TRACE_RING_SIZE ? count - TRACE_RING_SIZE : 0);
+
+		for(; i < count; i++) {
+			if(fwrite(&ring->events[i & (TRACE_RING_SIZE - 1)], sizeof(trace_event_t), 1, f) != 1) {
+				rc = PLCTAG_ERR_WRITE;
+				break;
+			}
+		}
+	}
+
+	lock_release((lock_t*)&trace_rings_lock);
+
+	if(fclose(f) && rc == PLCTAG_STATUS_OK) {
+		rc = PLCTAG_ERR_CLOSE;
+	}
+
+	return rc;
+}
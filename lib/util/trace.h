@@ -0,0 +1,104 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * trace.h
+ *
+ * Binary event trace.  Each thread that records an event gets its own
+ * ring of fixed size events, so recording never takes a lock.  The rings
+ * are written to a file with plc_tag_trace_dump() and turned back into
+ * text with tools/trace_decode.
+ *
+ * This header is also used by the decoder, so it must only depend on
+ * the standard integer types.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+#define TRACE_FILE_MAGIC	"PLCTRACE"
+#define TRACE_FILE_VERSION	(1)
+
+/* events per thread, must be a power of two. */
+#define TRACE_RING_SIZE		(2048)
+
+/*
+ * The event list.  The names are used by the decoder.  Only add to
+ * the end so that old dumps still decode.
+ */
+#define TRACE_EVENTS(X) \
+	X(NONE,              "none") \
+	X(TAG_READ,          "tag_read") \
+	X(TAG_WRITE,         "tag_write") \
+	X(TAG_TIMEOUT,       "tag_timeout") \
+	X(TAG_ABORT,         "tag_abort") \
+	X(REQ_QUEUED,        "req_queued") \
+	X(REQ_SEND_START,    "req_send_start") \
+	X(REQ_SENT,          "req_sent") \
+	X(REQ_SEND_ERROR,    "req_send_error") \
+	X(RESP_RECEIVED,     "resp_received") \
+	X(RESP_MATCHED,      "resp_matched") \
+	X(RESP_ORPHANED,     "resp_orphaned") \
+	X(REQ_ABANDONED,     "req_abandoned") \
+	X(REQ_DESTROYED,     "req_destroyed") \
+	X(SOCKET_ERROR,      "socket_error") \
+	X(SESSION_CONNECT,   "session_connect") \
+	X(SESSION_REGISTER,  "session_register") \
+	X(SESSION_DESTROY,   "session_destroy")
+
+#define TRACE_ENUM_ENTRY(id, name) TRACE_##id,
+enum {
+	TRACE_EVENTS(TRACE_ENUM_ENTRY)
+	TRACE_NUM_EVENTS
+};
+#undef TRACE_ENUM_ENTRY
+
+/* 32 bytes, written as is to the dump file. */
+typedef struct {
+	int64_t time_us;		/* time_mono_us() */
+	uint16_t event;
+	uint16_t thread;		/* index of the ring/thread */
+	uint32_t session;		/* TRACE_ID() of the session or zero */
+	uint32_t request;		/* TRACE_ID() of the request/tag or zero */
+	int32_t arg[3];
+} trace_event_t;
+
+/* dump file header */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t event_size;
+} trace_file_header_t;
+
+/* short ids for objects, unique while the object is alive. */
+#define TRACE_ID(p) ((uint32_t)(uintptr_t)(p))
+
+extern volatile int trace_enabled;
+extern void trace_event_impl(int event, uint32_t session, uint32_t request, int32_t a0, int32_t a1, int32_t a2);
+
+#define trace_event(e, s, r, a0, a1, a2) \
+	do { if(trace_enabled) trace_event_impl((e), (s), (r), (int32_t)(a0), (int32_t)(a1), (int32_t)(a2)); } while(0)
+
+extern int trace_dump(const char *file_name);
+
+
+#endif /* TRACE_H_ */
@@ -608,6 +608,108 @@ extern int thread_destroy(thread_p *t)
 
 
 
+/*
+ * thread_key_create()
+ *
+ * Make a key for a per-thread value.  When a thread that has set a
+ * non-NULL value exits, the destructor is called with that value.
+ * Keys are never destroyed.
+ *
+ * Fiber local storage calls back with only the value, so each value
+ * is stored along with the destructor.
+ */
+
+struct thread_key_t {
+	DWORD index;
+	void (*destructor)(void *value);
+};
+
+struct thread_key_value_t {
+	void (*destructor)(void *value);
+	void *value;
+};
+
+static VOID NTAPI thread_key_callback(PVOID data)
+{
+	struct thread_key_value_t *kv = (struct thread_key_value_t *)data;
+
+	if(kv) {
+		kv->destructor(kv->value);
+		mem_free(kv);
+	}
+}
+
+extern int thread_key_create(thread_key_p *key, void (*destructor)(void *value))
+{
+	if(!key || !destructor) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	*key = (thread_key_p)mem_alloc(sizeof(struct thread_key_t));
+
+	if(! *key) {
+		return PLCTAG_ERR_NO_MEM;
+	}
+
+	(*key)->index = FlsAlloc(thread_key_callback);
+
+	if((*key)->index == FLS_OUT_OF_INDEXES) {
+		mem_free(*key);
+		*key = NULL;
+		return PLCTAG_ERR_CREATE;
+	}
+
+	(*key)->destructor = destructor;
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+/*
+ * thread_key_set()
+ *
+ * Set the calling thread's value for the key.
+ */
+
+extern int thread_key_set(thread_key_p key, void *value)
+{
+	struct thread_key_value_t *kv = NULL;
+	struct thread_key_value_t *old;
+
+	if(!key) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	if(value) {
+		kv = (struct thread_key_value_t *)mem_alloc(sizeof(struct thread_key_value_t));
+
+		if(!kv) {
+			return PLCTAG_ERR_NO_MEM;
+		}
+
+		kv->destructor = key->destructor;
+		kv->value = value;
+	}
+
+	old = (struct thread_key_value_t *)FlsGetValue(key->index);
+
+	if(!FlsSetValue(key->index, kv)) {
+		if(kv) {
+			mem_free(kv);
+		}
+
+		return PLCTAG_ERR_SET;
+	}
+
+	if(old) {
+		mem_free(old);
+	}
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+
 
 
 /***************************************************************************
@@ -666,6 +768,11 @@ struct sock_t {
 	int fd;
 	int port;
 	int is_open;
+
+	/* tuning, see socket_set_profile() */
+	int profile;
+	int busy_poll_us;
+	int buf_size;
 };
 
 
@@ -706,11 +813,73 @@ extern int socket_create(sock_p *s)
 		return PLCTAG_ERR_NO_MEM;
 	}
 
+	/* nothing open yet, keep socket_destroy() from closing a random fd. */
+	(*s)->fd = -1;
+
 	return PLCTAG_STATUS_OK;
 }
 
 
 
+/*
+ * socket_set_profile
+ *
+ * Select the tuning profile for the socket.  This must be called before
+ * socket_connect_tcp().  Windows has no equivalent to quick ACK or busy
+ * polling, so the low latency profile only turns off Nagle here and
+ * busy_poll_us is accepted but ignored.
+ */
+
+extern int socket_set_profile(sock_p s, int profile, int busy_poll_us, int buf_size)
+{
+	if(!s) {
+		return PLCTAG_ERR_NULL_PTR;
+	}
+
+	if(profile != SOCKET_PROFILE_DEFAULT && profile != SOCKET_PROFILE_LOW_LATENCY) {
+		return PLCTAG_ERR_BAD_PARAM;
+	}
+
+	if(busy_poll_us < 0 || buf_size < 0) {
+		return PLCTAG_ERR_BAD_PARAM;
+	}
+
+	s->profile = profile;
+	s->busy_poll_us = busy_poll_us;
+	s->buf_size = buf_size;
+
+	return PLCTAG_STATUS_OK;
+}
+
+
+static int socket_apply_profile(sock_p s, int fd)
+{
+	int sock_opt;
+
+	if(s->buf_size > 0) {
+		sock_opt = s->buf_size;
+
+		if(setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (char*)&sock_opt, sizeof(sock_opt))) {
+			return PLCTAG_ERR_OPEN;
+		}
+
+		if(setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (char*)&sock_opt, sizeof(sock_opt))) {
+			return PLCTAG_ERR_OPEN;
+		}
+	}
+
+	if(s->profile == SOCKET_PROFILE_LOW_LATENCY) {
+		sock_opt = 1;
+
+		if(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char*)&sock_opt, sizeof(sock_opt))) {
+			return PLCTAG_ERR_OPEN;
+		}
+	}
+
+	return PLCTAG_STATUS_OK;
+}
+
+
 extern int socket_connect_tcp(sock_p s, const char *host, int port)
 {
 	IN_ADDR ips[MAX_IPS];
@@ -758,6 +927,12 @@ extern int socket_connect_tcp(sock_p s, const char *host, int port)
         return PLCTAG_ERR_OPEN;
     }
 
+    if(socket_apply_profile(s, fd) != PLCTAG_STATUS_OK) {
+		closesocket(fd);
+        /*pdebug("Error applying socket profile, errno: %d",errno);*/
+        return PLCTAG_ERR_OPEN;
+    }
+
     /* figure out what address we are connecting to. */
 
     /* try a numeric IP address conversion first. */
@@ -1443,6 +1618,28 @@ uint64_t time_ms(void)
 }
 
 
+/*
+ * time_mono_us
+ *
+ * Microseconds from an arbitrary starting point.  This does not jump
+ * when the wall clock is changed, so use it for measuring intervals.
+ */
+int64_t time_mono_us(void)
+{
+    static LARGE_INTEGER freq = {0};
+    LARGE_INTEGER count;
+
+    if(!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+
+    QueryPerformanceCounter(&count);
+
+    return (int64_t)((count.QuadPart / freq.QuadPart) * 1000000) +
+           (int64_t)(((count.QuadPart % freq.QuadPart) * 1000000) / freq.QuadPart);
+}
+
+
 /*
  * Debugging support.
  */
@@ -1475,39 +1672,48 @@ extern void pdebug_impl(const char *func, int line_num, const char *templ, ...)
 
 
 
+/*
+ * pdebug_dump_bytes_impl
+ *
+ * This is called with whole packets from the IO thread, so do not
+ * format byte by byte.  Each line is built by hand and written out
+ * with one call while holding the stream lock.
+ */
 extern void pdebug_dump_bytes_impl(uint8_t *data,int count)
 {
+    static const char hex_digits[] = "0123456789abcdef";
+    char line[80];
     int i;
-    int end;
-    char buf[2048];
+    int j;
 
-    sprintf_s(buf,sizeof buf,"Dumping bytes:\n");
+    pdebug_impl(__PRETTY_FUNCTION__, __LINE__, "Dumping %d bytes:", count);
 
-    end = str_length(buf);
+    _lock_file(stderr);
 
-    for(i=0; i<count; i++) {
-        if((i%10) == 0) {
-            sprintf_s(buf+end,sizeof(buf)-end,"%05d",i);
+    for(i=0; i < count; i += 10) {
+        int len = 5;
+        int offset = i;
 
-            end = strlen(buf);
+        /* five digit offset */
+        for(j=4; j >= 0; j--) {
+            line[j] = (char)('0' + (offset % 10));
+            offset /= 10;
         }
 
-        sprintf_s(buf+end,sizeof(buf)-end," %02x",data[i]);
-
-        end = strlen(buf);
+        for(j=i; j < count && j < i + 10; j++) {
+            line[len++] = ' ';
+            line[len++] = hex_digits[(data[j] >> 4) & 0x0F];
+            line[len++] = hex_digits[data[j] & 0x0F];
+        }
 
-        if((i%10) == 9) {
-            sprintf_s(buf+end,sizeof(buf)-end,"\n");
+        line[len++] = '\n';
 
-            end = strlen(buf);
-        }
+        fwrite(line, 1, len, stderr);
     }
 
-    /*if( ((i%10)!=9) || (i>=count && (i%10)==9))
-        sprintf_s(buf+end,sizeof(buf)-end,"\n");*/
-
-    pdebug("%s",buf);
     fflush(stderr);
+
+    _unlock_file(stderr);
 }
 
 
@@ -149,6 +149,14 @@ extern void thread_stop(void);
 extern int thread_join(thread_p t);
 extern int thread_destroy(thread_p *t);
 
+/* per-thread storage */
+#define THREAD_LOCAL __declspec(thread)
+
+/* per-thread values that are handed to a destructor when the thread exits */
+typedef struct thread_key_t *thread_key_p;
+extern int thread_key_create(thread_key_p *key, void (*destructor)(void *value));
+extern int thread_key_set(thread_key_p key, void *value);
+
 /* atomic operations */
 typedef volatile long int lock_t;
 
@@ -158,9 +166,28 @@ typedef volatile long int lock_t;
 extern int lock_acquire(lock_t *lock);
 extern void lock_release(lock_t *lock);
 
+/* 64-bit counters that one thread updates while others read them */
+#define atomic_add_u64(ptr, val) ((void)InterlockedExchangeAdd64((volatile LONG64 *)(ptr), (LONG64)(val)))
+#define atomic_get_u64(ptr) ((uint64_t)InterlockedExchangeAdd64((volatile LONG64 *)(ptr), (LONG64)0))
+
+/* 32-bit reference counts and slot claims, these are full barriers */
+#define atomic_add_i32(ptr, val) ((int32_t)InterlockedExchangeAdd((volatile LONG *)(ptr), (LONG)(val)) + (int32_t)(val))
+#define atomic_get_i32(ptr) ((int32_t)InterlockedExchangeAdd((volatile LONG *)(ptr), (LONG)0))
+#define atomic_cas_i32(ptr, oldval, newval) (InterlockedCompareExchange((volatile LONG *)(ptr), (LONG)(newval), (LONG)(oldval)) == (LONG)(oldval))
+
+/* plain loads for hot read paths: later reads stay after the load, earlier ones before the fence */
+#define atomic_load_i32(ptr) ((int32_t)(*(volatile LONG *)(ptr)))
+#define atomic_read_fence() MemoryBarrier()
+
 /* socket functions */
 typedef struct sock_t *sock_p;
+
+/* socket tuning profiles, applied by socket_connect_tcp(). */
+#define SOCKET_PROFILE_DEFAULT      (0)
+#define SOCKET_PROFILE_LOW_LATENCY  (1)
+
 extern int socket_create(sock_p *s);
+extern int socket_set_profile(sock_p s, int profile, int busy_poll_us, int buf_size);
 extern int socket_connect_tcp(sock_p s, const char *host, int port);
 extern int socket_read(sock_p s, uint8_t *buf, int size);
 extern int socket_write(sock_p s, uint8_t *buf, int size);
@@ -191,6 +218,7 @@ extern uint32_t be2h32(uint32_t v);
 /* misc functions */
 extern int sleep_ms(int ms);
 extern uint64_t time_ms(void);
+extern int64_t time_mono_us(void);
 
 extern void pdebug_impl(const char *func, int line_num, const char *templ, ...);
 #if defined(USE_STD_VARARG_MACROS) || defined(_WIN32)
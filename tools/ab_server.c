@@ -0,0 +1,2052 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**************************************************************************
+ * CHANGE LOG                                                             *
+ *                                                                        *
+ * 2015-11-20  KRH - Created file.                                        *
+ *                                                                        *
+ **************************************************************************/
+
+/*
+ * ab_server
+ *
+ * A small EtherNet/IP server that answers enough CIP and PCCC to drive
+ * the library without a PLC.  Tags live in memory and are shared by all
+ * clients.  Responses can be held back by a fixed latency plus random
+ * jitter to model a real network and controller.
+ *
+ * Supported:
+ *   - RegisterSession, UnRegisterSession, NOP
+ *   - SendRRData (unconnected) and SendUnitData (connected)
+ *   - Forward Open (small and large), Forward Close
+ *   - Unconnected Send through the Connection Manager
+ *   - CIP Read Tag, Read Tag Fragmented, Write Tag, Write Tag Fragmented,
+ *     Read Modify Write
+ *   - Multiple Service Packet
+ *   - PCCC Execute with typed read, typed write, read-modify-write and
+ *     the SLC masked write, both unconnected and over a DH+ bridged
+ *     connection.
+ *
+ * usage: ab_server [options]
+ *
+ *   --port=N            TCP port to listen on (44818)
+ *   --tag=NAME:TYPE[N]  add a tag, TYPE is BOOL, SINT, INT, DINT, LINT,
+ *                       REAL or LREAL.  PCCC tags are named by data file,
+ *                       for example N7:INT[100] or F8:REAL[10].
+ *   --latency-us=N      hold each response for N microseconds (0)
+ *   --jitter-us=N       add up to N random microseconds to that (0)
+ *   --max-reply=N       largest CIP reply payload in bytes (500)
+ *   --max-conn-size=N   reject Forward Opens asking for more (0, any)
+ *   --debug             dump every packet to stderr
+ *
+ * Without any --tag options a default set of test tags is created.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+
+#define DEFAULT_PORT        (44818)
+#define DEFAULT_MAX_REPLY   (500)
+#define MAX_PACKET          (4096)
+#define MAX_TAGS            (256)
+#define MAX_TAG_NAME        (64)
+#define MAX_CONNECTIONS     (64)
+
+/* EIP encapsulation commands */
+#define EIP_NOP                 (0x0000)
+#define EIP_REGISTER_SESSION    (0x0065)
+#define EIP_UNREGISTER_SESSION  (0x0066)
+#define EIP_SEND_RR_DATA        (0x006F)
+#define EIP_SEND_UNIT_DATA      (0x0070)
+
+#define EIP_HEADER_SIZE         (24)
+
+/* CPF item types */
+#define CPF_NAI (0x0000)
+#define CPF_CAI (0x00A1)
+#define CPF_CDI (0x00B1)
+#define CPF_UDI (0x00B2)
+
+/* CIP services */
+#define CIP_MULTI_SERVICE       (0x0A)
+#define CIP_GET_ATTR_SINGLE     (0x0E)
+#define CIP_PCCC_EXECUTE        (0x4B)
+#define CIP_READ                (0x4C)
+#define CIP_WRITE               (0x4D)
+#define CIP_FORWARD_CLOSE       (0x4E)
+#define CIP_READ_MODIFY_WRITE   (0x4E)  /* same code, on a tag path */
+#define CIP_READ_FRAG           (0x52)
+#define CIP_UNCONNECTED_SEND    (0x52)
+#define CIP_WRITE_FRAG          (0x53)
+#define CIP_FORWARD_OPEN        (0x54)
+#define CIP_GET_INSTANCE_LIST   (0x55)
+#define CIP_LARGE_FORWARD_OPEN  (0x5B)
+#define CIP_REPLY               (0x80)
+
+/* Logix Symbol Object class */
+#define CIP_CLASS_SYMBOL        (0x6B)
+#define CIP_CLASS_IDENTITY      (0x01)
+
+/* CIP general status values */
+#define CIP_OK                  (0x00)
+#define CIP_ERR_CONN_FAILURE    (0x01)
+#define CIP_ERR_PATH_SEGMENT    (0x04)
+#define CIP_ERR_PATH_DEST       (0x05)
+#define CIP_ERR_PARTIAL         (0x06)
+#define CIP_ERR_UNSUPPORTED     (0x08)
+#define CIP_ERR_REPLY_TOO_LARGE (0x11)
+#define CIP_ERR_NOT_ENOUGH_DATA (0x13)
+#define CIP_ERR_EMBEDDED        (0x1E)
+#define CIP_ERR_EXTENDED        (0xFF)
+
+/* extended status values */
+#define CIP_EXT_CONN_NOT_FOUND  (0x0107)
+#define CIP_EXT_BAD_CONN_SIZE   (0x0109)
+#define CIP_EXT_OUT_OF_RANGE    (0x2105)
+#define CIP_EXT_TYPE_MISMATCH   (0x2107)
+
+/* PCCC */
+#define PCCC_ECHO_CMD           (0x06)
+#define PCCC_ECHO_FNC           (0x00)
+#define PCCC_TYPED_CMD          (0x0F)
+#define PCCC_TYPED_WRITE        (0x67)
+#define PCCC_TYPED_READ         (0x68)
+#define PCCC_READ_MODIFY_WRITE  (0x26)
+#define PCCC_MASKED_WRITE       (0xAB)
+#define PCCC_REPLY              (0x40)
+#define PCCC_STS_ILLEGAL_CMD    (0x10)
+#define PCCC_STS_EXTENDED       (0xF0)
+#define PCCC_EXT_BAD_ADDRESS    (0x06)
+#define PCCC_EXT_BAD_TYPE       (0x07)
+
+#define PCCC_DT_INT             (4)
+#define PCCC_DT_REAL            (8)
+#define PCCC_DT_ARRAY           (9)
+
+
+struct tag_type {
+    const char *name;
+    uint8_t cip_type;
+    uint8_t pccc_type;
+    int size;
+};
+
+static const struct tag_type tag_types[] = {
+    { "BOOL",  0xC1, 0,            1 },
+    { "SINT",  0xC2, 0,            1 },
+    { "INT",   0xC3, PCCC_DT_INT,  2 },
+    { "DINT",  0xC4, 0,            4 },
+    { "LINT",  0xC5, 0,            8 },
+    { "REAL",  0xCA, PCCC_DT_REAL, 4 },
+    { "LREAL", 0xCB, 0,            8 },
+    { NULL,    0,    0,            0 }
+};
+
+
+struct sim_tag {
+    char name[MAX_TAG_NAME];
+    int file_num;       /* PCCC data file number or -1 */
+    const struct tag_type *type;
+    int elem_count;
+    uint8_t *data;
+};
+
+struct sim_conn {
+    int in_use;
+    int is_dhp;
+    uint32_t ot_id;     /* we pick this one */
+    uint32_t to_id;     /* the client picks this one */
+    uint16_t serial;
+    uint16_t vendor;
+    uint32_t orig_serial;
+    int size;
+};
+
+struct pending_resp {
+    struct pending_resp *next;
+    int64_t due_us;
+    int size;
+    uint8_t data[];
+};
+
+struct client {
+    int fd;
+    uint32_t session_handle;
+    unsigned int seed;
+    struct sim_conn conns[MAX_CONNECTIONS];
+    struct pending_resp *head;
+    struct pending_resp *tail;
+    int64_t last_due_us;
+    int in_size;
+    uint8_t in_buf[MAX_PACKET * 2];
+};
+
+
+/* configuration */
+static int port = DEFAULT_PORT;
+static int latency_us = 0;
+static int jitter_us = 0;
+static int max_reply = DEFAULT_MAX_REPLY;
+static int max_conn_size = 0;
+static int debug = 0;
+static int no_instance = 0;
+
+/* symbol instance of tags[0].  SIGUSR1 moves it, like a download would. */
+static volatile int instance_base = 1;
+
+/* tags are shared by all clients */
+static struct sim_tag tags[MAX_TAGS];
+static int num_tags = 0;
+static pthread_mutex_t tag_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile uint32_t next_conn_id = 0x10000000;
+static volatile uint32_t next_session_handle = 0x00001000;
+
+
+/*************************************************************************
+ ****************************** Helpers **********************************
+ ************************************************************************/
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    p[2] = (uint8_t)((v >> 16) & 0xFF);
+    p[3] = (uint8_t)((v >> 24) & 0xFF);
+}
+
+static void dump_bytes(const char *prefix, const uint8_t *data, int size)
+{
+    int i;
+
+    fprintf(stderr, "%s (%d bytes)", prefix, size);
+
+    for(i = 0; i < size; i++) {
+        if((i % 16) == 0) {
+            fprintf(stderr, "\n%05d", i);
+        }
+
+        fprintf(stderr, " %02x", data[i]);
+    }
+
+    fprintf(stderr, "\n");
+}
+
+
+/*************************************************************************
+ ******************************** Tags ***********************************
+ ************************************************************************/
+
+static int add_tag(const char *spec)
+{
+    char name[MAX_TAG_NAME];
+    char type_name[16];
+    int count = 1;
+    const char *colon;
+    const char *bracket;
+    const char *p;
+    struct sim_tag *tag;
+    int i;
+
+    if(num_tags >= MAX_TAGS) {
+        fprintf(stderr, "Too many tags!\n");
+        return -1;
+    }
+
+    /*
+     * PCCC names have a colon in them too, N7:INT[10], so split on the
+     * last one.
+     */
+    colon = strrchr(spec, ':');
+
+    if(!colon || colon == spec || (colon - spec) >= MAX_TAG_NAME) {
+        fprintf(stderr, "Bad tag spec \"%s\", expected NAME:TYPE[COUNT]\n", spec);
+        return -1;
+    }
+
+    memcpy(name, spec, colon - spec);
+    name[colon - spec] = 0;
+
+    bracket = strchr(colon, '[');
+
+    if(bracket) {
+        count = atoi(bracket + 1);
+    } else {
+        bracket = colon + strlen(colon);
+    }
+
+    if(count <= 0 || (bracket - colon - 1) <= 0 || (bracket - colon - 1) >= (int)sizeof(type_name)) {
+        fprintf(stderr, "Bad tag spec \"%s\", expected NAME:TYPE[COUNT]\n", spec);
+        return -1;
+    }
+
+    memcpy(type_name, colon + 1, bracket - colon - 1);
+    type_name[bracket - colon - 1] = 0;
+
+    tag = &tags[num_tags];
+    tag->type = NULL;
+
+    for(i = 0; tag_types[i].name; i++) {
+        if(!strcasecmp(tag_types[i].name, type_name)) {
+            tag->type = &tag_types[i];
+            break;
+        }
+    }
+
+    if(!tag->type) {
+        fprintf(stderr, "Unknown tag type \"%s\"!\n", type_name);
+        return -1;
+    }
+
+    snprintf(tag->name, sizeof(tag->name), "%s", name);
+    tag->elem_count = count;
+    tag->data = calloc(count, tag->type->size);
+
+    if(!tag->data) {
+        fprintf(stderr, "Out of memory for tag %s!\n", name);
+        return -1;
+    }
+
+    /* letters followed only by digits makes a PCCC data file. */
+    tag->file_num = -1;
+    p = name;
+
+    while(*p && isalpha((unsigned char)*p)) {
+        p++;
+    }
+
+    if(p != name && *p && tag->type->pccc_type) {
+        const char *digits = p;
+
+        while(*p && isdigit((unsigned char)*p)) {
+            p++;
+        }
+
+        if(!*p) {
+            tag->file_num = atoi(digits);
+        }
+    }
+
+    num_tags++;
+
+    return 0;
+}
+
+static void add_default_tags(void)
+{
+    static const char *defaults[] = {
+        "TestDINT:DINT[1]",
+        "TestINT:INT[1]",
+        "TestREAL:REAL[1]",
+        "TestDINTArray:DINT[10]",
+        "TestBigArray:DINT[2000]",
+        "N7:INT[100]",
+        "F8:REAL[50]",
+        NULL
+    };
+    int i;
+
+    for(i = 0; defaults[i]; i++) {
+        add_tag(defaults[i]);
+    }
+}
+
+static struct sim_tag *find_tag_by_name(const uint8_t *name, int name_len)
+{
+    int i;
+
+    for(i = 0; i < num_tags; i++) {
+        if((int)strlen(tags[i].name) == name_len && !strncasecmp(tags[i].name, (const char *)name, name_len)) {
+            return &tags[i];
+        }
+    }
+
+    return NULL;
+}
+
+static struct sim_tag *find_tag_by_file(int file_num)
+{
+    int i;
+
+    for(i = 0; i < num_tags; i++) {
+        if(tags[i].file_num == file_num) {
+            return &tags[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/*************************************************************************
+ ******************************** CIP ************************************
+ ************************************************************************/
+
+/*
+ * start a CIP reply.  Returns the number of bytes written.
+ */
+static int cip_reply_header(uint8_t *out, uint8_t service, uint8_t status, uint16_t ext_status)
+{
+    out[0] = service | CIP_REPLY;
+    out[1] = 0;
+    out[2] = status;
+
+    if(status == CIP_ERR_EXTENDED || (status == CIP_ERR_CONN_FAILURE && ext_status)) {
+        out[3] = 1;
+        put16(out + 4, ext_status);
+        return 6;
+    }
+
+    out[3] = 0;
+
+    return 4;
+}
+
+/*
+ * decode an 8, 16 or 32-bit logical instance segment.  Returns the
+ * segment size or zero if it is not one.
+ */
+static int get_instance_segment(const uint8_t *p, const uint8_t *end, uint32_t *instance)
+{
+    if(p + 2 <= end && p[0] == 0x24) {
+        *instance = p[1];
+        return 2;
+    }
+
+    if(p + 4 <= end && p[0] == 0x25) {
+        *instance = get16(p + 2);
+        return 4;
+    }
+
+    if(p + 6 <= end && p[0] == 0x26) {
+        *instance = get32(p + 2);
+        return 6;
+    }
+
+    return 0;
+}
+
+static struct sim_tag *find_tag_by_instance(uint32_t instance)
+{
+    int index = (int)instance - instance_base;
+
+    if(index < 0 || index >= num_tags) {
+        return NULL;
+    }
+
+    return &tags[index];
+}
+
+/*
+ * walk a tag path.  Only a single name or Symbol Object instance and
+ * an optional single dimension index are understood.
+ */
+static int resolve_tag_path(const uint8_t *path, int path_size, struct sim_tag **tag, int *index)
+{
+    const uint8_t *p = path;
+    const uint8_t *end = path + path_size;
+
+    *tag = NULL;
+    *index = 0;
+
+    while(p < end) {
+        switch(*p) {
+        case 0x91:
+            if(p + 2 > end || p + 2 + p[1] > end) {
+                return CIP_ERR_PATH_SEGMENT;
+            }
+
+            if(*tag) {
+                /* members of structures are not simulated. */
+                return CIP_ERR_PATH_DEST;
+            }
+
+            *tag = find_tag_by_name(p + 2, p[1]);
+
+            if(!*tag) {
+                return CIP_ERR_PATH_DEST;
+            }
+
+            p += 2 + p[1] + (p[1] & 0x01);
+            break;
+
+        case 0x20: {
+            uint32_t instance;
+            int seg_size;
+
+            if(p + 2 > end || p[1] != CIP_CLASS_SYMBOL || no_instance || *tag) {
+                return CIP_ERR_PATH_SEGMENT;
+            }
+
+            seg_size = get_instance_segment(p + 2, end, &instance);
+
+            if(!seg_size) {
+                return CIP_ERR_PATH_SEGMENT;
+            }
+
+            *tag = find_tag_by_instance(instance);
+
+            if(!*tag) {
+                return CIP_ERR_PATH_DEST;
+            }
+
+            p += 2 + seg_size;
+            break;
+        }
+
+        case 0x28:
+            if(p + 2 > end) {
+                return CIP_ERR_PATH_SEGMENT;
+            }
+
+            *index = p[1];
+            p += 2;
+            break;
+
+        case 0x29:
+            if(p + 4 > end) {
+                return CIP_ERR_PATH_SEGMENT;
+            }
+
+            *index = get16(p + 2);
+            p += 4;
+            break;
+
+        case 0x2A:
+            if(p + 6 > end) {
+                return CIP_ERR_PATH_SEGMENT;
+            }
+
+            *index = (int)get32(p + 2);
+            p += 6;
+            break;
+
+        default:
+            return CIP_ERR_PATH_SEGMENT;
+        }
+    }
+
+    return (*tag ? CIP_OK : CIP_ERR_PATH_DEST);
+}
+
+static int handle_read(uint8_t service, const uint8_t *path, int path_size, const uint8_t *data, int data_size, uint8_t *out, int out_max)
+{
+    struct sim_tag *tag;
+    int index;
+    int count;
+    uint32_t offset = 0;
+    int total;
+    int start;
+    int chunk;
+    int max_data;
+    int status;
+    int size;
+
+    status = resolve_tag_path(path, path_size, &tag, &index);
+
+    if(status != CIP_OK) {
+        return cip_reply_header(out, service, status, 0);
+    }
+
+    if(data_size < 2 || (service == CIP_READ_FRAG && data_size < 6)) {
+        return cip_reply_header(out, service, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    count = get16(data);
+
+    if(service == CIP_READ_FRAG) {
+        offset = get32(data + 2);
+    }
+
+    if(count <= 0 || index < 0 || index + count > tag->elem_count) {
+        return cip_reply_header(out, service, CIP_ERR_EXTENDED, CIP_EXT_OUT_OF_RANGE);
+    }
+
+    total = count * tag->type->size;
+    start = index * tag->type->size;
+
+    if((int)offset >= total) {
+        return cip_reply_header(out, service, CIP_ERR_EXTENDED, CIP_EXT_OUT_OF_RANGE);
+    }
+
+    /* keep the reply inside the limit, on an element boundary. */
+    max_data = out_max - 6;
+
+    if(max_data > max_reply - 6) {
+        max_data = max_reply - 6;
+    }
+
+    max_data -= max_data % tag->type->size;
+
+    if(max_data <= 0) {
+        return cip_reply_header(out, service, CIP_ERR_REPLY_TOO_LARGE, 0);
+    }
+
+    chunk = total - (int)offset;
+    status = CIP_OK;
+
+    if(chunk > max_data) {
+        chunk = max_data;
+        status = CIP_ERR_PARTIAL;
+    }
+
+    size = cip_reply_header(out, service, status, 0);
+
+    out[size++] = tag->type->cip_type;
+    out[size++] = 0;
+
+    pthread_mutex_lock(&tag_mutex);
+    memcpy(out + size, tag->data + start + offset, chunk);
+    pthread_mutex_unlock(&tag_mutex);
+
+    return size + chunk;
+}
+
+static int handle_write(uint8_t service, const uint8_t *path, int path_size, const uint8_t *data, int data_size, uint8_t *out)
+{
+    struct sim_tag *tag;
+    int index;
+    int count;
+    uint32_t offset = 0;
+    int type_size;
+    int total;
+    int start;
+    int status;
+    const uint8_t *payload;
+    int payload_size;
+
+    status = resolve_tag_path(path, path_size, &tag, &index);
+
+    if(status != CIP_OK) {
+        return cip_reply_header(out, service, status, 0);
+    }
+
+    if(data_size < 2) {
+        return cip_reply_header(out, service, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    /* abbreviated structure types carry a two byte handle too. */
+    type_size = (data[0] == 0xA0 ? 4 : 2);
+
+    if(data_size < type_size + 2 + (service == CIP_WRITE_FRAG ? 4 : 0)) {
+        return cip_reply_header(out, service, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    if(data[0] != tag->type->cip_type) {
+        return cip_reply_header(out, service, CIP_ERR_EXTENDED, CIP_EXT_TYPE_MISMATCH);
+    }
+
+    count = get16(data + type_size);
+    payload = data + type_size + 2;
+
+    if(service == CIP_WRITE_FRAG) {
+        offset = get32(payload);
+        payload += 4;
+    }
+
+    payload_size = data_size - (int)(payload - data);
+
+    if(count <= 0 || index < 0 || index + count > tag->elem_count) {
+        return cip_reply_header(out, service, CIP_ERR_EXTENDED, CIP_EXT_OUT_OF_RANGE);
+    }
+
+    total = count * tag->type->size;
+    start = index * tag->type->size;
+
+    /* drop the pad byte if there is one. */
+    if((int)offset + payload_size > total) {
+        payload_size = total - (int)offset;
+    }
+
+    if(payload_size <= 0) {
+        return cip_reply_header(out, service, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    if(service == CIP_WRITE && payload_size < total) {
+        return cip_reply_header(out, service, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    pthread_mutex_lock(&tag_mutex);
+    memcpy(tag->data + start + offset, payload, payload_size);
+    pthread_mutex_unlock(&tag_mutex);
+
+    return cip_reply_header(out, service, CIP_OK, 0);
+}
+
+/*
+ * Get_Instance_Attribute_List on the Symbol Object.  Only the name (1)
+ * and type (2) attributes are returned, in that order, whatever was
+ * asked for.  Instances from the one in the path up are listed until
+ * the reply is full.
+ */
+/*
+ * Read Modify Write: mask size, OR mask, AND mask, applied to one element.
+ */
+static int handle_rmw(const uint8_t *path, int path_size, const uint8_t *data, int data_size, uint8_t *out)
+{
+    struct sim_tag *tag;
+    uint8_t *elem;
+    int index;
+    int mask_size;
+    int status;
+    int i;
+
+    status = resolve_tag_path(path, path_size, &tag, &index);
+
+    if(status != CIP_OK) {
+        return cip_reply_header(out, CIP_READ_MODIFY_WRITE, status, 0);
+    }
+
+    if(data_size < 2) {
+        return cip_reply_header(out, CIP_READ_MODIFY_WRITE, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    mask_size = get16(data);
+
+    if(data_size < 2 + (2 * mask_size)) {
+        return cip_reply_header(out, CIP_READ_MODIFY_WRITE, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    if(mask_size != tag->type->size) {
+        return cip_reply_header(out, CIP_READ_MODIFY_WRITE, CIP_ERR_EXTENDED, CIP_EXT_TYPE_MISMATCH);
+    }
+
+    if(index < 0 || index >= tag->elem_count) {
+        return cip_reply_header(out, CIP_READ_MODIFY_WRITE, CIP_ERR_EXTENDED, CIP_EXT_OUT_OF_RANGE);
+    }
+
+    pthread_mutex_lock(&tag_mutex);
+
+    elem = tag->data + (index * tag->type->size);
+
+    for(i = 0; i < mask_size; i++) {
+        elem[i] = (elem[i] | data[2 + i]) & data[2 + mask_size + i];
+    }
+
+    pthread_mutex_unlock(&tag_mutex);
+
+    return cip_reply_header(out, CIP_READ_MODIFY_WRITE, CIP_OK, 0);
+}
+
+static int handle_symbol_list(const uint8_t *path, int path_size, uint8_t *out, int out_max)
+{
+    uint32_t start;
+    int size;
+    int room;
+    int index;
+
+    if(no_instance) {
+        return cip_reply_header(out, CIP_GET_INSTANCE_LIST, CIP_ERR_UNSUPPORTED, 0);
+    }
+
+    if(path_size < 4 || path[0] != 0x20 || path[1] != CIP_CLASS_SYMBOL
+       || get_instance_segment(path + 2, path + path_size, &start) != path_size - 2) {
+        return cip_reply_header(out, CIP_GET_INSTANCE_LIST, CIP_ERR_PATH_SEGMENT, 0);
+    }
+
+    size = cip_reply_header(out, CIP_GET_INSTANCE_LIST, CIP_OK, 0);
+
+    room = out_max;
+
+    if(room > max_reply) {
+        room = max_reply;
+    }
+
+    index = (int)start - instance_base;
+
+    if(index < 0) {
+        index = 0;
+    }
+
+    for(; index < num_tags; index++) {
+        struct sim_tag *tag = &tags[index];
+        int name_len = (int)strlen(tag->name);
+        uint16_t type = tag->type->cip_type;
+
+        if(size + 4 + 2 + name_len + 2 > room) {
+            out[2] = CIP_ERR_PARTIAL;
+            break;
+        }
+
+        if(tag->elem_count > 1) {
+            type |= 0x2000; /* one dimension */
+        }
+
+        put32(out + size, (uint32_t)(index + instance_base));
+        put16(out + size + 4, (uint16_t)name_len);
+        memcpy(out + size + 6, tag->name, name_len);
+        put16(out + size + 6 + name_len, type);
+        size += 4 + 2 + name_len + 2;
+    }
+
+    return size;
+}
+
+static int handle_cip_request(const uint8_t *req, int req_size, uint8_t *out, int out_max);
+
+static int handle_multi_service(const uint8_t *data, int data_size, uint8_t *out, int out_max)
+{
+    int count;
+    int i;
+    int size;
+    int status = CIP_OK;
+    uint8_t *reply_base;
+    uint8_t *reply;
+
+    if(data_size < 2) {
+        return cip_reply_header(out, CIP_MULTI_SERVICE, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    count = get16(data);
+
+    if(count <= 0 || data_size < 2 + (count * 2)) {
+        return cip_reply_header(out, CIP_MULTI_SERVICE, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    /* offsets in the reply are from the service count. */
+    reply_base = out + 4;
+    put16(reply_base, (uint16_t)count);
+    reply = reply_base + 2 + (count * 2);
+
+    for(i = 0; i < count; i++) {
+        int start = get16(data + 2 + (i * 2));
+        int end = (i + 1 < count ? get16(data + 2 + ((i + 1) * 2)) : data_size);
+        int room = (int)((out + out_max) - reply);
+        int sub_size;
+
+        if(start >= end || end > data_size) {
+            return cip_reply_header(out, CIP_MULTI_SERVICE, CIP_ERR_PATH_SEGMENT, 0);
+        }
+
+        put16(reply_base + 2 + (i * 2), (uint16_t)(reply - reply_base));
+
+        sub_size = handle_cip_request(data + start, end - start, reply, room);
+
+        if(sub_size <= 0 || (reply + sub_size) - out > max_reply) {
+            return cip_reply_header(out, CIP_MULTI_SERVICE, CIP_ERR_REPLY_TOO_LARGE, 0);
+        }
+
+        if(reply[2] != CIP_OK) {
+            status = CIP_ERR_EMBEDDED;
+        }
+
+        reply += sub_size;
+    }
+
+    size = cip_reply_header(out, CIP_MULTI_SERVICE, status, 0);
+
+    /* the header is always four bytes here, the data is already in place. */
+    (void)size;
+
+    return (int)(reply - out);
+}
+
+/*
+ * Message Router request: service, path size in words, path, data.
+ */
+static int handle_cip_request(const uint8_t *req, int req_size, uint8_t *out, int out_max)
+{
+    uint8_t service;
+    int path_size;
+    const uint8_t *path;
+    const uint8_t *data;
+    int data_size;
+
+    if(req_size < 2) {
+        return cip_reply_header(out, 0, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    service = req[0];
+    path_size = req[1] * 2;
+    path = req + 2;
+    data = path + path_size;
+    data_size = req_size - 2 - path_size;
+
+    if(data_size < 0) {
+        return cip_reply_header(out, service, CIP_ERR_PATH_SEGMENT, 0);
+    }
+
+    switch(service) {
+    case CIP_MULTI_SERVICE:
+        return handle_multi_service(data, data_size, out, out_max);
+
+    case CIP_READ:
+    case CIP_READ_FRAG:
+        return handle_read(service, path, path_size, data, data_size, out, out_max);
+
+    case CIP_WRITE:
+    case CIP_WRITE_FRAG:
+        return handle_write(service, path, path_size, data, data_size, out);
+
+    case CIP_GET_INSTANCE_LIST:
+        return handle_symbol_list(path, path_size, out, out_max);
+
+    case CIP_READ_MODIFY_WRITE:
+        return handle_rmw(path, path_size, data, data_size, out);
+
+    default:
+        return cip_reply_header(out, service, CIP_ERR_UNSUPPORTED, 0);
+    }
+}
+
+
+/*************************************************************************
+ ******************************** PCCC ***********************************
+ ************************************************************************/
+
+static int pccc_put_dt(uint8_t *p, int type, int size)
+{
+    int n = 1;
+    uint8_t t;
+    uint8_t s;
+
+    if(type <= 7) {
+        t = (uint8_t)type;
+    } else {
+        p[n++] = (uint8_t)type;
+        t = 0x09;
+    }
+
+    if(size <= 7) {
+        s = (uint8_t)size;
+    } else if(size <= 0xFF) {
+        p[n++] = (uint8_t)size;
+        s = 0x09;
+    } else {
+        p[n++] = (uint8_t)(size & 0xFF);
+        p[n++] = (uint8_t)((size >> 8) & 0xFF);
+        s = 0x0A;
+    }
+
+    p[0] = (uint8_t)((t << 4) | s);
+
+    return n;
+}
+
+static const uint8_t *pccc_get_dt(const uint8_t *p, const uint8_t *end, int *type, int *size)
+{
+    int t;
+    int s;
+    int i;
+
+    if(p >= end) {
+        return NULL;
+    }
+
+    t = (*p >> 4) & 0x0F;
+    s = *p & 0x0F;
+    p++;
+
+    if(t & 0x08) {
+        int n = t & 0x07;
+
+        for(t = 0, i = 0; i < n && p < end; i++, p++) {
+            t |= *p << (8 * i);
+        }
+    }
+
+    if(s & 0x08) {
+        int n = s & 0x07;
+
+        for(s = 0, i = 0; i < n && p < end; i++, p++) {
+            s |= *p << (8 * i);
+        }
+    }
+
+    *type = t;
+    *size = s;
+
+    return p;
+}
+
+static const uint8_t *pccc_get_level(const uint8_t *p, const uint8_t *end, int *val)
+{
+    if(p >= end) {
+        return NULL;
+    }
+
+    if(*p == 0xFF) {
+        if(p + 3 > end) {
+            return NULL;
+        }
+
+        *val = get16(p + 1);
+        return p + 3;
+    }
+
+    *val = *p;
+
+    return p + 1;
+}
+
+/*
+ * decode a level encoded logical address: flags byte then one value
+ * per flagged level.  Level two is the file, three the element.
+ */
+static const uint8_t *pccc_decode_address(const uint8_t *p, const uint8_t *end, int *file_num, int *element)
+{
+    uint8_t flags;
+    int level;
+    int val;
+
+    if(p >= end) {
+        return NULL;
+    }
+
+    flags = *p++;
+    *file_num = -1;
+    *element = 0;
+
+    for(level = 0; level < 8; level++) {
+        if(!(flags & (1 << level))) {
+            continue;
+        }
+
+        if(!(p = pccc_get_level(p, end, &val))) {
+            return NULL;
+        }
+
+        if(level == 1) {
+            *file_num = val;
+        } else if(level == 2) {
+            *element = val;
+        }
+    }
+
+    return p;
+}
+
+/*
+ * Handle a PCCC command starting at the command byte.  The reply
+ * (command, status, TNS, data) goes in out.
+ */
+static int handle_pccc(const uint8_t *req, int req_size, uint8_t *out)
+{
+    const uint8_t *end = req + req_size;
+    const uint8_t *p;
+    struct sim_tag *tag;
+    uint8_t fnc;
+    int transfer_count;
+    int file_num;
+    int element;
+    int size;
+    int n;
+
+    if(req_size < 5) {
+        return 0;
+    }
+
+    out[0] = req[0] | PCCC_REPLY;
+    out[1] = 0;
+    out[2] = req[2];
+    out[3] = req[3];
+    size = 4;
+
+    fnc = req[4];
+
+    /* echo sends the data back, the client uses it as a keepalive. */
+    if(req[0] == PCCC_ECHO_CMD && fnc == PCCC_ECHO_FNC) {
+        if(debug) {
+            fprintf(stderr, "PCCC echo: %d bytes\n", req_size - 5);
+        }
+
+        memcpy(out + size, req + 5, req_size - 5);
+        return size + req_size - 5;
+    }
+
+    /* read-modify-write: sets of word address, AND mask and OR mask. */
+    if(req[0] == PCCC_TYPED_CMD && fnc == PCCC_READ_MODIFY_WRITE) {
+        p = req + 5;
+
+        while(p < end) {
+            uint16_t word;
+
+            p = pccc_decode_address(p, end, &file_num, &element);
+            tag = (p ? find_tag_by_file(file_num) : NULL);
+
+            if(!tag || end - p < 4 || element >= tag->elem_count || tag->type->size != 2) {
+                out[1] = PCCC_STS_EXTENDED;
+                out[size++] = PCCC_EXT_BAD_ADDRESS;
+                return size;
+            }
+
+            pthread_mutex_lock(&tag_mutex);
+            word = get16(tag->data + (element * 2));
+            word = (word & get16(p)) | get16(p + 2);
+            put16(tag->data + (element * 2), word);
+            pthread_mutex_unlock(&tag_mutex);
+
+            p += 4;
+        }
+
+        return size;
+    }
+
+    /* SLC masked write: byte count, file, file type, element, sub-element, mask, data. */
+    if(req[0] == PCCC_TYPED_CMD && fnc == PCCC_MASKED_WRITE) {
+        int sub_element = 0;
+        uint16_t word;
+
+        p = req + 6;
+        tag = NULL;
+
+        if(req_size > 5 && req[5] == 2 && (p = pccc_get_level(p, end, &file_num)) && p < end
+           && (p = pccc_get_level(p + 1, end, &element)) && (p = pccc_get_level(p, end, &sub_element))) {
+            tag = find_tag_by_file(file_num);
+        }
+
+        if(!tag || end - p < 4 || sub_element || element >= tag->elem_count || tag->type->size != 2) {
+            out[1] = PCCC_STS_EXTENDED;
+            out[size++] = PCCC_EXT_BAD_ADDRESS;
+            return size;
+        }
+
+        pthread_mutex_lock(&tag_mutex);
+        word = get16(tag->data + (element * 2));
+        word = (word & ~get16(p)) | (get16(p + 2) & get16(p));
+        put16(tag->data + (element * 2), word);
+        pthread_mutex_unlock(&tag_mutex);
+
+        return size;
+    }
+
+    if(req[0] != PCCC_TYPED_CMD || (fnc != PCCC_TYPED_READ && fnc != PCCC_TYPED_WRITE) || req_size < 9) {
+        out[1] = PCCC_STS_ILLEGAL_CMD;
+        return size;
+    }
+
+    /* offset and transfer size, then the address. */
+    transfer_count = get16(req + 7);
+    p = pccc_decode_address(req + 9, end, &file_num, &element);
+
+    tag = (p ? find_tag_by_file(file_num) : NULL);
+
+    if(!tag || transfer_count <= 0 || element + transfer_count > tag->elem_count) {
+        out[1] = PCCC_STS_EXTENDED;
+        out[size++] = PCCC_EXT_BAD_ADDRESS;
+        return size;
+    }
+
+    if(fnc == PCCC_TYPED_READ) {
+        uint8_t elem_dt[8];
+        int elem_dt_size = pccc_put_dt(elem_dt, tag->type->pccc_type, tag->type->size);
+        int data_size = transfer_count * tag->type->size;
+
+        size += pccc_put_dt(out + size, PCCC_DT_ARRAY, elem_dt_size + data_size);
+        memcpy(out + size, elem_dt, elem_dt_size);
+        size += elem_dt_size;
+
+        pthread_mutex_lock(&tag_mutex);
+        memcpy(out + size, tag->data + (element * tag->type->size), data_size);
+        pthread_mutex_unlock(&tag_mutex);
+
+        size += data_size;
+    } else {
+        int type;
+        int type_size;
+
+        /* array definition, then the element definition. */
+        if(!(p = pccc_get_dt(p, end, &type, &type_size)) || type != PCCC_DT_ARRAY) {
+            out[1] = PCCC_STS_EXTENDED;
+            out[size++] = PCCC_EXT_BAD_TYPE;
+            return size;
+        }
+
+        if(!(p = pccc_get_dt(p, end, &type, &type_size)) || type != tag->type->pccc_type) {
+            out[1] = PCCC_STS_EXTENDED;
+            out[size++] = PCCC_EXT_BAD_TYPE;
+            return size;
+        }
+
+        n = transfer_count * tag->type->size;
+
+        if(end - p < n) {
+            out[1] = PCCC_STS_EXTENDED;
+            out[size++] = PCCC_EXT_BAD_ADDRESS;
+            return size;
+        }
+
+        pthread_mutex_lock(&tag_mutex);
+        memcpy(tag->data + (element * tag->type->size), p, n);
+        pthread_mutex_unlock(&tag_mutex);
+    }
+
+    return size;
+}
+
+/*
+ * PCCC Execute object request: request id, then the PCCC command.
+ */
+static int handle_pccc_execute(const uint8_t *data, int data_size, uint8_t *out)
+{
+    int id_size;
+    int size;
+    int pccc_size;
+
+    if(data_size < 1 || data_size < data[0] + 5) {
+        return cip_reply_header(out, CIP_PCCC_EXECUTE, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    id_size = data[0];
+
+    size = cip_reply_header(out, CIP_PCCC_EXECUTE, CIP_OK, 0);
+    memcpy(out + size, data, id_size);
+    size += id_size;
+
+    pccc_size = handle_pccc(data + id_size, data_size - id_size, out + size);
+
+    if(pccc_size <= 0) {
+        return cip_reply_header(out, CIP_PCCC_EXECUTE, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    return size + pccc_size;
+}
+
+
+/*************************************************************************
+ ************************* Connection Manager ****************************
+ ************************************************************************/
+
+static struct sim_conn *find_conn_by_id(struct client *c, uint32_t ot_id)
+{
+    int i;
+
+    for(i = 0; i < MAX_CONNECTIONS; i++) {
+        if(c->conns[i].in_use && c->conns[i].ot_id == ot_id) {
+            return &c->conns[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int handle_forward_open(struct client *c, uint8_t service, const uint8_t *data, int data_size, uint8_t *out)
+{
+    int large = (service == CIP_LARGE_FORWARD_OPEN);
+    int param_size = (large ? 4 : 2);
+    const uint8_t *p = data;
+    struct sim_conn *conn = NULL;
+    uint32_t to_id;
+    uint16_t serial;
+    uint16_t vendor;
+    uint32_t orig_serial;
+    uint32_t ot_rpi;
+    uint32_t to_rpi;
+    uint32_t ot_params;
+    int conn_size;
+    int path_size;
+    int size;
+    int i;
+
+    /* fixed part is 36 bytes for small, 40 for large. */
+    if(data_size < 32 + (2 * param_size)) {
+        return cip_reply_header(out, service, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    p += 2;                     /* secs per tick and timeout ticks */
+    p += 4;                     /* O->T id, ours to pick */
+    to_id = get32(p);
+    p += 4;
+    serial = get16(p);
+    p += 2;
+    vendor = get16(p);
+    p += 2;
+    orig_serial = get32(p);
+    p += 4;
+    p += 4;                     /* multiplier and reserved */
+    ot_rpi = get32(p);
+    p += 4;
+    ot_params = (large ? get32(p) : get16(p));
+    p += param_size;
+    to_rpi = get32(p);
+    p += 4;
+    p += param_size;            /* T->O params */
+    p += 1;                     /* transport */
+    path_size = *p * 2;
+    p += 1;
+
+    if((int)(p - data) + path_size > data_size) {
+        return cip_reply_header(out, service, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    conn_size = (int)(large ? (ot_params & 0xFFFF) : (ot_params & 0x01FF));
+
+    if(max_conn_size > 0 && conn_size > max_conn_size) {
+        size = cip_reply_header(out, service, CIP_ERR_CONN_FAILURE, CIP_EXT_BAD_CONN_SIZE);
+
+        /* the extra status word tells the client what we can take. */
+        out[3] = 2;
+        put16(out + size, (uint16_t)max_conn_size);
+        size += 2;
+
+        put16(out + size, serial);
+        put16(out + size + 2, vendor);
+        put32(out + size + 4, orig_serial);
+        out[size + 8] = 0;
+        out[size + 9] = 0;
+
+        return size + 10;
+    }
+
+    for(i = 0; i < MAX_CONNECTIONS; i++) {
+        if(!c->conns[i].in_use) {
+            conn = &c->conns[i];
+            break;
+        }
+    }
+
+    if(!conn) {
+        return cip_reply_header(out, service, CIP_ERR_CONN_FAILURE, 0x0113);
+    }
+
+    memset(conn, 0, sizeof(*conn));
+    conn->in_use = 1;
+    conn->ot_id = __sync_fetch_and_add(&next_conn_id, 1);
+    conn->to_id = to_id;
+    conn->serial = serial;
+    conn->vendor = vendor;
+    conn->orig_serial = orig_serial;
+    conn->size = conn_size;
+
+    /* a path into a DH+ bridge means raw PCCC over the connection. */
+    for(i = 0; i + 1 < path_size; i += 2) {
+        if(p[i] == 0x20 && p[i + 1] == 0xA6) {
+            conn->is_dhp = 1;
+        }
+    }
+
+    if(debug) {
+        fprintf(stderr, "Forward Open: O->T 0x%08x T->O 0x%08x size %d%s\n", conn->ot_id, conn->to_id, conn_size, conn->is_dhp ? " DH+" : "");
+    }
+
+    size = cip_reply_header(out, service, CIP_OK, 0);
+    put32(out + size, conn->ot_id);
+    put32(out + size + 4, conn->to_id);
+    put16(out + size + 8, serial);
+    put16(out + size + 10, vendor);
+    put32(out + size + 12, orig_serial);
+    put32(out + size + 16, ot_rpi);
+    put32(out + size + 20, to_rpi);
+    out[size + 24] = 0;         /* application reply size */
+    out[size + 25] = 0;
+
+    return size + 26;
+}
+
+static int handle_forward_close(struct client *c, const uint8_t *data, int data_size, uint8_t *out)
+{
+    uint16_t serial;
+    uint16_t vendor;
+    uint32_t orig_serial;
+    int size;
+    int i;
+
+    if(data_size < 10) {
+        return cip_reply_header(out, CIP_FORWARD_CLOSE, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    serial = get16(data + 2);
+    vendor = get16(data + 4);
+    orig_serial = get32(data + 6);
+
+    for(i = 0; i < MAX_CONNECTIONS; i++) {
+        struct sim_conn *conn = &c->conns[i];
+
+        if(conn->in_use && conn->serial == serial && conn->vendor == vendor && conn->orig_serial == orig_serial) {
+            conn->in_use = 0;
+            break;
+        }
+    }
+
+    if(debug) {
+        fprintf(stderr, "Forward Close: serial 0x%04x%s\n", serial, (i == MAX_CONNECTIONS) ? " not found" : "");
+    }
+
+    if(i == MAX_CONNECTIONS) {
+        size = cip_reply_header(out, CIP_FORWARD_CLOSE, CIP_ERR_CONN_FAILURE, CIP_EXT_CONN_NOT_FOUND);
+    } else {
+        size = cip_reply_header(out, CIP_FORWARD_CLOSE, CIP_OK, 0);
+    }
+
+    put16(out + size, serial);
+    put16(out + size + 2, vendor);
+    put32(out + size + 4, orig_serial);
+    out[size + 8] = 0;
+    out[size + 9] = 0;
+
+    return size + 10;
+}
+
+static int path_is(const uint8_t *path, int path_size, uint8_t class_id)
+{
+    return path_size == 4 && path[0] == 0x20 && path[1] == class_id && path[2] == 0x24 && path[3] == 0x01;
+}
+
+/*
+ * Top level unconnected request.  This is either a Connection Manager
+ * service, a PCCC Execute or a plain Message Router request.
+ */
+static int handle_unconnected(struct client *c, const uint8_t *req, int req_size, uint8_t *out, int out_max)
+{
+    uint8_t service;
+    int path_size;
+    const uint8_t *path;
+    const uint8_t *data;
+    int data_size;
+
+    if(req_size < 2) {
+        return cip_reply_header(out, 0, CIP_ERR_NOT_ENOUGH_DATA, 0);
+    }
+
+    service = req[0];
+    path_size = req[1] * 2;
+    path = req + 2;
+    data = path + path_size;
+    data_size = req_size - 2 - path_size;
+
+    if(data_size < 0) {
+        return cip_reply_header(out, service, CIP_ERR_PATH_SEGMENT, 0);
+    }
+
+    if(path_is(path, path_size, 0x06)) {
+        switch(service) {
+        case CIP_UNCONNECTED_SEND: {
+            int embedded_size;
+
+            if(data_size < 4) {
+                return cip_reply_header(out, service, CIP_ERR_NOT_ENOUGH_DATA, 0);
+            }
+
+            embedded_size = get16(data + 2);
+
+            if(embedded_size + 4 > data_size) {
+                return cip_reply_header(out, service, CIP_ERR_NOT_ENOUGH_DATA, 0);
+            }
+
+            /* the route path after the message is not checked. */
+            return handle_cip_request(data + 4, embedded_size, out, out_max);
+        }
+
+        case CIP_FORWARD_OPEN:
+        case CIP_LARGE_FORWARD_OPEN:
+            return handle_forward_open(c, service, data, data_size, out);
+
+        case CIP_FORWARD_CLOSE:
+            return handle_forward_close(c, data, data_size, out);
+
+        default:
+            return cip_reply_header(out, service, CIP_ERR_UNSUPPORTED, 0);
+        }
+    }
+
+    if(path_is(path, path_size, 0x67) && service == CIP_PCCC_EXECUTE) {
+        return handle_pccc_execute(data, data_size, out);
+    }
+
+    /* the Identity vendor ID, the library reads it as a keepalive. */
+    if(service == CIP_GET_ATTR_SINGLE && path_size == 6 && path_is(path, 4, CIP_CLASS_IDENTITY)
+       && path[4] == 0x30 && path[5] == 0x01) {
+        int size = cip_reply_header(out, service, CIP_OK, 0);
+
+        put16(out + size, 1);
+
+        return size + 2;
+    }
+
+    return handle_cip_request(req, req_size, out, out_max);
+}
+
+
+/*************************************************************************
+ **************************** Encapsulation ******************************
+ ************************************************************************/
+
+/*
+ * fill in the two CPF items of a reply.  Returns the offset of the
+ * second item's data.
+ */
+static int put_cpf(uint8_t *out, uint16_t addr_type, uint32_t conn_id, uint16_t data_type, int data_size)
+{
+    int size = 0;
+
+    put32(out + size, 0);       /* interface handle */
+    put16(out + size + 4, 0);   /* timeout */
+    put16(out + size + 6, 2);   /* item count */
+    size += 8;
+
+    put16(out + size, addr_type);
+
+    if(addr_type == CPF_CAI) {
+        put16(out + size + 2, 4);
+        put32(out + size + 4, conn_id);
+        size += 8;
+    } else {
+        put16(out + size + 2, 0);
+        size += 4;
+    }
+
+    put16(out + size, data_type);
+    put16(out + size + 2, (uint16_t)data_size);
+    size += 4;
+
+    return size;
+}
+
+/*
+ * Find the data item in a CPF list.  Returns a pointer to the data and
+ * fills in the size, or NULL.
+ */
+static const uint8_t *get_cpf_item(const uint8_t *cpf, int cpf_size, uint16_t type, int *size, uint32_t *conn_id)
+{
+    const uint8_t *p = cpf + 8;
+    const uint8_t *end = cpf + cpf_size;
+    int count;
+    int i;
+
+    if(cpf_size < 8) {
+        return NULL;
+    }
+
+    count = get16(cpf + 6);
+
+    for(i = 0; i < count && p + 4 <= end; i++) {
+        uint16_t item_type = get16(p);
+        int item_size = get16(p + 2);
+
+        if(p + 4 + item_size > end) {
+            return NULL;
+        }
+
+        if(item_type == CPF_CAI && conn_id && item_size >= 4) {
+            *conn_id = get32(p + 4);
+        }
+
+        if(item_type == type) {
+            *size = item_size;
+            return p + 4;
+        }
+
+        p += 4 + item_size;
+    }
+
+    return NULL;
+}
+
+/*
+ * Process one complete encapsulated packet.  Returns the size of the
+ * response, zero for no response or -1 to drop the client.
+ */
+static int handle_packet(struct client *c, const uint8_t *pkt, int pkt_size, uint8_t *out)
+{
+    uint16_t command = get16(pkt);
+    const uint8_t *payload = pkt + EIP_HEADER_SIZE;
+    int payload_size = pkt_size - EIP_HEADER_SIZE;
+    uint8_t *reply = out + EIP_HEADER_SIZE;
+    int reply_size = 0;
+
+    /* the reply echoes the header, including the sender context. */
+    memcpy(out, pkt, EIP_HEADER_SIZE);
+    put32(out + 8, 0);
+
+    switch(command) {
+    case EIP_NOP:
+        if(debug) {
+            fprintf(stderr, "NOP\n");
+        }
+
+        return 0;
+
+    case EIP_REGISTER_SESSION:
+        if(payload_size < 4) {
+            return -1;
+        }
+
+        c->session_handle = __sync_fetch_and_add(&next_session_handle, 1);
+        put32(out + 4, c->session_handle);
+        memcpy(reply, payload, 4);
+        reply_size = 4;
+        break;
+
+    case EIP_UNREGISTER_SESSION:
+        return -1;
+
+    case EIP_SEND_RR_DATA: {
+        const uint8_t *req;
+        int req_size = 0;
+        int cpf_size;
+        int cip_size;
+
+        req = get_cpf_item(payload, payload_size, CPF_UDI, &req_size, NULL);
+
+        if(!req) {
+            put32(out + 8, 0x0003); /* incorrect data */
+            break;
+        }
+
+        cpf_size = put_cpf(reply, CPF_NAI, 0, CPF_UDI, 0);
+        cip_size = handle_unconnected(c, req, req_size, reply + cpf_size, MAX_PACKET - EIP_HEADER_SIZE - cpf_size);
+
+        put16(reply + cpf_size - 2, (uint16_t)cip_size);
+        reply_size = cpf_size + cip_size;
+        break;
+    }
+
+    case EIP_SEND_UNIT_DATA: {
+        const uint8_t *req;
+        int req_size = 0;
+        uint32_t conn_id = 0;
+        struct sim_conn *conn;
+        int cpf_size;
+        int size;
+
+        req = get_cpf_item(payload, payload_size, CPF_CDI, &req_size, &conn_id);
+        conn = find_conn_by_id(c, conn_id);
+
+        if(!req || req_size < 2 || !conn) {
+            if(debug) {
+                fprintf(stderr, "Connected data for unknown connection 0x%08x dropped.\n", conn_id);
+            }
+
+            return 0;
+        }
+
+        cpf_size = put_cpf(reply, CPF_CAI, conn->to_id, CPF_CDI, 0);
+
+        /* the connection sequence number is echoed first. */
+        memcpy(reply + cpf_size, req, 2);
+        size = 2;
+
+        if(conn->is_dhp) {
+            int pccc_size;
+
+            if(req_size < 10) {
+                return 0;
+            }
+
+            /* swap the DH+ source and destination. */
+            memcpy(reply + cpf_size + size, req + 6, 4);
+            memcpy(reply + cpf_size + size + 4, req + 2, 4);
+            size += 8;
+
+            pccc_size = handle_pccc(req + 10, req_size - 10, reply + cpf_size + size);
+
+            if(pccc_size <= 0) {
+                return 0;
+            }
+
+            size += pccc_size;
+        } else {
+            size += handle_unconnected(c, req + 2, req_size - 2, reply + cpf_size + size, MAX_PACKET - EIP_HEADER_SIZE - cpf_size - size);
+        }
+
+        put16(reply + cpf_size - 2, (uint16_t)size);
+        reply_size = cpf_size + size;
+        break;
+    }
+
+    default:
+        put32(out + 8, 0x0001); /* invalid or unsupported command */
+        break;
+    }
+
+    put16(out + 2, (uint16_t)reply_size);
+
+    return EIP_HEADER_SIZE + reply_size;
+}
+
+
+/*************************************************************************
+ ****************************** Clients **********************************
+ ************************************************************************/
+
+static int queue_response(struct client *c, const uint8_t *data, int size)
+{
+    struct pending_resp *resp = malloc(sizeof(*resp) + size);
+    int64_t due = now_us() + latency_us;
+
+    if(!resp) {
+        return -1;
+    }
+
+    if(jitter_us > 0) {
+        due += rand_r(&c->seed) % (jitter_us + 1);
+    }
+
+    /* responses go out in order, like a real TCP stream. */
+    if(due < c->last_due_us) {
+        due = c->last_due_us;
+    }
+
+    c->last_due_us = due;
+
+    resp->next = NULL;
+    resp->due_us = due;
+    resp->size = size;
+    memcpy(resp->data, data, size);
+
+    if(c->tail) {
+        c->tail->next = resp;
+    } else {
+        c->head = resp;
+    }
+
+    c->tail = resp;
+
+    return 0;
+}
+
+static int send_all(int fd, const uint8_t *data, int size)
+{
+    while(size > 0) {
+        int rc = (int)send(fd, data, size, MSG_NOSIGNAL);
+
+        if(rc < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        data += rc;
+        size -= rc;
+    }
+
+    return 0;
+}
+
+static int send_due_responses(struct client *c)
+{
+    int64_t now = now_us();
+
+    while(c->head && c->head->due_us <= now) {
+        struct pending_resp *resp = c->head;
+
+        if(debug) {
+            dump_bytes("Response", resp->data, resp->size);
+        }
+
+        if(send_all(c->fd, resp->data, resp->size)) {
+            return -1;
+        }
+
+        c->head = resp->next;
+
+        if(!c->head) {
+            c->tail = NULL;
+        }
+
+        free(resp);
+    }
+
+    return 0;
+}
+
+static int process_input(struct client *c)
+{
+    uint8_t out[MAX_PACKET];
+
+    while(c->in_size >= EIP_HEADER_SIZE) {
+        int pkt_size = EIP_HEADER_SIZE + get16(c->in_buf + 2);
+        int rc;
+
+        if(pkt_size > MAX_PACKET) {
+            fprintf(stderr, "Packet of %d bytes is too large, dropping client.\n", pkt_size);
+            return -1;
+        }
+
+        if(c->in_size < pkt_size) {
+            break;
+        }
+
+        if(debug) {
+            dump_bytes("Request", c->in_buf, pkt_size);
+        }
+
+        rc = handle_packet(c, c->in_buf, pkt_size, out);
+
+        if(rc < 0) {
+            return -1;
+        }
+
+        if(rc > 0 && queue_response(c, out, rc)) {
+            return -1;
+        }
+
+        memmove(c->in_buf, c->in_buf + pkt_size, c->in_size - pkt_size);
+        c->in_size -= pkt_size;
+    }
+
+    return 0;
+}
+
+static void *client_thread(void *arg)
+{
+    struct client *c = (struct client *)arg;
+    struct pollfd pfd;
+
+    pfd.fd = c->fd;
+    pfd.events = POLLIN;
+
+    while(1) {
+        struct timespec ts;
+        struct timespec *timeout = NULL;
+        int rc;
+
+        if(c->head) {
+            int64_t wait = c->head->due_us - now_us();
+
+            if(wait < 0) {
+                wait = 0;
+            }
+
+            ts.tv_sec = wait / 1000000;
+            ts.tv_nsec = (wait % 1000000) * 1000;
+            timeout = &ts;
+        }
+
+        rc = ppoll(&pfd, 1, timeout, NULL);
+
+        if(rc < 0 && errno != EINTR) {
+            break;
+        }
+
+        if(rc > 0 && (pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+            int n = (int)recv(c->fd, c->in_buf + c->in_size, sizeof(c->in_buf) - c->in_size, 0);
+
+            if(n <= 0) {
+                break;
+            }
+
+            c->in_size += n;
+
+            if(process_input(c)) {
+                break;
+            }
+        }
+
+        if(send_due_responses(c)) {
+            break;
+        }
+    }
+
+    if(debug) {
+        fprintf(stderr, "Client on fd %d disconnected.\n", c->fd);
+    }
+
+    close(c->fd);
+
+    while(c->head) {
+        struct pending_resp *resp = c->head;
+        c->head = resp->next;
+        free(resp);
+    }
+
+    free(c);
+
+    return NULL;
+}
+
+
+/*************************************************************************
+ ******************************** Main ***********************************
+ ************************************************************************/
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--port=N] [--tag=NAME:TYPE[N]]... [--latency-us=N] [--jitter-us=N]\n"
+            "          [--max-reply=N] [--max-conn-size=N] [--no-instance] [--debug]\n"
+            "SIGUSR1 renumbers the symbol instances as if the project was downloaded again.\n"
+            "SIGUSR2 shifts them by one, so that old instances name other tags.\n",
+            prog);
+}
+
+static int parse_args(int argc, char **argv)
+{
+    int i;
+
+    for(i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if(!strncmp(arg, "--port=", 7)) {
+            port = atoi(arg + 7);
+        } else if(!strncmp(arg, "--tag=", 6)) {
+            if(add_tag(arg + 6)) {
+                return -1;
+            }
+        } else if(!strncmp(arg, "--latency-us=", 13)) {
+            latency_us = atoi(arg + 13);
+        } else if(!strncmp(arg, "--jitter-us=", 12)) {
+            jitter_us = atoi(arg + 12);
+        } else if(!strncmp(arg, "--max-reply=", 12)) {
+            max_reply = atoi(arg + 12);
+        } else if(!strncmp(arg, "--max-conn-size=", 16)) {
+            max_conn_size = atoi(arg + 16);
+        } else if(!strcmp(arg, "--no-instance")) {
+            no_instance = 1;
+        } else if(!strcmp(arg, "--debug")) {
+            debug = 1;
+        } else {
+            return -1;
+        }
+    }
+
+    if(port <= 0 || port > 65535 || latency_us < 0 || jitter_us < 0 || max_reply < 16 || max_reply > MAX_PACKET - 64 || max_conn_size < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void renumber_symbols(int sig)
+{
+    instance_base += (sig == SIGUSR2 ? 1 : 100);
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_in addr;
+    int listen_fd;
+    int opt = 1;
+
+    if(parse_args(argc, argv)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(num_tags == 0) {
+        add_default_tags();
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGUSR1, renumber_symbols);
+    signal(SIGUSR2, renumber_symbols);
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if(listen_fd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+
+    if(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+
+    if(listen(listen_fd, 64) < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    fprintf(stderr, "ab_server listening on port %d with %d tags.\n", port, num_tags);
+
+    while(1) {
+        pthread_t thread;
+        struct client *c;
+        int fd = accept(listen_fd, NULL, NULL);
+
+        if(fd < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            perror("accept");
+            break;
+        }
+
+        /* the simulator should never be what adds latency. */
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        c = calloc(1, sizeof(*c));
+
+        if(!c) {
+            close(fd);
+            continue;
+        }
+
+        c->fd = fd;
+        c->seed = (unsigned int)(now_us() ^ fd);
+
+        if(pthread_create(&thread, NULL, client_thread, c)) {
+            close(fd);
+            free(c);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+
+    close(listen_fd);
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OmanTek                                         *
+ *   Author Kyle Hayes  kylehayes@omantek.com                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Library General Public License as       *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Library General Public License for more details.                  *
+ *                                                                         *
+ *   You should have received a copy of the GNU Library General Public     *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**************************************************************************
+ * CHANGE LOG                                                             *
+ *                                                                        *
+ * 2015-11-20  KRH - Created file.                                        *
+ *                                                                        *
+ **************************************************************************/
+
+/*
+ * trace_decode
+ *
+ * Turn a binary trace written by plc_tag_trace_dump() into text, one
+ * event per line, merged across threads in time order.
+ *
+ * usage: trace_decode <trace file>
+ *
+ * Columns are the time in microseconds since the first event, the time
+ * since the previous event, the thread index, the event name, the
+ * session and request/tag ids and the three event arguments.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../lib/util/trace.h"
+
+
+#define TRACE_NAME_ENTRY(id, name) name,
+static const char *event_names[] = {
+    TRACE_EVENTS(TRACE_NAME_ENTRY)
+};
+#undef TRACE_NAME_ENTRY
+
+
+static int cmp_events(const void *a, const void *b)
+{
+    const trace_event_t *x = (const trace_event_t *)a;
+    const trace_event_t *y = (const trace_event_t *)b;
+
+    if(x->time_us != y->time_us) {
+        return (x->time_us > y->time_us) - (x->time_us < y->time_us);
+    }
+
+    return (int)x->thread - (int)y->thread;
+}
+
+
+int main(int argc, char **argv)
+{
+    trace_file_header_t header;
+    trace_event_t *events = NULL;
+    size_t num_events = 0;
+    size_t capacity = 0;
+    int64_t start_us;
+    int64_t prev_us;
+    FILE *f;
+    size_t i;
+
+    if(argc != 2) {
+        fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    f = fopen(argv[1], "rb");
+
+    if(!f) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    if(fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic))) {
+        fprintf(stderr, "%s is not a trace file!\n", argv[1]);
+        fclose(f);
+        return 1;
+    }
+
+    if(header.version != TRACE_FILE_VERSION || header.event_size != sizeof(trace_event_t)) {
+        fprintf(stderr, "Unsupported trace version %u with %u byte events!\n", header.version, header.event_size);
+        fclose(f);
+        return 1;
+    }
+
+    while(1) {
+        if(num_events == capacity) {
+            capacity = (capacity ? capacity * 2 : 4096);
+            events = realloc(events, capacity * sizeof(trace_event_t));
+
+            if(!events) {
+                fprintf(stderr, "Out of memory!\n");
+                fclose(f);
+                return 1;
+            }
+        }
+
+        if(fread(&events[num_events], sizeof(trace_event_t), 1, f) != 1) {
+            break;
+        }
+
+        num_events++;
+    }
+
+    fclose(f);
+
+    if(num_events == 0) {
+        printf("No events.\n");
+        free(events);
+        return 0;
+    }
+
+    qsort(events, num_events, sizeof(trace_event_t), cmp_events);
+
+    printf("%12s %10s %4s %-18s %-10s %-10s %s\n", "time_us", "delta_us", "thr", "event", "session", "request", "args");
+
+    start_us = events[0].time_us;
+    prev_us = start_us;
+
+    for(i=0; i < num_events; i++) {
+        const trace_event_t *ev = &events[i];
+        const char *name = (ev->event < TRACE_NUM_EVENTS ? event_names[ev->event] : "unknown");
+
+        printf("%12lld %10lld %4u %-18s 0x%08x 0x%08x %d %d %d\n",
+               (long long)(ev->time_us - start_us),
+               (long long)(ev->time_us - prev_us),
+               (unsigned)ev->thread,
+               name,
+               ev->session,
+               ev->request,
+               ev->arg[0], ev->arg[1], ev->arg[2]);
+
+        prev_us = ev->time_us;
+    }
+
+    free(events);
+
+    return 0;
+}
@@ -27,6 +27,7 @@ LIB_SRC= $(LIB_DIR)\libplctag_tag.c
 
 AB_DIR=..\lib\ab
 AB_SRC= $(AB_DIR)\ab_common.c \
+	$(AB_DIR)\batch.c \
 	$(AB_DIR)\cip.c \
 	$(AB_DIR)\connection.c \
 	$(AB_DIR)\eip.c \
@@ -35,10 +36,15 @@ AB_SRC= $(AB_DIR)\ab_common.c \
 	$(AB_DIR)\eip_pccc.c \
 	$(AB_DIR)\pccc.c \
 	$(AB_DIR)\request.c \
-	$(AB_DIR)\session.c
+	$(AB_DIR)\session.c \
+	$(AB_DIR)\symbol.c
 
 UTIL_DIR=..\lib\util
-UTIL_SRC=$(UTIL_DIR)\attr.c
+UTIL_SRC=$(UTIL_DIR)\attr.c \
+	$(UTIL_DIR)\handle.c \
+	$(UTIL_DIR)\share.c \
+	$(UTIL_DIR)\stats.c \
+	$(UTIL_DIR)\trace.c
 
 PLATFORM_DIR=..\lib\windows
 PLATFORM_SRC=$(PLATFORM_DIR)\platform.c
@@ -48,6 +54,7 @@ INC_DIRS=/I$(LIB_DIR) /I$(AB_DIR) /I$(UTIL_DIR) /I$(PLATFORM_DIR)
 OBJ_DIR=obj
 OBJS=	$(LIB_DIR)\libplctag_tag.obj \
 	$(AB_DIR)\ab_common.obj \
+	$(AB_DIR)\batch.obj \
 	$(AB_DIR)\cip.obj \
 	$(AB_DIR)\connection.obj \
 	$(AB_DIR)\eip.obj \
@@ -57,15 +64,23 @@ OBJS=	$(LIB_DIR)\libplctag_tag.obj \
 	$(AB_DIR)\pccc.obj \
 	$(AB_DIR)\request.obj \
 	$(AB_DIR)\session.obj \
+	$(AB_DIR)\symbol.obj \
 	$(UTIL_DIR)\attr.obj \
+	$(UTIL_DIR)\handle.obj \
+	$(UTIL_DIR)\share.obj \
+	$(UTIL_DIR)\stats.obj \
+	$(UTIL_DIR)\trace.obj \
 	$(PLATFORM_DIR)\platform.obj
 
-$(LIB_DIR)\libplctag_tag.obj: $(LIB_DIR)\libplctag_tag.c $(LIB_DIR)\libplctag_tag.h $(LIB_DIR)\libplctag.h $(PLATFORM_DIR)\platform.h $(UTIL_DIR)\attr.h
+$(LIB_DIR)\libplctag_tag.obj: $(LIB_DIR)\libplctag_tag.c $(LIB_DIR)\libplctag_tag.h $(LIB_DIR)\libplctag.h $(LIB_DIR)\libplctag_view.h $(PLATFORM_DIR)\platform.h $(UTIL_DIR)\attr.h $(UTIL_DIR)\handle.h $(UTIL_DIR)\share.h
 	cl $(INC_DIRS) $(CFLAGS) /Fo$(LIB_DIR)\ /Tc $(LIB_DIR)\libplctag_tag.c
 
 $(AB_DIR)\ab_common.obj: $(AB_DIR)\ab_common.c $(AB_DIR)\ab_common.h $(LIB_DIR)\libplctag_tag.h $(LIB_DIR)\libplctag.h $(PLATFORM_DIR)\platform.h $(UTIL_DIR)\attr.h $(AB_DIR)\ab.h $(AB_DIR)\pccc.h $(AB_DIR)\cip.h $(AB_DIR)\eip.h $(AB_DIR)\eip_cip.h $(AB_DIR)\eip_pccc.h $(AB_DIR)\eip_dhp_pccc.h $(AB_DIR)\session.h $(AB_DIR)\connection.h $(AB_DIR)\tag.h $(AB_DIR)\request.h
 	cl $(INC_DIRS) $(CFLAGS) /Fo$(AB_DIR)\ /Tc $(AB_DIR)\ab_common.c
 
+$(AB_DIR)\batch.obj: $(AB_DIR)\batch.c $(AB_DIR)\batch.h $(AB_DIR)\ab_common.h $(LIB_DIR)\libplctag_tag.h $(LIB_DIR)\libplctag.h $(PLATFORM_DIR)\platform.h $(AB_DIR)\session.h $(AB_DIR)\eip.h $(AB_DIR)\request.h $(UTIL_DIR)\stats.h
+	cl $(INC_DIRS) $(CFLAGS) /Fo$(AB_DIR)\ /Tc $(AB_DIR)\batch.c
+
 $(AB_DIR)\cip.obj: $(AB_DIR)\cip.c $(AB_DIR)\ab_common.h $(LIB_DIR)\libplctag_tag.h $(LIB_DIR)\libplctag.h $(PLATFORM_DIR)\platform.h $(UTIL_DIR)\attr.h $(AB_DIR)\ab_common.h $(AB_DIR)\cip.h $(AB_DIR)\tag.h  $(AB_DIR)\eip.h
 	cl $(INC_DIRS) $(CFLAGS) /Fo$(AB_DIR)\ /Tc $(AB_DIR)\cip.c
 
@@ -93,9 +108,24 @@ $(AB_DIR)\request.obj: $(AB_DIR)\request.c $(AB_DIR)\ab_common.h $(LIB_DIR)\libp
 $(AB_DIR)\session.obj: $(AB_DIR)\session.c $(AB_DIR)\ab_common.h $(LIB_DIR)\libplctag_tag.h $(LIB_DIR)\libplctag.h $(AB_DIR)\session.h $(AB_DIR)\tag.h $(AB_DIR)\eip.h
 	cl $(INC_DIRS) $(CFLAGS) /Fo$(AB_DIR)\ /Tc $(AB_DIR)\session.c
 
+$(AB_DIR)\symbol.obj: $(AB_DIR)\symbol.c $(AB_DIR)\symbol.h $(AB_DIR)\ab_common.h $(LIB_DIR)\libplctag_tag.h $(LIB_DIR)\libplctag.h $(PLATFORM_DIR)\platform.h $(AB_DIR)\session.h $(AB_DIR)\connection.h $(AB_DIR)\tag.h $(AB_DIR)\eip.h $(AB_DIR)\cip.h $(AB_DIR)\request.h
+	cl $(INC_DIRS) $(CFLAGS) /Fo$(AB_DIR)\ /Tc $(AB_DIR)\symbol.c
+
 $(UTIL_DIR)\attr.obj: $(UTIL_DIR)\attr.c $(UTIL_DIR)\attr.h $(PLATFORM_DIR)\platform.h 
 	cl $(INC_DIRS) $(CFLAGS) /Fo$(UTIL_DIR)\ /Tc $(UTIL_DIR)\attr.c
 
+$(UTIL_DIR)\handle.obj: $(UTIL_DIR)\handle.c $(UTIL_DIR)\handle.h $(LIB_DIR)\libplctag.h $(PLATFORM_DIR)\platform.h
+	cl $(INC_DIRS) $(CFLAGS) /Fo$(UTIL_DIR)\ /Tc $(UTIL_DIR)\handle.c
+
+$(UTIL_DIR)\share.obj: $(UTIL_DIR)\share.c $(UTIL_DIR)\share.h $(UTIL_DIR)\attr.h $(LIB_DIR)\libplctag.h $(PLATFORM_DIR)\platform.h
+	cl $(INC_DIRS) $(CFLAGS) /Fo$(UTIL_DIR)\ /Tc $(UTIL_DIR)\share.c
+
+$(UTIL_DIR)\stats.obj: $(UTIL_DIR)\stats.c $(UTIL_DIR)\stats.h $(LIB_DIR)\libplctag.h $(PLATFORM_DIR)\platform.h
+	cl $(INC_DIRS) $(CFLAGS) /Fo$(UTIL_DIR)\ /Tc $(UTIL_DIR)\stats.c
+
+$(UTIL_DIR)\trace.obj: $(UTIL_DIR)\trace.c $(UTIL_DIR)\trace.h $(LIB_DIR)\libplctag.h $(PLATFORM_DIR)\platform.h
+	cl $(INC_DIRS) $(CFLAGS) /Fo$(UTIL_DIR)\ /Tc $(UTIL_DIR)\trace.c
+
 $(PLATFORM_DIR)\platform.obj: $(PLATFORM_DIR)\platform.c 
 	cl $(INC_DIRS) $(CFLAGS) /Fo$(PLATFORM_DIR)\ /Tc $(PLATFORM_DIR)\platform.c
 
@@ -5,8 +5,6 @@ import java.util.ArrayList;
 import com.sun.jna.Library;
 import com.sun.jna.Native;
 import com.sun.jna.NativeLibrary;
-import com.sun.jna.Pointer;
-import com.sun.jna.PointerType;
 
 public class Tag implements Library {
 	// static native library stuff
@@ -107,7 +105,7 @@ public class Tag implements Library {
 	private long nextRetry;
 	
 	// the wrapped tag
-	private Tag.plc_tag tag;
+	private int tag;
 	
 
 	
@@ -121,7 +119,7 @@ public class Tag implements Library {
 	public static Tag create(String attributes) {
 		Tag tmp = new Tag(attributes);
 		
-		if(tmp.tag == null) {
+		if(tmp.tag == 0) {
 			return null;
 		} else {
 			synchronized(retryTags) {
@@ -143,39 +141,39 @@ public class Tag implements Library {
 	public int close() {
 		int rc = Tag.PLCTAG_ERR_NULL_PTR;
 		
-		if(tag != null)
+		if(tag != 0)
 			rc = Tag.plc_tag_destroy(tag);
 		
 		// make sure no one uses this again.
-		tag = null;
+		tag = 0;
 		
 		return rc;
 	}
 	
 	
 	public int size() {
-		if(tag != null)
+		if(tag != 0)
 			return checkResponse(Tag.plc_tag_get_size(tag));
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
 	}
 	
 	public int read(int timeout) {
-		if(tag != null)
+		if(tag != 0)
 			return checkResponse(Tag.plc_tag_read(tag, timeout));
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
 	}
 	
 	public int status() {
-		if(tag != null)
+		if(tag != 0)
 			return checkResponse(Tag.plc_tag_status(tag));
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
 	}
 	
 	public int write(int timeout) {
-		if(tag != null)
+		if(tag != 0)
 			return checkResponse(Tag.plc_tag_write(tag, timeout));
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
@@ -190,7 +188,7 @@ public class Tag implements Library {
 	}
 	
 	public int setUInt32(int offset, int val) {
-		if(tag != null)
+		if(tag != 0)
 			return Tag.plc_tag_set_uint32(tag, offset, val);
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
@@ -203,7 +201,7 @@ public class Tag implements Library {
 	}
 	
 	public int setInt32(int offset, int val) {
-		if(tag != null)
+		if(tag != 0)
 			return Tag.plc_tag_set_int32(tag, offset, val);
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
@@ -216,7 +214,7 @@ public class Tag implements Library {
 	}
 	
 	public int setUInt16(int offset, int val) {
-		if(tag != null)
+		if(tag != 0)
 			return Tag.plc_tag_set_uint16(tag, offset, (short)val);
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
@@ -229,7 +227,7 @@ public class Tag implements Library {
 	}
 	
 	public int setInt16(int offset, int val) {
-		if(tag != null)
+		if(tag != 0)
 			return Tag.plc_tag_set_int16(tag, offset, (short)val);
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
@@ -242,7 +240,7 @@ public class Tag implements Library {
 	}
 	
 	public int setUInt8(int offset, int val) {
-		if(tag != null)
+		if(tag != 0)
 			return Tag.plc_tag_set_uint8(tag, offset, (byte)val);
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
@@ -255,7 +253,7 @@ public class Tag implements Library {
 	}
 	
 	public int setInt8(int offset, int val) {
-		if(tag != null)
+		if(tag != 0)
 			return Tag.plc_tag_set_int8(tag, offset, (byte)val);
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
@@ -268,7 +266,7 @@ public class Tag implements Library {
 	}
 	
 	public int setFloat32(int offset, float val) {
-		if(tag != null)
+		if(tag != 0)
 			return Tag.plc_tag_set_float32(tag, offset, val);
 		else
 			return checkResponse(Tag.PLCTAG_ERR_NULL_PTR);
@@ -290,7 +288,7 @@ public class Tag implements Library {
 	 * Original signature : <code>plc_tag plc_tag_create(const char*)</code><br>
 	 * <i>native declaration : line 75</i>
 	 */
-	private static native Tag.plc_tag plc_tag_create(String attrib_str);
+	private static native int plc_tag_create(String attrib_str);
 	
 	/**
 	 * plc_tag_abort
@@ -307,7 +305,7 @@ public class Tag implements Library {
 	 * Original signature : <code>int plc_tag_abort(plc_tag)</code>
 	 * <i>native declaration : line 98</i>
 	 */
-	private static native int plc_tag_abort(Tag.plc_tag tag);
+	private static native int plc_tag_abort(int tag);
 
 	/**
 	 * plc_tag_destroy
@@ -320,7 +318,7 @@ public class Tag implements Library {
 	 * Original signature : <code>int plc_tag_destroy(plc_tag)</code>
 	 * <i>native declaration : line 111</i>
 	 */
-	private static native int plc_tag_destroy(Tag.plc_tag tag);
+	private static native int plc_tag_destroy(int tag);
 
 	/**
 	 * plc_tag_read
@@ -336,7 +334,7 @@ public class Tag implements Library {
 	 * Original signature : <code>int plc_tag_read(plc_tag, int)</code>
 	 * <i>native declaration : line 128</i>
 	 */
-	private static native int plc_tag_read(Tag.plc_tag tag, int timeout);
+	private static native int plc_tag_read(int tag, int timeout);
 	
 	/**
 	 * plc_tag_status
@@ -350,7 +348,7 @@ public class Tag implements Library {
 	 * Original signature : <code>int plc_tag_status(plc_tag)</code>
 	 * <i>native declaration : line 142</i>
 	 */
-	private static native int plc_tag_status(Tag.plc_tag tag);
+	private static native int plc_tag_status(int tag);
 	
 	/**
 	 * plc_tag_write
@@ -367,7 +365,7 @@ public class Tag implements Library {
 	 * Original signature : <code>int plc_tag_write(plc_tag, int)</code>
 	 * <i>native declaration : line 160</i>
 	 */
-	private static native int plc_tag_write(Tag.plc_tag tag, int timeout);
+	private static native int plc_tag_write(int tag, int timeout);
 	
 	/**
 	 * plc_tag_get_size
@@ -378,7 +376,7 @@ public class Tag implements Library {
 	 * Original signature : <code>int plc_tag_get_size(plc_tag)</code>
 	 * <i>native declaration : line 169</i>
 	 */
-	private static native int plc_tag_get_size(Tag.plc_tag tag);
+	private static native int plc_tag_get_size(int tag);
 
 	/**
 	 * plc_tag_get_uint32
@@ -389,98 +387,89 @@ public class Tag implements Library {
 	 * Original signature : <code>uint32_t plc_tag_get_uint32(plc_tag, int)</code>
 	 * <i>native declaration : line 171</i>
 	 */
-	private static native int plc_tag_get_uint32(Tag.plc_tag tag, int offset);
+	private static native int plc_tag_get_uint32(int tag, int offset);
 	
 	/**
 	 * Original signature : <code>int plc_tag_set_uint32(plc_tag, int, uint32_t)</code>
 	 * <i>native declaration : line 172</i>
 	 */
-	private static native int plc_tag_set_uint32(Tag.plc_tag tag, int offset, int val);
+	private static native int plc_tag_set_uint32(int tag, int offset, int val);
 	
 	/**
 	 * Original signature : <code>int32_t plc_tag_get_int32(plc_tag, int)</code>
 	 * <i>native declaration : line 174</i>
 	 */
-	private static native int plc_tag_get_int32(Tag.plc_tag tag, int offset);
+	private static native int plc_tag_get_int32(int tag, int offset);
 	
 	/**
 	 * Original signature : <code>int plc_tag_set_int32(plc_tag, int, int32_t)</code>
 	 * <i>native declaration : line 175</i>
 	 */
-	private static native int plc_tag_set_int32(Tag.plc_tag plc_tag1, int offset, int val);
+	private static native int plc_tag_set_int32(int plc_tag1, int offset, int val);
 	
 	/**
 	 * Original signature : <code>uint16_t plc_tag_get_uint16(plc_tag, int)</code>
 	 * <i>native declaration : line 178</i>
 	 */
-	private static native short plc_tag_get_uint16(Tag.plc_tag tag, int offset);
+	private static native short plc_tag_get_uint16(int tag, int offset);
 	
 	/**
 	 * Original signature : <code>int plc_tag_set_uint16(plc_tag, int, uint16_t)</code>
 	 * <i>native declaration : line 179</i>
 	 */
-	private static native int plc_tag_set_uint16(Tag.plc_tag tag, int offset, short val);
+	private static native int plc_tag_set_uint16(int tag, int offset, short val);
 	
 	/**
 	 * Original signature : <code>int16_t plc_tag_get_int16(plc_tag, int)</code>
 	 * <i>native declaration : line 181</i>
 	 */
-	private static native short plc_tag_get_int16(Tag.plc_tag tag, int offset);
+	private static native short plc_tag_get_int16(int tag, int offset);
 	
 	/**
 	 * Original signature : <code>int plc_tag_set_int16(plc_tag, int, int16_t)</code>
 	 * <i>native declaration : line 182</i>
 	 */
-	private static native int plc_tag_set_int16(Tag.plc_tag plc_tag1, int offset, short val);
+	private static native int plc_tag_set_int16(int plc_tag1, int offset, short val);
 	
 	/**
 	 * Original signature : <code>uint8_t plc_tag_get_uint8(plc_tag, int)</code>
 	 * <i>native declaration : line 185</i>
 	 */
-	private static native byte plc_tag_get_uint8(Tag.plc_tag tag, int offset);
+	private static native byte plc_tag_get_uint8(int tag, int offset);
 	
 	/**
 	 * Original signature : <code>int plc_tag_set_uint8(plc_tag, int, uint8_t)</code>
 	 * <i>native declaration : line 186</i>
 	 */
-	private static native int plc_tag_set_uint8(Tag.plc_tag tag, int offset, byte val);
+	private static native int plc_tag_set_uint8(int tag, int offset, byte val);
 	
 	/**
 	 * Original signature : <code>int8_t plc_tag_get_int8(plc_tag, int)</code>
 	 * <i>native declaration : line 188</i>
 	 */
-	private static native byte plc_tag_get_int8(Tag.plc_tag tag, int offset);
+	private static native byte plc_tag_get_int8(int tag, int offset);
 
 	/**
 	 * Original signature : <code>int plc_tag_set_int8(plc_tag, int, int8_t)</code>
 	 * <i>native declaration : line 189</i>
 	 */
-	private static native int plc_tag_set_int8(Tag.plc_tag plc_tag1, int offset, byte val);
+	private static native int plc_tag_set_int8(int plc_tag1, int offset, byte val);
 	
 	/**
 	 * Original signature : <code>float plc_tag_get_float32(plc_tag, int)</code>
 	 * <i>native declaration : line 192</i>
 	 */
-	private static native float plc_tag_get_float32(Tag.plc_tag tag, int offset);
+	private static native float plc_tag_get_float32(int tag, int offset);
 	
 	/**
 	 * Original signature : <code>int plc_tag_set_float32(plc_tag, int, float)</code>
 	 * <i>native declaration : line 193</i>
 	 */
-	private static native int plc_tag_set_float32(Tag.plc_tag tag, int offset, float val);
+	private static native int plc_tag_set_float32(int tag, int offset, float val);
 	
 	/*
 	 * wrapper for the plc_tag opaque pointer.
 	 */
-	public static class plc_tag extends PointerType {
-		public plc_tag(Pointer address) {
-			super(address);
-		}
-		public plc_tag() {
-			super();
-		}
-	}
-
 	
 	/*
 	 * Private implementation methods etc.
@@ -506,10 +495,7 @@ public class Tag implements Library {
 	private void createTag() {
 		tag = Tag.plc_tag_create(attributeString);
 		
-		/* how to check for NULL? */
-		if(tag == null || tag.getPointer().equals(Pointer.NULL)) {
-			tag = null;
-		}
+		/* zero is PLC_TAG_NULL, nothing more to check. */
 	}
 	
 	private int checkResponse(int rc) {
@@ -551,7 +537,7 @@ public class Tag implements Library {
 	 * tag's memory, eventually.
 	 */
 	protected void finalize() {
-		if(tag != null) {
+		if(tag != 0) {
 			close();
 		}
 	}